@@ -78,6 +78,12 @@ int main (int argc, char *argv[])
     radSemDebug ();
     printf ("\n");
 
+    // dump the message router's live traffic stats if it publishes them
+    if (radMsgRouterStatsPrint (stdout) == OK)
+    {
+        printf ("\n");
+    }
+
     // if the message router work directory was given, try to dump his stats
     if (argc > 2)
     {
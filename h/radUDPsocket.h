@@ -200,6 +200,18 @@ extern int radUDPSocketSendTo
     int             length
 );
 
+/*  ... Send a datagram to an address already resolved (no name lookup, 
+    ... so it may be used from several threads at once)
+    ... returns OK or ERROR
+*/
+extern int radUDPSocketSendToAddress
+(
+    RADUDPSOCK_ID       id, 
+    struct sockaddr_in  *destAdrs,
+    void                *data,
+    int                 length
+);
+
 /*  ... Set the socket for blocking or non-blocking IO - 
     ... it is the user's responsibility to handle blocking/non-blocking IO
     ... properly (EAGAIN and EINTR errno's);
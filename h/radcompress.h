@@ -0,0 +1,110 @@
+#ifndef INC_radcompressh
+#define INC_radcompressh
+#ifdef __cplusplus
+extern "C" {
+#endif
+/*---------------------------------------------------------------------------
+
+  FILENAME:
+        radcompress.h
+
+  PURPOSE:
+        Provide a fast LZ77-class block compressor.
+
+  REVISION HISTORY:
+        Date            Engineer        Revision        Remarks
+        10/18/2026      radlib          0               Original
+
+  NOTES:
+        The codec trades ratio for speed: it finds matches through a single
+        hash of the next 3 bytes, with no chains or lazy evaluation, and
+        needs no state between calls. It suits the repetitive headers and
+        records of message traffic rather than archival storage.
+
+        The compressed stream is a series of items, each led by a control
+        byte:
+            000LLLLL                    literal run of L+1 bytes that follow
+            LLLOOOOO [EEEEEEEE] OOOOOOOO
+                                        copy L+2 bytes (LLL < 7) or
+                                        E+9 bytes (LLL == 7) starting
+                                        (OOOOO << 8 | OOOOOOOO) + 1 bytes
+                                        back in the output
+        so matches reach back at most RADLZ_MAX_OFFSET bytes and are at most
+        RADLZ_MAX_MATCH bytes long. The stream carries no length or check
+        value; callers send the uncompressed length along with it.
+
+  LICENSE:
+        Copyright 2001-2005 Mark S. Teel. All rights reserved.
+
+        Redistribution and use in source and binary forms, with or without
+        modification, are permitted provided that the following conditions
+        are met:
+
+        1. Redistributions of source code must retain the above copyright
+           notice, this list of conditions and the following disclaimer.
+        2. Redistributions in binary form must reproduce the above copyright
+           notice, this list of conditions and the following disclaimer in the
+           documentation and/or other materials provided with the distribution.
+
+        THIS SOFTWARE IS PROVIDED BY Mark Teel ``AS IS'' AND ANY EXPRESS OR
+        IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+        WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+        DISCLAIMED. IN NO EVENT SHALL MARK TEEL OR CONTRIBUTORS BE LIABLE FOR
+        ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+        OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+        HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+        STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+        IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+        POSSIBILITY OF SUCH DAMAGE.
+
+----------------------------------------------------------------------------*/
+
+/*  ... System include files
+*/
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+
+/*  ... Library include files
+*/
+#include <radsysdefs.h>
+
+
+/*  ...HIDDEN, don't use
+*/
+
+#define RADLZ_HASH_BITS             12
+#define RADLZ_HASH_SIZE             (1 << RADLZ_HASH_BITS)
+#define RADLZ_MAX_LITERALS          32
+#define RADLZ_MIN_MATCH             3
+#define RADLZ_MAX_MATCH             (7 + 255 + 2)
+#define RADLZ_MAX_OFFSET            8192
+
+/*  ... END HIDDEN
+*/
+
+/*  ... API methods
+*/
+
+/*  ... compress 'inLength' bytes at 'in' into at most 'outSize' bytes at
+    ... 'out';
+    ... returns the compressed length, or 0 if the data did not fit in
+    ... 'outSize' bytes (callers then send it uncompressed)
+*/
+extern int radCompressLZ (void *in, int inLength, void *out, int outSize);
+
+
+/*  ... expand 'inLength' compressed bytes at 'in' into at most 'outSize'
+    ... bytes at 'out';
+    ... returns the expanded length or ERROR if the data is corrupt or
+    ... expands past 'outSize' bytes
+*/
+extern int radDecompressLZ (void *in, int inLength, void *out, int outSize);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+
@@ -26,7 +26,7 @@ extern "C" {
         the working directory for the application must be passed as arguments 
         to radmrouted.
         
-        USAGE: [prefix]/radmrouted radSystemID workingDirectory <listenPort> <remoteIP:remotePort>
+        USAGE: [prefix]/radmrouted radSystemID workingDirectory <listenPort> <remoteIP:remotePort> ...
         
             radSystemID           the same system ID used by other processes in 
                                   this group
@@ -34,11 +34,25 @@ extern "C" {
             <listenPort>          optional local port to listen on for remote 
                                   router connections
             <remoteIP:remotePort> optional remote server IP address and port to 
-                                  connect to
+                                  connect to; more than one may be given
 
         "workingDirectory" should match the working directory passed to 
         'radMsgRouterInit' by your processes.
 
+        radmrouted features (linked router meshes, worker threads, direct
+        local delivery, statistics, request/reply, the radmrouted.conf
+        settings, spooling, compression, multicast and capture/replay) are
+        described in the MESSAGE ROUTER section of the radlib README.
+
+        The router message header (MSGRTR_HDR) grew the flags, origin,
+        correlation and reply fields; this breaks the wire format with
+        radmrouted and radlib clients built before it, both for local
+        queues and links to remote routers. MSGRTR_MAGIC_NUMBER was changed
+        with it, so radmrouted refuses (and logs) messages and router links
+        carrying the old MSGRTR_MAGIC_NUMBER_V1 header instead of misreading
+        them. Upgrade radmrouted, its clients and every linked router
+        together.
+
 
         radlib processes which want to be a message producer and/or consumer 
         will initialize the message router interface then register or deregister 
@@ -87,9 +101,21 @@ extern "C" {
 #include <radlist.h>
 #include <radprocess.h>
 #include <radsocket.h>
+#include <radUDPsocket.h>
 #include <radthread.h>
 
 
+// identifies a received request to 'radMsgRouterReply' - copy it if the 
+// reply is sent after the request handler returns:
+typedef struct
+{
+    ULONG           msgID;
+    ULONG           correlationID;
+    ULONG           replyRouterID;
+    int             replyPid;
+} MSGRTR_REQUEST_ID;
+
+
 ///*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*///
 ///*/*/*/*    H I D D E N - I N T E R N A L  U S E  O N L Y    */*/*/*/*/*/*///
 ///*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*///
@@ -97,15 +123,356 @@ extern "C" {
 #define MSGRTR_LOCK_FILE_NAME           "radmrouted.pid"
 #define MSGRTR_QUEUE_NAME               "radmroutedfifo"
 #define PROC_NAME_MSGRTR                "radmrouted"
-#define MSGRTR_NUM_TIMERS               1
+#define MSGRTR_CONFIG_FILE_NAME         "radmrouted.conf"
+#define MSGRTR_NUM_TIMERS               6
 
 #define MSGRTR_REMOTE_RETRY_INTERVAL    5000            // 5 secs
+#define MSGRTR_LOCAL_LINK_DIR           "/tmp"
+#define MSGRTR_LOCAL_LINK_NAME          "radmrouted.%d.sock"    // listen port
 #define MSGRTR_MAX_ACK_WAIT             1000
+#define MSGRTR_MAX_ACK_POLL             25              // msecs between timeout checks
 
 #define MSGRTR_INTERNAL_MSGID           0xFFFFFFFF
 
 #define MSGRTR_MAX_CLIENTS              32
 
+// Most msgIDs carried by one MSGRTR_SUBTYPE_ENABLE_MSGID_LIST message:
+#define MSGRTR_MAX_LIST_MSGIDS          256
+
+// Router mesh:
+#define MSGRTR_MAX_PEERS                8               // configured peers
+#define MSGRTR_MAX_HOPS                 16              // interest flood limit
+#define MSGRTR_MAX_ORIGINS              64              // routers tracked for dups
+#define MSGRTR_DUP_WINDOW               1024            // seqs remembered per origin
+#define MSGRTR_INTEREST_HASH_SIZE       1024
+
+// Remote link output coalescing (see radmrouted.conf above):
+#define MSGRTR_TX_BUFFER_SIZE           65536           // per remote router
+#define MSGRTR_TX_FLUSH_BYTES           16384
+#define MSGRTR_TX_FLUSH_DELAY           2               // msecs
+#define MSGRTR_TX_QUEUE_BYTES           1048576         // per remote router
+
+// Remote link compression (see radmrouted.conf above):
+#define MSGRTR_LINK_COMPRESS            0x00000001      // handshake linkFlags
+#define MSGRTR_COMPRESS_MIN_BYTES       512
+#define MSGRTR_COMPRESS_CHUNK_BYTES     (2*SYS_BUFFER_LARGEST_SIZE)
+#define MSGRTR_COMPRESS_MAX_CHUNKS      16              // per flush
+
+// Remote multicast fan-out (see radmrouted.conf above):
+#define MSGRTR_LINK_MULTICAST           0x00000002      // handshake linkFlags
+#define MSGRTR_MCAST_MAGIC              0x4D4D4354      // "MMCT"
+#define MSGRTR_MCAST_MIN_PEERS          2
+#define MSGRTR_MCAST_MAX_PEERS          64              // group routers per message
+#define MSGRTR_MCAST_HISTORY_BYTES      (4*1024*1024)
+#define MSGRTR_MCAST_MIN_HISTORY        (256*1024)
+#define MSGRTR_MCAST_HISTORY_SLOTS      16384           // datagrams indexed by seq
+#define MSGRTR_MCAST_HOLD_SLOTS         256             // held past a gap per sender
+#define MSGRTR_MCAST_MAX_NAK            256             // seqs asked for per NAK
+#define MSGRTR_MCAST_NAK_TRIES          5
+#define MSGRTR_MCAST_RX_BURST           64              // datagrams read per wake-up
+#define MSGRTR_MCAST_RCVBUF_BYTES       (4*1024*1024)   // socket receive buffers
+#define MSGRTR_MCAST_TIMER_INTERVAL     50              // msecs: heartbeats, NAK retries
+#define MSGRTR_MCAST_IDLE_TICKS         20              // heartbeat at least this often
+#define MSGRTR_MCAST_DEAF_TICKS         60              // silent peer => TCP fallback
+#define MSGRTR_MCAST_DATAGRAM_SIZE                                          \
+    (sizeof(MSGRTR_MCAST_HDR) + sizeof(MSGRTR_HDR) + SYS_BUFFER_LARGEST_SIZE)
+
+// Remote link outbound queue overflow policies:
+typedef enum
+{
+    MSGRTR_TX_DROP_OLDEST       = 0,
+    MSGRTR_TX_DROP_NEWEST,
+    MSGRTR_TX_DISCONNECT
+} MSGRTR_TX_POLICY;
+
+// Local consumer spill queue (see radmrouted.conf above):
+#define MSGRTR_LOCAL_SPILL_MSGS         256
+#define MSGRTR_SPILL_RETRY_INTERVAL     10              // msecs
+
+// Threaded routing (see radmrouted.conf above):
+#define MSGRTR_MAX_WORKERS              16
+#define MSGRTR_SHARD_QUEUE_SIZE         4096            // msgs per worker
+#define MSGRTR_TX_POLL_INTERVAL         100             // msecs
+
+// Last-value cache and conflation (see radmrouted.conf above):
+#define MSGRTR_MAX_LVC_RULES            64
+#define MSGRTR_LVC_HASH_SIZE            1024
+#define MSGRTR_LVC_CACHE                0x00000001
+#define MSGRTR_LVC_CONFLATE             0x00000002
+#define MSGRTR_LVC_MULTICAST            0x00000004      // MULTICAST rule
+
+// Content filters (see 'radMsgRouterMessageRegisterFilter'):
+#define MSGRTR_MAX_FILTER_TERMS         8
+
+typedef enum
+{
+    MSGRTR_FILTER_EQ            = 1,    // field == value
+    MSGRTR_FILTER_NE,                   // field != value
+    MSGRTR_FILTER_LT,                   // field <  value
+    MSGRTR_FILTER_LE,                   // field <= value
+    MSGRTR_FILTER_GT,                   // field >  value
+    MSGRTR_FILTER_GE,                   // field >= value
+    MSGRTR_FILTER_ANY_BITS,             // (field & value) != 0
+    MSGRTR_FILTER_ALL_BITS              // (field & value) == value
+} MSGRTR_FILTER_OP;
+
+// filter term flags:
+#define MSGRTR_FILTER_SIGNED            0x00000001  // compare as signed
+#define MSGRTR_FILTER_NET_ORDER         0x00000002  // field is big endian
+#define MSGRTR_FILTER_OR                0x00000004  // starts an alternative
+
+typedef struct
+{
+    USHORT          offset;             // of the field in the message
+    UCHAR           width;              // field bytes: 1, 2, 4 or 8
+    UCHAR           op;                 // MSGRTR_FILTER_OP
+    UINT            flags;
+    ULONGLONG       value;
+} MSGRTR_FILTER_TERM;
+
+// a consumer's filter for one msgID:
+typedef struct
+{
+    ULONG           msgID;
+    int             numTerms;
+    MSGRTR_FILTER_TERM terms[MSGRTR_MAX_FILTER_TERMS];
+} MSGRTR_FILTER;
+
+// Traffic capture (see radmrouted.conf above):
+#define MSGRTR_CAPTURE_MAGIC            0x4D435052      // "MCPR"
+#define MSGRTR_CAPTURE_VERSION          1
+#define MSGRTR_CAPTURE_SEGMENT_BYTES    (64*1024*1024)
+#define MSGRTR_CAPTURE_MIN_SEGMENT      (1024*1024)
+#define MSGRTR_CAPTURE_SEGMENTS         16
+
+// Store-and-forward spools (see radmrouted.conf above):
+#define MSGRTR_MAX_SPOOLS               16
+#define MSGRTR_SPOOL_MIN_BYTES          65536
+#define MSGRTR_SPOOL_FILE_NAME          "radmrouted-spool"
+#define MSGRTR_SPOOL_MAGIC              0x4D53504C      // "MSPL"
+#define MSGRTR_SPOOL_VERSION            1
+#define MSGRTR_SPOOL_DRAIN_INTERVAL     5               // msecs
+#define MSGRTR_SPOOL_DRAIN_BATCH        1024            // msgs per drain tick
+#define MSGRTR_SPOOL_PAD                0x00000001      // record flag: skip to start
+
+// Persisted routing state (see radmrouted.conf above):
+#define MSGRTR_STATE_FILE_NAME          "radmrouted-state"
+#define MSGRTR_STATE_MAGIC              0x4D535453      // "MSTS"
+#define MSGRTR_STATE_VERSION            1
+#define MSGRTR_STATE_MIN_BYTES          (256*1024)
+
+typedef enum
+{
+    MSGRTR_STATE_CLIENT     = 1,        // a MSGRTR_STATE_CLIENT_DATA follows
+    MSGRTR_STATE_CLIENT_DEL,
+    MSGRTR_STATE_ADD_MSGID,
+    MSGRTR_STATE_DEL_MSGID,
+    MSGRTR_STATE_ADD_RANGE,
+    MSGRTR_STATE_DEL_RANGE,
+    MSGRTR_STATE_FILTER                 // a MSGRTR_FILTER follows
+} MSGRTR_STATE_TYPE;
+
+// The state file starts with this header; 'size' bytes of journal follow 
+// it, 'used' of them written. Each record is a MSGRTR_STATE_RECORD (plus 
+// a MSGRTR_STATE_CLIENT_DATA for clients or a MSGRTR_FILTER for filters) 
+// padded to 8 bytes:
+typedef struct
+{
+    ULONG           magic;
+    ULONG           version;
+    ULONG           recordSize;         // sizeof(MSGRTR_STATE_RECORD) of the writer
+    ULONG           records;
+    ULONGLONG       size;
+    volatile ULONGLONG used;
+} MSGRTR_STATE_FILE;
+
+typedef struct
+{
+    ULONG           recordLength;       // to the next record
+    ULONG           type;               // MSGRTR_STATE_TYPE
+    ULONG           first;              // msgID or range
+    ULONG           last;
+    int             pid;                // the client's
+    int             reserved;
+} MSGRTR_STATE_RECORD;
+
+typedef struct
+{
+    char            name[PROCESS_MAX_NAME_LEN+1];
+    char            queueName[QUEUE_NAME_LENGTH+1];
+} MSGRTR_STATE_CLIENT_DATA;
+
+// A spool file starts with this header; 'size' bytes of ring follow it. 
+// 'head' and 'tail' only grow (offsets are taken modulo 'size'); each 
+// record is a MSGRTR_SPOOL_RECORD, the MSGRTR_HDR and payload as routed 
+// (host byte order) and padding to 8 bytes:
+typedef struct
+{
+    ULONG           magic;
+    ULONG           version;
+    ULONG           routerID;           // the peer it holds traffic for
+    ULONG           hdrSize;            // sizeof(MSGRTR_HDR) of the writer
+    ULONGLONG       size;
+    volatile ULONGLONG head;            // oldest record
+    volatile ULONGLONG tail;            // where the next one goes
+    ULONG           records;
+    ULONG           drops;              // oldest records lost to full rings
+} MSGRTR_SPOOL_FILE;
+
+typedef struct
+{
+    ULONG           recordLength;       // to the next record
+    ULONG           flags;              // MSGRTR_SPOOL_PAD
+} MSGRTR_SPOOL_RECORD;
+
+typedef enum
+{
+    MSGRTR_SPOOL_IDLE       = 0,        // linked and caught up (or unused)
+    MSGRTR_SPOOL_OUTAGE,                // link down, collecting
+    MSGRTR_SPOOL_DRAINING               // link up, sending what was collected
+} MSGRTR_SPOOL_STATE;
+
+typedef struct
+{
+    ULONG           first;
+    ULONG           last;
+} MSGRTR_SPOOL_RANGE;
+
+// define a peer router's spool:
+typedef struct _msgrtrSpoolTag
+{
+    ULONG           routerID;
+    MSGRTR_SPOOL_STATE state;
+    pthread_mutex_t lock;               // routing threads append
+    int             fd;
+    MSGRTR_SPOOL_FILE *ring;
+    struct _msgrtrPibTag *pib;          // while draining
+    MSGRTR_SPOOL_RANGE *ranges;         // what it consumed when the link dropped
+    int             numRanges;          //   (sorted, disjoint)
+    ULONG           spooled;
+    ULONG           drained;
+} MSGRTR_SPOOL;
+
+// A capture segment file starts with this header; records follow it, each 
+// a MSGRTR_CAPTURE_RECORD, the MSGRTR_HDR and payload as routed (host byte 
+// order) and padding to 8 bytes:
+typedef struct
+{
+    ULONG           magic;
+    ULONG           version;
+    ULONG           segment;            // sequence number of this file
+    ULONG           routerID;
+    ULONGLONG       started;            // usecs since epoch
+    volatile ULONGLONG used;            // bytes written, this header included
+    ULONG           records;
+    ULONG           hdrSize;            // sizeof(MSGRTR_HDR) of the writer
+} MSGRTR_CAPTURE_SEGMENT;
+
+typedef struct
+{
+    ULONGLONG       timestamp;          // usecs since epoch
+    ULONG           recordLength;       // to the next record
+    ULONG           reserved;
+} MSGRTR_CAPTURE_RECORD;
+
+// A configured LAST_VALUE, CONFLATE or MULTICAST msgID range:
+typedef struct
+{
+    ULONG           first;
+    ULONG           last;
+    UINT            flags;              // MSGRTR_LVC_CACHE, _CONFLATE or _MULTICAST
+} MSGRTR_LVC_RULE;
+
+// The last message seen for a cached msgID:
+typedef struct _msgrtrLvcTag
+{
+    NODE            node;
+    struct _msgrtrLvcTag *hashNext;
+    ULONG           msgID;
+    UINT            length;
+    UINT            size;               // allocated for 'data'
+    UCHAR           *data;
+} MSGRTR_LVC;
+
+// A message waiting for a local consumer's queue to drain:
+typedef struct
+{
+    NODE            node;
+    ULONG           msgID;
+    void            *buffer;            // system buffer
+    UINT            length;
+    int             control;            // router ACK/answer, never dropped
+} MSGRTR_SPILL_MSG;
+
+// A block of frames waiting for a remote router's socket to drain:
+typedef struct
+{
+    NODE            node;
+    int             length;
+    int             offset;             // bytes already written
+    int             numFrames;
+    UCHAR           data[0];
+} MSGRTR_TX_CHUNK;
+
+
+// The datagrams on the multicast group and the unicast NAKs and repairs 
+// start with this header (network order); a DATA datagram carries one 
+// network order frame after it:
+typedef enum
+{
+    MSGRTR_MCAST_DATA       = 1,        // seq: this datagram's
+    MSGRTR_MCAST_HEARTBEAT,             // seq: the last DATA sent
+    MSGRTR_MCAST_NAK,                   // resend seq..seq+count-1 (to the sender)
+    MSGRTR_MCAST_LOST                   // seq..seq+count-1 are gone (from it)
+} MSGRTR_MCAST_TYPE;
+
+typedef struct
+{
+    ULONG           magic;
+    ULONG           type;               // MSGRTR_MCAST_TYPE
+    ULONG           routerID;           // who sent this datagram
+    ULONG           epoch;              // DATA sender's start time
+    ULONG           seq;
+    ULONG           count;
+} MSGRTR_MCAST_HDR;
+
+// where a sent DATA datagram is kept in the history ring:
+typedef struct
+{
+    UINT            seq;
+    UINT            length;             // 0 => never used
+    ULONGLONG       offset;             // grows like the ring's tail
+} MSGRTR_MCAST_SENT;
+
+// a remote router's multicast stream as received by us (sequence numbers
+// wrap, they are compared by their 32 bit difference):
+typedef struct
+{
+    int             inSync;             // FALSE until its first datagram
+    ULONG           epoch;
+    UINT            nextSeq;            // next to deliver
+    UINT            highSeq;            // newest known to have been sent
+    struct sockaddr_in source;          // its unicast address for NAKs
+    UCHAR           *held[MSGRTR_MCAST_HOLD_SLOTS];     // past a gap, by seq
+    int             heldLength[MSGRTR_MCAST_HOLD_SLOTS];
+    int             numHeld;
+    UINT            nakSeq;             // nextSeq when last NAKed
+    int             nakTries;
+    int             silentTicks;        // timer ticks since we heard it
+    ULONG           received;
+    ULONG           repaired;
+    ULONG           lost;
+    ULONG           naks;
+} MSGRTR_MCAST_RX;
+
+
+// Define the routing table hash sizes (must be powers of 2):
+#define MSGRTR_MIIB_HASH_SIZE           1024
+#define MSGRTR_PIB_HASH_SIZE            64
+
+// Initial size of the contiguous consumer/subscription arrays:
+#define MSGRTR_INITIAL_SET_SIZE         4
+
 
 // Define PIB types:
 typedef enum
@@ -114,48 +481,326 @@ typedef enum
     PIB_TYPE_REMOTE
 } MSGRTR_PIB_TYPE;
 
-// define the process information block (PIB):
+
+// define the shared traffic statistics block; msgID rows are claimed and 
+// counted atomically by the router and by senders delivering directly, the
+// rates and consumer rows are rewritten by the router every 
+// MSGRTR_STATS_INTERVAL:
+#define MSGRTR_STATS_MAGIC              0x7A41D2E5
+#define MSGRTR_STATS_MSGID_BITS         10
+#define MSGRTR_STATS_MSGIDS             (1 << MSGRTR_STATS_MSGID_BITS)
+#define MSGRTR_STATS_MAX_TRIES          32          // probes before giving up
+#define MSGRTR_STATS_MAX_CONSUMERS      64
+#define MSGRTR_STATS_FANOUT_BUCKETS     8           // 0,1,2,3-4,5-8,9-16,17-32,33+
+#define MSGRTR_STATS_WINDOW             10          // secs in the rate window
+#define MSGRTR_STATS_INTERVAL           1000        // msecs
+
+// first row probed for a msgID (linear probing from there):
+#define MSGRTR_STATS_INDEX(msgID)                                           \
+    ((UINT)((UINT)(msgID) * 2654435761U) >> (32 - MSGRTR_STATS_MSGID_BITS))
+
+typedef struct
+{
+    ULONG           msgID;              // 0 => row is free
+    ULONG           msgs;
+    ULONG           bytes;
+    ULONG           failures;           // deliveries that failed
+    ULONG           fanOut[MSGRTR_STATS_FANOUT_BUCKETS];
+    UINT            msgRate;            // per second over the window
+    UINT            byteRate;
+} MSGRTR_STATS_MSGID;
+
+typedef struct
+{
+    char            name[PROCESS_MAX_NAME_LEN+1];
+    int             pid;                // 0 for remote routers
+    ULONG           routerID;           // remote routers only
+    ULONG           msgs;               // delivered, directly or routed
+    ULONG           bytes;
+    ULONG           failures;           // queue sends that failed or were refused
+    ULONG           drops;              // overflow policy drops
+    int             lag;                // msgs (local) or frames (remote) held
+    UINT            msgRate;
+    UINT            byteRate;
+} MSGRTR_STATS_CONSUMER;
+
 typedef struct
+{
+    ULONG           magic;
+    int             routerPid;
+    UINT            window;             // secs the rates are taken over
+    ULONG           updates;            // router stats intervals so far
+    ULONG           unrecorded;         // msgs whose msgID found no free row
+    MSGRTR_STATS_MSGID      msgIDs[MSGRTR_STATS_MSGIDS];
+    volatile UINT           sequence;   // odd while consumer rows change
+    int                     numConsumers;
+    MSGRTR_STATS_CONSUMER   consumers[MSGRTR_STATS_MAX_CONSUMERS];
+} MSGRTR_STATS_BLOCK;
+
+// the router's rate window history for one row:
+typedef struct
+{
+    ULONG           msgs[MSGRTR_STATS_WINDOW+1];
+    ULONG           bytes[MSGRTR_STATS_WINDOW+1];
+} MSGRTR_STATS_HISTORY;
+
+
+// define the process information block (PIB):
+typedef struct _msgrtrPibTag
 {
     NODE            node;
     MSGRTR_PIB_TYPE type;
     char            name[PROCESS_MAX_NAME_LEN+1];
 
+    // Hash chains (by pid and by TX socket descriptor):
+    struct _msgrtrPibTag *pidNext;
+    struct _msgrtrPibTag *sockNext;
+    int             sockfd;             // -1 if not in the socket hash
+
+    // msgIDs this PIB consumes (contiguous, unordered):
+    ULONG           *subs;
+    int             numSubs;
+    int             maxSubs;
+    ULONG           routeMark[MSGRTR_MAX_WORKERS];  // last message routed
+                                                    // to this PIB, per worker
+
+    // Content filters on its msgID subscriptions (contiguous, unordered):
+    MSGRTR_FILTER   *filters;
+    int             numFilters;
+    int             maxFilters;
+    ULONG           filtered;           // msgs its filters held back
+
     // Local clients:
     int             pid;
     char            queueName[QUEUE_NAME_LENGTH+1];
+    int             shmSlot;            // client slot in the shared table or -1
+    RADLIST         spillQueue;         // MSGRTR_SPILL_MSGs its queue refused
+    int             spillCount;
+    int             spillPeak;
+    ULONG           spillDrops;
 
     // Remote clients:
     RADSOCK_ID      rxclient;
     RADSOCK_ID      txclient;
     ULONG           maxMsgSize;
+    UCHAR           *txBuffer;          // frames waiting to be written
+    int             txLength;
+    int             txFrames;
+    RADLIST         txQueue;            // MSGRTR_TX_CHUNKs the socket refused
+    int             txQueueBytes;
+    int             txQueueFrames;
+    PROC_IO_ID      txWriteId;          // write-ready registration or -1
+    int             txDown;             // TRUE => link failed, discard output
+    ULONG           txQueuePeak;
+    ULONG           txDrops;
+    ULONG           routerID;           // the peer router's mesh ID
+    struct _msgrtrSpoolTag *spool;      // set while its spool drains
+    ULONG           linkFlags;          // MSGRTR_LINK_* agreed for our TX
+    UCHAR           *zBuffer;           // compressed frames being written
+    UCHAR           *zRxBuffer;         // RX thread's expanded batch
+    ULONGLONG       zRawBytes;          // bytes sent compressed ...
+    ULONGLONG       zBytes;             // ... and what they took
+    ULONG           zBatches;
+    ULONG           zRxBatches;
+    MSGRTR_MCAST_RX *mcastRx;           // its group stream, NULL until heard
+
+    // Threaded mode:
+    pthread_mutex_t lock;               // guards the spill queue or TX state
+    pthread_cond_t  txCond;             // wakes the TX thread
+    RAD_THREAD_ID   rxThread;
+    RAD_THREAD_ID   txThread;
+    int             ioStop;             // TRUE => I/O threads should exit
+    int             jobRefs;            // its messages waiting for a worker
 
     // Stats:
     ULONG           transmits;
     ULONG           receives;
     ULONG           rxErrors;
     ULONG           txErrors;
+    ULONG           rxBytes;
+    ULONG           sendBusy;           // queue sends refused (spilled)
+    ULONG           spillConflated;     // held msgs replaced by newer ones
+    MSGRTR_STATS_HISTORY history;       // for the published rates
 } MSGRTR_PIB;
 
 
-// define the consumer information block (CIB):
+// define a msgID range subscription (first and last inclusive):
 typedef struct
 {
     NODE            node;
-    MSGRTR_PIB      *pib;               // points to members of master PIB list
-} MSGRTR_CIB;
+    ULONG           first;
+    ULONG           last;
+    MSGRTR_PIB      *consumer;
+} MSGRTR_RANGE;
 
+// define a range segment - the range subscriptions are flattened into a
+// sorted array of disjoint segments, each with the consumers of every range
+// covering it:
+typedef struct
+{
+    ULONG           first;
+    ULONG           last;
+    MSGRTR_PIB      **consumers;
+    int             numConsumers;
+} MSGRTR_RANGE_SEG;
 
-// define the message ID information block (MIIB)
-// this contains the list of registered consumers:
+// define a range end point - RangeRebuild sorts them and sweeps once:
 typedef struct
+{
+    ULONGLONG       bound;              // range first, or last + 1
+    MSGRTR_PIB      *consumer;
+    int             delta;              // 1 entering the range, -1 leaving
+} MSGRTR_RANGE_BOUND;
+
+// define the message ID information block (MIIB)
+// this contains the set of registered consumers:
+typedef struct _msgrtrMiibTag
 {
     NODE            node;
+    struct _msgrtrMiibTag *hashNext;
     ULONG           msgID;
-    RADLIST         consumers;          // list of MSGRTR_CIB
+    MSGRTR_PIB      **consumers;        // points to members of master PIB list
+    int             numConsumers;
+    int             maxConsumers;
+    MSGRTR_RANGE_SEG *rangeSeg;         // range consumers of msgID or NULL
 } MSGRTR_MIIB;
 
 
+// define the shared subscription table (clients only update the slot 
+// counters); local producers use it to deliver directly to local consumers'
+// queues and only involve the router for remote (or unslotted) consumers, 
+// or for one whose queue is full until the router has caught him up:
+#define MSGRTR_SHM_MAGIC                0x3C91A5E7
+#define MSGRTR_SHM_TABLE_BITS           11
+#define MSGRTR_SHM_TABLE_SIZE           (1 << MSGRTR_SHM_TABLE_BITS)
+#define MSGRTR_SHM_MAX_TRIES            64          // reader retries per lookup
+#define MSGRTR_SHM_MAX_RANGES           128         // published range segments
+#define MSGRTR_SHM_RETRY_INTERVAL       1000        // msecs between re-attach
+                                                    // tries once withdrawn
+
+// first slot probed for a msgID (linear probing from there):
+#define MSGRTR_SHM_INDEX(msgID)                                             \
+    ((UINT)((UINT)(msgID) * 2654435761U) >> (32 - MSGRTR_SHM_TABLE_BITS))
+
+// entry flags:
+#define MSGRTR_SHM_ROUTER_DELIVERS      0x00000001  // router has consumers too
+#define MSGRTR_SHM_ROUTER_CACHES        0x00000002  // router caches the last one
+#define MSGRTR_SHM_ROUTER_CONFLATES     0x00000004  // router delivers to all
+
+typedef struct
+{
+    int             pid;                // 0 => slot is free
+    char            queueName[QUEUE_NAME_LENGTH+1];
+    ULONG           directSends;        // msgs delivered directly to this slot
+    ULONG           directBytes;
+    ULONG           directFailures;     // queue sends to this slot that failed
+    volatile int    spilling;           // TRUE => router holds a backlog for it
+    volatile ULONG  handoffs;           // msgs producers left to the router
+    volatile ULONG  handoffsDone;       //   and those the router is through with
+                                        //   (kept when the slot is reused)
+} MSGRTR_SHM_CLIENT;
+
+typedef struct
+{
+    ULONG           msgID;              // 0 => never used
+    UINT            localMask;          // bit N => clients[N] consumes msgID
+    UINT            flags;
+} MSGRTR_SHM_ENTRY;
+
+// range segments are sorted by 'first'; exact entries already include the
+// consumers of ranges that cover them:
+typedef struct
+{
+    ULONG           first;
+    ULONG           last;
+    UINT            localMask;
+    UINT            flags;
+} MSGRTR_SHM_RANGE;
+
+typedef struct
+{
+    ULONG           magic;
+    int             routerPid;
+    volatile UINT   sequence;           // odd while the router is updating
+    int             overflow;           // TRUE => table misses must use router
+    MSGRTR_SHM_CLIENT   clients[MSGRTR_MAX_CLIENTS];
+    MSGRTR_SHM_ENTRY    entries[MSGRTR_SHM_TABLE_SIZE];
+    int                 numRanges;
+    MSGRTR_SHM_RANGE    ranges[MSGRTR_SHM_MAX_RANGES];
+} MSGRTR_SHM_TABLE;
+
+
+// define a router's interest in first..last (first == last for an exact 
+// msgID); 'via' is the peer it was first heard from, NULL for our own:
+typedef struct _msgrtrInterestTag
+{
+    NODE            node;
+    struct _msgrtrInterestTag *hashNext;
+    ULONG           first;
+    ULONG           last;
+    ULONG           routerID;           // the subscribing router
+    MSGRTR_PIB      *via;
+    ULONG           hops;
+} MSGRTR_INTEREST;
+
+// define the duplicate filter for messages entering the mesh at one router:
+typedef struct
+{
+    ULONG           routerID;
+    ULONG           epoch;
+    UINT            highSeq;            // 32 bits on the wire, wraps
+    UINT            seen[MSGRTR_DUP_WINDOW/32];
+    MSGRTR_PIB      *via;               // link it was last heard from (replies)
+} MSGRTR_ORIGIN;
+
+// define a message waiting for a routing worker; 'hdr' is a system buffer
+// the worker releases:
+typedef struct
+{
+    struct _msgrtrHdrTag *hdr;
+    MSGRTR_PIB      *sockpib;           // remote source or NULL
+} MSGRTR_JOB;
+
+// define a routing worker and its queue:
+typedef struct
+{
+    RAD_THREAD_ID   thread;
+    int             lane;               // index into PIB routeMark
+    pthread_mutex_t lock;
+    pthread_cond_t  notEmpty;
+    pthread_cond_t  notFull;
+    MSGRTR_JOB      *ring;              // MSGRTR_SHARD_QUEUE_SIZE jobs
+    int             head;
+    int             count;
+    int             stop;
+    ULONG           routeMark;          // bumped for each routed message
+    ULONG           jobs;
+    int             peak;
+} MSGRTR_SHARD;
+
+// define work handed from the remote RX threads to the main thread:
+typedef enum
+{
+    MSGRTR_INBOX_CONTROL    = 1,        // router control message
+    MSGRTR_INBOX_LINK_DOWN              // RX failed, close the PIB
+} MSGRTR_INBOX_TYPE;
+
+typedef struct
+{
+    NODE            node;
+    MSGRTR_INBOX_TYPE type;
+    struct _msgrtrHdrTag *hdr;          // system buffer or NULL
+    MSGRTR_PIB      *pib;
+} MSGRTR_INBOX_MSG;
+
+// define a configured peer router:
+typedef struct
+{
+    char            remoteIP[256];
+    int             remotePort;
+    RADSOCK_ID      remoteServer;       // our TX socket while connected
+} MSGRTR_PEER;
+
 // define the message router work data:
 typedef struct
 {
@@ -164,16 +809,131 @@ typedef struct
     char            pidFile[128];
     char            fifoFile[128];
     TIMER_ID        remoteConnectTimer;
+    TIMER_ID        txFlushTimer;
+    int             txFlushPending;
+    int             txFlushBytes;
+    int             txFlushDelay;
+    int             txQueueLimit;
+    MSGRTR_TX_POLICY txPolicy;
+    TIMER_ID        spillTimer;
+    int             spillPending;
+    int             spillLimit;
+    MSGRTR_TX_POLICY spillPolicy;       // drop-oldest or drop-newest only
 
-    char            remoteIP[256];
-    int             remotePort;
-    RADSOCK_ID      remoteServer;
+    MSGRTR_PEER     peers[MSGRTR_MAX_PEERS];
+    int             numPeers;
+
+    // Mesh state:
+    ULONG           routerID;
+    ULONG           epoch;              // start time, resets peers' dup filters
+    UINT            originSeq;          // last stamped, wraps at 32 bits (skips 0)
+    RADLIST         interestList;       // MSGRTR_INTEREST, ours and learned
+    MSGRTR_INTEREST *interestHash[MSGRTR_INTEREST_HASH_SIZE];
+    MSGRTR_ORIGIN   origins[MSGRTR_MAX_ORIGINS];
+    int             numOrigins;
+    ULONG           duplicates;         // mesh copies dropped
+
+    // Last-value cache and conflation:
+    MSGRTR_LVC_RULE lvcRules[MSGRTR_MAX_LVC_RULES];
+    int             numLvcRules;
+    RADLIST         lvcList;            // MSGRTR_LVCs
+    MSGRTR_LVC      *lvcHash[MSGRTR_LVC_HASH_SIZE];
+    pthread_mutex_t lvcLock;            // workers update, main replays
+    ULONG           lvcBytes;
+    ULONG           lvcReplays;
+
+    // Traffic capture:
+    char            captureBase[256];   // "" => not capturing
+    ULONG           captureSegmentBytes;
+    int             captureSegments;
+    pthread_mutex_t captureLock;        // routing threads append
+    int             captureFd;
+    MSGRTR_CAPTURE_SEGMENT *captureMap; // current segment, NULL if failed
+    ULONG           captureNumber;
+    ULONG           captureRecords;
+    ULONG           captureDrops;
+
+    // Store-and-forward spools for remote routers:
+    char            spoolDir[256];
+    ULONG           spoolBytes;         // 0 => not spooling
+    MSGRTR_SPOOL    spools[MSGRTR_MAX_SPOOLS];
+    int             numSpools;
+    int             numOutages;         // spools collecting in RouteMessage
+    TIMER_ID        spoolTimer;
+
+    // Persisted routing state:
+    int             persistState;
+    char            stateFile[256];
+    int             stateFd;
+    MSGRTR_STATE_FILE *stateMap;        // NULL => not persisting
+    int             stateLoading;       // TRUE => replaying, don't journal
+
+    // Remote link compression and multicast:
+    ULONG           linkFlags;          // MSGRTR_LINK_* we offer
+    int             compressMinBytes;
+    char            mcastGroup[128];    // "" => no multicast
+    int             mcastPort;
+    char            mcastInterface[128];
+    int             mcastTTL;
+    int             mcastMinPeers;
+    ULONG           mcastHistoryBytes;
+    RADUDPSOCK_ID   mcastRxSock;        // bound to the group port
+    RADUDPSOCK_ID   mcastTxSock;        // sends all, NAKs come back to it
+    struct sockaddr_in mcastAdrs;       // the group
+    pthread_mutex_t mcastLock;          // routing threads send
+    UINT            mcastSeq;           // last DATA sequence number sent
+    UINT            mcastBeatSeq;       // as of the last heartbeat
+    int             mcastIdleTicks;
+    UCHAR           *mcastHistory;      // ring of sent DATA datagrams
+    ULONGLONG       mcastTail;
+    MSGRTR_MCAST_SENT *mcastSent;       // MSGRTR_MCAST_HISTORY_SLOTS, by seq
+    TIMER_ID        mcastTimer;
+    ULONG           mcastSends;
+    ULONGLONG       mcastBytes;
+    ULONG           mcastPeerSends;     // TCP sends the group saved
+    ULONG           mcastNaksRx;
+    ULONG           mcastResends;
+    ULONG           mcastGone;          // NAKed seqs no longer held
 
     RADLIST         pibList;            // list of registrants (MSGRTR_PIB)
     RADLIST         miibList;           // list of messages by msgID (MSGRTR_MIIB)
+    RADLIST         rangeList;          // range subscriptions (MSGRTR_RANGE)
+    MSGRTR_RANGE_SEG *rangeSegs;        // flattened rangeList, sorted
+    int             numRangeSegs;
+    ULONG           routeMark;          // bumped for each message routed here
+
+    // Threaded routing:
+    int             numWorkers;         // 0 => route on the main thread
+    MSGRTR_SHARD    shards[MSGRTR_MAX_WORKERS];
+    pthread_rwlock_t tableLock;         // workers read, changes write
+    pthread_mutex_t originLock;         // guards origins[]
+    pthread_mutex_t inboxLock;
+    RADLIST         inbox;              // MSGRTR_INBOX_MSGs for the main thread
+    int             inboxPipe[2];       // wakes the main thread
+    int             spillWake;          // TRUE => spill timer start requested
+
+    // Routing table indexes:
+    MSGRTR_MIIB     *miibHash[MSGRTR_MIIB_HASH_SIZE];
+    MSGRTR_PIB      *pidHash[MSGRTR_PIB_HASH_SIZE];
+    MSGRTR_PIB      *sockHash[MSGRTR_PIB_HASH_SIZE];
 
     RADSOCK_ID      server;
     int             listenPort;
+    RADSOCK_ID      localServer;        // Unix-domain listen socket or NULL
+    int             localLinks;         // TRUE => co-located peers use it
+    char            localLinkDir[256];
+    char            localPath[128];     // our socket's path
+
+    // Shared subscription table:
+    SHMEM_ID        shmId;
+    MSGRTR_SHM_TABLE *shmTable;
+    int             shmUpdateDepth;     // nested ShmTableBeginUpdate calls
+
+    // Shared traffic statistics:
+    SHMEM_ID        statsId;
+    MSGRTR_STATS_BLOCK *stats;
+    MSGRTR_STATS_HISTORY *statsHistory; // one per msgID row
+    TIMER_ID        statsTimer;
 
     ULONG           transmits;
     ULONG           receives;
@@ -184,20 +944,72 @@ typedef struct
 typedef struct
 {
     char            rtrQueueName[QUEUE_NAME_LENGTH+1];
+
+    // Shared subscription table (NULL => route everything via the router):
+    SHMEM_ID        shmId;
+    MSGRTR_SHM_TABLE *shmTable;
+
+    // Shared traffic statistics (NULL => not published):
+    SHMEM_ID        statsId;
+    MSGRTR_STATS_BLOCK *stats;
+    ULONGLONG       shmRetryTime;       // last attach attempt after a restart
+
+    // Cached copies of the table's client slots:
+    int             slotPid[MSGRTR_MAX_CLIENTS];
+    char            slotQueue[MSGRTR_MAX_CLIENTS][QUEUE_NAME_LENGTH+1];
+
+    // Batched registration ACK tracking:
+    ULONG           lastAckToken;
+    RADLIST         asyncList;          // MSGRTR_ASYNC_REGISTERs awaiting ACK
+    long            asyncHandlerId;     // our queue handler, 0 if not installed
+
+    // Request/reply:
+    long            rpcHandlerId;       // our queue handler, 0 if not installed
+    ULONG           lastCorrelationID;
+    RADLIST         requestList;        // MSGRTR_PENDING_REQUESTs by deadline
+    TIMER_ID        requestTimer;       // NULL until the first request
+    void            (*requestHandler) (ULONG msgID, void *request, ULONG length,
+                                       MSGRTR_REQUEST_ID *requestID, void *userData);
+    void            *requestUserData;
 } MSGRTR_LOCAL_WORK;
 
 
 // define the message router message header:
-#define MSGRTR_MAGIC_NUMBER             0x59E723F3
-typedef struct
+#define MSGRTR_MAGIC_NUMBER             0x59E723F4  // header layout 2
+#define MSGRTR_MAGIC_NUMBER_V1          0x59E723F3  // original layout, refused
+typedef struct _msgrtrHdrTag
 {
     ULONG           magicNumber;        // guard against non-API sends to router
     int             srcpid;
     ULONG           msgID;
     ULONG           length;
+    ULONG           flags;
+    ULONG           routerSlots;        // slotted locals the sender left to
+                                        //   the router (bit N => slot N)
+    ULONG           originID;           // router the msg entered the mesh at
+    ULONG           originEpoch;
+    ULONG           originSeq;          // 0 for router control messages
+    ULONG           correlationID;      // request/reply only:
+    ULONG           replyRouterID;      //   where the requester is
+    int             replyPid;
     UCHAR           msg[0];             // placeholder for start of message
 } MSGRTR_HDR;
 
+// define the message header flags:
+#define MSGRTR_FLAG_LOCAL_DONE          0x00000001  // sender delivered to slotted locals
+#define MSGRTR_FLAG_REQUEST             0x00000002  // routed by msgID, answer expected
+#define MSGRTR_FLAG_REPLY               0x00000004  // routed to replyRouterID/replyPid
+#define MSGRTR_FLAG_RPC                 (MSGRTR_FLAG_REQUEST | MSGRTR_FLAG_REPLY)
+#define MSGRTR_FLAG_COMPRESSED          0x00000008  // router link: a MSGRTR_ZBATCH
+#define MSGRTR_FLAG_MULTICAST           0x00000010  // router only: came off the group
+
+// with MSGRTR_FLAG_LOCAL_DONE the sender's direct deliveries and failures
+// ride in the upper flag bits, so the router's stats cover the whole fan-out:
+#define MSGRTR_FLAG_DIRECT(sent, failed)                                    \
+    ((((ULONG)(sent) & 0xFF) << 16) | (((ULONG)(failed) & 0xFF) << 24))
+#define MSGRTR_FLAG_DIRECT_SENT(flags)  (((flags) >> 16) & 0xFF)
+#define MSGRTR_FLAG_DIRECT_FAILED(flags) (((flags) >> 24) & 0xFF)
+
 // define the internal admin message subtypes:
 enum
 {
@@ -207,7 +1019,14 @@ enum
     MSGRTR_SUBTYPE_ENABLE_MSGID,
     MSGRTR_SUBTYPE_MSGID_IS_REGISTERED,
     MSGRTR_SUBTYPE_DISABLE_MSGID,
-    MSGRTR_SUBTYPE_DUMP_STATS
+    MSGRTR_SUBTYPE_DUMP_STATS,
+    MSGRTR_SUBTYPE_ENABLE_MSGID_LIST,
+    MSGRTR_SUBTYPE_ENABLE_MSGID_RANGE,
+    MSGRTR_SUBTYPE_DISABLE_MSGID_RANGE,
+    MSGRTR_SUBTYPE_INTEREST_ADD,
+    MSGRTR_SUBTYPE_INTEREST_DEL,
+    MSGRTR_SUBTYPE_ENABLE_MSGID_FILTER,
+    MSGRTR_SUBTYPE_MCAST_DEAF
 };
 
 // define the internal admin message:
@@ -218,10 +1037,104 @@ typedef struct
     ULONG           targetMsgID;
     char            srcIP[128];
     int             srcPort;
-    ULONG           socketID;
+    ULONG           socketID;           // TX socket descriptor of the requester
     ULONG           maxMsgSize;
     int             isRegistered;
+    ULONG           lastMsgID;          // range subtypes: targetMsgID..lastMsgID
+    ULONG           routerID;           // router handshake: sender's mesh ID
+    ULONG           linkFlags;          // router handshake: MSGRTR_LINK_*
+                                        //   offered (REGISTER), agreed (ACK)
 } MSGRTR_INTERNAL_MSG;
+
+// define a compressed frame batch (MSGRTR_FLAG_COMPRESSED) - 'frames' 
+// network order frames, 'rawLength' bytes once expanded, follow it 
+// compressed by radCompressLZ:
+typedef struct
+{
+    ULONG           rawLength;
+    ULONG           frames;
+    UCHAR           data[0];
+} MSGRTR_ZBATCH;
+
+// define the router-to-router interest message (MSGRTR_SUBTYPE_INTEREST_*):
+// router 'routerID' gained or lost interest in each first..last item
+typedef struct
+{
+    ULONG           first;
+    ULONG           last;
+} MSGRTR_INTEREST_ITEM;
+
+typedef struct
+{
+    ULONG           subMsgID;
+    ULONG           routerID;
+    ULONG           hops;
+    ULONG           numItems;
+    MSGRTR_INTEREST_ITEM items[0];
+} MSGRTR_INTERNAL_INTEREST_MSG;
+
+// define an interest announcement being built by the router:
+typedef struct
+{
+    MSGRTR_INTERNAL_INTEREST_MSG *msg;
+    MSGRTR_PIB      *except;            // send to all peers but this one
+    MSGRTR_PIB      *only;              // or just to this one
+    ULONG           bfr[(sizeof(MSGRTR_INTERNAL_INTEREST_MSG) + 
+                         MSGRTR_MAX_LIST_MSGIDS*sizeof(MSGRTR_INTEREST_ITEM))/sizeof(ULONG)];
+} MSGRTR_ANNOUNCE;
+
+// define the batched registration message (MSGRTR_SUBTYPE_ENABLE_MSGID_LIST);
+// the router ACKs local senders with 'ackToken' in the ACK's targetMsgID
+// when it is non-zero:
+typedef struct
+{
+    ULONG           subMsgID;
+    ULONG           ackToken;
+    ULONG           numMsgIDs;
+    ULONG           msgIDs[0];
+} MSGRTR_INTERNAL_LIST_MSG;
+
+// define the filtered registration message (MSGRTR_SUBTYPE_ENABLE_MSGID_FILTER);
+// 'numTerms' 0 removes the filter but keeps the registration:
+typedef struct
+{
+    ULONG           subMsgID;
+    ULONG           msgID;
+    ULONG           numTerms;
+    MSGRTR_FILTER_TERM terms[0];
+} MSGRTR_INTERNAL_FILTER_MSG;
+
+// define a pending asynchronous batched registration:
+typedef struct
+{
+    NODE            node;
+    ULONG           ackToken;
+    void            (*doneHandler) (int status, void *userData);
+    void            *userData;
+} MSGRTR_ASYNC_REGISTER;
+
+// define a request waiting for its reply:
+typedef struct
+{
+    NODE            node;
+    ULONG           correlationID;
+    ULONG           msgID;
+    ULONGLONG       deadline;           // radTimeGetMSSinceEpoch
+    void            (*replyHandler) (int status, ULONG msgID, void *reply, 
+                                     ULONG length, void *userData);
+    void            *userData;
+} MSGRTR_PENDING_REQUEST;
+
+// Count one message for msgID in the shared stats block (used by the router
+// and by senders delivering directly):
+extern void msgrtrStatsRecord
+(
+    MSGRTR_STATS_BLOCK  *stats,
+    ULONG               msgID,
+    ULONG               length,
+    int                 fanOut,
+    int                 failures
+);
     
 
 ///*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*/*///
@@ -256,6 +1169,55 @@ extern void radMsgRouterProcessExit (int pid);
 extern int radMsgRouterMessageRegister (ULONG msgID);
 
 
+//  Request to receive all 'count' msgIDs in 'msgIDs' - the router applies
+//  them as one batch and ACKs once; blocks until the ACK arrives (messages
+//  received meanwhile are delivered by the next radProcessWait calls)
+//  - returns OK or ERROR
+//  Note: msgID "MSGRTR_INTERNAL_MSGID" is reserved for internal use
+extern int radMsgRouterMessageRegisterMany (ULONG *msgIDs, int count);
+
+
+//  Asynchronous 'radMsgRouterMessageRegisterMany' - returns once the batch
+//  is sent; 'doneHandler' is called from radProcessWait with status OK and
+//  'userData' when the router has applied it
+//  - returns OK or ERROR
+//  Note: msgID "MSGRTR_INTERNAL_MSGID" is reserved for internal use
+extern int radMsgRouterMessageRegisterManyAsync
+(
+    ULONG           *msgIDs,
+    int             count,
+    void            (*doneHandler) (int status, void *userData),
+    void            *userData
+);
+
+
+//  Request to receive every msgID from 'firstMsgID' to 'lastMsgID' inclusive
+//  - returns OK or ERROR
+//  Note: msgID "MSGRTR_INTERNAL_MSGID" is reserved for internal use
+extern int radMsgRouterMessageRegisterRange (ULONG firstMsgID, ULONG lastMsgID);
+
+
+//  Request to receive every msgID whose top 'prefixBits' bits match those
+//  of 'msgID' (i.e., msgID/prefixBits like an IP network)
+//  - returns OK or ERROR
+//  Note: msgID "MSGRTR_INTERNAL_MSGID" is reserved for internal use
+extern int radMsgRouterMessageRegisterPrefix (ULONG msgID, int prefixBits);
+
+
+//  Request to receive only the 'msgID' messages that pass the filter of
+//  'numTerms' 'terms' (see MSGRTR_FILTER_TERM); registers for 'msgID' if
+//  not yet registered and replaces any filter set for it before; 
+//  'numTerms' 0 removes the filter, so every 'msgID' message is received
+//  - returns OK or ERROR
+//  Note: msgID "MSGRTR_INTERNAL_MSGID" is reserved for internal use
+extern int radMsgRouterMessageRegisterFilter
+(
+    ULONG               msgID,
+    MSGRTR_FILTER_TERM  *terms,
+    int                 numTerms
+);
+
+
 //  Request if there are any subscribers to 'msgID' messages
 //  - returns FALSE or TRUE
 //  Note: msgID "MSGRTR_INTERNAL_MSGID" is reserved for internal use
@@ -268,20 +1230,76 @@ extern int radMsgRouterMessageIsRegistered (ULONG msgID);
 extern int radMsgRouterMessageDeregister (ULONG msgID);
 
 
+//  Request to NOT receive the range registered with the same arguments
+//  - returns OK or ERROR
+extern int radMsgRouterMessageDeregisterRange (ULONG firstMsgID, ULONG lastMsgID);
+extern int radMsgRouterMessageDeregisterPrefix (ULONG msgID, int prefixBits);
+
+
 //  Send a message through the message router - all processes which have
 //  subscribed to 'msgID' will receive a copy of the message;
 //  'msg' will be copied - ownership of 'msg' is NOT transferred but remains 
-//  with the caller;
+//  with the caller; a local subscriber that is not keeping up never blocks 
+//  the sender, radmrouted holds or drops for it per LOCAL_SPILL_MSGS;
 //  - returns OK or ERROR
 //  Note: msgID "MSGRTR_INTERNAL_MSGID" is reserved for internal use
 extern int radMsgRouterMessageSend (ULONG msgID, void *msg, ULONG byteLength);
 
 
+//  Send a request to the subscribers of 'msgID' (local or remote) - 
+//  'replyHandler' is called from radProcessWait with status OK and the 
+//  first reply, or with status TIMEOUT (reply NULL) if none arrives within 
+//  'timeoutMS'; later replies are discarded;
+//  'request' will be copied - ownership is NOT transferred;
+//  the first request uses one of the process's radTimerCreate timers
+//  - returns OK or ERROR (the handler is not called)
+extern int radMsgRouterRequest
+(
+    ULONG           msgID,
+    void            *request,
+    ULONG           byteLength,
+    ULONG           timeoutMS,
+    void            (*replyHandler) (int status, ULONG msgID, void *reply, 
+                                     ULONG byteLength, void *userData),
+    void            *userData
+);
+
+
+//  Set the handler called from radProcessWait for requests to the msgIDs 
+//  this process has registered for; requests arriving while no handler is 
+//  set are discarded; NULL removes the handler
+//  - returns OK or ERROR
+extern int radMsgRouterRequestHandlerSet
+(
+    void            (*requestHandler) (ULONG msgID, void *request, ULONG byteLength,
+                                       MSGRTR_REQUEST_ID *requestID, void *userData),
+    void            *userData
+);
+
+
+//  Reply to the request identified by 'requestID' - the reply goes only to 
+//  the requesting process; 'reply' will be copied
+//  - returns OK or ERROR
+extern int radMsgRouterReply
+(
+    MSGRTR_REQUEST_ID   *requestID,
+    void                *reply,
+    ULONG               byteLength
+);
+
+
 //  instruct the message router to dump statistics to the log file
 //  - returns OK or ERROR
 extern int radMsgRouterStatsDump (void);
 
 
+//  print the router's live traffic statistics (per msgID and per consumer)
+//  from its shared stats block to 'out' - radmrouted is not involved, so 
+//  only 'radSystemInit' is required
+//  - returns OK or ERROR if radmrouted is not publishing statistics
+extern int radMsgRouterStatsPrint (FILE *out);
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -116,10 +116,21 @@ typedef struct
     void            *udata;
 } PROC_MSGQ_HANDLER;
 
+// a received queue message set aside by radProcessQueueDefer:
+typedef struct
+{
+    NODE            node;
+    char            srcQueueName[QUEUE_NAME_LENGTH+1];
+    UINT            msgType;
+    void            *msg;
+    UINT            length;
+} PROC_MSGQ_DEFERRED;
+
 typedef struct processIoTag
 {
     void            (*ioCallback) (int fd, void *userData);
     void            *userData;
+    int             forWrite;           // TRUE => wait for output space
 } PROC_IO_BLK;
 
 
@@ -131,12 +142,14 @@ typedef struct
     char            name[PROCESS_MAX_NAME_LEN+1];
     pid_t           pid;
     fd_set          fdSet;
+    fd_set          writeFdSet;
     int             fdMax;
     int             fds   [PROC_FD_NUM_INDEXES];
     PROC_IO_BLK     ioIDs [PROC_FD_NUM_INDEXES];
     T_QUEUE_ID      myQueue;
     long            defaultMsgQID;
     RADLIST         msgqHandlerList;
+    RADLIST         msgqDeferredList;
 
     // two flags for queue message handling
     int             keepMsgQBuffer;
@@ -265,6 +278,20 @@ extern PROC_IO_ID radProcessIORegisterDescriptor
     void        *userData
 );
 
+/*  ... register your file descriptor to be notified by "processWait" when
+    ... it can be written without blocking (use with non-blocking output);
+    ... 'ioCallback' will be executed while 'fd' is writable or in error,
+    ... so de-register once your output is drained;
+    ... 'userData' will be passed to 'ioCallback';
+    ... returns PROC_IO_ID or ERROR
+*/
+extern PROC_IO_ID radProcessIORegisterWriteDescriptor
+(
+    int         fd,
+    void        (*ioCallback) (int fd, void *userData),
+    void        *userData
+);
+
 /*  ... de-register your file descriptor for "processWait" inclusion;
     ... returns OK or ERROR
 */
@@ -372,11 +399,22 @@ extern int radProcessQueueQuitGroup
     int         groupNumber
 );
 
+/*  ... set blocking (the default) or non-blocking writes to an attached
+    ... queue; radProcessQueueSend to a full non-blocking queue returns BUSY;
+    ... returns OK or ERROR
+*/
+extern int radProcessQueueSetSendBlocking
+(
+    char        *destQueueName,
+    int         isBlocking
+);
+
 /*  ... write to a queue;
     ... assumes sysBuffer is a valid pointer to a system buffer (unless length
     ... is zero, in which case a zero-length message is sent);
     ... system buffer ownership is transfered to the receiving queue;
-    ... returns OK, ERROR, or ERROR_ABORT if the dest queue is gone;
+    ... returns OK, ERROR, ERROR_ABORT if the dest queue is gone or BUSY if
+    ... the dest is non-blocking and full (ownership is NOT transferred);
     ... user should dettach from a dest on ERROR_ABORT!
 */
 extern int radProcessQueueSend
@@ -436,6 +474,21 @@ extern int radProcessQueueStopHandlerList
     void
 );
 
+/*  ... set aside a message read from the process queue outside of the
+    ... handlers (a utility waiting on the queue for its own reply, say) so
+    ... the next 'radProcessWait' dispatches it to the message queue handlers,
+    ... ahead of anything still in the queue; ownership of 'msg' passes to
+    ... radProcessWait;
+    ... returns OK or ERROR (the caller keeps 'msg')
+*/
+extern int radProcessQueueDefer
+(
+    char            *srcQueueName,
+    UINT            msgType,
+    void            *msg,
+    UINT            length
+);
+
 /*  ... prepend an additional message queue handler to the existing list of 
     ... message handlers; this allows other utilities/objects/etc. to insert
     ... a message handler to process specific utility messages without the 
@@ -76,6 +76,8 @@ typedef struct
     pid_t           pid;
     int             (*entry) (void *pargs);
     void            *args;
+    int             placed;
+    RAD_PLACEMENT   placement;
 } PROC_DATA, *PROC_DATA_ID;
 
 
@@ -137,6 +139,22 @@ extern int radPlistAdd
 );
 
 
+/*  ... radPlistAddPlaced
+    ... as radPlistAdd, with the process started under <placement>
+    ... (CPU affinity, scheduling class and NUMA memory binding, see
+    ... radprocutils.h); the placement is copied;
+    ... returns - OK or ERROR
+*/
+extern int radPlistAddPlaced
+(
+    PROC_LIST_ID    plistId,
+    int             (*entry) (void *pargs),
+    void            *args,
+    int             priority,
+    RAD_PLACEMENT   *placement
+);
+
+
 /*  ... radPlistStart
     ... start all process entries in an existing process list, ordered
     ... by priority (1 -> 100);
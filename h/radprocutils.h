@@ -17,6 +17,17 @@ extern "C" {
  
   NOTES:
         semProcessInit must have been called...
+
+        A RAD_PLACEMENT describes where a process or thread runs: the CPUs
+        it may use, an optional SCHED_FIFO priority and the NUMA nodes its
+        memory is bound to. Each is left alone when not given. It is built
+        from list strings such as "0-3,8" with radPlacementInit and applied
+        by the process or thread itself with radPlacementApply;
+        radStartProcessPlaced applies one in the child before its entry
+        point runs. A placement is all or nothing: if any part is refused
+        the rest is undone, and radStartProcessPlaced and
+        radthreadCreatePlaced fail. SCHED_FIFO normally needs root or
+        CAP_SYS_NICE.
  
   LICENSE:
         Copyright 2001-2005 Mark S. Teel. All rights reserved.
@@ -59,9 +70,19 @@ extern "C" {
 
 /*  ... macro definitions
 */
+#define RAD_PLACEMENT_MAX_CPUS      1024
+#define RAD_PLACEMENT_MAX_NODES     (sizeof(ULONG) * 8)
+#define RAD_PLACEMENT_CPU_WORDS     (RAD_PLACEMENT_MAX_CPUS / (sizeof(ULONG) * 8))
+
 
 /*  ... typedefs
 */
+typedef struct
+{
+    ULONG           cpus[RAD_PLACEMENT_CPU_WORDS];  // none set: any CPU
+    int             fifoPriority;                   // 1-99, 0: normal
+    ULONG           memoryNodes;                    // 0: default policy
+} RAD_PLACEMENT;
 
 
 /*  ... methods
@@ -81,6 +102,51 @@ extern int radStartProcess
 );
 
 
+/*  ... radPlacementInit
+    ... build a placement;
+    ... cpuList - CPUs to run on, i.e. "0-3,8", or NULL/"" for any;
+    ... fifoPriority - SCHED_FIFO priority 1-99, or 0 to leave the
+    ...                scheduling class alone;
+    ... nodeList - NUMA nodes to bind memory to, i.e. "0", or NULL/""
+    ...            for the default policy;
+    ... returns - OK or ERROR if a list or the priority is invalid
+*/
+extern int radPlacementInit
+(
+    RAD_PLACEMENT   *placement,
+    char            *cpuList,
+    int             fifoPriority,
+    char            *nodeList
+);
+
+
+/*  ... radPlacementApply
+    ... apply a placement to the calling thread (the whole process if it
+    ... has only one thread); memory binding affects later allocations;
+    ... returns - OK or ERROR (errno is set, and nothing is changed)
+*/
+extern int radPlacementApply
+(
+    RAD_PLACEMENT   *placement
+);
+
+
+/*  ... radStartProcessPlaced
+    ... as radStartProcess, with the child applying <placement> (if not
+    ... NULL) before <entryPoint> is called;
+    ... returns - the new child pid or ERROR for the parent (errno set if
+    ...           the system refused the placement - the child exits
+    ...           without running <entryPoint>), and never returns if it
+    ...           becomes the child
+*/
+extern int radStartProcessPlaced
+(
+    int             (*entryPoint) (void * pargs),
+    void            *args,
+    RAD_PLACEMENT   *placement
+);
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -240,11 +240,24 @@ extern int radQueueRecv
 );
 
 
+/*  ... set blocking (the default) or non-blocking writes to an attached
+    ... queue; radQueueSend to a full non-blocking queue returns BUSY
+    ... returns OK or ERROR
+*/
+extern int radQueueSetSendBlocking
+(
+    T_QUEUE_ID  tqid,
+    char        *destQueueName,
+    int         isBlocking
+);
+
+
 /*  ... write to a queue
     ... assumes sysBuffer is a valid pointer to a system buffer (unless length
     ... is zero, in which case a zero-length message is sent)
     ... system buffer ownership is transfered to the receiving queue
-    ... returns OK, ERROR, or ERROR_ABORT if the dest queue is gone
+    ... returns OK, ERROR, ERROR_ABORT if the dest queue is gone or BUSY if
+    ... the dest is non-blocking and full (ownership is NOT transferred)
     ... user should dettach from a dest on ERROR_ABORT!
 */
 extern int radQueueSend
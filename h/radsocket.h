@@ -9,7 +9,7 @@ extern "C" {
         radsocket.h
 
   PURPOSE:
-        Provide standard AF_INET TCP stream socket utilities.
+        Provide standard AF_INET TCP (and AF_UNIX) stream socket utilities.
 
   REVISION HISTORY:
         Date            Engineer        Revision        Remarks
@@ -20,6 +20,10 @@ extern "C" {
         content of the data is not considered. The user is responsible for 
         data contents and byte ordering conversions (if required).        
 
+        AF_UNIX sockets, for processes on the same host, are created with 
+        the "Unix" variants and otherwise used like TCP ones. Their host is 
+        the socket path (or "unix" for an unnamed end) and their port 0.
+
   LICENSE:
         Copyright 2001-2005 Mark S. Teel. All rights reserved.
 
@@ -56,6 +60,8 @@ extern "C" {
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <sys/time.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
@@ -135,6 +141,20 @@ extern RADSOCK_ID radSocketClientCreate (char *hostNameOrIP, int port);
 extern RADSOCK_ID radSocketClientCreateAny (char *hostNameOrIP, int port);
 
 
+/*	... Create a socket server to listen on the AF_UNIX socket "path" (a 
+	... stale socket file there is removed first - the caller must own 
+	... "path"); radSocketServerAcceptConnection accepts on it;
+	... returns RADSOCK_ID or NULL if ERROR
+*/
+extern RADSOCK_ID radSocketServerCreateUnix (char *path);
+
+
+/*	... Create a socket client that connects to the AF_UNIX socket "path";
+	... returns RADSOCK_ID or NULL if ERROR
+*/
+extern RADSOCK_ID radSocketClientCreateUnix (char *path);
+
+
 /*	... Close connection and cleanup resources;
 	... returns OK or ERROR
 */
@@ -186,6 +206,18 @@ extern int radSocketWriteExact
     int             lengthToWrite
 );
 
+/*  ... gather write all of the "iovCount" buffers in "iov" with as few 
+    ... writev calls as possible (will block if a blocking socket);
+    ... "iov" is modified as data is written;
+    ... returns bytes written or ERROR if an error occurs
+*/
+extern int radSocketWriteVectorExact
+(
+    RADSOCK_ID      id,
+    struct iovec    *iov,
+    int             iovCount
+);
+
 
 /*  ... Set the socket for blocking or non-blocking IO - 
     ... it is the user's responsibility to handle blocking/non-blocking IO
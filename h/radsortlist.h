@@ -16,9 +16,18 @@ extern "C" {
         11/14/98        MST             0               Original
         12/23/01        MST             1               Port to "C"
         02/08/07        MST             2               Add 64-bit support
+        10/18/26        radlib          3               Skip list index
  
   NOTES:
         See list.h for list usage.
+
+        The nodes stay on a sorted RADLIST (so the list may still be walked
+        with the radList calls) which is the bottom level of a skip list: 
+        about one node in SORTLIST_BRANCH also gets an index entry with its
+        key on 1 or more express levels, so insert, find and remove take 
+        O(log n) key comparisons instead of walking the list. Nodes with 
+        equal keys are kept in insertion order. A node's key must not change
+        while it is on the list.
  
   LICENSE:
         Copyright 2001-2005 Mark S. Teel. All rights reserved.
@@ -58,11 +67,24 @@ extern "C" {
 
 /*  ... macro definitions
 */
+#define SORTLIST_MAX_LEVEL      16
+#define SORTLIST_BRANCH         4
 
 
 /*  ... typedefs
 */
 
+/*  ...HIDDEN, don't use
+*/
+typedef struct _sortListIndexTag
+{
+    long                        key;
+    NODE_PTR                    node;
+    struct _sortListIndexTag    *next[1];   /* one per level it is on */
+} SORTLIST_INDEX;
+/*  ... END HIDDEN
+*/
+
 
 /*  ... consts
 */
@@ -70,8 +92,11 @@ extern "C" {
 
 typedef struct
 {
-    RADLIST     list;
-    long        (*keyFunc) (void *data);
+    RADLIST         list;
+    long            (*keyFunc) (void *data);
+    SORTLIST_INDEX  *head[SORTLIST_MAX_LEVEL];
+    int             levels;                 /* express levels in use */
+    ULONG           seed;
 } *SORTLIST_ID;
 
 
@@ -104,6 +129,30 @@ extern int radSortListRemove (SORTLIST_ID id, NODE_PTR node);
 */
 extern NODE_PTR radSortListFind (SORTLIST_ID id, long key);
 
+/* ... find the first node whose key is >= key;
+ ... returns NODE_PTR or NULL if all keys are less
+*/
+extern NODE_PTR radSortListLowerBound (SORTLIST_ID id, long key);
+
+/* ... in-order iteration; GetNext returns NULL after the last node
+*/
+extern NODE_PTR radSortListGetFirst (SORTLIST_ID id);
+extern NODE_PTR radSortListGetNext (SORTLIST_ID id, NODE_PTR node);
+
+/* ... call execFunction, in order, for each node with a key from minKey
+ ... through maxKey; it must not insert or remove nodes; returning FALSE
+ ... stops the iteration;
+ ... returns the number of nodes execFunction was called for
+*/
+extern int radSortListExecRange
+(
+    SORTLIST_ID     id,
+    long            minKey,
+    long            maxKey,
+    int             (*execFunction) (NODE_PTR node, void *data),
+    void            *data
+);
+
 
 #ifdef __cplusplus
 }
@@ -176,6 +176,8 @@ enum SemIndexes
     SEM_INDEX_PROCLIST      = 3,
     SEM_INDEX_MSGQ          = 4,
     SEM_INDEX_CONFIG        = 5,
+    SEM_INDEX_MSGRTR        = 6,
+    SEM_INDEX_MSGRTR_STATS  = 7,
 
     SEM_INDEX_USER_START    = 10,               /* user sems begin here */
 
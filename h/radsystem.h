@@ -95,6 +95,8 @@ extern UINT     KEY_MSGQ;
 extern UINT     KEY_SEMAPHORES;
 extern UINT     KEY_BUFFERS_SHMEM;
 extern UINT     KEY_CONFIG_SHMEM;
+extern UINT     KEY_MSGRTR_SHMEM;
+extern UINT     KEY_MSGRTR_STATS_SHMEM;
 
 
 typedef struct
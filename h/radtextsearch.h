@@ -9,21 +9,32 @@ extern "C" {
         radtextsearch.h
  
   PURPOSE:
-        Provide a red-black tree based text matching utility.
+        Provide a radix tree based text matching utility.
  
   REVISION HISTORY:
         Date            Engineer        Revision        Remarks
         1/7/2009        MST             0               Original
+        10/18/2026      radlib          1               Adaptive radix tree
  
   NOTES:
-        The inspiration for these algorithms was taken from Julienne Walker.
-
         This utility provides fast text string search given a well-known set
         of text strings (the universe). An ordinal value is stored with each
-        text string in a red-black binary tree. Once the tree is populated with
+        text string in an adaptive radix tree. Once the tree is populated with
         the universe of possible text strings and corresponding ordinal values,
         the find method can be used to retrieve the corresponding ordinal if
-        a matching text string is found.        
+        a matching text string is found.
+
+        The tree follows "The Adaptive Radix Tree" (Leis, Kemper, Neumann):
+        each inner node branches on one byte of the key and grows from 4 to
+        16, 48 and 256 children as needed, and runs of bytes shared by all
+        keys below a node are skipped in one step. Lookups cost one node per
+        distinguishing byte rather than a string compare per tree level.
+        Members (key text and ordinal) are packed into arena chunks sized to
+        the key, so keys have no length limit; the space of removed members
+        is reclaimed by compacting the arena once it is mostly unused.
+
+        Members are kept in text (strcmp) order, so all members beginning with
+        a prefix, or all members, can be visited in order.
  
   LICENSE:
         Copyright 2001-2009 Mark S. Teel. All rights reserved.
@@ -55,25 +66,85 @@ extern "C" {
 
 
 // Define constants:
-#define SEARCH_TEXT_MAX                 128
+#define SEARCH_TEXT_MAX                 128     // former key limit, unused
+#define SEARCH_PREFIX_MAX               8       // prefix bytes kept in a node
+#define SEARCH_ARENA_SIZE               65536   // bytes per key arena chunk
+
+// Node types:
+#define SEARCH_NODE_LEAF                0
+#define SEARCH_NODE_4                   1
+#define SEARCH_NODE_16                  2
+#define SEARCH_NODE_48                  3
+#define SEARCH_NODE_256                 4
 
 
 // Define data:
 
-// Define the node:
-typedef struct _rbNode
+// Define the header shared by the inner node types:
+typedef struct
 {
-    int             red;
-    struct _rbNode* link[2];
-    char            text[SEARCH_TEXT_MAX];
-    int             ordinal;
+    UCHAR           type;
+    USHORT          count;                      // children
+    UINT            prefixLen;                  // bytes skipped by this node
+    UCHAR           prefix[SEARCH_PREFIX_MAX];  // the first of them
 } SEARCH_NODE;
 
+// Inner nodes for up to 4 and 16 children keep sorted key bytes:
+typedef struct
+{
+    SEARCH_NODE     node;
+    UCHAR           keys[4];
+    SEARCH_NODE*    child[4];
+} SEARCH_NODE4;
+
+typedef struct
+{
+    SEARCH_NODE     node;
+    UCHAR           keys[16];
+    SEARCH_NODE*    child[16];
+} SEARCH_NODE16;
+
+// Up to 48 children are indexed by key byte (slot + 1, 0 for none):
+typedef struct
+{
+    SEARCH_NODE     node;
+    UCHAR           index[256];
+    SEARCH_NODE*    child[48];
+} SEARCH_NODE48;
+
+typedef struct
+{
+    SEARCH_NODE     node;
+    SEARCH_NODE*    child[256];
+} SEARCH_NODE256;
+
+// Define a member (leaf), allocated from the key arena:
+typedef struct
+{
+    UCHAR           type;                       // SEARCH_NODE_LEAF
+    UINT            length;                     // key bytes with the NUL
+    int             ordinal;
+    char            key[1];
+} SEARCH_LEAF;
+
+// Define a key arena chunk:
+typedef struct _searchArenaTag
+{
+    struct _searchArenaTag* next;
+    UINT            size;
+    UINT            used;
+    UCHAR           data[0];
+} SEARCH_ARENA;
+
 
 // Define the ID for a text search object:
-typedef struct _rbTree
+typedef struct _textSearchTag
 {
     SEARCH_NODE*    root;
+    SEARCH_ARENA*   arena;                      // chunk in use first
+    ULONG           members;
+    ULONG           arenaBytes;                 // leaf bytes allocated
+    ULONG           freeBytes;                  // of those, removed
 } *TEXT_SEARCH_ID;
 
 
@@ -87,11 +158,12 @@ extern TEXT_SEARCH_ID radtextsearchInit (void);
 // Cleanup and delete a search object:
 extern void radtextsearchExit (TEXT_SEARCH_ID id);
 
-// Insert a member of the text string universe:
+// Insert a member of the text string universe (a member already present
+// keeps its ordinal):
 // Returns OK or ERROR if a new node cannot be allocated:
 extern int radtextsearchInsert (TEXT_SEARCH_ID id, const char* text, int ordinal);
 
-// Delete a member of the universe:
+// Delete a member of the universe ("text" of NULL deletes the first member):
 // Returns OK if found/removed, ERROR otherwise:
 extern int radtextsearchRemove (TEXT_SEARCH_ID id, const char* text);
 
@@ -100,7 +172,33 @@ extern int radtextsearchRemove (TEXT_SEARCH_ID id, const char* text);
 // Returns OK if found (and ordinalStore populated) or ERROR if not found:
 extern int radtextsearchFind (TEXT_SEARCH_ID id, const char* text, int* ordinalStore);
 
+// Call "execFunction" for each member beginning with "prefix", in text
+// order; "execFunction" returns TRUE to continue or FALSE to stop and must
+// not insert or remove members:
+// Returns the number of members visited:
+extern int radtextsearchPrefix
+(
+    TEXT_SEARCH_ID  id,
+    const char*     prefix,
+    int             (*execFunction) (const char* text, int ordinal, void* data),
+    void*           data
+);
+
+// Call "execFunction" for each member in text order (as radtextsearchPrefix
+// with an empty prefix):
+// Returns the number of members visited:
+extern int radtextsearchExecAll
+(
+    TEXT_SEARCH_ID  id,
+    int             (*execFunction) (const char* text, int ordinal, void* data),
+    void*           data
+);
+
+// Return the number of members:
+extern int radtextsearchCount (TEXT_SEARCH_ID id);
+
 // Provide a tree traversal debugger:
+// Returns 1 if the tree below "root" is valid, 0 otherwise:
 extern int radtextsearchDebug (SEARCH_NODE* root);
 
 
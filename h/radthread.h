@@ -24,6 +24,23 @@ extern "C" {
         1) Using the radthread internal queues via radthreadSendToThread,
            radthreadReceiveFromThread, radthreadSendToParent, 
            raddthreadReceiveFromParent.
+           Each direction is a lock-free single producer/single consumer
+           channel: only the parent may send to and receive from a thread,
+           and only that thread may use the other ends. Received data is 
+           the radsysBuffer the sender queued, so there is no second copy;
+           radthreadSendBufferToThread and radthreadSendBufferToParent
+           queue a caller's radsysBuffer without copying it at all. A 
+           receiver only sleeps (and a sender only signals) when its 
+           channel is empty.
+           radthreadCreate registers each thread's notify descriptor (an
+           eventfd that is readable while data is queued for the parent)
+           with radProcessWait when the process has called radProcessInit
+           and a descriptor slot is free. With no handler set,
+           radProcessWait only wakes for the data, which stays queued for
+           radthreadReceiveFromThread; radthreadSetParentHandler has it
+           dispatched to a callback instead, so the parent neither polls
+           nor blocks outside radProcessWait. A NULL handler releases the
+           descriptor slot (radProcessWait has PROC_TOTAL_IO_BLOCKS).
         2) If the parent is using radProcessWait to receive messages and wait on
            file descriptor IO, the producer threads can use radMsgRouterMessageSend
            to send data to the Consumer (parent). The parent thread must have 
@@ -50,18 +67,37 @@ extern "C" {
                                                               void* threadData), 
                                           void* threadData)
 
+        To create and start a thread pinned to CPUs/NUMA nodes:
+            RAD_THREAD_ID radthreadCreatePlaced(void (*ThreadEntry)(...),
+                                                void* threadData,
+                                                RAD_PLACEMENT* placement)
+
         To send data to the thread:
             void radthreadSendToThread(RAD_THREAD_ID threadId, 
                                        int type, 
                                        void* data, 
                                        int length)
 
+        To pass a radsysBuffer to the thread:
+            int radthreadSendBufferToThread(RAD_THREAD_ID threadId, 
+                                            int type, 
+                                            void* buffer, 
+                                            int length)
+
         To receive data from the thread:
             int radthreadReceiveFromThread(RAD_THREAD_ID threadId, 
                                            void** data, 
                                            int *length,
                                            int blocking)
 
+        To have radProcessWait dispatch data from the thread:
+            int radthreadSetParentHandler(RAD_THREAD_ID threadId,
+                                          void (*handler)(...),
+                                          void* userData)
+
+        To get the descriptor readable while data from the thread waits:
+            int radthreadGetNotifyFD(RAD_THREAD_ID threadId)
+
         To set exit flag and wait for thread to exit:
             void radthreadWaitExit(RAD_THREAD_ID threadId)
 
@@ -87,6 +123,12 @@ extern "C" {
                                        void* data, 
                                        int length)
 
+        To pass a radsysBuffer to the parent:
+            int radthreadSendBufferToParent(RAD_THREAD_ID threadId, 
+                                            int type, 
+                                            void* buffer, 
+                                            int length)
+
         To receive data from the parent:
             int radthreadReceiveFromParent(RAD_THREAD_ID threadId, 
                                            void** data, 
@@ -135,23 +177,68 @@ extern "C" {
 #include <pthread.h>
 #include <radlist.h>
 #include <radbuffers.h>
+#include <radprocutils.h>
 
 
 // // Data Definitions.
 
+// Slots per channel ring; a full ring is chained to a fresh one:
+#define RADTHREAD_RING_SLOTS        256
+
+// Define a queued message:
+typedef struct
+{
+    void* volatile      data;           // NULL until the slot is filled
+    int                 type;
+    int                 length;
+} RAD_THREAD_SLOT;
+
+// Define a channel ring:
+typedef struct _radThreadRingTag
+{
+    struct _radThreadRingTag* volatile  next;
+    RAD_THREAD_SLOT                     slot[RADTHREAD_RING_SLOTS];
+} RAD_THREAD_RING;
+
+// Define a single producer/single consumer channel:
+typedef struct
+{
+    // Producer only:
+    RAD_THREAD_RING*    tail;
+    int                 tailIndex;
+    UCHAR               pad1[64];
+
+    // Consumer only:
+    RAD_THREAD_RING*    head;
+    int                 headIndex;
+    UCHAR               pad2[64];
+
+    // Shared:
+    RAD_THREAD_RING*    spare;          // a drained ring kept for reuse
+    volatile int        waiting;        // TRUE while the consumer sleeps
+    int                 notifyFD;       // eventfd or -1
+    volatile int        notified;       // TRUE once notifyFD is written
+    pthread_mutex_t     mutex;
+    pthread_cond_t      condition;
+} RAD_THREAD_CHANNEL;
+
 // Define the thread ID:
 typedef struct _radThreadIdTag
 {
     pthread_t           thread;
-    int                 exitFlag;
-
-    RADLIST             ToThreadQueue;
-    pthread_mutex_t     ToThreadMutex;
-    pthread_cond_t      ToThreadCondition;
-
-    RADLIST             ToParentQueue;
-    pthread_mutex_t     ToParentMutex;
-    pthread_cond_t      ToParentCondition;
+    volatile int        exitFlag;
+
+    RAD_THREAD_CHANNEL  ToThread;
+    RAD_THREAD_CHANNEL  ToParent;
+
+    // radthreadSetParentHandler dispatch:
+    void                (*parentHandler)(struct _radThreadIdTag* threadId,
+                                         int type,
+                                         void* data,
+                                         int length,
+                                         void* userData);
+    void*               parentData;
+    int                 parentIO;       // PROC_IO_ID or ERROR
 } *RAD_THREAD_ID;
 
 // Define the thread args container:
@@ -160,17 +247,14 @@ typedef struct
     void                (*Entry)(RAD_THREAD_ID threadId, void* threadData);
     RAD_THREAD_ID       id;
     void*               data;
-} RAD_THREAD_ARGS;
-
-// Define the generic data container for queues:
-typedef struct
-{
-    NODE                node;
-    int                 type;
-    int                 length;
-    UCHAR               data[0];
-} RAD_THREAD_NODE;
 
+    // radthreadCreatePlaced waits for the thread to place itself:
+    RAD_PLACEMENT*      placement;
+    pthread_mutex_t     mutex;
+    pthread_cond_t      condition;
+    int                 started;
+    int                 status;         // 0 or the placement errno
+} RAD_THREAD_ARGS;
 
 // // API methods:
 
@@ -182,6 +266,18 @@ extern RAD_THREAD_ID radthreadCreate
     void*   threadData
 );
 
+// Parent: To create and start a thread that first applies "placement" 
+// (CPU affinity, SCHED_FIFO priority and NUMA memory binding, see 
+// radprocutils.h) to itself:
+// Returns: the new RAD_THREAD_ID or NULL (errno set) if not successful or 
+// the placement was refused.
+extern RAD_THREAD_ID radthreadCreatePlaced
+(
+    void            (*ThreadEntry)(RAD_THREAD_ID threadId, void* threadData), 
+    void*           threadData,
+    RAD_PLACEMENT*  placement
+);
+
 // Parent: To set exit flag and wait for thread to exit:
 extern void radthreadWaitExit(RAD_THREAD_ID threadId);
 
@@ -197,6 +293,19 @@ extern int radthreadSendToThread
     int             length
 );
 
+// Parent: To pass a radsysBuffer to the thread without copying it:
+// "type" is a user-defined value;
+// "buffer" must come from radBufferGet and belongs to the thread once OK is 
+// returned (on ERROR it still belongs to the caller);
+// Returns: OK or ERROR
+extern int radthreadSendBufferToThread
+(
+    RAD_THREAD_ID   threadId, 
+    int             type, 
+    void*           buffer, 
+    int             length
+);
+
 // Parent: To receive data from the thread:
 // Returns: user-defined msg type or ERROR_ABORT if non-blocking and no msg
 // "*data" will point to a radsysBuffer which must be freed via radBufferRls 
@@ -209,6 +318,30 @@ extern int radthreadReceiveFromThread
     int             blocking
 );
 
+// Parent: To have radProcessWait call "handler" for data from the thread:
+// "data" is a radsysBuffer which must be freed via radBufferRls when the 
+// handler is done with it; a NULL "handler" stops the dispatch and the
+// radProcessWait wakeups and releases the descriptor; radthreadWaitExit
+// does as well;
+// Returns: OK or ERROR
+extern int radthreadSetParentHandler
+(
+    RAD_THREAD_ID   threadId, 
+    void            (*handler)(RAD_THREAD_ID threadId, 
+                               int type, 
+                               void* data, 
+                               int length, 
+                               void* userData),
+    void*           userData
+);
+
+// Parent: To get the thread's notify descriptor:
+// It is readable while data from the thread may be queued and is reset 
+// when radthreadReceiveFromThread finds nothing queued, so parents with 
+// their own select loop receive until ERROR_ABORT each time it is ready;
+// Returns: the descriptor
+extern int radthreadGetNotifyFD(RAD_THREAD_ID threadId);
+
 // Thread: To send data to the parent:
 // "type" is a user-defined value;
 // "data" is copied to the thread queue (ownership is not transferred);
@@ -221,8 +354,22 @@ extern int radthreadSendToParent
     int             length
 );
 
+// Thread: To pass a radsysBuffer to the parent without copying it:
+// "type" is a user-defined value;
+// "buffer" must come from radBufferGet and belongs to the parent once OK is 
+// returned (on ERROR it still belongs to the caller);
+// Returns: OK or ERROR
+extern int radthreadSendBufferToParent
+(
+    RAD_THREAD_ID   threadId, 
+    int             type, 
+    void*           buffer, 
+    int             length
+);
+
 // Thread: To receive data from the parent:
-// Returns: user-defined msg type or ERROR_ABORT if non-blocking and no msg
+// Returns: user-defined msg type or ERROR_ABORT if non-blocking and no msg,
+// or if blocking and the parent has called radthreadWaitExit
 // "*data" will point to a radsysBuffer which must be freed via radBufferRls 
 // when the receiver is done with it;
 extern int radthreadReceiveFromParent
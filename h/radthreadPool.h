@@ -0,0 +1,208 @@
+#ifndef INC_radthreadPoolh
+#define INC_radthreadPoolh
+#ifdef __cplusplus
+extern "C" {
+#endif
+/*---------------------------------------------------------------------------
+
+  FILENAME:
+        radthreadPool.h
+
+  PURPOSE:
+        Provide a work-stealing thread pool for radlib processes.
+
+  REVISION HISTORY:
+        Date            Engineer        Revision        Remarks
+        10/18/2026      radlib          0               Original
+
+  NOTES:
+        A pool runs submitted tasks on a fixed set of radthread workers.
+        Each worker has its own deque: it takes its newest task first and,
+        when its deque is empty, steals the oldest task from another
+        worker. Tasks submitted by a running task go on that worker's own
+        deque; tasks submitted by the parent are spread round robin.
+
+        A task may have a completion callback. Completions are queued to
+        the parent and dispatched from radProcessWait through the pool's
+        notify descriptor (registered by radthreadPoolCreate, so the
+        parent must have called radProcessInit), or by radthreadPoolWait.
+
+        radthreadPoolParallelFor splits an index range into tasks and
+        returns when all of them have run; the caller runs tasks itself
+        while it waits, so it may also be called from within a task.
+        The tasks a waiting caller runs may be any queued ones, not only
+        its own, and they run on its stack: each nested call can add a
+        task (and any calls it nests) to the stack, so the depth grows with
+        the queued tasks that themselves call radthreadPoolParallelFor.
+        Keep nesting shallow, or give such tasks little stack to use.
+
+        Tasks run on pool threads and so are limited to the radlib
+        functions listed for threads in radthread.h.
+
+       *Parent Actions
+        --------------
+
+        To create a pool:
+            RAD_THREAD_POOL_ID radthreadPoolCreate(int numWorkers)
+
+        To run queued tasks and dispatch completions until all are done:
+            void radthreadPoolWait(RAD_THREAD_POOL_ID pool)
+
+        To finish all tasks and destroy the pool:
+            void radthreadPoolDestroy(RAD_THREAD_POOL_ID pool)
+
+       *Parent or Task Actions
+        ----------------------
+
+        To queue a task:
+            int radthreadPoolSubmit(RAD_THREAD_POOL_ID pool,
+                                    void (*Task)(void* taskData),
+                                    void (*Done)(void* taskData),
+                                    void* taskData)
+
+        To run a function over an index range in parallel:
+            int radthreadPoolParallelFor(RAD_THREAD_POOL_ID pool,
+                                         int first,
+                                         int last,
+                                         int grain,
+                                         void (*Body)(int index, void* data),
+                                         void* data)
+
+  LICENSE:
+        Copyright 2011 Mark S. Teel. All rights reserved.
+
+        Redistribution and use in source and binary forms, with or without
+        modification, are permitted provided that the following conditions
+        are met:
+
+        1. Redistributions of source code must retain the above copyright
+           notice, this list of conditions and the following disclaimer.
+        2. Redistributions in binary form must reproduce the above copyright
+           notice, this list of conditions and the following disclaimer in the
+           documentation and/or other materials provided with the distribution.
+
+        THIS SOFTWARE IS PROVIDED BY Mark Teel ``AS IS'' AND ANY EXPRESS OR
+        IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+        WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+        DISCLAIMED. IN NO EVENT SHALL MARK TEEL OR CONTRIBUTORS BE LIABLE FOR
+        ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+        OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+        HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+        STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+        IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+        POSSIBILITY OF SUCH DAMAGE.
+
+----------------------------------------------------------------------------*/
+#include <pthread.h>
+#include <radsysdefs.h>
+#include <radthread.h>
+
+
+// // Data Definitions.
+
+// Initial slots in each worker deque (grows as needed):
+#define RADTHREAD_POOL_DEQUE_SIZE   256
+
+// Tasks per worker radthreadPoolParallelFor aims for when "grain" is 0:
+#define RADTHREAD_POOL_SPLIT        4
+
+// Define a queued task:
+typedef struct _radThreadTaskTag
+{
+    struct _radThreadTaskTag*   next;       // completion list
+    void                        (*Task)(void* taskData);
+    void                        (*Done)(void* taskData);
+    void*                       taskData;
+    volatile int*               pending;    // counts down when run
+} RAD_THREAD_TASK;
+
+// Define a worker and its deque:
+typedef struct
+{
+    struct _radThreadPoolTag*   pool;
+    RAD_THREAD_ID               thread;
+    int                         index;
+
+    pthread_mutex_t             mutex;
+    RAD_THREAD_TASK**           tasks;
+    int                         size;       // a power of 2
+    volatile UINT               head;       // oldest, thieves take here
+    volatile UINT               tail;       // newest, the owner takes here
+    UCHAR                       pad[64];
+} RAD_THREAD_WORKER;
+
+// Define the pool ID:
+typedef struct _radThreadPoolTag
+{
+    RAD_THREAD_WORKER*  workers;
+    int                 numWorkers;
+    pthread_key_t       workerKey;          // the calling worker, if any
+    volatile int        exiting;
+    volatile UINT       nextWorker;         // round robin for the parent
+
+    // Sleeping workers and waiters:
+    volatile int        queued;             // tasks in the deques
+    volatile int        sleepers;
+    volatile int        waiters;
+    pthread_mutex_t     mutex;
+    pthread_cond_t      workCondition;
+    pthread_cond_t      doneCondition;
+
+    // Submitted tasks not yet run:
+    volatile int        outstanding;
+
+    // Completions for the parent:
+    RAD_THREAD_TASK*    completed;          // lock-free stack
+    int                 notifyFD;
+    int                 notifyIO;
+} *RAD_THREAD_POOL_ID;
+
+
+// // API methods:
+
+// Parent: To create a pool and start its workers:
+// "numWorkers" of 0 starts one worker per online CPU;
+// Returns: the new RAD_THREAD_POOL_ID or NULL if not successful.
+extern RAD_THREAD_POOL_ID radthreadPoolCreate(int numWorkers);
+
+// Parent: To wait for all submitted tasks to run, helping to run them, and
+// call their completion callbacks:
+extern void radthreadPoolWait(RAD_THREAD_POOL_ID pool);
+
+// Parent: To finish all tasks (as radthreadPoolWait), stop the workers and
+// free the pool:
+extern void radthreadPoolDestroy(RAD_THREAD_POOL_ID pool);
+
+// Parent/Task: To queue "Task" to run on a worker:
+// "Done" (may be NULL) is called with "taskData" in the parent, from
+// radProcessWait or radthreadPoolWait, after "Task" has run;
+// Returns: OK or ERROR
+extern int radthreadPoolSubmit
+(
+    RAD_THREAD_POOL_ID  pool,
+    void                (*Task)(void* taskData),
+    void                (*Done)(void* taskData),
+    void*               taskData
+);
+
+// Parent/Task: To call "Body" for each index from "first" up to (not
+// including) "last", "grain" indexes per task (0 chooses), and return when
+// all have been called:
+// Returns: OK or ERROR
+extern int radthreadPoolParallelFor
+(
+    RAD_THREAD_POOL_ID  pool,
+    int                 first,
+    int                 last,
+    int                 grain,
+    void                (*Body)(int index, void* data),
+    void*               data
+);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+
@@ -47,9 +47,15 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
+#include <ifaddrs.h>
 
 //  Library include files
+#include <radconffile.h>
+#include <radcompress.h>
 #include <radmsgRouter.h>
 
 //  Local include files
@@ -62,11 +68,58 @@
 
 static MSGRTR_WORK          msgrtrWork;         // for the msg router process only
 
+// Counters bumped by the routing workers as well as the main thread:
+#define MSGRTR_COUNT(x)             __sync_fetch_and_add (&(x), 1)
+
+// Order of 32 bit sequence numbers (origin and multicast) across the wrap:
+#define MSGRTR_SEQ_DIFF(a,b)        ((int)((UINT)(a) - (UINT)(b)))
+
 
 // Local methods:
 static void ClientRXHandler (int fd, void *userData);
+static void CaptureClose (void);
+static void SpoolCloseAll (void);
+static void StateClose (void);
+static void McastClose (void);
+static void AddClient (MSGRTR_MIIB *miib, MSGRTR_PIB *consumer);
+static void RemoveClient (MSGRTR_MIIB *miib, MSGRTR_PIB *consumer);
+static void InboxWake (void);
+static void QuiescePIB (MSGRTR_PIB *pib);
+static int StartPeerThreads (MSGRTR_PIB *pib);
 
 //  system initialization:
+// Is the router that left our lock file gone? Either its pid is, or no 
+// one reads its FIFO any more (a dead daemon may linger unreaped):
+static int msgrtrLockIsStale (MSGRTR_WORK *work)
+{
+    FILE            *lockFile;
+    int             fd, pid = 0;
+
+    lockFile = fopen (work->pidFile, "r");
+    if (lockFile == NULL)
+    {
+        return FALSE;
+    }
+    if (fscanf (lockFile, "%d", &pid) != 1)
+    {
+        pid = 0;
+    }
+    fclose (lockFile);
+
+    if (pid > 0 && kill (pid, 0) == -1 && errno == ESRCH)
+    {
+        return TRUE;
+    }
+
+    fd = open (work->fifoFile, O_WRONLY | O_NONBLOCK);
+    if (fd == -1)
+    {
+        return (errno == ENXIO);
+    }
+    close (fd);
+    return FALSE;
+}
+
 static int msgrtrSysInit (MSGRTR_WORK *work, char *workingDir)
 {
     struct stat     fileData;
@@ -74,6 +127,12 @@ static int msgrtrSysInit (MSGRTR_WORK *work, char *workingDir)
     sprintf (work->pidFile, "%s/%s", workingDir, MSGRTR_LOCK_FILE_NAME);
     sprintf (work->fifoFile, "%s/%s", workingDir, MSGRTR_QUEUE_NAME);
 
+    // a lock file whose router died is only in the way of its restart:
+    if (stat (work->pidFile, &fileData) == 0 && msgrtrLockIsStale (work))
+    {
+        unlink (work->pidFile);
+    }
+
     // check for our pid file, don't run if it IS there
     if (stat (work->pidFile, &fileData) == 0)
     {
@@ -93,6 +152,31 @@ static int msgrtrSysExit (MSGRTR_WORK *work)
 {
     struct stat     fileData;
 
+    CaptureClose ();
+    SpoolCloseAll ();
+    StateClose ();
+    McastClose ();
+
+    // withdraw the subscription table so clients fall back to routing:
+    if (work->shmTable != NULL)
+    {
+        work->shmTable->magic = 0;
+        radShmemExitAndDestroy (work->shmId);
+        work->shmTable = NULL;
+    }
+
+    if (work->stats != NULL)
+    {
+        work->stats->magic = 0;
+        radShmemExitAndDestroy (work->statsId);
+        work->stats = NULL;
+    }
+
+    if (work->localServer != NULL)
+    {
+        unlink (work->localPath);
+    }
+
     // delete our pid file:
     if (stat (work->pidFile, &fileData) == 0)
     {
@@ -152,1054 +236,7040 @@ static void defaultSigHandler (int signum)
     return;
 }
 
-// Send a message to a remote client:
-static int SendToRemote(MSGRTR_PIB* pib, ULONG msgID, void *data, int length)
+// Add a peer router given as "remoteIP:remotePort":
+static int AddPeer (MSGRTR_WORK *work, char *address)
 {
-    MSGRTR_HDR          *msg;
+    MSGRTR_PEER     *peer;
+    char            *port = strrchr (address, ':');
 
-    msg = (MSGRTR_HDR *)radBufferGet(sizeof(*msg)+length);
-    if (msg == NULL)
+    if (port == NULL || port == address || atoi (port + 1) <= 0 || 
+        (port - address) >= (int)sizeof(peer->remoteIP))
     {
-        radMsgLog(PRI_HIGH, "SendToRemote: radBufferGet failed!");
+        radMsgLog(PRI_CATASTROPHIC, "bad remoteIP:remotePort %s given - ignoring!",
+                   address);
         return ERROR;
     }
-
-    msg->magicNumber        = MSGRTR_MAGIC_NUMBER;
-    msg->srcpid             = 0;
-    msg->msgID              = msgID;
-    msg->length             = length;
-    memcpy (msg->msg, data, length);
-
-    msg->magicNumber        = htonl(msg->magicNumber);
-    msg->srcpid             = htonl(msg->srcpid);
-    msg->msgID              = htonl(msg->msgID);
-    msg->length             = htonl(msg->length);
-
-    if (radSocketWriteExact(pib->txclient, msg, sizeof(*msg)+length) 
-        != sizeof(*msg)+length)
+    if (work->numPeers == MSGRTR_MAX_PEERS)
     {
-        radMsgLog(PRI_HIGH, "SendToRemote: radSocketWriteExact msg failed!");
-        radBufferRls(msg);
+        radMsgLog(PRI_CATASTROPHIC, "more than %d peers given - ignoring %s!",
+                   MSGRTR_MAX_PEERS, address);
         return ERROR;
     }
 
-    radBufferRls(msg);
+    peer = &work->peers[work->numPeers ++];
+    memset (peer, 0, sizeof(*peer));
+    strncpy (peer->remoteIP, address, port - address);
+    peer->remotePort = atoi (port + 1);
     return OK;
 }
 
-static MSGRTR_PIB *getPIBByPID (int findpid)
+// Add a LAST_VALUE, CONFLATE or MULTICAST rule, 'value' is "msgID" or 
+// "first-last":
+static int AddLvcRule (MSGRTR_WORK *work, char *value, UINT flags)
 {
-    MSGRTR_PIB      *node;
+    MSGRTR_LVC_RULE *rule;
+    char            *next;
+    ULONG           first, last;
 
-    for (node = (MSGRTR_PIB *)radListGetFirst (&msgrtrWork.pibList);
-         node != NULL;
-         node = (MSGRTR_PIB *)radListGetNext (&msgrtrWork.pibList, (NODE *)node))
+    first = strtoul (value, &next, 0);
+    last  = (*next == '-') ? strtoul (next + 1, &next, 0) : first;
+    if (first == 0 || last < first || *next != 0)
     {
-        if (node->pid == findpid)
-        {
-            // got 'em!
-            return node;
-        }
+        radMsgLog(PRI_CATASTROPHIC, "bad msgID or range %s given - ignoring!",
+                   value);
+        return ERROR;
     }
-
-    return NULL;
-}
-
-static int RemovePIB(MSGRTR_PIB* pib)
-{
-    MSGRTR_PIB      *node;
-
-    for (node = (MSGRTR_PIB *)radListGetFirst (&msgrtrWork.pibList);
-         node != NULL;
-         node = (MSGRTR_PIB *)radListGetNext (&msgrtrWork.pibList, (NODE *)node))
+    if (work->numLvcRules == MSGRTR_MAX_LVC_RULES)
     {
-        if (node == pib)
-        {
-            // got 'em!
-            radListRemove(&msgrtrWork.pibList, (NODE *)node);
-            free(pib);
-            return OK;
-        }
+        radMsgLog(PRI_CATASTROPHIC, "more than %d LAST_VALUE/CONFLATE/MULTICAST entries given - ignoring %s!",
+                   MSGRTR_MAX_LVC_RULES, value);
+        return ERROR;
     }
 
-    // didn't find him:
-    return ERROR;
+    rule = &work->lvcRules[work->numLvcRules ++];
+    rule->first = first;
+    rule->last  = last;
+    rule->flags = flags;
+    return OK;
 }
 
-static MSGRTR_PIB *getPIBBySocket (int socketfd)
+// Return the LAST_VALUE/CONFLATE/MULTICAST flags of the rules touching 
+// first..last:
+static UINT LvcRuleFlags (ULONG first, ULONG last)
 {
-    MSGRTR_PIB      *node;
+    UINT            flags = 0;
+    int             i;
 
-    for (node = (MSGRTR_PIB *)radListGetFirst (&msgrtrWork.pibList);
-         node != NULL;
-         node = (MSGRTR_PIB *)radListGetNext (&msgrtrWork.pibList, (NODE *)node))
+    for (i = 0; i < msgrtrWork.numLvcRules; i ++)
     {
-        if (node->txclient != NULL)
+        if (msgrtrWork.lvcRules[i].first <= last && 
+            msgrtrWork.lvcRules[i].last >= first)
         {
-            if (radSocketGetDescriptor(node->txclient) == socketfd)
-            {
-                // got 'em!
-                return node;
-            }
+            flags |= msgrtrWork.lvcRules[i].flags;
         }
     }
 
-    return NULL;
+    return flags;
 }
 
-static MSGRTR_MIIB *getMIIB (int findMsgID)
+// Read the optional radmrouted.conf settings:
+static void msgrtrReadConfig (MSGRTR_WORK *work, char *workingDir)
 {
-    MSGRTR_MIIB     *node;
-
-    for (node = (MSGRTR_MIIB *)radListGetFirst (&msgrtrWork.miibList);
-         node != NULL;
-         node = (MSGRTR_MIIB *)radListGetNext (&msgrtrWork.miibList, (NODE *)node))
+    struct stat     fileData;
+    char            configFile[256];
+    char            instance[MAX_LINE_LENGTH];
+    char            value[MAX_LINE_LENGTH];
+    CF_ID           cfId;
+    int             retVal;
+
+    work->txFlushBytes = MSGRTR_TX_FLUSH_BYTES;
+    work->txFlushDelay = MSGRTR_TX_FLUSH_DELAY;
+    work->txQueueLimit = MSGRTR_TX_QUEUE_BYTES;
+    work->txPolicy     = MSGRTR_TX_DROP_OLDEST;
+    work->spillLimit   = MSGRTR_LOCAL_SPILL_MSGS;
+    work->spillPolicy  = MSGRTR_TX_DROP_OLDEST;
+    work->captureSegmentBytes = MSGRTR_CAPTURE_SEGMENT_BYTES;
+    work->captureSegments = MSGRTR_CAPTURE_SEGMENTS;
+    strncpy (work->spoolDir, workingDir, sizeof(work->spoolDir) - 1);
+    work->persistState = TRUE;
+    work->compressMinBytes = MSGRTR_COMPRESS_MIN_BYTES;
+    work->mcastTTL     = 1;
+    work->mcastMinPeers = MSGRTR_MCAST_MIN_PEERS;
+    work->mcastHistoryBytes = MSGRTR_MCAST_HISTORY_BYTES;
+    work->localLinks   = TRUE;
+    strcpy (work->localLinkDir, MSGRTR_LOCAL_LINK_DIR);
+    sprintf (work->stateFile, "%s/%s", workingDir, MSGRTR_STATE_FILE_NAME);
+    work->routerID     = ((ULONG)gethostid() << 16 ^ 
+                          (ULONG)work->listenPort << 8 ^ 
+                          (ULONG)getpid()) & 0xFFFFFFFF;
+    work->epoch        = (ULONG)time(NULL);
+
+    // radCfOpen creates missing files, so only open one that is there:
+    sprintf (configFile, "%s/%s", workingDir, MSGRTR_CONFIG_FILE_NAME);
+    if (stat (configFile, &fileData) != 0)
     {
-        if (node->msgID == findMsgID)
-        {
-            // got 'em!
-            return node;
-        }
+        return;
     }
 
-    return NULL;
-}
-
-// Send an ack to a local client:
-static int SendACK (MSGRTR_PIB *dest)
-{
-    MSGRTR_HDR          *hdr;
-    MSGRTR_INTERNAL_MSG *msg;
-
-    hdr = (MSGRTR_HDR *)radBufferGet (sizeof (*hdr) + sizeof(*msg));
-    if (hdr == NULL)
+    cfId = radCfOpen (configFile);
+    if (cfId == NULL)
     {
-        radMsgLog(PRI_HIGH, "SendACK: radBufferGet failed!");
-        return ERROR;
+        radMsgLog(PRI_MEDIUM, "radCfOpen %s failed - using defaults", configFile);
+        return;
     }
 
-    hdr->magicNumber        = MSGRTR_MAGIC_NUMBER;
-    hdr->srcpid             = getpid ();
-    hdr->msgID              = MSGRTR_INTERNAL_MSGID;
-    hdr->length             = sizeof (*msg);
-
-    msg = (MSGRTR_INTERNAL_MSG *)hdr->msg;
-    msg->subMsgID           = MSGRTR_SUBTYPE_ACK;
-
-    switch(dest->type)
+    if (radCfGetEntry (cfId, "TX_FLUSH_BYTES", NULL, value) == OK)
     {
-        case PIB_TYPE_LOCAL:
+        work->txFlushBytes = atoi (value);
+        if (work->txFlushBytes < 0 || work->txFlushBytes > MSGRTR_TX_BUFFER_SIZE)
         {
-            if (radProcessQueueSend (dest->queueName,
-                                     MSGRTR_INTERNAL_MSGID,
-                                     hdr,
-                                     sizeof (*hdr) + sizeof(*msg))
-                != OK)
-            {
-                radBufferRls (hdr);
-                return ERROR;
-            }
-            break;
+            work->txFlushBytes = MSGRTR_TX_BUFFER_SIZE;
         }
-        case PIB_TYPE_REMOTE:
+    }
+    if (radCfGetEntry (cfId, "TX_FLUSH_DELAY", NULL, value) == OK)
+    {
+        work->txFlushDelay = atoi (value);
+        if (work->txFlushDelay < 0)
         {
-            if (radSocketWriteExact (dest->txclient,
-                                     hdr,
-                                     sizeof (*hdr) + sizeof(*msg))
-                != sizeof (*hdr) + sizeof(*msg))
-            {
-                radBufferRls (hdr);
-                return ERROR;
-            }
-            radBufferRls(hdr);
-            break;
+            work->txFlushDelay = 0;
         }
     }
-    return OK;
-}
-
-// Send a MSGRTR_SUBTYPE_MSGID_IS_REGISTERED answer to a local client:
-static int SendIsRegistered (MSGRTR_PIB *dest, int isRegistered)
-{
-    MSGRTR_HDR          *hdr;
-    MSGRTR_INTERNAL_MSG *msg;
-
-    hdr = (MSGRTR_HDR *)radBufferGet (sizeof (*hdr) + sizeof(*msg));
-    if (hdr == NULL)
+    if (radCfGetEntry (cfId, "TX_QUEUE_BYTES", NULL, value) == OK)
     {
-        radMsgLog(PRI_HIGH, "SendACK: radBufferGet failed!");
-        return ERROR;
+        work->txQueueLimit = atoi (value);
+        if (work->txQueueLimit < MSGRTR_TX_BUFFER_SIZE)
+        {
+            work->txQueueLimit = MSGRTR_TX_BUFFER_SIZE;
+        }
     }
-
-    hdr->magicNumber        = MSGRTR_MAGIC_NUMBER;
-    hdr->srcpid             = getpid ();
-    hdr->msgID              = MSGRTR_INTERNAL_MSGID;
-    hdr->length             = sizeof (*msg);
-
-    msg = (MSGRTR_INTERNAL_MSG *)hdr->msg;
-    msg->subMsgID           = MSGRTR_SUBTYPE_MSGID_IS_REGISTERED;
-    msg->isRegistered       = isRegistered;
-
-    switch(dest->type)
+    if (radCfGetEntry (cfId, "TX_OVERFLOW_POLICY", NULL, value) == OK)
     {
-        case PIB_TYPE_LOCAL:
+        if (! strcmp (value, "drop-oldest"))
         {
-            if (radProcessQueueSend (dest->queueName,
-                                     MSGRTR_INTERNAL_MSGID,
-                                     hdr,
-                                     sizeof (*hdr) + sizeof(*msg))
-                != OK)
-            {
-                radBufferRls (hdr);
-                return ERROR;
-            }
-            break;
+            work->txPolicy = MSGRTR_TX_DROP_OLDEST;
         }
-        case PIB_TYPE_REMOTE:
+        else if (! strcmp (value, "drop-newest"))
         {
-            if (radSocketWriteExact (dest->txclient,
-                                     hdr,
-                                     sizeof (*hdr) + sizeof(*msg))
-                != sizeof (*hdr) + sizeof(*msg))
-            {
-                radBufferRls (hdr);
-                return ERROR;
-            }
-            radBufferRls(hdr);
-            break;
+            work->txPolicy = MSGRTR_TX_DROP_NEWEST;
         }
-    }
-    return OK;
-}
-
-// Register one or all existing msgIDs with a remote client:
-// Pass 0 for msgID to send all:
-static int RegisterRemoteMsgID(MSGRTR_PIB* remote, ULONG msgID, int IsRegister)
-{
-    MSGRTR_MIIB*        msgNode;
-    MSGRTR_INTERNAL_MSG intMsg;
-
-    for (msgNode = (MSGRTR_MIIB*)radListGetFirst(&msgrtrWork.miibList);
-         msgNode != NULL;
-         msgNode = (MSGRTR_MIIB*)radListGetNext(&msgrtrWork.miibList, (NODE*)msgNode))
-    {
-        if (msgID == 0 || msgNode->msgID == msgID)
+        else if (! strcmp (value, "disconnect"))
         {
-            // Got one:
-            memset(&intMsg, 0, sizeof(intMsg));
-            if (! IsRegister)
-            {
-                intMsg.subMsgID     = MSGRTR_SUBTYPE_DISABLE_MSGID;
-            }
-            else
-            {
-                intMsg.subMsgID     = MSGRTR_SUBTYPE_ENABLE_MSGID;
-            }
-            intMsg.targetMsgID  = msgNode->msgID;
-            if (SendToRemote(remote, MSGRTR_INTERNAL_MSGID, &intMsg, sizeof(intMsg)) == ERROR)
-            {
-                radMsgLog(PRI_HIGH, "RegisterRemoteMsgID: SendToRemote failed!");
-                return ERROR;
-            }
+            work->txPolicy = MSGRTR_TX_DISCONNECT;
         }
-    }
-
-    return OK;
-}
-
-// Send msgID registration to all remote clients except "notThisOne":
-static int RegisterAllRemotesMsgID(ULONG msgID, MSGRTR_PIB* notThisOne)
-{
-    MSGRTR_PIB*     pib;
-
-    for (pib = (MSGRTR_PIB*)radListGetFirst(&msgrtrWork.pibList);
-         pib != NULL;
-         pib = (MSGRTR_PIB*)radListGetNext(&msgrtrWork.pibList, (NODE*)pib))
-    {
-        if (pib == notThisOne)
+        else
         {
-            continue;
+            radMsgLog(PRI_MEDIUM, "unknown TX_OVERFLOW_POLICY %s - using drop-oldest",
+                       value);
         }
-
-        if (pib->type == PIB_TYPE_REMOTE)
+    }
+    if (radCfGetEntry (cfId, "LOCAL_SPILL_MSGS", NULL, value) == OK)
+    {
+        work->spillLimit = atoi (value);
+        if (work->spillLimit < 1)
         {
-            RegisterRemoteMsgID(pib, msgID, TRUE);
+            work->spillLimit = 1;
         }
     }
-
-    return OK;
-}
-
-// Send msgID deregistration to all remote clients except "notThisOne":
-static int DeregisterAllRemotesMsgID(ULONG msgID, MSGRTR_PIB* notThisOne)
-{
-    MSGRTR_PIB*     pib;
-
-    for (pib = (MSGRTR_PIB*)radListGetFirst(&msgrtrWork.pibList);
-         pib != NULL;
-         pib = (MSGRTR_PIB*)radListGetNext(&msgrtrWork.pibList, (NODE*)pib))
+    if (radCfGetEntry (cfId, "LOCAL_OVERFLOW_POLICY", NULL, value) == OK)
     {
-        if (pib == notThisOne)
+        if (! strcmp (value, "drop-oldest"))
         {
-            continue;
+            work->spillPolicy = MSGRTR_TX_DROP_OLDEST;
         }
-
-        if (pib->type == PIB_TYPE_REMOTE)
+        else if (! strcmp (value, "drop-newest"))
+        {
+            work->spillPolicy = MSGRTR_TX_DROP_NEWEST;
+        }
+        else
         {
-            RegisterRemoteMsgID(pib, msgID, FALSE);
+            radMsgLog(PRI_MEDIUM, "unknown LOCAL_OVERFLOW_POLICY %s - using drop-oldest",
+                       value);
         }
     }
-
-    return OK;
-}
-
-// Send a message to a client, local or remote:
-static int SendToClient(MSGRTR_PIB *consumer, MSGRTR_HDR* hdr)
-{
-    UCHAR*          sendBfr;
-    int             length  = hdr->length;
-
-    switch(consumer->type)
+    if (radCfGetEntry (cfId, "ROUTER_THREADS", NULL, value) == OK)
     {
-        case PIB_TYPE_LOCAL:
+        work->numWorkers = atoi (value);
+        if (work->numWorkers < 0)
         {
-            sendBfr = (UCHAR*)radBufferGet(length);
-            if (sendBfr == NULL)
-            {
-                radMsgLog(PRI_HIGH, "SendToClient: radBufferGet failed!");
-                return ERROR;
-            }
-            memcpy(sendBfr, hdr->msg, length);
-
-            if (radProcessQueueSend (consumer->queueName, hdr->msgID, sendBfr, length)
-                != OK)
-            {
-                radMsgLog(PRI_HIGH, "SendToClient: %s: radProcessQueueSend failed!",
-                           consumer->name);
-                radBufferRls (sendBfr);
-                consumer->rxErrors ++;
-                return ERROR;
-            }
-            break;
+            work->numWorkers = 0;
         }
-        case PIB_TYPE_REMOTE:
+        else if (work->numWorkers > MSGRTR_MAX_WORKERS)
         {
-            if (consumer->maxMsgSize < length)
-            {
-                radMsgLog(PRI_HIGH, "SendToClient: %s: msg length %d exceeds remote capability %d!",
-                           consumer->name, length, consumer->maxMsgSize);
-                consumer->rxErrors ++;
-                return ERROR;
-            }
-
-            if (SendToRemote(consumer, hdr->msgID, hdr->msg, hdr->length)== ERROR)
-            {
-                radMsgLog(PRI_HIGH, "SendToClient: %s: SendToRemote failed!",
-                           consumer->name);
-                consumer->rxErrors ++;
-                return ERROR;
-            }
-            break;
+            work->numWorkers = MSGRTR_MAX_WORKERS;
         }
-        default:
+    }
+    if (radCfGetEntry (cfId, "CAPTURE_FILE", NULL, value) == OK)
+    {
+        strncpy (work->captureBase, value, sizeof(work->captureBase) - 1);
+    }
+    if (radCfGetEntry (cfId, "CAPTURE_SEGMENT_BYTES", NULL, value) == OK)
+    {
+        work->captureSegmentBytes = strtoul (value, NULL, 0);
+        if (work->captureSegmentBytes < MSGRTR_CAPTURE_MIN_SEGMENT)
         {
-            radMsgLog(PRI_HIGH, "SendToClient: unknown PIB type %d",
-                       consumer->type);
-            return ERROR;
+            work->captureSegmentBytes = MSGRTR_CAPTURE_MIN_SEGMENT;
         }
     }
-
-    consumer->receives ++;
-    msgrtrWork.transmits ++;
-    return OK;
-}
-
-// Remove a given client from all msgID lists:
-static void RemoveClientFromAllMsgs(MSGRTR_PIB *consumer)
-{
-    MSGRTR_MIIB     *node, *tempnode;
-    MSGRTR_CIB      *cib;
-
-    for (node = (MSGRTR_MIIB *)radListGetFirst (&msgrtrWork.miibList);
-         node != NULL;
-         node = (MSGRTR_MIIB *)radListGetNext (&msgrtrWork.miibList, (NODE *)node))
+    if (radCfGetEntry (cfId, "CAPTURE_SEGMENTS", NULL, value) == OK)
     {
-        // loop through the consumer list for this msgID
-        for (cib = (MSGRTR_CIB *)radListGetFirst (&node->consumers);
-             cib != NULL;
-             cib = (MSGRTR_CIB *)radListGetNext (&node->consumers, (NODE *)cib))
+        work->captureSegments = atoi (value);
+        if (work->captureSegments < 0)
         {
-            if (cib->pib == consumer)
-            {
-                // got 'em!
-                radListRemove (&node->consumers, (NODE *)cib);
-                free (cib);
-                break;
-            }
+            work->captureSegments = 0;
         }
-
-        // if the consumer list is empty, remove the MIIB
-        if (radListGetNumberOfNodes(&node->consumers) == 0)
+    }
+    if (radCfGetEntry (cfId, "PEER_SPOOL_BYTES", NULL, value) == OK)
+    {
+        work->spoolBytes = strtoul (value, NULL, 0) & ~7UL;
+        if (work->spoolBytes != 0 && work->spoolBytes < MSGRTR_SPOOL_MIN_BYTES)
         {
-            tempnode = (MSGRTR_MIIB *)radListGetPrevious (&msgrtrWork.miibList, (NODE *)node);
-            radListRemove (&msgrtrWork.miibList, (NODE *)node);
-            free (node);
-            node = tempnode;
+            work->spoolBytes = MSGRTR_SPOOL_MIN_BYTES;
         }
     }
-
-    return;
+    if (radCfGetEntry (cfId, "PEER_SPOOL_DIR", NULL, value) == OK)
+    {
+        strncpy (work->spoolDir, value, sizeof(work->spoolDir) - 1);
+    }
+    if (radCfGetEntry (cfId, "LOCAL_LINKS", NULL, value) == OK)
+    {
+        work->localLinks = (atoi (value) != 0);
+    }
+    if (radCfGetEntry (cfId, "LOCAL_LINK_DIR", NULL, value) == OK)
+    {
+        strncpy (work->localLinkDir, value, sizeof(work->localLinkDir) - 1);
+    }
+    if (radCfGetEntry (cfId, "PERSIST_STATE", NULL, value) == OK)
+    {
+        work->persistState = (atoi (value) != 0);
+    }
+    if (radCfGetEntry (cfId, "LINK_COMPRESSION", NULL, value) == OK)
+    {
+        if (! strcmp (value, "lz"))
+        {
+            work->linkFlags |= MSGRTR_LINK_COMPRESS;
+        }
+        else if (strcmp (value, "none"))
+        {
+            radMsgLog(PRI_MEDIUM, "unknown LINK_COMPRESSION %s - using none",
+                       value);
+        }
+    }
+    if (radCfGetEntry (cfId, "COMPRESS_MIN_BYTES", NULL, value) == OK)
+    {
+        work->compressMinBytes = atoi (value);
+        if (work->compressMinBytes < (int)sizeof(MSGRTR_HDR))
+        {
+            work->compressMinBytes = sizeof(MSGRTR_HDR);
+        }
+    }
+    if (radCfGetEntry (cfId, "MULTICAST_GROUP", NULL, value) == OK)
+    {
+        char *port = strrchr (value, ':');
+
+        if (port == NULL || port == value || atoi (port + 1) <= 0 || 
+            (port - value) >= (int)sizeof(work->mcastGroup))
+        {
+            radMsgLog(PRI_CATASTROPHIC, "bad MULTICAST_GROUP groupIP:port %s given - ignoring!",
+                       value);
+        }
+        else
+        {
+            strncpy (work->mcastGroup, value, port - value);
+            work->mcastPort = atoi (port + 1);
+        }
+    }
+    if (radCfGetEntry (cfId, "MULTICAST_INTERFACE", NULL, value) == OK)
+    {
+        strncpy (work->mcastInterface, value, sizeof(work->mcastInterface) - 1);
+    }
+    if (radCfGetEntry (cfId, "MULTICAST_TTL", NULL, value) == OK)
+    {
+        work->mcastTTL = atoi (value);
+        if (work->mcastTTL < 1 || work->mcastTTL > 255)
+        {
+            work->mcastTTL = 1;
+        }
+    }
+    if (radCfGetEntry (cfId, "MULTICAST_MIN_PEERS", NULL, value) == OK)
+    {
+        work->mcastMinPeers = atoi (value);
+        if (work->mcastMinPeers < 1)
+        {
+            work->mcastMinPeers = 1;
+        }
+    }
+    if (radCfGetEntry (cfId, "MULTICAST_HISTORY_BYTES", NULL, value) == OK)
+    {
+        work->mcastHistoryBytes = strtoul (value, NULL, 0) & ~7UL;
+        if (work->mcastHistoryBytes < MSGRTR_MCAST_MIN_HISTORY)
+        {
+            work->mcastHistoryBytes = MSGRTR_MCAST_MIN_HISTORY;
+        }
+    }
+    if (radCfGetEntry (cfId, "ROUTER_ID", NULL, value) == OK)
+    {
+        work->routerID = strtoul (value, NULL, 0) & 0xFFFFFFFF;
+    }
+    for (retVal = radCfGetFirstEntry (cfId, "PEER", instance, value);
+         retVal == OK;
+         retVal = radCfGetNextEntry (cfId, "PEER", instance, value))
+    {
+        AddPeer (work, value);
+    }
+    for (retVal = radCfGetFirstEntry (cfId, "LAST_VALUE", instance, value);
+         retVal == OK;
+         retVal = radCfGetNextEntry (cfId, "LAST_VALUE", instance, value))
+    {
+        AddLvcRule (work, value, MSGRTR_LVC_CACHE);
+    }
+    for (retVal = radCfGetFirstEntry (cfId, "CONFLATE", instance, value);
+         retVal == OK;
+         retVal = radCfGetNextEntry (cfId, "CONFLATE", instance, value))
+    {
+        AddLvcRule (work, value, MSGRTR_LVC_CONFLATE);
+    }
+    for (retVal = radCfGetFirstEntry (cfId, "MULTICAST", instance, value);
+         retVal == OK;
+         retVal = radCfGetNextEntry (cfId, "MULTICAST", instance, value))
+    {
+        AddLvcRule (work, value, MSGRTR_LVC_MULTICAST);
+    }
+
+    radCfClose (cfId);
+    return;
 }
 
-// Add a client to a msgID list (check for duplicate):
-static void AddClient(MSGRTR_MIIB* miib, MSGRTR_PIB* consumer)
+// Convert a message header from network order in place:
+static void HdrNtoH (MSGRTR_HDR *hdr)
+{
+    hdr->magicNumber    = ntohl(hdr->magicNumber);
+    hdr->srcpid         = ntohl(hdr->srcpid);
+    hdr->msgID          = ntohl(hdr->msgID);
+    hdr->length         = ntohl(hdr->length);
+    hdr->flags          = ntohl(hdr->flags);
+    hdr->routerSlots    = ntohl(hdr->routerSlots);
+    hdr->originID       = ntohl(hdr->originID);
+    hdr->originEpoch    = ntohl(hdr->originEpoch);
+    hdr->originSeq      = ntohl(hdr->originSeq);
+    hdr->correlationID  = ntohl(hdr->correlationID);
+    hdr->replyRouterID  = ntohl(hdr->replyRouterID);
+    hdr->replyPid       = ntohl(hdr->replyPid);
+    return;
+}
+
+// Build the network order header of a frame to another router; 'origin' 
+// is the header of the message being passed on, NULL for one we originate:
+static void HdrHtoN (MSGRTR_HDR *out, ULONG msgID, ULONG length, MSGRTR_HDR *origin)
+{
+    out->magicNumber        = htonl(MSGRTR_MAGIC_NUMBER);
+    out->srcpid             = htonl(0);
+    out->msgID              = htonl(msgID);
+    out->length             = htonl(length);
+    if (origin != NULL)
+    {
+        out->flags          = htonl(origin->flags & MSGRTR_FLAG_RPC);
+        out->routerSlots    = htonl(0);
+        out->originID       = htonl(origin->originID);
+        out->originEpoch    = htonl(origin->originEpoch);
+        out->originSeq      = htonl(origin->originSeq);
+        out->correlationID  = htonl(origin->correlationID);
+        out->replyRouterID  = htonl(origin->replyRouterID);
+        out->replyPid       = htonl(origin->replyPid);
+    }
+    else
+    {
+        out->flags          = htonl(0);
+        out->routerSlots    = htonl(0);
+        out->originID       = htonl(msgrtrWork.routerID);
+        out->originEpoch    = htonl(msgrtrWork.epoch);
+        out->originSeq      = htonl(0);
+        out->correlationID  = htonl(0);
+        out->replyRouterID  = htonl(0);
+        out->replyPid       = htonl(0);
+    }
+    return;
+}
+
+// Stop using a failed remote link; the shutdown wakes its RX handler, which
+// closes the PIB, so this is safe to call in the middle of routing:
+static void RemoteLinkDown (MSGRTR_PIB* pib)
+{
+    MSGRTR_TX_CHUNK     *chunk;
+
+    if (pib->txDown)
+    {
+        return;
+    }
+    pib->txDown = TRUE;
+
+    while ((chunk = (MSGRTR_TX_CHUNK *)radListRemoveFirst(&pib->txQueue)) != NULL)
+    {
+        free (chunk);
+    }
+    pib->txQueueBytes   = 0;
+    pib->txQueueFrames  = 0;
+    pib->txLength       = 0;
+    pib->txFrames       = 0;
+
+    if (pib->txWriteId != -1)
+    {
+        radProcessIODeRegisterDescriptor(pib->txWriteId);
+        pib->txWriteId = -1;
+    }
+
+    shutdown (radSocketGetDescriptor(pib->txclient), SHUT_RDWR);
+    if (pib->rxclient != NULL)
+    {
+        shutdown (radSocketGetDescriptor(pib->rxclient), SHUT_RDWR);
+    }
+    return;
+}
+
+// Write as much of a remote client's queue as the socket will take:
+static void DrainRemote (MSGRTR_PIB* pib)
 {
-    MSGRTR_CIB      *cib;
+    MSGRTR_TX_CHUNK     *chunk;
+    int                 retVal;
 
-    // loop through the consumer list for this pib:
-    for (cib = (MSGRTR_CIB *)radListGetFirst (&miib->consumers);
-         cib != NULL;
-         cib = (MSGRTR_CIB *)radListGetNext (&miib->consumers, (NODE *)cib))
+    while ((chunk = (MSGRTR_TX_CHUNK *)radListGetFirst(&pib->txQueue)) != NULL)
     {
-        if (cib->pib == consumer)
+        retVal = write (radSocketGetDescriptor(pib->txclient),
+                        chunk->data + chunk->offset,
+                        chunk->length - chunk->offset);
+        if (retVal == -1)
         {
-            // He's already here, just return:
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                radMsgLog(PRI_HIGH, "DrainRemote: %s: %s - closing!",
+                           pib->name, strerror(errno));
+                RemoteLinkDown (pib);
+            }
             return;
         }
+
+        chunk->offset       += retVal;
+        pib->txQueueBytes   -= retVal;
+        if (chunk->offset < chunk->length)
+        {
+            return;
+        }
+
+        pib->txQueueFrames -= chunk->numFrames;
+        radListRemove (&pib->txQueue, (NODE *)chunk);
+        free (chunk);
     }
 
-    // If here, we need to add him:
-    cib = (MSGRTR_CIB *)malloc (sizeof(*cib));
-    if (cib == NULL)
+    // all caught up:
+    if (pib->txWriteId != -1)
     {
-        radMsgLog(PRI_HIGH, "AddClient: %d: malloc CIB failed!",
-                   miib->msgID);
-        return;
+        radProcessIODeRegisterDescriptor(pib->txWriteId);
+        pib->txWriteId = -1;
     }
+    return;
+}
+
+// Remote TX socket write-ready handler:
+static void RemoteTXHandler (int fd, void *userData)
+{
+    MSGRTR_PIB*         pib = (MSGRTR_PIB*)userData;
 
-    cib->pib = consumer;
-    radListAddToEnd(&miib->consumers, (NODE *)cib);
+    pthread_mutex_lock (&pib->lock);
+    DrainRemote (pib);
+    pthread_mutex_unlock (&pib->lock);
     return;
 }
 
-// radlib message queue receive handler:
-static void QueueMsgHandler
-(
-    char                *srcQueueName,
-    UINT                msgType,
-    void                *msg,
-    UINT                length,
-    void                *userData           // != NULL => socket RX invocation
-)
+// Apply the overflow policy so 'length' more bytes fit in the queue;
+// returns OK or ERROR if the new frames must be dropped:
+static int RemoteQueueMakeRoom (MSGRTR_PIB* pib, int length)
 {
-    MSGRTR_HDR          *hdr = (MSGRTR_HDR *)msg;
-    MSGRTR_INTERNAL_MSG *intMsg = (MSGRTR_INTERNAL_MSG *)hdr->msg;
-    MSGRTR_PIB          *sockpib = (MSGRTR_PIB*)userData;
-    MSGRTR_PIB          *pib;
-    MSGRTR_MIIB         *miib;
-    MSGRTR_CIB          *cib;
+    MSGRTR_TX_CHUNK     *chunk, *next;
 
-    // Note: This function is called in two different scenarios:
-    // 1) Automatically for internal message RX, in which case sockpib = NULL
-    // 2) By the remote socket RX handler, in which case sockpib = RX PIB
-    // sockpib is used to determine local or remote reception.
-    if (hdr->magicNumber != MSGRTR_MAGIC_NUMBER)
+    if (pib->txQueueBytes + length <= msgrtrWork.txQueueLimit)
     {
-        radMsgLog(PRI_HIGH, "QueueMsgHandler: RX bad magic number 0x%8.8X", 
-                   hdr->magicNumber);
-        return;
+        return OK;
     }
 
-    if (hdr->msgID == MSGRTR_INTERNAL_MSGID)
+    switch (msgrtrWork.txPolicy)
     {
-        switch (intMsg->subMsgID)
+        case MSGRTR_TX_DROP_OLDEST:
         {
-            case MSGRTR_SUBTYPE_REGISTER:
+            // a partly written chunk must finish or the peer loses framing:
+            for (chunk = (MSGRTR_TX_CHUNK *)radListGetFirst(&pib->txQueue);
+                 chunk != NULL && pib->txQueueBytes + length > msgrtrWork.txQueueLimit;
+                 chunk = next)
             {
-                if (sockpib != NULL)
+                next = (MSGRTR_TX_CHUNK *)radListGetNext(&pib->txQueue, (NODE *)chunk);
+                if (chunk->offset > 0)
                 {
-                    // We don't handle socket registers here:
-                    return;
+                    continue;
                 }
 
-                if ((pib = getPIBByPID (hdr->srcpid)) != NULL)
-                {
-                    // he already exists, just ACK his funky self
-                    SendACK (pib);
-                    return;
-                }
+                pib->txQueueBytes   -= chunk->length;
+                pib->txQueueFrames  -= chunk->numFrames;
+                pib->txDrops        += chunk->numFrames;
+                radListRemove (&pib->txQueue, (NODE *)chunk);
+                free (chunk);
+            }
 
-                // let's insert this guy
-                pib = (MSGRTR_PIB *)malloc (sizeof(*pib));
-                if (pib == NULL)
-                {
-                    radMsgLog(PRI_HIGH, "QueueMsgHandler: %s: malloc PIB failed!",
-                               intMsg->name);
-                    return;
-                }
+            if (pib->txQueueBytes + length <= msgrtrWork.txQueueLimit)
+            {
+                return OK;
+            }
+            return ERROR;
+        }
+        case MSGRTR_TX_DROP_NEWEST:
+        {
+            return ERROR;
+        }
+        case MSGRTR_TX_DISCONNECT:
+        default:
+        {
+            radMsgLog(PRI_HIGH, "%s: %d bytes queued - disconnecting!",
+                       pib->name, pib->txQueueBytes);
+            RemoteLinkDown (pib);
+            return ERROR;
+        }
+    }
+}
 
-                memset (pib, 0, sizeof(*pib));
-                pib->type   = PIB_TYPE_LOCAL;
-                pib->pid    = hdr->srcpid;
-                strncpy (pib->name, intMsg->name, PROCESS_MAX_NAME_LEN);
-                strncpy (pib->queueName, srcQueueName, QUEUE_NAME_LENGTH);
+// Write frames to a remote client without blocking; what the socket won't 
+// take now is queued and written as it drains;
+// returns OK (frames sent, queued or dropped by policy) or ERROR:
+static int WriteRemote (MSGRTR_PIB* pib, struct iovec *iov, int iovCount, int numFrames)
+{
+    MSGRTR_TX_CHUNK     *chunk;
+    UCHAR               *dest;
+    int                 i, skip, total = 0, written = 0;
 
-                //  attach queue
-                if (radProcessQueueAttach (pib->queueName, QUEUE_GROUP_ALL) == ERROR)
-                {
-                    radMsgLog(PRI_HIGH, "radProcessQueueAttach %s failed!",
-                               pib->queueName);
-                    free (pib);
-                    return;
-                }
+    if (pib->txDown)
+    {
+        pib->txDrops += numFrames;
+        return ERROR;
+    }
 
-                radListAddToEnd (&msgrtrWork.pibList, (NODE *)pib);
+    for (i = 0; i < iovCount; i ++)
+    {
+        total += iov[i].iov_len;
+    }
 
-                // finally, ACK 'em
-                SendACK (pib);
-                return;
+    if (radListGetNumberOfNodes(&pib->txQueue) == 0)
+    {
+        written = writev (radSocketGetDescriptor(pib->txclient), iov, iovCount);
+        if (written == -1)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                radMsgLog(PRI_HIGH, "WriteRemote: %s: %s - closing!",
+                           pib->name, strerror(errno));
+                RemoteLinkDown (pib);
+                return ERROR;
             }
+            written = 0;
+        }
 
-            case MSGRTR_SUBTYPE_DEREGISTER:
-            {
-                if (sockpib == NULL)
-                {
-                    if ((pib = getPIBByPID (hdr->srcpid)) == NULL)
-                    {
-                        // he does not exist
-                        return;
-                    }
-                }
-                else
-                {
-                    pib = sockpib;
-                }
+        if (written == total)
+        {
+            return OK;
+        }
+    }
 
-                // first, remove him from the consumer lists
-                RemoveClientFromAllMsgs (pib);
+    // whole frames can be dropped; the tail of a partial write can not:
+    if (written == 0 && RemoteQueueMakeRoom(pib, total) == ERROR)
+    {
+        pib->txDrops += numFrames;
+        return (pib->txDown ? ERROR : OK);
+    }
 
-                // remove him from the PIB list
-                radListRemove (&msgrtrWork.pibList, (NODE *)pib);
+    chunk = (MSGRTR_TX_CHUNK *)malloc (sizeof(*chunk) + total - written);
+    if (chunk == NULL)
+    {
+        radMsgLog(PRI_HIGH, "WriteRemote: %s: malloc failed - closing!", pib->name);
+        RemoteLinkDown (pib);
+        return ERROR;
+    }
 
-                if (sockpib == NULL)
-                {
-                    radProcessQueueDettach(pib->queueName, QUEUE_GROUP_ALL);
-                }
-                else
-                {
-                    radSocketDestroy(pib->txclient);
-                    radSocketDestroy(pib->rxclient);
-                }
-                free (pib);
+    dest = chunk->data;
+    skip = written;
+    for (i = 0; i < iovCount; i ++)
+    {
+        if (skip >= (int)iov[i].iov_len)
+        {
+            skip -= iov[i].iov_len;
+            continue;
+        }
+        memcpy (dest, (UCHAR *)iov[i].iov_base + skip, iov[i].iov_len - skip);
+        dest += iov[i].iov_len - skip;
+        skip = 0;
+    }
 
-                return;
-            }
+    chunk->length       = total - written;
+    chunk->offset       = 0;
+    chunk->numFrames    = numFrames;
+    radListAddToEnd (&pib->txQueue, (NODE *)chunk);
+
+    pib->txQueueBytes   += chunk->length;
+    pib->txQueueFrames  += numFrames;
+    if (pib->txQueueBytes > pib->txQueuePeak)
+    {
+        pib->txQueuePeak = pib->txQueueBytes;
+    }
 
-        case MSGRTR_SUBTYPE_ENABLE_MSGID:
+    if (msgrtrWork.numWorkers > 0)
+    {
+        // the TX thread waits for the socket to drain:
+        pthread_cond_signal (&pib->txCond);
+    }
+    else if (pib->txWriteId == -1)
+    {
+        pib->txWriteId = radProcessIORegisterWriteDescriptor(radSocketGetDescriptor(pib->txclient),
+                                                             RemoteTXHandler,
+                                                             (void*)pib);
+        if (pib->txWriteId == ERROR)
         {
-            if (sockpib == NULL)
-            {
-                if ((pib = getPIBByPID (hdr->srcpid)) == NULL)
-                {
-                    // he does not exist
-                    return;
-                }
-            }
-            else
+            // no IO block free - the flush timer will keep draining it:
+            pib->txWriteId = -1;
+            if (! msgrtrWork.txFlushPending)
             {
-                pib = sockpib;
+                msgrtrWork.txFlushPending = TRUE;
+                radTimerStart(msgrtrWork.txFlushTimer, MSGRTR_TX_FLUSH_DELAY);
             }
+        }
+    }
 
-            // first, get the MIID
-            miib = getMIIB(intMsg->targetMsgID);
-            if (miib == NULL)
-            {
-                // new msgID, create the MIIB
-                miib = (MSGRTR_MIIB *)malloc (sizeof(*miib));
-                if (miib == NULL)
-                {
-                    radMsgLog(PRI_HIGH, "QueueMsgHandler: %d: malloc MIIB failed!",
-                               intMsg->targetMsgID);
-                    return;
-                }
+    return OK;
+}
 
-                miib->msgID = intMsg->targetMsgID;
-                radListReset (&miib->consumers);
-                radListAddToEnd (&msgrtrWork.miibList, (NODE *)miib);
-            }
+// Compress a remote client's staged frames into its zBuffer, in chunks of 
+// whole frames that expand to at most MSGRTR_COMPRESS_CHUNK_BYTES (and so 
+// compress to a frame any router can read); chunks that don't shrink are 
+// left as they are; fills 'iov' in order and returns the iov count:
+static int CompressRemote (MSGRTR_PIB* pib, struct iovec *iov)
+{
+    MSGRTR_HDR          hdr;
+    MSGRTR_ZBATCH       batch;
+    UCHAR               *zNext;
+    int                 offset, start, frames, frameLength;
+    int                 zLength, zMax, iovCount = 0;
 
-            // now that we have the MIIB, add this consumer
-            AddClient(miib, pib);
+    if (pib->zBuffer == NULL)
+    {
+        pib->zBuffer = (UCHAR *)malloc (MSGRTR_TX_BUFFER_SIZE);
+        if (pib->zBuffer == NULL)
+        {
+            iov[0].iov_base = pib->txBuffer;
+            iov[0].iov_len  = pib->txLength;
+            return 1;
+        }
+    }
 
-            // Register with all remotes for this msgID too:
-            RegisterAllRemotesMsgID(miib->msgID, sockpib);
+    // compressed frames are smaller than their chunks, so they fit:
+    zNext = pib->zBuffer;
 
-            return;
-        }
+    for (offset = 0; offset < pib->txLength; )
+    {
+        start   = offset;
+        frames  = 0;
+        zLength = 0;
 
-        case MSGRTR_SUBTYPE_MSGID_IS_REGISTERED:
+        if (iovCount == MSGRTR_COMPRESS_MAX_CHUNKS - 1)
         {
-            int     isRegistered = 0;
-
-            if (sockpib == NULL)
+            // out of iovs - the rest goes as it is
+            offset = pib->txLength;
+        }
+        else
+        {
+            while (offset < pib->txLength)
             {
-                if ((pib = getPIBByPID (hdr->srcpid)) == NULL)
+                memcpy (&hdr, pib->txBuffer + offset, sizeof(hdr));
+                frameLength = sizeof(hdr) + ntohl(hdr.length);
+                if (frames > 0 && 
+                    offset - start + frameLength > MSGRTR_COMPRESS_CHUNK_BYTES)
                 {
-                    // he does not exist
-                    return;
+                    break;
                 }
-            }
-            else
-            {
-                pib = sockpib;
+                offset += frameLength;
+                frames ++;
             }
 
-            // first, get the MIID
-            miib = getMIIB(intMsg->targetMsgID);
-            if (miib == NULL)
+            zMax = offset - start - sizeof(hdr) - sizeof(batch) - 1;
+            if (zMax > SYS_BUFFER_LARGEST_SIZE - (int)sizeof(batch))
             {
-                // unknown msgId
-                return;
+                zMax = SYS_BUFFER_LARGEST_SIZE - sizeof(batch);
             }
-
-            // Are there any consumers?
-            if (radListGetNumberOfNodes(&miib->consumers) > 0)
+            if (offset - start >= msgrtrWork.compressMinBytes && zMax > 0)
             {
-                isRegistered = 1;
+                zLength = radCompressLZ (pib->txBuffer + start, offset - start,
+                                         zNext + sizeof(hdr) + sizeof(batch), zMax);
             }
+        }
 
-            // Send response:
-            SendIsRegistered (pib, isRegistered);
-
-            return;
+        if (zLength > 0)
+        {
+            hdr.magicNumber     = htonl(MSGRTR_MAGIC_NUMBER);
+            hdr.srcpid          = htonl(0);
+            hdr.msgID           = htonl(MSGRTR_INTERNAL_MSGID);
+            hdr.length          = htonl(sizeof(batch) + zLength);
+            hdr.flags           = htonl(MSGRTR_FLAG_COMPRESSED);
+            hdr.routerSlots     = htonl(0);
+            hdr.originID        = htonl(msgrtrWork.routerID);
+            hdr.originEpoch     = htonl(msgrtrWork.epoch);
+            hdr.originSeq       = htonl(0);
+            hdr.correlationID   = htonl(0);
+            hdr.replyRouterID   = htonl(0);
+            hdr.replyPid        = htonl(0);
+            batch.rawLength     = htonl(offset - start);
+            batch.frames        = htonl(frames);
+            memcpy (zNext, &hdr, sizeof(hdr));
+            memcpy (zNext + sizeof(hdr), &batch, sizeof(batch));
+
+            iov[iovCount].iov_base  = zNext;
+            iov[iovCount].iov_len   = sizeof(hdr) + sizeof(batch) + zLength;
+            zNext += iov[iovCount].iov_len;
+
+            pib->zRawBytes  += offset - start;
+            pib->zBytes     += iov[iovCount].iov_len;
+            pib->zBatches ++;
+            iovCount ++;
+        }
+        else if (iovCount > 0 && 
+                 (UCHAR *)iov[iovCount-1].iov_base + iov[iovCount-1].iov_len == 
+                 pib->txBuffer + start)
+        {
+            // follows the last chunk left as it was
+            iov[iovCount-1].iov_len += offset - start;
+        }
+        else
+        {
+            iov[iovCount].iov_base  = pib->txBuffer + start;
+            iov[iovCount].iov_len   = offset - start;
+            iovCount ++;
         }
+    }
 
-            case MSGRTR_SUBTYPE_DISABLE_MSGID:
-            {
-                if (sockpib == NULL)
-                {
-                    if ((pib = getPIBByPID (hdr->srcpid)) == NULL)
-                    {
-                        // he does not exist
-                        return;
-                    }
-                }
-                else
-                {
-                    pib = sockpib;
-                }
+    return iovCount;
+}
+
+// Expand a compressed frame batch from a remote router into 'raw' (of 
+// MSGRTR_TX_BUFFER_SIZE bytes) and check the frames in it;
+// returns the expanded length or ERROR:
+static int ExpandRemote (MSGRTR_PIB* pib, MSGRTR_HDR *hdr, UCHAR *raw)
+{
+    MSGRTR_ZBATCH       batch;
+    MSGRTR_HDR          frame;
+    int                 rawLength, offset;
+    ULONG               frames = 0;
+
+    if (hdr->length < sizeof(batch))
+    {
+        return ERROR;
+    }
+    memcpy (&batch, hdr->msg, sizeof(batch));
+    batch.rawLength = ntohl(batch.rawLength);
+    batch.frames    = ntohl(batch.frames);
+
+    rawLength = radDecompressLZ (hdr->msg + sizeof(batch), hdr->length - sizeof(batch),
+                                 raw, MSGRTR_TX_BUFFER_SIZE);
+    if (rawLength == ERROR || rawLength != (int)batch.rawLength)
+    {
+        return ERROR;
+    }
+
+    for (offset = 0; rawLength - offset >= (int)sizeof(frame); frames ++)
+    {
+        memcpy (&frame, raw + offset, sizeof(frame));
+        HdrNtoH (&frame);
+        if (frame.magicNumber != MSGRTR_MAGIC_NUMBER || 
+            frame.length > SYS_BUFFER_LARGEST_SIZE ||
+            (frame.flags & MSGRTR_FLAG_COMPRESSED))
+        {
+            return ERROR;
+        }
+        offset += sizeof(frame) + frame.length;
+    }
+
+    if (offset != rawLength || frames != batch.frames)
+    {
+        return ERROR;
+    }
+
+    pib->zRxBatches ++;
+    return rawLength;
+}
+
+// Write a remote client's staged frames:
+static int FlushRemote (MSGRTR_PIB* pib)
+{
+    struct iovec        iov[MSGRTR_COMPRESS_MAX_CHUNKS];
+    int                 iovCount = 1;
+    int                 numFrames = pib->txFrames;
+
+    if (pib->txLength == 0)
+    {
+        return OK;
+    }
+
+    if ((pib->linkFlags & MSGRTR_LINK_COMPRESS) && 
+        pib->txLength >= msgrtrWork.compressMinBytes)
+    {
+        iovCount = CompressRemote (pib, iov);
+    }
+    else
+    {
+        iov[0].iov_base = pib->txBuffer;
+        iov[0].iov_len  = pib->txLength;
+    }
+    pib->txLength   = 0;
+    pib->txFrames   = 0;
+
+    return WriteRemote(pib, iov, iovCount, numFrames);
+}
+
+// Stage a message for a remote client (PIB lock held) - frames are 
+// coalesced in the PIB's output buffer and written when it fills or the 
+// flush timer (TX thread in threaded mode) expires; 'origin' is the header 
+// of the message being passed on, NULL for one we originate:
+static int StageRemote
+(
+    MSGRTR_PIB      *pib,
+    ULONG           msgID,
+    void            *data,
+    int             length,
+    MSGRTR_HDR      *origin
+)
+{
+    MSGRTR_HDR          hdr;
+    struct iovec        iov[2];
+    int                 frameLength = sizeof(hdr) + length;
+
+    if (pib->txDown)
+    {
+        pib->txDrops ++;
+        return ERROR;
+    }
+
+    HdrHtoN (&hdr, msgID, length, origin);
+
+    if (pib->txBuffer == NULL && msgrtrWork.txFlushDelay > 0)
+    {
+        pib->txBuffer = (UCHAR *)malloc (MSGRTR_TX_BUFFER_SIZE);
+    }
+
+    // keep frames in order - make room first:
+    if (pib->txLength + frameLength > MSGRTR_TX_BUFFER_SIZE)
+    {
+        if (FlushRemote(pib) == ERROR)
+        {
+            return ERROR;
+        }
+    }
+
+    if (pib->txBuffer == NULL || frameLength > MSGRTR_TX_BUFFER_SIZE)
+    {
+        // not buffering, or too big to stage: gather write it in place
+        iov[0].iov_base = &hdr;
+        iov[0].iov_len  = sizeof(hdr);
+        iov[1].iov_base = data;
+        iov[1].iov_len  = length;
+
+        return WriteRemote(pib, iov, 2, 1);
+    }
+
+    memcpy (pib->txBuffer + pib->txLength, &hdr, sizeof(hdr));
+    memcpy (pib->txBuffer + pib->txLength + sizeof(hdr), data, length);
+    pib->txLength += frameLength;
+    pib->txFrames ++;
+
+    if (pib->txLength >= msgrtrWork.txFlushBytes)
+    {
+        return FlushRemote(pib);
+    }
+
+    if (msgrtrWork.numWorkers > 0)
+    {
+        if (pib->txFrames == 1)
+        {
+            pthread_cond_signal (&pib->txCond);
+        }
+    }
+    else if (! msgrtrWork.txFlushPending)
+    {
+        msgrtrWork.txFlushPending = TRUE;
+        radTimerStart(msgrtrWork.txFlushTimer, msgrtrWork.txFlushDelay);
+    }
+
+    return OK;
+}
+
+// Send a message to a remote client (any thread):
+static int SendToRemote
+(
+    MSGRTR_PIB      *pib,
+    ULONG           msgID,
+    void            *data,
+    int             length,
+    MSGRTR_HDR      *origin
+)
+{
+    int             retVal;
+
+    pthread_mutex_lock (&pib->lock);
+    retVal = StageRemote (pib, msgID, data, length, origin);
+    pthread_mutex_unlock (&pib->lock);
+    return retVal;
+}
+
+// Routing table hash function (spreads sequential and sparse keys):
+static UINT msgrtrHash (ULONG key, int tableSize)
+{
+    UINT            hash = (UINT)key;
+
+    hash ^= hash >> 16;
+    hash *= 0x45D9F3B;
+    hash ^= hash >> 16;
+
+    return (hash & (tableSize - 1));
+}
+
+// Append an element to a contiguous set, growing it as needed:
+static int SetAppend (void **set, int *num, int *max, int elemSize, void *elem)
+{
+    void            *newSet;
+    int             newMax;
+
+    if (*num >= *max)
+    {
+        newMax = ((*max == 0) ? MSGRTR_INITIAL_SET_SIZE : (*max * 2));
+        newSet = realloc (*set, newMax * elemSize);
+        if (newSet == NULL)
+        {
+            return ERROR;
+        }
+        *set = newSet;
+        *max = newMax;
+    }
+
+    memcpy ((UCHAR *)(*set) + (*num * elemSize), elem, elemSize);
+    (*num) ++;
+    return OK;
+}
+
+// Find a consumer's content filter for 'msgID', NULL if it has none:
+static MSGRTR_FILTER *FilterFind (MSGRTR_PIB *pib, ULONG msgID)
+{
+    int             i;
+
+    for (i = 0; i < pib->numFilters; i ++)
+    {
+        if (pib->filters[i].msgID == msgID)
+        {
+            return &pib->filters[i];
+        }
+    }
+
+    return NULL;
+}
+
+// Set a consumer's content filter for 'msgID', or remove it if 'numTerms' 
+// is 0 (tables locked); returns OK or ERROR:
+static int FilterSet 
+(
+    MSGRTR_PIB          *pib, 
+    ULONG               msgID, 
+    MSGRTR_FILTER_TERM  *terms, 
+    int                 numTerms
+)
+{
+    MSGRTR_FILTER       *filter = FilterFind (pib, msgID);
+    MSGRTR_FILTER       newFilter;
+    int                 i;
+
+    if (numTerms == 0)
+    {
+        if (filter != NULL)
+        {
+            *filter = pib->filters[pib->numFilters - 1];
+            pib->numFilters --;
+        }
+        return OK;
+    }
+
+    if (numTerms < 0 || numTerms > MSGRTR_MAX_FILTER_TERMS)
+    {
+        return ERROR;
+    }
+    for (i = 0; i < numTerms; i ++)
+    {
+        if ((terms[i].width != 1 && terms[i].width != 2 && 
+             terms[i].width != 4 && terms[i].width != 8) ||
+            terms[i].op < MSGRTR_FILTER_EQ || terms[i].op > MSGRTR_FILTER_ALL_BITS)
+        {
+            return ERROR;
+        }
+    }
+
+    if (filter == NULL)
+    {
+        memset (&newFilter, 0, sizeof(newFilter));
+        newFilter.msgID = msgID;
+        if (SetAppend ((void **)&pib->filters, 
+                       &pib->numFilters, 
+                       &pib->maxFilters, 
+                       sizeof(MSGRTR_FILTER), 
+                       &newFilter)
+            == ERROR)
+        {
+            return ERROR;
+        }
+        filter = &pib->filters[pib->numFilters - 1];
+    }
+
+    filter->numTerms = numTerms;
+    memcpy (filter->terms, terms, numTerms * sizeof(MSGRTR_FILTER_TERM));
+    return OK;
+}
+
+// Does one filter term hold for a message? A field reaching past the end 
+// of the message never matches:
+static int FilterTermMatch (MSGRTR_FILTER_TERM *term, UCHAR *msg, ULONG length)
+{
+    ULONGLONG       field = 0, value = term->value;
+    USHORT          field16;
+    UINT            field32;
+    int             i;
+
+    if ((ULONG)term->offset + term->width > length)
+    {
+        return FALSE;
+    }
+
+    if (term->flags & MSGRTR_FILTER_NET_ORDER)
+    {
+        for (i = 0; i < term->width; i ++)
+        {
+            field = (field << 8) | msg[term->offset + i];
+        }
+    }
+    else
+    {
+        switch (term->width)
+        {
+            case 1:
+                field = msg[term->offset];
+                break;
+            case 2:
+                memcpy (&field16, msg + term->offset, sizeof(field16));
+                field = field16;
+                break;
+            case 4:
+                memcpy (&field32, msg + term->offset, sizeof(field32));
+                field = field32;
+                break;
+            default:
+                memcpy (&field, msg + term->offset, sizeof(field));
+                break;
+        }
+    }
+
+    switch (term->op)
+    {
+        case MSGRTR_FILTER_ANY_BITS:
+            return ((field & value) != 0);
+        case MSGRTR_FILTER_ALL_BITS:
+            return ((field & value) == value);
+    }
+
+    if (term->flags & MSGRTR_FILTER_SIGNED)
+    {
+        // sign extend, then flip the sign bits so unsigned order is signed order:
+        if (term->width < 8 && (field & (1ULL << (term->width * 8 - 1))))
+        {
+            field |= ~0ULL << (term->width * 8);
+        }
+        field ^= 1ULL << 63;
+        value ^= 1ULL << 63;
+    }
+
+    switch (term->op)
+    {
+        case MSGRTR_FILTER_EQ:
+            return (field == value);
+        case MSGRTR_FILTER_NE:
+            return (field != value);
+        case MSGRTR_FILTER_LT:
+            return (field < value);
+        case MSGRTR_FILTER_LE:
+            return (field <= value);
+        case MSGRTR_FILTER_GT:
+            return (field > value);
+        case MSGRTR_FILTER_GE:
+            return (field >= value);
+    }
+
+    return FALSE;
+}
+
+// Does a message pass a content filter? Terms are ANDed; a term flagged 
+// MSGRTR_FILTER_OR starts another alternative:
+static int FilterMatch (MSGRTR_FILTER *filter, void *msg, ULONG length)
+{
+    int             i, match = TRUE;
+
+    for (i = 0; i < filter->numTerms; i ++)
+    {
+        if (i > 0 && (filter->terms[i].flags & MSGRTR_FILTER_OR))
+        {
+            if (match)
+            {
+                return TRUE;
+            }
+            match = TRUE;
+        }
+        else if (! match)
+        {
+            // this alternative has failed already
+            continue;
+        }
+
+        match = FilterTermMatch (&filter->terms[i], (UCHAR *)msg, length);
+    }
+
+    return match;
+}
+
+// Shared subscription table maintenance - radmrouted is the only writer of
+// the subscription data; readers retry while 'sequence' is odd or changes;
+// updates nest so a batch is published as one change:
+static void ShmTableBeginUpdate (void)
+{
+    if (msgrtrWork.shmUpdateDepth ++ > 0)
+    {
+        return;
+    }
+    msgrtrWork.shmTable->sequence ++;
+    __sync_synchronize ();
+    return;
+}
+
+static void ShmTableEndUpdate (void)
+{
+    if (-- msgrtrWork.shmUpdateDepth > 0)
+    {
+        return;
+    }
+    __sync_synchronize ();
+    msgrtrWork.shmTable->sequence ++;
+    return;
+}
+
+// Find the table entry for msgID (or, if 'forInsert', an entry to hold it):
+static MSGRTR_SHM_ENTRY *ShmTableFind (ULONG msgID, int forInsert)
+{
+    MSGRTR_SHM_ENTRY    *entry = NULL;
+    MSGRTR_SHM_ENTRY    *unused = NULL;
+    UINT                index;
+    int                 probes;
+
+    index = MSGRTR_SHM_INDEX(msgID);
+    for (probes = 0; probes < MSGRTR_SHM_TABLE_SIZE; probes ++)
+    {
+        entry = &msgrtrWork.shmTable->entries[(index + probes) & (MSGRTR_SHM_TABLE_SIZE - 1)];
+        if (entry->msgID == msgID)
+        {
+            return entry;
+        }
+        if (entry->msgID == 0)
+        {
+            // end of the probe chain
+            break;
+        }
+        if (unused == NULL && entry->localMask == 0 && entry->flags == 0)
+        {
+            // stale entry we can reuse
+            unused = entry;
+        }
+    }
+
+    if (! forInsert)
+    {
+        return NULL;
+    }
+    if (unused != NULL)
+    {
+        return unused;
+    }
+    return ((probes < MSGRTR_SHM_TABLE_SIZE) ? entry : NULL);
+}
+
+// Add a consumer set to a table entry's slot mask and flags:
+static void ShmTableMask
+(
+    MSGRTR_PIB      **consumers,
+    int             numConsumers,
+    ULONG           msgID,              // 0 for a range
+    UINT            *localMask,
+    UINT            *flags
+)
+{
+    MSGRTR_PIB      *consumer;
+    int             i;
+
+    for (i = 0; i < numConsumers; i ++)
+    {
+        consumer = consumers[i];
+
+        // only the router can apply a consumer's content filter:
+        if (consumer->type == PIB_TYPE_LOCAL && consumer->shmSlot >= 0 &&
+            (msgID == 0 || consumer->numFilters == 0 || 
+             FilterFind (consumer, msgID) == NULL))
+        {
+            *localMask |= (1U << consumer->shmSlot);
+        }
+        else
+        {
+            *flags |= MSGRTR_SHM_ROUTER_DELIVERS;
+        }
+    }
+
+    return;
+}
+
+// Load an entry from the MIIB's consumer set (NULL MIIB clears it):
+static void ShmTableFill (MSGRTR_SHM_ENTRY *entry, MSGRTR_MIIB *miib)
+{
+    UINT            lvcFlags;
+
+    entry->localMask = 0;
+    entry->flags     = 0;
+    if (miib == NULL)
+    {
+        return;
+    }
+
+    ShmTableMask (miib->consumers, miib->numConsumers, entry->msgID,
+                  &entry->localMask, &entry->flags);
+    if (miib->rangeSeg != NULL)
+    {
+        ShmTableMask (miib->rangeSeg->consumers, miib->rangeSeg->numConsumers, 
+                      entry->msgID, &entry->localMask, &entry->flags);
+    }
+
+    // cached msgIDs must pass through the router, conflated ones must be 
+    // delivered by it (only it can hold them back for a lagging consumer):
+    if (entry->localMask == 0 && entry->flags == 0)
+    {
+        return;
+    }
+    lvcFlags = LvcRuleFlags (entry->msgID, entry->msgID);
+    if (lvcFlags & MSGRTR_LVC_CACHE)
+    {
+        entry->flags |= MSGRTR_SHM_ROUTER_CACHES;
+    }
+    if (lvcFlags & MSGRTR_LVC_CONFLATE)
+    {
+        entry->flags |= MSGRTR_SHM_ROUTER_CONFLATES;
+    }
+
+    return;
+}
+
+// Rebuild the whole table from the MIIB list and range segments (used after
+// an overflow or a range change):
+static void ShmTableRebuild (void)
+{
+    MSGRTR_MIIB         *miib;
+    MSGRTR_SHM_ENTRY    *entry;
+    MSGRTR_SHM_RANGE    *range;
+    int                 i;
+
+    ShmTableBeginUpdate ();
+
+    memset (msgrtrWork.shmTable->entries, 0, sizeof(msgrtrWork.shmTable->entries));
+    msgrtrWork.shmTable->overflow = FALSE;
+
+    for (miib = (MSGRTR_MIIB *)radListGetFirst (&msgrtrWork.miibList);
+         miib != NULL;
+         miib = (MSGRTR_MIIB *)radListGetNext (&msgrtrWork.miibList, (NODE *)miib))
+    {
+        if (miib->numConsumers == 0)
+        {
+            continue;
+        }
+
+        entry = ShmTableFind (miib->msgID, TRUE);
+        if (entry == NULL)
+        {
+            msgrtrWork.shmTable->overflow = TRUE;
+            continue;
+        }
+
+        entry->msgID = miib->msgID;
+        ShmTableFill (entry, miib);
+    }
+
+    msgrtrWork.shmTable->numRanges = 0;
+    for (i = 0; i < msgrtrWork.numRangeSegs; i ++)
+    {
+        if (i == MSGRTR_SHM_MAX_RANGES)
+        {
+            radMsgLog(PRI_MEDIUM, "subscription table full - %d range segments will be routed",
+                       msgrtrWork.numRangeSegs - i);
+            msgrtrWork.shmTable->overflow = TRUE;
+            break;
+        }
+
+        range = &msgrtrWork.shmTable->ranges[i];
+        range->first        = msgrtrWork.rangeSegs[i].first;
+        range->last         = msgrtrWork.rangeSegs[i].last;
+        range->localMask    = 0;
+        range->flags        = 0;
+        ShmTableMask (msgrtrWork.rangeSegs[i].consumers, 
+                      msgrtrWork.rangeSegs[i].numConsumers,
+                      0,
+                      &range->localMask, 
+                      &range->flags);
+        if (LvcRuleFlags (range->first, range->last) & MSGRTR_LVC_CACHE)
+        {
+            range->flags |= MSGRTR_SHM_ROUTER_CACHES;
+        }
+        if (LvcRuleFlags (range->first, range->last) & MSGRTR_LVC_CONFLATE)
+        {
+            range->flags |= MSGRTR_SHM_ROUTER_CONFLATES;
+        }
+        msgrtrWork.shmTable->numRanges ++;
+    }
+
+    ShmTableEndUpdate ();
+    return;
+}
+
+// Publish the current consumer set for msgID:
+static void ShmTableUpdate (ULONG msgID, MSGRTR_MIIB *miib)
+{
+    MSGRTR_SHM_ENTRY    *entry;
+    int                 isLive = (miib != NULL && miib->numConsumers > 0);
+
+    if (msgrtrWork.shmTable == NULL)
+    {
+        return;
+    }
+
+    entry = ShmTableFind (msgID, isLive);
+    if (entry == NULL)
+    {
+        if (isLive && ! msgrtrWork.shmTable->overflow)
+        {
+            // clients must now ask the router about msgIDs they can't find:
+            radMsgLog(PRI_MEDIUM, "subscription table full - msgID %u will be routed",
+                       msgID);
+            msgrtrWork.shmTable->overflow = TRUE;
+        }
+        return;
+    }
+
+    ShmTableBeginUpdate ();
+    entry->msgID = msgID;
+    ShmTableFill (entry, miib);
+    ShmTableEndUpdate ();
+    return;
+}
+
+// Assign a local client a slot in the table so producers can reach it:
+static void ShmSlotAlloc (MSGRTR_PIB *pib)
+{
+    MSGRTR_SHM_CLIENT   *client;
+    int                 i;
+
+    pib->shmSlot = -1;
+    if (msgrtrWork.shmTable == NULL)
+    {
+        return;
+    }
+
+    for (i = 0; i < MSGRTR_MAX_CLIENTS; i ++)
+    {
+        client = &msgrtrWork.shmTable->clients[i];
+        if (client->pid == 0)
+        {
+            ShmTableBeginUpdate ();
+            strncpy (client->queueName, pib->queueName, QUEUE_NAME_LENGTH);
+            client->directSends = 0;
+            client->directBytes = 0;
+            client->directFailures = 0;
+            client->spilling = FALSE;
+            client->pid = pib->pid;
+            ShmTableEndUpdate ();
+
+            pib->shmSlot = i;
+            return;
+        }
+    }
+
+    // no slot, the router will deliver to this one:
+    return;
+}
+
+static void ShmSlotFree (MSGRTR_PIB *pib)
+{
+    MSGRTR_SHM_CLIENT   *client;
+    ULONG               handoffs, handoffsDone;
+
+    if (msgrtrWork.shmTable == NULL || pib->shmSlot < 0)
+    {
+        return;
+    }
+
+    // hand-offs still on their way to us are counted done against the
+    // slot, whoever has it by then, so the counts must carry over:
+    client = &msgrtrWork.shmTable->clients[pib->shmSlot];
+    ShmTableBeginUpdate ();
+    handoffs        = client->handoffs;
+    handoffsDone    = client->handoffsDone;
+    memset (client, 0, sizeof(MSGRTR_SHM_CLIENT));
+    client->handoffs        = handoffs;
+    client->handoffsDone    = handoffsDone;
+    ShmTableEndUpdate ();
+
+    pib->shmSlot = -1;
+    return;
+}
+
+// Tell producers whether we are holding a backlog for a local client (only 
+// a hint, it is not covered by the table sequence):
+static void ShmSlotSpilling (MSGRTR_PIB *pib, int isSpilling)
+{
+    if (msgrtrWork.shmTable == NULL || pib->shmSlot < 0)
+    {
+        return;
+    }
+
+    msgrtrWork.shmTable->clients[pib->shmSlot].spilling = isSpilling;
+    return;
+}
+
+// We are through with a message its sender left to us for the slots in 
+// 'routerSlots' (it is in their queues, spilled or dropped), so the sender 
+// can go straight to them again without overtaking it:
+static void ShmHandoffsDone (MSGRTR_HDR *hdr)
+{
+    int                 i;
+
+    if (msgrtrWork.shmTable == NULL || hdr->routerSlots == 0)
+    {
+        return;
+    }
+
+    for (i = 0; i < MSGRTR_MAX_CLIENTS; i ++)
+    {
+        if (hdr->routerSlots & (1U << i))
+        {
+            __sync_fetch_and_add (&msgrtrWork.shmTable->clients[i].handoffsDone, 1);
+        }
+    }
+    return;
+}
+
+static MSGRTR_PIB *getPIBByPID (int findpid)
+{
+    MSGRTR_PIB      *node;
+
+    for (node = msgrtrWork.pidHash[msgrtrHash(findpid, MSGRTR_PIB_HASH_SIZE)];
+         node != NULL;
+         node = node->pidNext)
+    {
+        if (node->type == PIB_TYPE_LOCAL && node->pid == findpid)
+        {
+            // got 'em!
+            return node;
+        }
+    }
+
+    return NULL;
+}
+
+static MSGRTR_PIB *getPIBBySocket (int socketfd)
+{
+    MSGRTR_PIB      *node;
+
+    for (node = msgrtrWork.sockHash[msgrtrHash(socketfd, MSGRTR_PIB_HASH_SIZE)];
+         node != NULL;
+         node = node->sockNext)
+    {
+        if (node->sockfd == socketfd)
+        {
+            // got 'em!
+            return node;
+        }
+    }
+
+    return NULL;
+}
+
+// Add a PIB to the master list and the lookup tables:
+static void AddPIB (MSGRTR_PIB* pib)
+{
+    UINT            index;
+
+    radListAddToEnd (&msgrtrWork.pibList, (NODE *)pib);
+
+    pib->shmSlot = -1;
+    if (pib->type == PIB_TYPE_LOCAL)
+    {
+        index = msgrtrHash(pib->pid, MSGRTR_PIB_HASH_SIZE);
+        pib->pidNext = msgrtrWork.pidHash[index];
+        msgrtrWork.pidHash[index] = pib;
+
+        ShmSlotAlloc (pib);
+    }
+
+    pib->sockfd = -1;
+    if (pib->txclient != NULL)
+    {
+        pib->sockfd = radSocketGetDescriptor(pib->txclient);
+        index = msgrtrHash(pib->sockfd, MSGRTR_PIB_HASH_SIZE);
+        pib->sockNext = msgrtrWork.sockHash[index];
+        msgrtrWork.sockHash[index] = pib;
+    }
+
+    return;
+}
+
+// Remove a PIB from the master list and the lookup tables (does not free it):
+static void UnlinkPIB (MSGRTR_PIB* pib)
+{
+    MSGRTR_PIB      **link;
+
+    if (pib->type == PIB_TYPE_LOCAL)
+    {
+        ShmSlotFree (pib);
+
+        for (link = &msgrtrWork.pidHash[msgrtrHash(pib->pid, MSGRTR_PIB_HASH_SIZE)];
+             *link != NULL;
+             link = &(*link)->pidNext)
+        {
+            if (*link == pib)
+            {
+                *link = pib->pidNext;
+                break;
+            }
+        }
+    }
+
+    if (pib->sockfd != -1)
+    {
+        for (link = &msgrtrWork.sockHash[msgrtrHash(pib->sockfd, MSGRTR_PIB_HASH_SIZE)];
+             *link != NULL;
+             link = &(*link)->sockNext)
+        {
+            if (*link == pib)
+            {
+                *link = pib->sockNext;
+                break;
+            }
+        }
+        pib->sockfd = -1;
+    }
+
+    radListRemove (&msgrtrWork.pibList, (NODE *)pib);
+    return;
+}
+
+static void FreePIB (MSGRTR_PIB* pib)
+{
+    MSGRTR_TX_CHUNK     *chunk;
+    MSGRTR_SPILL_MSG    *spill;
+    int                 i;
+
+    if (pib->type == PIB_TYPE_LOCAL)
+    {
+        while ((spill = (MSGRTR_SPILL_MSG *)radListRemoveFirst(&pib->spillQueue)) != NULL)
+        {
+            radBufferRls (spill->buffer);
+            free (spill);
+        }
+    }
+    else if (pib->type == PIB_TYPE_REMOTE)
+    {
+        if (pib->txWriteId != -1)
+        {
+            radProcessIODeRegisterDescriptor(pib->txWriteId);
+        }
+        while ((chunk = (MSGRTR_TX_CHUNK *)radListRemoveFirst(&pib->txQueue)) != NULL)
+        {
+            free (chunk);
+        }
+    }
+    if (pib->subs != NULL)
+    {
+        free (pib->subs);
+    }
+    if (pib->filters != NULL)
+    {
+        free (pib->filters);
+    }
+    if (pib->txBuffer != NULL)
+    {
+        free (pib->txBuffer);
+    }
+    if (pib->zBuffer != NULL)
+    {
+        free (pib->zBuffer);
+    }
+    if (pib->zRxBuffer != NULL)
+    {
+        free (pib->zRxBuffer);
+    }
+    if (pib->mcastRx != NULL)
+    {
+        for (i = 0; i < MSGRTR_MCAST_HOLD_SLOTS; i ++)
+        {
+            if (pib->mcastRx->held[i] != NULL)
+            {
+                free (pib->mcastRx->held[i]);
+            }
+        }
+        free (pib->mcastRx);
+    }
+    pthread_mutex_destroy (&pib->lock);
+    pthread_cond_destroy (&pib->txCond);
+    free (pib);
+    return;
+}
+
+// Create and add the PIB of a local client, attached to its queue:
+static MSGRTR_PIB *CreateLocalPIB (int pid, char *name, char *queueName)
+{
+    MSGRTR_PIB      *pib;
+
+    pib = (MSGRTR_PIB *)malloc (sizeof(*pib));
+    if (pib == NULL)
+    {
+        radMsgLog(PRI_HIGH, "CreateLocalPIB: %s: malloc PIB failed!", name);
+        return NULL;
+    }
+
+    memset (pib, 0, sizeof(*pib));
+    pthread_mutex_init (&pib->lock, NULL);
+    pthread_cond_init (&pib->txCond, NULL);
+    pib->type   = PIB_TYPE_LOCAL;
+    pib->pid    = pid;
+    strncpy (pib->name, name, PROCESS_MAX_NAME_LEN);
+    strncpy (pib->queueName, queueName, QUEUE_NAME_LENGTH);
+    radListReset (&pib->spillQueue);
+
+    //  attach queue
+    if (radProcessQueueAttach (pib->queueName, QUEUE_GROUP_ALL) == ERROR)
+    {
+        radMsgLog(PRI_HIGH, "radProcessQueueAttach %s failed!",
+                   pib->queueName);
+        pthread_mutex_destroy (&pib->lock);
+        pthread_cond_destroy (&pib->txCond);
+        free (pib);
+        return NULL;
+    }
+
+    // a consumer that stops reading must not stall the router:
+    radProcessQueueSetSendBlocking (pib->queueName, FALSE);
+
+    AddPIB (pib);
+    return pib;
+}
+
+// Find the range segment holding msgID (binary search):
+static MSGRTR_RANGE_SEG *RangeFind (ULONG msgID)
+{
+    MSGRTR_RANGE_SEG    *seg;
+    int                 low = 0, high = msgrtrWork.numRangeSegs - 1, mid;
+
+    while (low <= high)
+    {
+        mid = (low + high) / 2;
+        seg = &msgrtrWork.rangeSegs[mid];
+        if (msgID < seg->first)
+        {
+            high = mid - 1;
+        }
+        else if (msgID > seg->last)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            return seg;
+        }
+    }
+
+    return NULL;
+}
+
+static MSGRTR_MIIB *getMIIB (ULONG findMsgID)
+{
+    MSGRTR_MIIB     *node;
+
+    for (node = msgrtrWork.miibHash[msgrtrHash(findMsgID, MSGRTR_MIIB_HASH_SIZE)];
+         node != NULL;
+         node = node->hashNext)
+    {
+        if (node->msgID == findMsgID)
+        {
+            // got 'em!
+            return node;
+        }
+    }
+
+    return NULL;
+}
+
+// Create a new (empty) MIIB and add it to the lookup tables:
+static MSGRTR_MIIB *CreateMIIB (ULONG msgID)
+{
+    MSGRTR_MIIB     *miib;
+    UINT            index;
+
+    miib = (MSGRTR_MIIB *)malloc (sizeof(*miib));
+    if (miib == NULL)
+    {
+        return NULL;
+    }
+
+    memset (miib, 0, sizeof(*miib));
+    miib->msgID = msgID;
+    miib->rangeSeg = RangeFind (msgID);
+
+    index = msgrtrHash(msgID, MSGRTR_MIIB_HASH_SIZE);
+    miib->hashNext = msgrtrWork.miibHash[index];
+    msgrtrWork.miibHash[index] = miib;
+    radListAddToEnd (&msgrtrWork.miibList, (NODE *)miib);
+
+    return miib;
+}
+
+// Remove an MIIB from the lookup tables and free it:
+static void RemoveMIIB (MSGRTR_MIIB *miib)
+{
+    MSGRTR_MIIB     **link;
+    ULONG           msgID = miib->msgID;
+
+    for (link = &msgrtrWork.miibHash[msgrtrHash(miib->msgID, MSGRTR_MIIB_HASH_SIZE)];
+         *link != NULL;
+         link = &(*link)->hashNext)
+    {
+        if (*link == miib)
+        {
+            *link = miib->hashNext;
+            break;
+        }
+    }
+
+    radListRemove (&msgrtrWork.miibList, (NODE *)miib);
+    if (miib->consumers != NULL)
+    {
+        free (miib->consumers);
+    }
+    free (miib);
+
+    if (msgrtrWork.shmTable != NULL && msgrtrWork.shmTable->overflow)
+    {
+        // there may be room for the msgIDs we could not publish:
+        ShmTableRebuild ();
+    }
+    else
+    {
+        ShmTableUpdate (msgID, NULL);
+    }
+    return;
+}
+
+static int RangeBoundCompare (const void *a, const void *b)
+{
+    ULONGLONG       boundA = ((const MSGRTR_RANGE_BOUND *)a)->bound;
+    ULONGLONG       boundB = ((const MSGRTR_RANGE_BOUND *)b)->bound;
+
+    return ((boundA < boundB) ? -1 : ((boundA > boundB) ? 1 : 0));
+}
+
+// Count a consumer into (delta 1) or out of (delta -1) the consumers of the
+// ranges covering the sweep position; a consumer's overlapping ranges count
+// once:
+static void RangeSweepApply
+(
+    MSGRTR_RANGE_BOUND  *bound,
+    MSGRTR_PIB          **active,
+    int                 *activeCount,
+    int                 *numActive
+)
+{
+    int                 i;
+
+    for (i = 0; i < *numActive; i ++)
+    {
+        if (active[i] == bound->consumer)
+        {
+            break;
+        }
+    }
+
+    if (i == *numActive)
+    {
+        if (bound->delta > 0)
+        {
+            active[i]       = bound->consumer;
+            activeCount[i]  = 1;
+            (*numActive) ++;
+        }
+        return;
+    }
+
+    activeCount[i] += bound->delta;
+    if (activeCount[i] == 0)
+    {
+        (*numActive) --;
+        active[i]       = active[*numActive];
+        activeCount[i]  = activeCount[*numActive];
+    }
+    return;
+}
+
+// Flatten the range subscriptions into sorted, disjoint segments (sort the
+// end points, then one sweep), point the MIIBs at theirs and republish the
+// shared table:
+static void RangeRebuild (void)
+{
+    MSGRTR_RANGE        *range;
+    MSGRTR_RANGE_SEG    *segs = NULL;
+    MSGRTR_RANGE_SEG    *seg;
+    MSGRTR_MIIB         *miib;
+    MSGRTR_RANGE_BOUND  *bounds;
+    MSGRTR_PIB          **active;
+    int                 *activeCount;
+    ULONGLONG           position;
+    int                 numRanges, numBounds = 0, numSegs = 0, numActive = 0;
+    int                 i;
+
+    for (i = 0; i < msgrtrWork.numRangeSegs; i ++)
+    {
+        free (msgrtrWork.rangeSegs[i].consumers);
+    }
+    free (msgrtrWork.rangeSegs);
+    msgrtrWork.rangeSegs    = NULL;
+    msgrtrWork.numRangeSegs = 0;
+
+    numRanges = radListGetNumberOfNodes (&msgrtrWork.rangeList);
+    if (numRanges > 0)
+    {
+        bounds      = (MSGRTR_RANGE_BOUND *)malloc (2 * numRanges * sizeof(MSGRTR_RANGE_BOUND));
+        segs        = (MSGRTR_RANGE_SEG *)malloc (2 * numRanges * sizeof(MSGRTR_RANGE_SEG));
+        active      = (MSGRTR_PIB **)malloc (numRanges * sizeof(MSGRTR_PIB *));
+        activeCount = (int *)malloc (numRanges * sizeof(int));
+        if (bounds == NULL || segs == NULL || active == NULL || activeCount == NULL)
+        {
+            radMsgLog(PRI_HIGH, "RangeRebuild: malloc failed - ranges disabled!");
+            free (segs);
+            segs = NULL;
+        }
+        else
+        {
+            // every range start and every end + 1 starts a segment:
+            for (range = (MSGRTR_RANGE *)radListGetFirst (&msgrtrWork.rangeList);
+                 range != NULL;
+                 range = (MSGRTR_RANGE *)radListGetNext (&msgrtrWork.rangeList, (NODE *)range))
+            {
+                bounds[numBounds].bound     = range->first;
+                bounds[numBounds].consumer  = range->consumer;
+                bounds[numBounds].delta     = 1;
+                numBounds ++;
+                bounds[numBounds].bound     = (ULONGLONG)range->last + 1;
+                bounds[numBounds].consumer  = range->consumer;
+                bounds[numBounds].delta     = -1;
+                numBounds ++;
+            }
+            qsort (bounds, numBounds, sizeof(MSGRTR_RANGE_BOUND), RangeBoundCompare);
+
+            // the consumers between two bounds are the ones entered and not
+            // yet left:
+            i = 0;
+            while (i < numBounds)
+            {
+                position = bounds[i].bound;
+                for (; i < numBounds && bounds[i].bound == position; i ++)
+                {
+                    RangeSweepApply (&bounds[i], active, activeCount, &numActive);
+                }
+                if (i == numBounds || numActive == 0)
+                {
+                    continue;
+                }
+
+                seg = &segs[numSegs];
+                seg->first          = (ULONG)position;
+                seg->last           = (ULONG)(bounds[i].bound - 1);
+                seg->numConsumers   = numActive;
+                seg->consumers      = (MSGRTR_PIB **)malloc (numActive * sizeof(MSGRTR_PIB *));
+                if (seg->consumers == NULL)
+                {
+                    radMsgLog(PRI_HIGH, "RangeRebuild: consumer set alloc failed!");
+                    continue;
+                }
+                memcpy (seg->consumers, active, numActive * sizeof(MSGRTR_PIB *));
+                numSegs ++;
+            }
+        }
+
+        free (bounds);
+        free (active);
+        free (activeCount);
+    }
+
+    msgrtrWork.rangeSegs    = segs;
+    msgrtrWork.numRangeSegs = numSegs;
+
+    for (miib = (MSGRTR_MIIB *)radListGetFirst (&msgrtrWork.miibList);
+         miib != NULL;
+         miib = (MSGRTR_MIIB *)radListGetNext (&msgrtrWork.miibList, (NODE *)miib))
+    {
+        miib->rangeSeg = RangeFind (miib->msgID);
+    }
+
+    if (msgrtrWork.shmTable != NULL)
+    {
+        ShmTableRebuild ();
+    }
+    return;
+}
+
+// Add a range subscription (ignores duplicates):
+static int RangeAdd (ULONG first, ULONG last, MSGRTR_PIB *consumer)
+{
+    MSGRTR_RANGE        *range;
+
+    for (range = (MSGRTR_RANGE *)radListGetFirst (&msgrtrWork.rangeList);
+         range != NULL;
+         range = (MSGRTR_RANGE *)radListGetNext (&msgrtrWork.rangeList, (NODE *)range))
+    {
+        if (range->first == first && range->last == last && range->consumer == consumer)
+        {
+            return OK;
+        }
+    }
+
+    range = (MSGRTR_RANGE *)malloc (sizeof(*range));
+    if (range == NULL)
+    {
+        return ERROR;
+    }
+
+    range->first    = first;
+    range->last     = last;
+    range->consumer = consumer;
+    radListAddToEnd (&msgrtrWork.rangeList, (NODE *)range);
+
+    RangeRebuild ();
+    return OK;
+}
+
+// Remove one range subscription; returns OK or ERROR if not found:
+static int RangeRemove (ULONG first, ULONG last, MSGRTR_PIB *consumer)
+{
+    MSGRTR_RANGE        *range;
+
+    for (range = (MSGRTR_RANGE *)radListGetFirst (&msgrtrWork.rangeList);
+         range != NULL;
+         range = (MSGRTR_RANGE *)radListGetNext (&msgrtrWork.rangeList, (NODE *)range))
+    {
+        if (range->first == first && range->last == last && range->consumer == consumer)
+        {
+            radListRemove (&msgrtrWork.rangeList, (NODE *)range);
+            free (range);
+            RangeRebuild ();
+            return OK;
+        }
+    }
+
+    return ERROR;
+}
+
+// Try to hand a local client's spilled messages to its queue, oldest first:
+static void DrainLocal (MSGRTR_PIB *pib)
+{
+    MSGRTR_SPILL_MSG    *spill;
+    int                 retVal;
+
+    while ((spill = (MSGRTR_SPILL_MSG *)radListGetFirst (&pib->spillQueue)) != NULL)
+    {
+        retVal = radProcessQueueSend (pib->queueName, spill->msgID, spill->buffer, spill->length);
+        if (retVal == BUSY)
+        {
+            return;
+        }
+        if (retVal != OK)
+        {
+            radMsgLog(PRI_HIGH, "DrainLocal: %s: radProcessQueueSend failed!",
+                       pib->name);
+            radBufferRls (spill->buffer);
+            pib->rxErrors ++;
+        }
+
+        radListRemove (&pib->spillQueue, (NODE *)spill);
+        free (spill);
+        pib->spillCount --;
+    }
+
+    // caught up, producers can go straight to him again:
+    ShmSlotSpilling (pib, FALSE);
+    return;
+}
+
+// Hold a message for a local client whose queue is full - a 'control' 
+// message (the client is waiting for it) is exempt from the spill limit:
+static void SpillLocal 
+(
+    MSGRTR_PIB          *pib, 
+    ULONG               msgID, 
+    void                *buffer, 
+    UINT                length, 
+    int                 control
+)
+{
+    MSGRTR_SPILL_MSG    *spill;
+
+    // a conflated msgID keeps only its newest message in the queue:
+    if (! control && msgrtrWork.numLvcRules > 0 && 
+        (LvcRuleFlags (msgID, msgID) & MSGRTR_LVC_CONFLATE))
+    {
+        for (spill = (MSGRTR_SPILL_MSG *)radListGetFirst (&pib->spillQueue);
+             spill != NULL;
+             spill = (MSGRTR_SPILL_MSG *)radListGetNext (&pib->spillQueue, (NODE *)spill))
+        {
+            if (spill->msgID == msgID && ! spill->control)
+            {
+                radBufferRls (spill->buffer);
+                spill->buffer   = buffer;
+                spill->length   = length;
+                pib->spillConflated ++;
+                return;
+            }
+        }
+    }
+
+    if (! control && pib->spillCount >= msgrtrWork.spillLimit)
+    {
+        // the oldest message that is not control:
+        spill = (MSGRTR_SPILL_MSG *)radListGetFirst (&pib->spillQueue);
+        while (spill != NULL && spill->control)
+        {
+            spill = (MSGRTR_SPILL_MSG *)radListGetNext (&pib->spillQueue, (NODE *)spill);
+        }
+
+        pib->spillDrops ++;
+        if (msgrtrWork.spillPolicy == MSGRTR_TX_DROP_NEWEST || spill == NULL)
+        {
+            radBufferRls (buffer);
+            return;
+        }
+
+        radListRemove (&pib->spillQueue, (NODE *)spill);
+        radBufferRls (spill->buffer);
+        free (spill);
+        pib->spillCount --;
+    }
+
+    spill = (MSGRTR_SPILL_MSG *)malloc (sizeof(*spill));
+    if (spill == NULL)
+    {
+        radMsgLog(PRI_HIGH, "SpillLocal: %s: malloc failed!", pib->name);
+        radBufferRls (buffer);
+        pib->spillDrops ++;
+        return;
+    }
+
+    spill->msgID    = msgID;
+    spill->buffer   = buffer;
+    spill->length   = length;
+    spill->control  = control;
+    radListAddToEnd (&pib->spillQueue, (NODE *)spill);
+
+    if (pib->spillCount == 0)
+    {
+        // producers must queue behind the backlog, send them through us:
+        ShmSlotSpilling (pib, TRUE);
+    }
+    pib->spillCount ++;
+    if (pib->spillCount > pib->spillPeak)
+    {
+        pib->spillPeak = pib->spillCount;
+    }
+
+    if (msgrtrWork.numWorkers > 0)
+    {
+        // timers belong to the main thread, ask it to start this one:
+        if (! __sync_lock_test_and_set (&msgrtrWork.spillWake, TRUE))
+        {
+            InboxWake ();
+        }
+    }
+    else if (! msgrtrWork.spillPending)
+    {
+        msgrtrWork.spillPending = TRUE;
+        radTimerStart (msgrtrWork.spillTimer, MSGRTR_SPILL_RETRY_INTERVAL);
+    }
+
+    return;
+}
+
+// Deliver a system buffer to a local client without blocking - a full queue
+// spills into the PIB (ownership of 'buffer' passes in either case);
+// returns OK or ERROR:
+static int LocalSend 
+(
+    MSGRTR_PIB          *pib, 
+    ULONG               msgID, 
+    void                *buffer, 
+    UINT                length, 
+    int                 control
+)
+{
+    int                 retVal = OK;
+
+    pthread_mutex_lock (&pib->lock);
+
+    if (pib->spillCount > 0)
+    {
+        // keep the order, the new one waits its turn:
+        DrainLocal (pib);
+        if (pib->spillCount > 0)
+        {
+            SpillLocal (pib, msgID, buffer, length, control);
+            pthread_mutex_unlock (&pib->lock);
+            return OK;
+        }
+    }
+
+    retVal = radProcessQueueSend (pib->queueName, msgID, buffer, length);
+    if (retVal == BUSY)
+    {
+        pib->sendBusy ++;
+        SpillLocal (pib, msgID, buffer, length, control);
+        retVal = OK;
+    }
+    else if (retVal != OK)
+    {
+        radBufferRls (buffer);
+        retVal = ERROR;
+    }
+
+    pthread_mutex_unlock (&pib->lock);
+    return retVal;
+}
+
+static int SendToLocal (MSGRTR_PIB *pib, ULONG msgID, void *buffer, UINT length)
+{
+    return LocalSend (pib, msgID, buffer, length, FALSE);
+}
+
+// An ACK or answer the client is blocked waiting for - it may queue behind 
+// a backlog but the overflow policy never drops it:
+static int SendControlToLocal (MSGRTR_PIB *pib, void *buffer, UINT length)
+{
+    return LocalSend (pib, MSGRTR_INTERNAL_MSGID, buffer, length, TRUE);
+}
+
+// Spill retry timer handler:
+static void spillTimerHandler (void *parm)
+{
+    MSGRTR_PIB          *pib;
+    int                 restart = FALSE;
+
+    msgrtrWork.spillPending = FALSE;
+
+    for (pib = (MSGRTR_PIB *)radListGetFirst (&msgrtrWork.pibList);
+         pib != NULL;
+         pib = (MSGRTR_PIB *)radListGetNext (&msgrtrWork.pibList, (NODE *)pib))
+    {
+        if (pib->type == PIB_TYPE_LOCAL && pib->spillCount > 0)
+        {
+            pthread_mutex_lock (&pib->lock);
+            DrainLocal (pib);
+            if (pib->spillCount > 0)
+            {
+                restart = TRUE;
+            }
+            pthread_mutex_unlock (&pib->lock);
+        }
+    }
+
+    if (restart)
+    {
+        msgrtrWork.spillPending = TRUE;
+        radTimerStart (msgrtrWork.spillTimer, MSGRTR_SPILL_RETRY_INTERVAL);
+    }
+
+    return;
+}
+
+// Rate over the window from a row's history, after recording 'now':
+static UINT StatsRate (ULONG *history, ULONG now)
+{
+    ULONG               ticks = msgrtrWork.stats->updates;
+    ULONG               span = (ticks < MSGRTR_STATS_WINDOW) ? ticks : MSGRTR_STATS_WINDOW;
+    ULONG               then;
+
+    history[ticks % (MSGRTR_STATS_WINDOW+1)] = now;
+    if (span == 0)
+    {
+        return 0;
+    }
+
+    then = history[(ticks - span) % (MSGRTR_STATS_WINDOW+1)];
+    return (UINT)((now - then) * 1000 / (span * MSGRTR_STATS_INTERVAL));
+}
+
+// Stats timer handler - publish rates and consumer rows:
+static void statsTimerHandler (void *parm)
+{
+    MSGRTR_STATS_BLOCK      *stats = msgrtrWork.stats;
+    MSGRTR_STATS_MSGID      *row;
+    MSGRTR_STATS_CONSUMER   *consumer;
+    MSGRTR_SHM_CLIENT       *client;
+    MSGRTR_PIB              *pib;
+    int                     i;
+
+    stats->updates ++;
+
+    for (i = 0; i < MSGRTR_STATS_MSGIDS; i ++)
+    {
+        row = &stats->msgIDs[i];
+        if (row->msgID == 0)
+        {
+            continue;
+        }
+        row->msgRate  = StatsRate (msgrtrWork.statsHistory[i].msgs, row->msgs);
+        row->byteRate = StatsRate (msgrtrWork.statsHistory[i].bytes, row->bytes);
+    }
+
+    stats->sequence ++;
+    __sync_synchronize ();
+
+    i = 0;
+    for (pib = (MSGRTR_PIB *)radListGetFirst (&msgrtrWork.pibList);
+         pib != NULL && i < MSGRTR_STATS_MAX_CONSUMERS;
+         pib = (MSGRTR_PIB *)radListGetNext (&msgrtrWork.pibList, (NODE *)pib))
+    {
+        consumer = &stats->consumers[i++];
+        strncpy (consumer->name, pib->name, PROCESS_MAX_NAME_LEN);
+        consumer->msgs      = pib->receives;
+        consumer->bytes     = pib->rxBytes;
+        consumer->failures  = pib->rxErrors + pib->sendBusy;
+        if (pib->type == PIB_TYPE_LOCAL)
+        {
+            consumer->pid       = pib->pid;
+            consumer->routerID  = 0;
+            consumer->drops     = pib->spillDrops;
+            consumer->lag       = pib->spillCount;
+            if (pib->shmSlot >= 0)
+            {
+                client = &msgrtrWork.shmTable->clients[pib->shmSlot];
+                consumer->msgs     += client->directSends;
+                consumer->bytes    += client->directBytes;
+                consumer->failures += client->directFailures;
+            }
+        }
+        else
+        {
+            consumer->pid       = 0;
+            consumer->routerID  = pib->routerID;
+            consumer->drops     = pib->txDrops;
+            consumer->lag       = pib->txQueueFrames + pib->txFrames;
+        }
+        consumer->msgRate   = StatsRate (pib->history.msgs, consumer->msgs);
+        consumer->byteRate  = StatsRate (pib->history.bytes, consumer->bytes);
+    }
+    stats->numConsumers = i;
+
+    __sync_synchronize ();
+    stats->sequence ++;
+
+    radTimerStart (msgrtrWork.statsTimer, MSGRTR_STATS_INTERVAL);
+    return;
+}
+
+// Send an ack carrying 'ackToken' to a local client:
+static int SendACK (MSGRTR_PIB *dest, ULONG ackToken)
+{
+    MSGRTR_HDR          *hdr;
+    MSGRTR_INTERNAL_MSG *msg;
+
+    hdr = (MSGRTR_HDR *)radBufferGet (sizeof (*hdr) + sizeof(*msg));
+    if (hdr == NULL)
+    {
+        radMsgLog(PRI_HIGH, "SendACK: radBufferGet failed!");
+        return ERROR;
+    }
+
+    hdr->magicNumber        = MSGRTR_MAGIC_NUMBER;
+    hdr->srcpid             = getpid ();
+    hdr->msgID              = MSGRTR_INTERNAL_MSGID;
+    hdr->length             = sizeof (*msg);
+    hdr->flags              = 0;
+    hdr->routerSlots        = 0;
+    hdr->originID           = 0;
+    hdr->originEpoch        = 0;
+    hdr->originSeq          = 0;
+    hdr->correlationID      = 0;
+    hdr->replyRouterID      = 0;
+    hdr->replyPid           = 0;
+
+    msg = (MSGRTR_INTERNAL_MSG *)hdr->msg;
+    memset (msg, 0, sizeof(*msg));
+    msg->subMsgID           = MSGRTR_SUBTYPE_ACK;
+    msg->targetMsgID        = ackToken;
+
+    switch(dest->type)
+    {
+        case PIB_TYPE_LOCAL:
+        {
+            if (SendControlToLocal (dest, hdr, sizeof (*hdr) + sizeof(*msg)) != OK)
+            {
+                return ERROR;
+            }
+            break;
+        }
+        case PIB_TYPE_REMOTE:
+        {
+            // queue behind any frames already waiting for this peer:
+            if (SendToRemote (dest, MSGRTR_INTERNAL_MSGID, msg, sizeof(*msg), NULL) 
+                == ERROR)
+            {
+                radBufferRls (hdr);
+                return ERROR;
+            }
+            radBufferRls(hdr);
+            break;
+        }
+    }
+    return OK;
+}
+
+// Send a MSGRTR_SUBTYPE_MSGID_IS_REGISTERED answer to a local client:
+static int SendIsRegistered (MSGRTR_PIB *dest, int isRegistered)
+{
+    MSGRTR_HDR          *hdr;
+    MSGRTR_INTERNAL_MSG *msg;
+
+    hdr = (MSGRTR_HDR *)radBufferGet (sizeof (*hdr) + sizeof(*msg));
+    if (hdr == NULL)
+    {
+        radMsgLog(PRI_HIGH, "SendIsRegistered: radBufferGet failed!");
+        return ERROR;
+    }
+
+    hdr->magicNumber        = MSGRTR_MAGIC_NUMBER;
+    hdr->srcpid             = getpid ();
+    hdr->msgID              = MSGRTR_INTERNAL_MSGID;
+    hdr->length             = sizeof (*msg);
+    hdr->flags              = 0;
+    hdr->routerSlots        = 0;
+    hdr->originID           = 0;
+    hdr->originEpoch        = 0;
+    hdr->originSeq          = 0;
+    hdr->correlationID      = 0;
+    hdr->replyRouterID      = 0;
+    hdr->replyPid           = 0;
+
+    msg = (MSGRTR_INTERNAL_MSG *)hdr->msg;
+    memset (msg, 0, sizeof(*msg));
+    msg->subMsgID           = MSGRTR_SUBTYPE_MSGID_IS_REGISTERED;
+    msg->isRegistered       = isRegistered;
+
+    switch(dest->type)
+    {
+        case PIB_TYPE_LOCAL:
+        {
+            if (SendControlToLocal (dest, hdr, sizeof (*hdr) + sizeof(*msg)) != OK)
+            {
+                return ERROR;
+            }
+            break;
+        }
+        case PIB_TYPE_REMOTE:
+        {
+            // queue behind any frames already waiting for this peer:
+            if (SendToRemote (dest, MSGRTR_INTERNAL_MSGID, msg, sizeof(*msg), NULL) 
+                == ERROR)
+            {
+                radBufferRls (hdr);
+                return ERROR;
+            }
+            radBufferRls(hdr);
+            break;
+        }
+    }
+    return OK;
+}
+
+// Start an interest announcement for router 'routerID'; it goes to 'only'
+// if given, otherwise to every peer except 'except':
+static void AnnounceBegin
+(
+    MSGRTR_ANNOUNCE *ann,
+    ULONG           subMsgID,
+    ULONG           routerID,
+    ULONG           hops,
+    MSGRTR_PIB      *except,
+    MSGRTR_PIB      *only
+)
+{
+    ann->msg            = (MSGRTR_INTERNAL_INTEREST_MSG *)ann->bfr;
+    ann->msg->subMsgID  = subMsgID;
+    ann->msg->routerID  = routerID;
+    ann->msg->hops      = hops;
+    ann->msg->numItems  = 0;
+    ann->except         = except;
+    ann->only           = only;
+    return;
+}
+
+// Send the items collected so far:
+static void AnnounceFlush (MSGRTR_ANNOUNCE *ann)
+{
+    MSGRTR_PIB          *pib;
+    int                 length;
+
+    if (ann->msg->numItems == 0)
+    {
+        return;
+    }
+
+    length = sizeof(*ann->msg) + (ann->msg->numItems * sizeof(MSGRTR_INTEREST_ITEM));
+    if (ann->only != NULL)
+    {
+        SendToRemote (ann->only, MSGRTR_INTERNAL_MSGID, ann->msg, length, NULL);
+    }
+    else
+    {
+        for (pib = (MSGRTR_PIB *)radListGetFirst (&msgrtrWork.pibList);
+             pib != NULL;
+             pib = (MSGRTR_PIB *)radListGetNext (&msgrtrWork.pibList, (NODE *)pib))
+        {
+            if (pib->type == PIB_TYPE_REMOTE && pib != ann->except)
+            {
+                SendToRemote (pib, MSGRTR_INTERNAL_MSGID, ann->msg, length, NULL);
+            }
+        }
+    }
+
+    ann->msg->numItems = 0;
+    return;
+}
+
+static void AnnounceItem (MSGRTR_ANNOUNCE *ann, ULONG first, ULONG last)
+{
+    if (ann->msg->numItems == MSGRTR_MAX_LIST_MSGIDS)
+    {
+        AnnounceFlush (ann);
+    }
+
+    ann->msg->items[ann->msg->numItems].first  = first;
+    ann->msg->items[ann->msg->numItems].last   = last;
+    ann->msg->numItems ++;
+    return;
+}
+
+static UINT InterestHash (ULONG first, ULONG last, ULONG routerID)
+{
+    return msgrtrHash (first ^ (last << 7) ^ (routerID * 31), MSGRTR_INTEREST_HASH_SIZE);
+}
+
+static MSGRTR_INTEREST *InterestFind (ULONG first, ULONG last, ULONG routerID)
+{
+    MSGRTR_INTEREST     *interest;
+
+    for (interest = msgrtrWork.interestHash[InterestHash(first, last, routerID)];
+         interest != NULL;
+         interest = interest->hashNext)
+    {
+        if (interest->first == first && 
+            interest->last == last && 
+            interest->routerID == routerID)
+        {
+            return interest;
+        }
+    }
+
+    return NULL;
+}
+
+static MSGRTR_INTEREST *InterestAdd
+(
+    ULONG           first,
+    ULONG           last,
+    ULONG           routerID,
+    MSGRTR_PIB      *via,
+    ULONG           hops
+)
+{
+    MSGRTR_INTEREST     *interest;
+    UINT                index;
+
+    interest = (MSGRTR_INTEREST *)malloc (sizeof(*interest));
+    if (interest == NULL)
+    {
+        radMsgLog(PRI_HIGH, "InterestAdd: malloc failed!");
+        return NULL;
+    }
+
+    interest->first     = first;
+    interest->last      = last;
+    interest->routerID  = routerID;
+    interest->via       = via;
+    interest->hops      = hops;
+
+    index = InterestHash (first, last, routerID);
+    interest->hashNext = msgrtrWork.interestHash[index];
+    msgrtrWork.interestHash[index] = interest;
+    radListAddToEnd (&msgrtrWork.interestList, (NODE *)interest);
+
+    return interest;
+}
+
+static void InterestRemove (MSGRTR_INTEREST *interest)
+{
+    MSGRTR_INTEREST     **link;
+
+    for (link = &msgrtrWork.interestHash[InterestHash(interest->first, 
+                                                      interest->last, 
+                                                      interest->routerID)];
+         *link != NULL;
+         link = &(*link)->hashNext)
+    {
+        if (*link == interest)
+        {
+            *link = interest->hashNext;
+            break;
+        }
+    }
+
+    radListRemove (&msgrtrWork.interestList, (NODE *)interest);
+    free (interest);
+    return;
+}
+
+// Is 'peer' the next hop toward any router interested in first..last?
+static int InterestIsVia (ULONG first, ULONG last, MSGRTR_PIB *peer)
+{
+    MSGRTR_INTEREST     *interest;
+
+    for (interest = (MSGRTR_INTEREST *)radListGetFirst (&msgrtrWork.interestList);
+         interest != NULL;
+         interest = (MSGRTR_INTEREST *)radListGetNext (&msgrtrWork.interestList, (NODE *)interest))
+    {
+        if (interest->via == peer && interest->first == first && interest->last == last)
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+// Make a peer a consumer of first..last:
+static void PeerAttach (ULONG first, ULONG last, MSGRTR_PIB *peer)
+{
+    MSGRTR_MIIB         *miib;
+
+    if (first != last)
+    {
+        if (RangeAdd (first, last, peer) == ERROR)
+        {
+            radMsgLog(PRI_HIGH, "PeerAttach: %u-%u: malloc range failed!", first, last);
+        }
+        return;
+    }
+
+    miib = getMIIB (first);
+    if (miib == NULL)
+    {
+        miib = CreateMIIB (first);
+        if (miib == NULL)
+        {
+            radMsgLog(PRI_HIGH, "PeerAttach: %u: malloc MIIB failed!", first);
+            return;
+        }
+    }
+
+    AddClient (miib, peer);
+    return;
+}
+
+// Stop a peer consuming first..last unless it still leads to another 
+// interested router:
+static void PeerDetach (ULONG first, ULONG last, MSGRTR_PIB *peer)
+{
+    MSGRTR_MIIB         *miib;
+
+    if (InterestIsVia (first, last, peer))
+    {
+        return;
+    }
+
+    if (first != last)
+    {
+        RangeRemove (first, last, peer);
+        return;
+    }
+
+    miib = getMIIB (first);
+    if (miib == NULL)
+    {
+        return;
+    }
+
+    RemoveClient (miib, peer);
+    if (miib->numConsumers == 0)
+    {
+        RemoveMIIB (miib);
+    }
+    return;
+}
+
+// Does any local client consume first..last?
+static int LocalInterest (ULONG first, ULONG last)
+{
+    MSGRTR_MIIB         *miib;
+    MSGRTR_RANGE        *range;
+    int                 i;
+
+    if (first == last && (miib = getMIIB (first)) != NULL)
+    {
+        for (i = 0; i < miib->numConsumers; i ++)
+        {
+            if (miib->consumers[i]->type == PIB_TYPE_LOCAL)
+            {
+                return TRUE;
+            }
+        }
+    }
+
+    for (range = (MSGRTR_RANGE *)radListGetFirst (&msgrtrWork.rangeList);
+         range != NULL;
+         range = (MSGRTR_RANGE *)radListGetNext (&msgrtrWork.rangeList, (NODE *)range))
+    {
+        if (range->first == first && range->last == last && 
+            range->consumer->type == PIB_TYPE_LOCAL)
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+// Bring our own interest in first..last up to date, queueing any change on
+// the 'add' or 'del' announcement (either may be NULL):
+static void InterestLocalUpdate
+(
+    ULONG           first,
+    ULONG           last,
+    MSGRTR_ANNOUNCE *add,
+    MSGRTR_ANNOUNCE *del
+)
+{
+    MSGRTR_INTEREST     *interest = InterestFind (first, last, msgrtrWork.routerID);
+    int                 wanted = LocalInterest (first, last);
+
+    if (wanted && interest == NULL)
+    {
+        if (InterestAdd (first, last, msgrtrWork.routerID, NULL, 0) != NULL && add != NULL)
+        {
+            AnnounceItem (add, first, last);
+        }
+    }
+    else if (! wanted && interest != NULL)
+    {
+        InterestRemove (interest);
+        if (del != NULL)
+        {
+            AnnounceItem (del, first, last);
+        }
+    }
+
+    return;
+}
+
+// Announce a change (if any) in our own interest in first..last:
+static void InterestLocalChanged (ULONG first, ULONG last)
+{
+    MSGRTR_ANNOUNCE     add, del;
+
+    AnnounceBegin (&add, MSGRTR_SUBTYPE_INTEREST_ADD, msgrtrWork.routerID, 1, NULL, NULL);
+    AnnounceBegin (&del, MSGRTR_SUBTYPE_INTEREST_DEL, msgrtrWork.routerID, 1, NULL, NULL);
+    InterestLocalUpdate (first, last, &add, &del);
+    AnnounceFlush (&add);
+    AnnounceFlush (&del);
+    return;
+}
+
+// Process an interest announcement from a peer - the first peer we hear a
+// router's interest from becomes our next hop toward it; news is passed on
+// to the other peers, so each router's announcement crosses each link once:
+static void InterestRX (MSGRTR_PIB *peer, MSGRTR_INTERNAL_INTEREST_MSG *msg, ULONG length)
+{
+    MSGRTR_ANNOUNCE     fwd, back;
+    MSGRTR_INTEREST     *interest;
+    ULONG               first, last, backHops = 0;
+    int                 i;
+
+    if (length < sizeof(*msg) || 
+        msg->numItems > MSGRTR_MAX_LIST_MSGIDS ||
+        length < sizeof(*msg) + (msg->numItems * sizeof(MSGRTR_INTEREST_ITEM)))
+    {
+        radMsgLog(PRI_HIGH, "InterestRX: %s: bad length %u", peer->name, length);
+        return;
+    }
+
+    if (msg->routerID == msgrtrWork.routerID || msg->hops >= MSGRTR_MAX_HOPS)
+    {
+        // our own interest coming back, or gone around too far:
+        return;
+    }
+
+    AnnounceBegin (&fwd, msg->subMsgID, msg->routerID, msg->hops + 1, peer, NULL);
+    AnnounceBegin (&back, MSGRTR_SUBTYPE_INTEREST_ADD, msg->routerID, 0, NULL, peer);
+
+    for (i = 0; i < (int)msg->numItems; i ++)
+    {
+        first       = msg->items[i].first;
+        last        = msg->items[i].last;
+        if (first > last)
+        {
+            continue;
+        }
+        interest    = InterestFind (first, last, msg->routerID);
+
+        if (msg->subMsgID == MSGRTR_SUBTYPE_INTEREST_ADD)
+        {
+            if (interest != NULL)
+            {
+                // we already have a path to this router
+                continue;
+            }
+            if (InterestAdd (first, last, msg->routerID, peer, msg->hops) == NULL)
+            {
+                continue;
+            }
+            PeerAttach (first, last, peer);
+            AnnounceItem (&fwd, first, last);
+        }
+        else
+        {
+            if (interest == NULL)
+            {
+                continue;
+            }
+            if (interest->via != peer)
+            {
+                // we still reach the router another way - tell the sender:
+                if (interest->hops + 1 > backHops)
+                {
+                    backHops = interest->hops + 1;
+                }
+                AnnounceItem (&back, first, last);
+                continue;
+            }
+            InterestRemove (interest);
+            PeerDetach (first, last, peer);
+            AnnounceItem (&fwd, first, last);
+        }
+    }
+
+    AnnounceFlush (&fwd);
+    back.msg->hops = backHops;
+    AnnounceFlush (&back);
+    return;
+}
+
+// Tell a new peer about every interest it can reach through us:
+static void InterestSyncPeer (MSGRTR_PIB *peer)
+{
+    MSGRTR_ANNOUNCE     ann;
+    MSGRTR_INTEREST     *interest;
+    int                 started = FALSE;
+
+    for (interest = (MSGRTR_INTEREST *)radListGetFirst (&msgrtrWork.interestList);
+         interest != NULL;
+         interest = (MSGRTR_INTEREST *)radListGetNext (&msgrtrWork.interestList, (NODE *)interest))
+    {
+        if (interest->via == peer)
+        {
+            continue;
+        }
+
+        if (! started || 
+            ann.msg->routerID != interest->routerID ||
+            ann.msg->hops != interest->hops + 1)
+        {
+            if (started)
+            {
+                AnnounceFlush (&ann);
+            }
+            AnnounceBegin (&ann, MSGRTR_SUBTYPE_INTEREST_ADD, 
+                           interest->routerID, interest->hops + 1, NULL, peer);
+            started = TRUE;
+        }
+        AnnounceItem (&ann, interest->first, interest->last);
+    }
+
+    if (started)
+    {
+        AnnounceFlush (&ann);
+    }
+    return;
+}
+
+// Withdraw every interest learned through a peer that went away (its 
+// consumer entries are removed with the PIB):
+static void InterestPeerDown (MSGRTR_PIB *peer)
+{
+    MSGRTR_ANNOUNCE     ann;
+    MSGRTR_INTEREST     *interest, *next;
+    int                 started = FALSE;
+
+    for (interest = (MSGRTR_INTEREST *)radListGetFirst (&msgrtrWork.interestList);
+         interest != NULL;
+         interest = next)
+    {
+        next = (MSGRTR_INTEREST *)radListGetNext (&msgrtrWork.interestList, (NODE *)interest);
+        if (interest->via != peer)
+        {
+            continue;
+        }
+
+        if (! started || ann.msg->routerID != interest->routerID)
+        {
+            if (started)
+            {
+                AnnounceFlush (&ann);
+            }
+            AnnounceBegin (&ann, MSGRTR_SUBTYPE_INTEREST_DEL, 
+                           interest->routerID, interest->hops + 1, peer, NULL);
+            started = TRUE;
+        }
+        AnnounceItem (&ann, interest->first, interest->last);
+        InterestRemove (interest);
+    }
+
+    if (started)
+    {
+        AnnounceFlush (&ann);
+    }
+    return;
+}
+
+// Have we routed this mesh message already (it came over another link)?
+// New ones note 'via' as the way back to their origin:
+static int MeshIsDuplicate (MSGRTR_HDR *hdr, MSGRTR_PIB *via)
+{
+    MSGRTR_ORIGIN       *origin = NULL;
+    UINT                seq = (UINT)hdr->originSeq, bit;
+    int                 i, diff;
+
+    if (seq == 0)
+    {
+        return FALSE;
+    }
+
+    for (i = 0; i < msgrtrWork.numOrigins; i ++)
+    {
+        if (msgrtrWork.origins[i].routerID == hdr->originID)
+        {
+            origin = &msgrtrWork.origins[i];
+            break;
+        }
+    }
+
+    if (origin == NULL)
+    {
+        if (msgrtrWork.numOrigins == MSGRTR_MAX_ORIGINS)
+        {
+            // can't track it, pass it on
+            return FALSE;
+        }
+        origin = &msgrtrWork.origins[msgrtrWork.numOrigins ++];
+        origin->routerID = hdr->originID;
+        origin->epoch    = hdr->originEpoch - 1;
+    }
+
+    if (origin->epoch != hdr->originEpoch)
+    {
+        // new (or restarted) origin:
+        memset (origin->seen, 0, sizeof(origin->seen));
+        origin->epoch   = hdr->originEpoch;
+        origin->highSeq = seq - 1;
+    }
+
+    diff = MSGRTR_SEQ_DIFF(seq, origin->highSeq);
+    if (diff > 0)
+    {
+        if (diff >= MSGRTR_DUP_WINDOW)
+        {
+            memset (origin->seen, 0, sizeof(origin->seen));
+        }
+        else
+        {
+            for (i = 1; i < diff; i ++)
+            {
+                bit = (origin->highSeq + i) % MSGRTR_DUP_WINDOW;
+                origin->seen[bit >> 5] &= ~(1U << (bit & 31));
+            }
+        }
+        origin->highSeq = seq;
+    }
+    else if (-diff >= MSGRTR_DUP_WINDOW)
+    {
+        // too old to tell, assume we had it
+        return TRUE;
+    }
+    else
+    {
+        bit = seq % MSGRTR_DUP_WINDOW;
+        if (origin->seen[bit >> 5] & (1U << (bit & 31)))
+        {
+            return TRUE;
+        }
+    }
+
+    bit = seq % MSGRTR_DUP_WINDOW;
+    origin->seen[bit >> 5] |= (1U << (bit & 31));
+    origin->via = via;
+    return FALSE;
+}
+
+// Which link leads back to 'routerID' (NULL if we have not heard from it):
+static MSGRTR_PIB *MeshRouteBack (ULONG routerID)
+{
+    MSGRTR_PIB          *via = NULL;
+    int                 i;
+
+    pthread_mutex_lock (&msgrtrWork.originLock);
+    for (i = 0; i < msgrtrWork.numOrigins; i ++)
+    {
+        if (msgrtrWork.origins[i].routerID == routerID)
+        {
+            via = msgrtrWork.origins[i].via;
+            break;
+        }
+    }
+    pthread_mutex_unlock (&msgrtrWork.originLock);
+    return via;
+}
+
+// Forget the routes back through a link that went away:
+static void MeshLinkDown (MSGRTR_PIB *pib)
+{
+    int                 i;
+
+    pthread_mutex_lock (&msgrtrWork.originLock);
+    for (i = 0; i < msgrtrWork.numOrigins; i ++)
+    {
+        if (msgrtrWork.origins[i].via == pib)
+        {
+            msgrtrWork.origins[i].via = NULL;
+        }
+    }
+    pthread_mutex_unlock (&msgrtrWork.originLock);
+    return;
+}
+
+// Should a message from a peer be routed - drop what came around a loop or 
+// over a second path (any thread); 'pib' is the link it came over:
+static int MeshAccept (MSGRTR_HDR *hdr, MSGRTR_PIB *pib)
+{
+    int                 duplicate;
+
+    if (hdr->originID == msgrtrWork.routerID)
+    {
+        MSGRTR_COUNT(msgrtrWork.duplicates);
+        return FALSE;
+    }
+
+    pthread_mutex_lock (&msgrtrWork.originLock);
+    duplicate = MeshIsDuplicate (hdr, pib);
+    pthread_mutex_unlock (&msgrtrWork.originLock);
+
+    if (duplicate)
+    {
+        MSGRTR_COUNT(msgrtrWork.duplicates);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Send a message to a client, local or remote:
+static int SendToClient(MSGRTR_PIB *consumer, MSGRTR_HDR* hdr)
+{
+    UCHAR*          sendBfr;
+    int             length  = hdr->length;
+
+    switch(consumer->type)
+    {
+        case PIB_TYPE_LOCAL:
+        {
+            if (hdr->flags & MSGRTR_FLAG_RPC)
+            {
+                // the API needs the header to match or answer it:
+                sendBfr = (UCHAR*)radBufferGet(sizeof(*hdr) + length);
+                if (sendBfr == NULL)
+                {
+                    radMsgLog(PRI_HIGH, "SendToClient: radBufferGet failed!");
+                    return ERROR;
+                }
+                memcpy(sendBfr, hdr, sizeof(*hdr) + length);
+
+                if (SendToLocal (consumer, MSGRTR_INTERNAL_MSGID, sendBfr, 
+                                 sizeof(*hdr) + length) 
+                    != OK)
+                {
+                    radMsgLog(PRI_HIGH, "SendToClient: %s: SendToLocal failed!",
+                               consumer->name);
+                    MSGRTR_COUNT(consumer->rxErrors);
+                    return ERROR;
+                }
+                break;
+            }
+
+            sendBfr = (UCHAR*)radBufferGet(length);
+            if (sendBfr == NULL)
+            {
+                radMsgLog(PRI_HIGH, "SendToClient: radBufferGet failed!");
+                return ERROR;
+            }
+            memcpy(sendBfr, hdr->msg, length);
+
+            if (SendToLocal (consumer, hdr->msgID, sendBfr, length) != OK)
+            {
+                radMsgLog(PRI_HIGH, "SendToClient: %s: SendToLocal failed!",
+                           consumer->name);
+                MSGRTR_COUNT(consumer->rxErrors);
+                return ERROR;
+            }
+            break;
+        }
+        case PIB_TYPE_REMOTE:
+        {
+            if (consumer->maxMsgSize < length)
+            {
+                radMsgLog(PRI_HIGH, "SendToClient: %s: msg length %d exceeds remote capability %d!",
+                           consumer->name, length, consumer->maxMsgSize);
+                MSGRTR_COUNT(consumer->rxErrors);
+                return ERROR;
+            }
+
+            if (SendToRemote(consumer, hdr->msgID, hdr->msg, hdr->length, hdr) == ERROR)
+            {
+                radMsgLog(PRI_HIGH, "SendToClient: %s: SendToRemote failed!",
+                           consumer->name);
+                MSGRTR_COUNT(consumer->rxErrors);
+                return ERROR;
+            }
+            break;
+        }
+        default:
+        {
+            radMsgLog(PRI_HIGH, "SendToClient: unknown PIB type %d",
+                       consumer->type);
+            return ERROR;
+        }
+    }
+
+    MSGRTR_COUNT(consumer->receives);
+    __sync_fetch_and_add (&consumer->rxBytes, length);
+    MSGRTR_COUNT(msgrtrWork.transmits);
+    return OK;
+}
+
+// Remove a consumer from one MIIB (the MIIB is left in place even if empty):
+static void RemoveClient(MSGRTR_MIIB* miib, MSGRTR_PIB* consumer)
+{
+    int             i;
+
+    for (i = 0; i < miib->numConsumers; i ++)
+    {
+        if (miib->consumers[i] == consumer)
+        {
+            // got 'em - keep the delivery order of the remaining consumers:
+            memmove (&miib->consumers[i], 
+                     &miib->consumers[i+1], 
+                     (miib->numConsumers - i - 1) * sizeof(MSGRTR_PIB *));
+            miib->numConsumers --;
+            ShmTableUpdate (miib->msgID, miib);
+            break;
+        }
+    }
+
+    for (i = 0; i < consumer->numSubs; i ++)
+    {
+        if (consumer->subs[i] == miib->msgID)
+        {
+            consumer->subs[i] = consumer->subs[consumer->numSubs - 1];
+            consumer->numSubs --;
+            break;
+        }
+    }
+
+    return;
+}
+
+// Remove a given client from all msgID lists (and ranges), withdrawing 
+// whatever interest of ours goes away with a local client:
+static void RemoveClientFromAllMsgs(MSGRTR_PIB *consumer)
+{
+    MSGRTR_MIIB     *miib;
+    MSGRTR_RANGE    *range, *next;
+    MSGRTR_ANNOUNCE del;
+    ULONG           msgID, first, last;
+    int             removed = FALSE;
+
+    AnnounceBegin (&del, MSGRTR_SUBTYPE_INTEREST_DEL, msgrtrWork.routerID, 1, NULL, NULL);
+
+    // only visit the msgIDs this client actually consumes:
+    while (consumer->numSubs > 0)
+    {
+        msgID = consumer->subs[consumer->numSubs - 1];
+        miib = getMIIB(msgID);
+        if (miib == NULL)
+        {
+            // should not happen, but don't spin on it:
+            consumer->numSubs --;
+            continue;
+        }
+
+        RemoveClient(miib, consumer);
+
+        // if the consumer list is empty, remove the MIIB
+        if (miib->numConsumers == 0)
+        {
+            RemoveMIIB(miib);
+        }
+
+        if (consumer->type == PIB_TYPE_LOCAL)
+        {
+            InterestLocalUpdate (msgID, msgID, NULL, &del);
+        }
+    }
+
+    for (range = (MSGRTR_RANGE *)radListGetFirst (&msgrtrWork.rangeList);
+         range != NULL;
+         range = next)
+    {
+        next = (MSGRTR_RANGE *)radListGetNext (&msgrtrWork.rangeList, (NODE *)range);
+        if (range->consumer == consumer)
+        {
+            first = range->first;
+            last  = range->last;
+            radListRemove (&msgrtrWork.rangeList, (NODE *)range);
+            free (range);
+            removed = TRUE;
+
+            if (consumer->type == PIB_TYPE_LOCAL)
+            {
+                InterestLocalUpdate (first, last, NULL, &del);
+            }
+        }
+    }
+
+    if (removed)
+    {
+        RangeRebuild ();
+    }
+
+    AnnounceFlush (&del);
+    return;
+}
+
+// Add a client to a msgID list (check for duplicate):
+static void AddClient(MSGRTR_MIIB* miib, MSGRTR_PIB* consumer)
+{
+    int             i;
+
+    // check the consumer set for this msgID:
+    for (i = 0; i < miib->numConsumers; i ++)
+    {
+        if (miib->consumers[i] == consumer)
+        {
+            // He's already here, just return:
+            return;
+        }
+    }
+
+    // If here, we need to add him:
+    if (SetAppend((void **)&miib->consumers, 
+                  &miib->numConsumers, 
+                  &miib->maxConsumers, 
+                  sizeof(MSGRTR_PIB *),
+                  &consumer)
+        == ERROR)
+    {
+        radMsgLog(PRI_HIGH, "AddClient: %u: consumer set alloc failed!",
+                   miib->msgID);
+        return;
+    }
+
+    if (SetAppend((void **)&consumer->subs, 
+                  &consumer->numSubs, 
+                  &consumer->maxSubs, 
+                  sizeof(ULONG),
+                  &miib->msgID)
+        == ERROR)
+    {
+        radMsgLog(PRI_HIGH, "AddClient: %u: subscription set alloc failed!",
+                   miib->msgID);
+        miib->numConsumers --;
+        return;
+    }
+
+    ShmTableUpdate (miib->msgID, miib);
+    return;
+}
+
+// Finish the current capture segment, trimming the file to what was used:
+static void CaptureSegmentClose (void)
+{
+    ULONGLONG       used;
+
+    if (msgrtrWork.captureMap == NULL)
+    {
+        return;
+    }
+
+    used = msgrtrWork.captureMap->used;
+    munmap (msgrtrWork.captureMap, msgrtrWork.captureSegmentBytes);
+    msgrtrWork.captureMap = NULL;
+    if (ftruncate (msgrtrWork.captureFd, (off_t)used) == -1)
+    {
+        radMsgLog(PRI_MEDIUM, "CaptureSegmentClose: ftruncate failed: %s", 
+                   strerror(errno));
+    }
+    close (msgrtrWork.captureFd);
+    msgrtrWork.captureFd = -1;
+    return;
+}
+
+// Start capture segment 'number', removing the oldest one kept:
+static int CaptureSegmentOpen (ULONG number)
+{
+    char            name[300];
+    struct timeval  tv;
+    void            *map;
+    int             fd;
+
+    if (msgrtrWork.captureSegments > 0 && number >= (ULONG)msgrtrWork.captureSegments)
+    {
+        sprintf (name, "%s.%6.6lu", msgrtrWork.captureBase, 
+                 number - msgrtrWork.captureSegments);
+        unlink (name);
+    }
+
+    sprintf (name, "%s.%6.6lu", msgrtrWork.captureBase, number);
+    fd = open (name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+    {
+        radMsgLog(PRI_HIGH, "CaptureSegmentOpen: open %s failed: %s", 
+                   name, strerror(errno));
+        return ERROR;
+    }
+    if (ftruncate (fd, (off_t)msgrtrWork.captureSegmentBytes) == -1)
+    {
+        radMsgLog(PRI_HIGH, "CaptureSegmentOpen: ftruncate %s failed: %s", 
+                   name, strerror(errno));
+        close (fd);
+        return ERROR;
+    }
+
+    map = mmap (NULL, msgrtrWork.captureSegmentBytes, PROT_READ | PROT_WRITE, 
+                MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        radMsgLog(PRI_HIGH, "CaptureSegmentOpen: mmap %s failed: %s", 
+                   name, strerror(errno));
+        close (fd);
+        return ERROR;
+    }
+
+    gettimeofday (&tv, NULL);
+    msgrtrWork.captureFd            = fd;
+    msgrtrWork.captureMap           = (MSGRTR_CAPTURE_SEGMENT *)map;
+    msgrtrWork.captureNumber        = number;
+    msgrtrWork.captureMap->magic    = MSGRTR_CAPTURE_MAGIC;
+    msgrtrWork.captureMap->version  = MSGRTR_CAPTURE_VERSION;
+    msgrtrWork.captureMap->segment  = number;
+    msgrtrWork.captureMap->routerID = msgrtrWork.routerID;
+    msgrtrWork.captureMap->started  = (ULONGLONG)tv.tv_sec * 1000000 + tv.tv_usec;
+    msgrtrWork.captureMap->used     = sizeof(MSGRTR_CAPTURE_SEGMENT);
+    msgrtrWork.captureMap->records  = 0;
+    msgrtrWork.captureMap->hdrSize  = sizeof(MSGRTR_HDR);
+    return OK;
+}
+
+// Stop capturing (the routing threads must be stopped):
+static void CaptureClose (void)
+{
+    if (msgrtrWork.captureBase[0] == 0)
+    {
+        return;
+    }
+
+    CaptureSegmentClose ();
+    msgrtrWork.captureBase[0] = 0;
+    return;
+}
+
+// Append a routed message to the capture (any routing thread) - it is 
+// copied straight from the routing buffer into the mapped segment:
+static void CaptureMessage (MSGRTR_HDR *hdr)
+{
+    MSGRTR_CAPTURE_RECORD   *record;
+    struct timeval          tv;
+    ULONG                   length;
+
+    length = (sizeof(*record) + sizeof(*hdr) + hdr->length + 7) & ~7UL;
+    gettimeofday (&tv, NULL);
+
+    pthread_mutex_lock (&msgrtrWork.captureLock);
+
+    if (msgrtrWork.captureMap != NULL &&
+        msgrtrWork.captureMap->used + length > msgrtrWork.captureSegmentBytes &&
+        length <= msgrtrWork.captureSegmentBytes - sizeof(MSGRTR_CAPTURE_SEGMENT))
+    {
+        // this one is full, start the next:
+        CaptureSegmentClose ();
+        if (CaptureSegmentOpen (msgrtrWork.captureNumber + 1) == ERROR)
+        {
+            radMsgLog(PRI_HIGH, "CaptureMessage: capture stopped!");
+        }
+    }
+
+    if (msgrtrWork.captureMap == NULL ||
+        msgrtrWork.captureMap->used + length > msgrtrWork.captureSegmentBytes)
+    {
+        msgrtrWork.captureDrops ++;
+        pthread_mutex_unlock (&msgrtrWork.captureLock);
+        return;
+    }
+
+    record = (MSGRTR_CAPTURE_RECORD *)
+             ((UCHAR *)msgrtrWork.captureMap + msgrtrWork.captureMap->used);
+    record->timestamp       = (ULONGLONG)tv.tv_sec * 1000000 + tv.tv_usec;
+    record->recordLength    = length;
+    record->reserved        = 0;
+    memcpy (record + 1, hdr, sizeof(*hdr) + hdr->length);
+
+    // readers trust 'used', so it moves only after the record is complete:
+    __sync_synchronize ();
+    msgrtrWork.captureMap->used += length;
+    msgrtrWork.captureMap->records ++;
+    msgrtrWork.captureRecords ++;
+
+    pthread_mutex_unlock (&msgrtrWork.captureLock);
+    return;
+}
+
+// Build the name of the spool file for peer 'routerID':
+static void SpoolFileName (ULONG routerID, char *name)
+{
+    sprintf (name, "%s/%s.%8.8lX", msgrtrWork.spoolDir, MSGRTR_SPOOL_FILE_NAME, routerID);
+    return;
+}
+
+// Map a spool's ring file, keeping what an earlier run left in it:
+static int SpoolOpen (MSGRTR_SPOOL *spool)
+{
+    char            name[300];
+    struct stat     fileData;
+    off_t           fileSize = sizeof(MSGRTR_SPOOL_FILE) + msgrtrWork.spoolBytes;
+    void            *map;
+    int             fd;
+
+    SpoolFileName (spool->routerID, name);
+    fd = open (name, O_RDWR | O_CREAT, 0644);
+    if (fd == -1 || fstat (fd, &fileData) == -1)
+    {
+        radMsgLog(PRI_HIGH, "SpoolOpen: %s: %s", name, strerror(errno));
+        if (fd != -1)
+        {
+            close (fd);
+        }
+        return ERROR;
+    }
+    if (fileData.st_size != fileSize && ftruncate (fd, fileSize) == -1)
+    {
+        radMsgLog(PRI_HIGH, "SpoolOpen: ftruncate %s: %s", name, strerror(errno));
+        close (fd);
+        return ERROR;
+    }
+
+    map = mmap (NULL, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        radMsgLog(PRI_HIGH, "SpoolOpen: mmap %s: %s", name, strerror(errno));
+        close (fd);
+        return ERROR;
+    }
+
+    spool->fd   = fd;
+    spool->ring = (MSGRTR_SPOOL_FILE *)map;
+    if (fileData.st_size == fileSize &&
+        spool->ring->magic == MSGRTR_SPOOL_MAGIC &&
+        spool->ring->version == MSGRTR_SPOOL_VERSION &&
+        spool->ring->routerID == spool->routerID &&
+        spool->ring->hdrSize == sizeof(MSGRTR_HDR) &&
+        spool->ring->size == msgrtrWork.spoolBytes &&
+        spool->ring->tail - spool->ring->head <= spool->ring->size)
+    {
+        if (spool->ring->records > 0)
+        {
+            radMsgLog(PRI_STATUS, "spool for router %u: %lu messages kept from the last run",
+                       spool->routerID, spool->ring->records);
+        }
+        return OK;
+    }
+
+    // new, resized or not ours - start it empty:
+    memset (spool->ring, 0, sizeof(MSGRTR_SPOOL_FILE));
+    spool->ring->version    = MSGRTR_SPOOL_VERSION;
+    spool->ring->routerID   = spool->routerID;
+    spool->ring->hdrSize    = sizeof(MSGRTR_HDR);
+    spool->ring->size       = msgrtrWork.spoolBytes;
+    __sync_synchronize ();
+    spool->ring->magic      = MSGRTR_SPOOL_MAGIC;
+    return OK;
+}
+
+// Find the spool for peer 'routerID', setting one up if 'create' is TRUE 
+// (main thread, tables locked):
+static MSGRTR_SPOOL *SpoolGet (ULONG routerID, int create)
+{
+    MSGRTR_SPOOL    *spool;
+    int             i;
+
+    for (i = 0; i < msgrtrWork.numSpools; i ++)
+    {
+        if (msgrtrWork.spools[i].routerID == routerID)
+        {
+            return &msgrtrWork.spools[i];
+        }
+    }
+
+    if (! create)
+    {
+        return NULL;
+    }
+    if (msgrtrWork.numSpools == MSGRTR_MAX_SPOOLS)
+    {
+        radMsgLog(PRI_MEDIUM, "SpoolGet: more than %d peers - router %u not spooled",
+                   MSGRTR_MAX_SPOOLS, routerID);
+        return NULL;
+    }
+
+    spool = &msgrtrWork.spools[msgrtrWork.numSpools];
+    memset (spool, 0, sizeof(*spool));
+    spool->routerID = routerID;
+    spool->state    = MSGRTR_SPOOL_IDLE;
+    if (SpoolOpen (spool) == ERROR)
+    {
+        return NULL;
+    }
+    pthread_mutex_init (&spool->lock, NULL);
+    msgrtrWork.numSpools ++;
+    return spool;
+}
+
+// The record at ring offset 'offset':
+static MSGRTR_SPOOL_RECORD *SpoolRecord (MSGRTR_SPOOL_FILE *ring, ULONGLONG offset)
+{
+    return (MSGRTR_SPOOL_RECORD *)((UCHAR *)(ring + 1) + (offset % ring->size));
+}
+
+// Discard the oldest record (spool lock held):
+static void SpoolPop (MSGRTR_SPOOL_FILE *ring, int dropped)
+{
+    MSGRTR_SPOOL_RECORD *record = SpoolRecord (ring, ring->head);
+
+    if ((record->flags & MSGRTR_SPOOL_PAD) == 0)
+    {
+        ring->records --;
+        if (dropped)
+        {
+            ring->drops ++;
+        }
+    }
+    ring->head += record->recordLength;
+    return;
+}
+
+// Append a message to a spool, making room by dropping the oldest (spool 
+// lock held):
+static void SpoolAppend (MSGRTR_SPOOL *spool, MSGRTR_HDR *hdr)
+{
+    MSGRTR_SPOOL_FILE   *ring = spool->ring;
+    MSGRTR_SPOOL_RECORD *record;
+    ULONGLONG           pad;
+    ULONG               length;
+
+    length = (sizeof(*record) + sizeof(*hdr) + hdr->length + 7) & ~7UL;
+    if (length > ring->size / 2)
+    {
+        ring->drops ++;
+        return;
+    }
+
+    // records never wrap, skip the end of the ring if it is too short:
+    pad = ring->size - (ring->tail % ring->size);
+    if (pad >= length)
+    {
+        pad = 0;
+    }
+
+    while (ring->size - (ring->tail - ring->head) < length + pad)
+    {
+        SpoolPop (ring, TRUE);
+    }
+
+    if (pad > 0)
+    {
+        record = SpoolRecord (ring, ring->tail);
+        record->recordLength    = (ULONG)pad;
+        record->flags           = MSGRTR_SPOOL_PAD;
+        ring->tail += pad;
+    }
+
+    record = SpoolRecord (ring, ring->tail);
+    record->recordLength    = length;
+    record->flags           = 0;
+    memcpy (record + 1, hdr, sizeof(*hdr) + hdr->length);
+
+    __sync_synchronize ();
+    ring->tail += length;
+    ring->records ++;
+    spool->spooled ++;
+    return;
+}
+
+// Did the peer consume 'msgID' when its link dropped?
+static int SpoolMatches (MSGRTR_SPOOL *spool, ULONG msgID)
+{
+    int             low = 0, high = spool->numRanges - 1, mid;
+
+    while (low <= high)
+    {
+        mid = (low + high) / 2;
+        if (msgID < spool->ranges[mid].first)
+        {
+            high = mid - 1;
+        }
+        else if (msgID > spool->ranges[mid].last)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// Collect a routed message for every peer whose link is down and which 
+// consumed it (any routing thread):
+static void SpoolCollect (MSGRTR_HDR *hdr)
+{
+    MSGRTR_SPOOL    *spool;
+    int             i;
+
+    for (i = 0; i < msgrtrWork.numSpools; i ++)
+    {
+        spool = &msgrtrWork.spools[i];
+        if (spool->state != MSGRTR_SPOOL_OUTAGE ||
+            spool->routerID == hdr->originID ||
+            ! SpoolMatches (spool, hdr->msgID))
+        {
+            continue;
+        }
+
+        pthread_mutex_lock (&spool->lock);
+        SpoolAppend (spool, hdr);
+        pthread_mutex_unlock (&spool->lock);
+    }
+    return;
+}
+
+// Queue a message for a peer behind its draining spool; returns FALSE if 
+// the spool has drained meanwhile and the message should be sent (any 
+// routing thread):
+static int SpoolDivert (MSGRTR_SPOOL *spool, MSGRTR_HDR *hdr)
+{
+    int             diverted = FALSE;
+
+    pthread_mutex_lock (&spool->lock);
+    if (spool->state == MSGRTR_SPOOL_DRAINING)
+    {
+        SpoolAppend (spool, hdr);
+        diverted = TRUE;
+    }
+    pthread_mutex_unlock (&spool->lock);
+    return diverted;
+}
+
+static int SpoolRangeCompare (const void *a, const void *b)
+{
+    const MSGRTR_SPOOL_RANGE *ra = (const MSGRTR_SPOOL_RANGE *)a;
+    const MSGRTR_SPOOL_RANGE *rb = (const MSGRTR_SPOOL_RANGE *)b;
+
+    return (ra->first < rb->first) ? -1 : (ra->first > rb->first) ? 1 : 0;
+}
+
+// A peer's link failed - start collecting what it consumed (main thread, 
+// tables locked, before its consumer entries are removed):
+static void SpoolLinkDown (MSGRTR_PIB *pib)
+{
+    MSGRTR_SPOOL        *spool;
+    MSGRTR_SPOOL_RANGE  *ranges;
+    MSGRTR_RANGE        *range;
+    int                 i, count = pib->numSubs;
+
+    if (msgrtrWork.spoolBytes == 0 || pib->routerID == 0)
+    {
+        return;
+    }
+
+    for (range = (MSGRTR_RANGE *)radListGetFirst (&msgrtrWork.rangeList);
+         range != NULL;
+         range = (MSGRTR_RANGE *)radListGetNext (&msgrtrWork.rangeList, (NODE *)range))
+    {
+        if (range->consumer == pib)
+        {
+            count ++;
+        }
+    }
+
+    // a peer that consumed nothing only needs a spool if it has one already:
+    spool = SpoolGet (pib->routerID, (count > 0));
+    if (spool == NULL)
+    {
+        return;
+    }
+
+    ranges = (MSGRTR_SPOOL_RANGE *)malloc ((count + 1) * sizeof(*ranges));
+    if (ranges == NULL)
+    {
+        radMsgLog(PRI_HIGH, "SpoolLinkDown: malloc failed - router %u not spooled!", 
+                   pib->routerID);
+        return;
+    }
+
+    count = 0;
+    for (i = 0; i < pib->numSubs; i ++)
+    {
+        ranges[count].first = ranges[count].last = pib->subs[i];
+        count ++;
+    }
+    for (range = (MSGRTR_RANGE *)radListGetFirst (&msgrtrWork.rangeList);
+         range != NULL;
+         range = (MSGRTR_RANGE *)radListGetNext (&msgrtrWork.rangeList, (NODE *)range))
+    {
+        if (range->consumer == pib)
+        {
+            ranges[count].first = range->first;
+            ranges[count].last  = range->last;
+            count ++;
+        }
+    }
+
+    // sort and merge them for SpoolMatches:
+    qsort (ranges, count, sizeof(*ranges), SpoolRangeCompare);
+    for (i = 1, spool->numRanges = (count > 0) ? 1 : 0; i < count; i ++)
+    {
+        if (ranges[i].first <= ranges[spool->numRanges-1].last + 1 &&
+            ranges[spool->numRanges-1].last != 0xFFFFFFFF)
+        {
+            if (ranges[i].last > ranges[spool->numRanges-1].last)
+            {
+                ranges[spool->numRanges-1].last = ranges[i].last;
+            }
+        }
+        else if (ranges[i].first > ranges[spool->numRanges-1].last)
+        {
+            ranges[spool->numRanges ++] = ranges[i];
+        }
+    }
+    free (spool->ranges);
+    spool->ranges = ranges;
+
+    pthread_mutex_lock (&spool->lock);
+    if (spool->state != MSGRTR_SPOOL_OUTAGE)
+    {
+        msgrtrWork.numOutages ++;
+    }
+    spool->state    = MSGRTR_SPOOL_OUTAGE;
+    spool->pib      = NULL;
+    pib->spool      = NULL;
+    pthread_mutex_unlock (&spool->lock);
+
+    radMsgLog(PRI_STATUS, "spooling for router %u (%d msgID ranges)",
+               spool->routerID, spool->numRanges);
+    return;
+}
+
+// A peer linked up - send it what was spooled for it first (main thread, 
+// tables locked):
+static void SpoolLinkUp (MSGRTR_PIB *pib)
+{
+    MSGRTR_SPOOL    *spool;
+    struct stat     fileData;
+    char            name[300];
+
+    if (msgrtrWork.spoolBytes == 0 || pib->routerID == 0)
+    {
+        return;
+    }
+
+    spool = SpoolGet (pib->routerID, FALSE);
+    if (spool == NULL)
+    {
+        // maybe one from our last run:
+        SpoolFileName (pib->routerID, name);
+        if (stat (name, &fileData) != 0 || 
+            (spool = SpoolGet (pib->routerID, TRUE)) == NULL)
+        {
+            return;
+        }
+    }
+
+    pthread_mutex_lock (&spool->lock);
+    if (spool->state == MSGRTR_SPOOL_OUTAGE)
+    {
+        msgrtrWork.numOutages --;
+    }
+    if (spool->ring->head == spool->ring->tail)
+    {
+        spool->state = MSGRTR_SPOOL_IDLE;
+    }
+    else
+    {
+        spool->state    = MSGRTR_SPOOL_DRAINING;
+        spool->pib      = pib;
+        pib->spool      = spool;
+    }
+    pthread_mutex_unlock (&spool->lock);
+
+    if (spool->state == MSGRTR_SPOOL_DRAINING)
+    {
+        radMsgLog(PRI_STATUS, "sending %lu spooled messages to router %u",
+                   spool->ring->records, spool->routerID);
+        radTimerStart (msgrtrWork.spoolTimer, MSGRTR_SPOOL_DRAIN_INTERVAL);
+    }
+    return;
+}
+
+// Is a peer up with room for spooled messages (routing threads queue to it
+// too, so read its queue under its lock)?
+static int SpoolPeerReady (MSGRTR_PIB *pib)
+{
+    int                 ready;
+
+    pthread_mutex_lock (&pib->lock);
+    ready = (! pib->txDown &&
+             pib->txQueueBytes + pib->txLength < msgrtrWork.txQueueLimit / 2);
+    pthread_mutex_unlock (&pib->lock);
+    return ready;
+}
+
+// Spool drain timer handler - pass spooled messages on as fast as each 
+// link takes them, a batch at a time so local routing carries on:
+static void spoolTimerHandler (void *parm)
+{
+    MSGRTR_SPOOL        *spool;
+    MSGRTR_SPOOL_FILE   *ring;
+    MSGRTR_SPOOL_RECORD *record;
+    MSGRTR_HDR          *hdr;
+    MSGRTR_PIB          *pib;
+    int                 i, sent, restart = FALSE;
+
+    for (i = 0; i < msgrtrWork.numSpools; i ++)
+    {
+        spool = &msgrtrWork.spools[i];
+        if (spool->state != MSGRTR_SPOOL_DRAINING)
+        {
+            continue;
+        }
+
+        pib     = spool->pib;
+        ring    = spool->ring;
+        pthread_mutex_lock (&spool->lock);
+
+        for (sent = 0; 
+             sent < MSGRTR_SPOOL_DRAIN_BATCH && ring->head != ring->tail &&
+             SpoolPeerReady (pib);
+             )
+        {
+            record = SpoolRecord (ring, ring->head);
+            if ((record->flags & MSGRTR_SPOOL_PAD) == 0)
+            {
+                hdr = (MSGRTR_HDR *)(record + 1);
+                SendToRemote (pib, hdr->msgID, hdr->msg, hdr->length, hdr);
+                spool->drained ++;
+                sent ++;
+            }
+            SpoolPop (ring, FALSE);
+        }
+
+        if (ring->head == ring->tail)
+        {
+            radMsgLog(PRI_STATUS, "spool for router %u drained", spool->routerID);
+            spool->state    = MSGRTR_SPOOL_IDLE;
+            spool->pib      = NULL;
+            pib->spool      = NULL;
+        }
+        else
+        {
+            restart = TRUE;
+        }
+
+        pthread_mutex_unlock (&spool->lock);
+    }
+
+    if (restart)
+    {
+        radTimerStart (msgrtrWork.spoolTimer, MSGRTR_SPOOL_DRAIN_INTERVAL);
+    }
+    return;
+}
+
+// Unmap the spools at exit (what is in them stays for the next run):
+static void SpoolCloseAll (void)
+{
+    int             i;
+
+    for (i = 0; i < msgrtrWork.numSpools; i ++)
+    {
+        munmap (msgrtrWork.spools[i].ring, 
+                sizeof(MSGRTR_SPOOL_FILE) + msgrtrWork.spoolBytes);
+        close (msgrtrWork.spools[i].fd);
+    }
+    msgrtrWork.numSpools = 0;
+    return;
+}
+
+// Send a multicast control datagram (HEARTBEAT, NAK or LOST) to 'dest':
+static void McastSendControl
+(
+    ULONG               type,
+    ULONG               epoch,
+    UINT                seq,
+    ULONG               count,
+    struct sockaddr_in  *dest
+)
+{
+    MSGRTR_MCAST_HDR    mhdr;
+
+    mhdr.magic      = htonl(MSGRTR_MCAST_MAGIC);
+    mhdr.type       = htonl(type);
+    mhdr.routerID   = htonl(msgrtrWork.routerID);
+    mhdr.epoch      = htonl(epoch);
+    mhdr.seq        = htonl(seq);
+    mhdr.count      = htonl(count);
+    radUDPSocketSendToAddress (msgrtrWork.mcastTxSock, dest, &mhdr, sizeof(mhdr));
+    return;
+}
+
+// Publish a message once on the multicast group (any routing thread) - 
+// the datagram is built in the history ring so NAKs can be answered from 
+// it; returns OK or ERROR:
+static int McastSend (MSGRTR_HDR *hdr)
+{
+    MSGRTR_MCAST_HDR    *mhdr;
+    MSGRTR_MCAST_SENT   *slot;
+    ULONG               size = msgrtrWork.mcastHistoryBytes;
+    ULONG               pos;
+    int                 length = sizeof(*mhdr) + sizeof(MSGRTR_HDR) + hdr->length;
+    int                 retVal;
+
+    pthread_mutex_lock (&msgrtrWork.mcastLock);
+
+    // records are kept whole, one that won't fit at the end goes first:
+    pos = msgrtrWork.mcastTail % size;
+    if (pos + length > size)
+    {
+        msgrtrWork.mcastTail += size - pos;
+        pos = 0;
+    }
+
+    msgrtrWork.mcastSeq ++;
+    mhdr = (MSGRTR_MCAST_HDR *)(msgrtrWork.mcastHistory + pos);
+    mhdr->magic     = htonl(MSGRTR_MCAST_MAGIC);
+    mhdr->type      = htonl(MSGRTR_MCAST_DATA);
+    mhdr->routerID  = htonl(msgrtrWork.routerID);
+    mhdr->epoch     = htonl(msgrtrWork.epoch);
+    mhdr->seq       = htonl(msgrtrWork.mcastSeq);
+    mhdr->count     = htonl(1);
+    HdrHtoN ((MSGRTR_HDR *)(mhdr + 1), hdr->msgID, hdr->length, hdr);
+    memcpy ((UCHAR *)(mhdr + 1) + sizeof(MSGRTR_HDR), hdr->msg, hdr->length);
+
+    slot = &msgrtrWork.mcastSent[msgrtrWork.mcastSeq % MSGRTR_MCAST_HISTORY_SLOTS];
+    slot->seq       = msgrtrWork.mcastSeq;
+    slot->length    = length;
+    slot->offset    = msgrtrWork.mcastTail;
+    msgrtrWork.mcastTail += (length + 7) & ~7;
+
+    // a failed send is still in the history, receivers will NAK it if the 
+    // caller's TCP fallback doesn't get there first:
+    retVal = radUDPSocketSendToAddress (msgrtrWork.mcastTxSock, 
+                                        &msgrtrWork.mcastAdrs, 
+                                        mhdr, length);
+    msgrtrWork.mcastSends ++;
+    msgrtrWork.mcastBytes += length;
+
+    pthread_mutex_unlock (&msgrtrWork.mcastLock);
+    return retVal;
+}
+
+// Send a message to the group routers RouteToConsumers collected: once on 
+// the group if there are enough of them, else over their links; returns 
+// the number sent, adds the number that failed to 'failures':
+static int McastFanOut
+(
+    MSGRTR_HDR      *hdr,
+    MSGRTR_PIB      **peers,
+    int             numPeers,
+    int             *failures
+)
+{
+    int             i, sent = 0;
+
+    if (numPeers >= msgrtrWork.mcastMinPeers && McastSend (hdr) == OK)
+    {
+        for (i = 0; i < numPeers; i ++)
+        {
+            MSGRTR_COUNT(peers[i]->receives);
+            __sync_fetch_and_add (&peers[i]->rxBytes, hdr->length);
+            MSGRTR_COUNT(msgrtrWork.transmits);
+        }
+        __sync_fetch_and_add (&msgrtrWork.mcastPeerSends, numPeers);
+        return numPeers;
+    }
+
+    for (i = 0; i < numPeers; i ++)
+    {
+        if (SendToClient(peers[i], hdr) == ERROR)
+        {
+            radMsgLog(PRI_HIGH, "McastFanOut: %s: SendToClient failed!",
+                      peers[i]->name);
+            (*failures) ++;
+        }
+        else
+        {
+            sent ++;
+        }
+    }
+
+    return sent;
+}
+
+// Answer a NAK from 'to' (main thread) - resend what the history still 
+// holds of seq..seq+count-1, and say which are gone:
+static void McastResend (UINT seq, ULONG count, struct sockaddr_in *to)
+{
+    MSGRTR_MCAST_SENT   *slot;
+    UINT                lostSeq = 0;
+    ULONG               numLost = 0, i;
+
+    if (count > MSGRTR_MCAST_MAX_NAK)
+    {
+        count = MSGRTR_MCAST_MAX_NAK;
+    }
+
+    pthread_mutex_lock (&msgrtrWork.mcastLock);
+    msgrtrWork.mcastNaksRx ++;
+
+    for (i = 0; i < count; i ++, seq ++)
+    {
+        slot = &msgrtrWork.mcastSent[seq % MSGRTR_MCAST_HISTORY_SLOTS];
+        if (slot->seq == seq && slot->length > 0 && 
+            MSGRTR_SEQ_DIFF(msgrtrWork.mcastSeq, seq) >= 0 &&
+            msgrtrWork.mcastTail - slot->offset <= msgrtrWork.mcastHistoryBytes)
+        {
+            if (numLost > 0)
+            {
+                McastSendControl (MSGRTR_MCAST_LOST, msgrtrWork.epoch, 
+                                  lostSeq, numLost, to);
+                numLost = 0;
+            }
+            radUDPSocketSendToAddress (msgrtrWork.mcastTxSock, to,
+                                       msgrtrWork.mcastHistory + 
+                                       (slot->offset % msgrtrWork.mcastHistoryBytes),
+                                       slot->length);
+            msgrtrWork.mcastResends ++;
+        }
+        else
+        {
+            // overwritten, or never sent
+            if (numLost == 0)
+            {
+                lostSeq = seq;
+            }
+            numLost ++;
+            msgrtrWork.mcastGone ++;
+        }
+    }
+    if (numLost > 0)
+    {
+        McastSendControl (MSGRTR_MCAST_LOST, msgrtrWork.epoch, lostSeq, numLost, to);
+    }
+
+    pthread_mutex_unlock (&msgrtrWork.mcastLock);
+    return;
+}
+
+// Remember the last message for a cached msgID (any routing thread):
+static void LvcUpdate (MSGRTR_HDR *hdr)
+{
+    MSGRTR_LVC      *lvc;
+    UCHAR           *data;
+    int             index = msgrtrHash (hdr->msgID, MSGRTR_LVC_HASH_SIZE);
+
+    pthread_mutex_lock (&msgrtrWork.lvcLock);
+
+    for (lvc = msgrtrWork.lvcHash[index]; lvc != NULL; lvc = lvc->hashNext)
+    {
+        if (lvc->msgID == hdr->msgID)
+        {
+            break;
+        }
+    }
+
+    if (lvc == NULL)
+    {
+        lvc = (MSGRTR_LVC *)malloc (sizeof(*lvc));
+        if (lvc == NULL)
+        {
+            radMsgLog(PRI_HIGH, "LvcUpdate: malloc failed!");
+            pthread_mutex_unlock (&msgrtrWork.lvcLock);
+            return;
+        }
+        memset (lvc, 0, sizeof(*lvc));
+        lvc->msgID = hdr->msgID;
+        lvc->hashNext = msgrtrWork.lvcHash[index];
+        msgrtrWork.lvcHash[index] = lvc;
+        radListAddToEnd (&msgrtrWork.lvcList, (NODE *)lvc);
+    }
+
+    if (lvc->size < hdr->length)
+    {
+        data = (UCHAR *)realloc (lvc->data, hdr->length);
+        if (data == NULL)
+        {
+            radMsgLog(PRI_HIGH, "LvcUpdate: %u: realloc failed!", hdr->msgID);
+            pthread_mutex_unlock (&msgrtrWork.lvcLock);
+            return;
+        }
+        msgrtrWork.lvcBytes += hdr->length - lvc->size;
+        lvc->data = data;
+        lvc->size = hdr->length;
+    }
+
+    memcpy (lvc->data, hdr->msg, hdr->length);
+    lvc->length = hdr->length;
+
+    pthread_mutex_unlock (&msgrtrWork.lvcLock);
+    return;
+}
+
+// Deliver the cached messages for first..last to a consumer that just 
+// registered for them (main thread):
+static void LvcReplay (MSGRTR_PIB *pib, ULONG first, ULONG last)
+{
+    MSGRTR_LVC      *lvc;
+    MSGRTR_FILTER   *filter;
+    UCHAR           *sendBfr;
+
+    if (pib->type != PIB_TYPE_LOCAL || 
+        radListGetNumberOfNodes (&msgrtrWork.lvcList) == 0 ||
+        (LvcRuleFlags (first, last) & MSGRTR_LVC_CACHE) == 0)
+    {
+        return;
+    }
+
+    pthread_mutex_lock (&msgrtrWork.lvcLock);
+
+    if (first == last)
+    {
+        lvc = msgrtrWork.lvcHash[msgrtrHash (first, MSGRTR_LVC_HASH_SIZE)];
+    }
+    else
+    {
+        lvc = (MSGRTR_LVC *)radListGetFirst (&msgrtrWork.lvcList);
+    }
+
+    // the hash chain or the whole list, bounded by the cached msgIDs:
+    for (; lvc != NULL; 
+         lvc = (first == last) ? lvc->hashNext : 
+                (MSGRTR_LVC *)radListGetNext (&msgrtrWork.lvcList, (NODE *)lvc))
+    {
+        if (lvc->msgID < first || lvc->msgID > last)
+        {
+            continue;
+        }
+
+        filter = (pib->numFilters > 0) ? FilterFind (pib, lvc->msgID) : NULL;
+        if (filter != NULL && ! FilterMatch (filter, lvc->data, lvc->length))
+        {
+            continue;
+        }
+
+        sendBfr = (UCHAR *)radBufferGet (lvc->length);
+        if (sendBfr == NULL)
+        {
+            radMsgLog(PRI_HIGH, "LvcReplay: radBufferGet failed!");
+            break;
+        }
+        memcpy (sendBfr, lvc->data, lvc->length);
+
+        if (SendToLocal (pib, lvc->msgID, sendBfr, lvc->length) == OK)
+        {
+            msgrtrWork.lvcReplays ++;
+        }
+    }
+
+    pthread_mutex_unlock (&msgrtrWork.lvcLock);
+    return;
+}
+
+// Send a routed message to a consumer set; 'lane' is the routing thread's
+// slot in the PIB route marks and 'mark' its number for this message;
+// routers on the multicast group are collected in 'mcastPeers' instead, 
+// if given; returns the number sent, adds the number that failed to 
+// 'failures':
+static int RouteToConsumers
+(
+    MSGRTR_PIB      **consumers,
+    int             numConsumers,
+    MSGRTR_HDR      *hdr,
+    MSGRTR_PIB      *sockpib,
+    int             lane,
+    ULONG           mark,
+    int             *failures,
+    MSGRTR_PIB      **mcastPeers,
+    int             *numMcast
+)
+{
+    MSGRTR_PIB      *consumer;
+    MSGRTR_FILTER   *filter;
+    int             i, sent = 0;
+
+    for (i = 0; i < numConsumers; i ++)
+    {
+        consumer = consumers[i];
+        if (consumer->routeMark[lane] == mark)
+        {
+            // already has it
+            continue;
+        }
+        consumer->routeMark[lane] = mark;
+
+        if (consumer == sockpib)
+        {
+            // Don't send it back to the remote source (we allow local loopback):
+            continue;
+        }
+
+        if (consumer->type == PIB_TYPE_REMOTE && consumer->routerID == hdr->originID)
+        {
+            // nor to the router it started from
+            continue;
+        }
+
+        filter = (consumer->numFilters > 0) ? FilterFind (consumer, hdr->msgID) : NULL;
+
+        if ((hdr->flags & MSGRTR_FLAG_LOCAL_DONE) && consumer->shmSlot >= 0 &&
+            (hdr->routerSlots & (1U << consumer->shmSlot)) == 0 &&
+            filter == NULL)
+        {
+            // the sender already delivered to this one directly:
+            continue;
+        }
+
+        if (filter != NULL && ! FilterMatch (filter, hdr->msg, hdr->length))
+        {
+            // he doesn't want this one
+            MSGRTR_COUNT(consumer->filtered);
+            continue;
+        }
+
+        if (consumer->spool != NULL && SpoolDivert (consumer->spool, hdr))
+        {
+            // it goes after what was spooled for him
+            sent ++;
+            continue;
+        }
+
+        if (mcastPeers != NULL && consumer->type == PIB_TYPE_REMOTE &&
+            (consumer->linkFlags & MSGRTR_LINK_MULTICAST) &&
+            consumer->maxMsgSize >= (int)hdr->length &&
+            *numMcast < MSGRTR_MCAST_MAX_PEERS)
+        {
+            // one datagram on the group may do for all of them
+            mcastPeers[(*numMcast) ++] = consumer;
+            continue;
+        }
+
+        // send it to him
+        if (SendToClient(consumer, hdr) == ERROR)
+        {
+            radMsgLog(PRI_HIGH, "RouteToConsumers: %s: SendToClient failed!",
+                      consumer->name);
+            (*failures) ++;
+        }
+        else
+        {
+            sent ++;
+        }
+    }
+
+    return sent;
+}
+
+// Send a reply straight back toward its requester (any routing thread):
+static void RouteReply (MSGRTR_HDR *hdr, MSGRTR_PIB *srcpib)
+{
+    MSGRTR_PIB      *dest;
+    int             sent = 0, failures = 0;
+
+    if (hdr->replyRouterID == msgrtrWork.routerID)
+    {
+        dest = getPIBByPID (hdr->replyPid);
+    }
+    else
+    {
+        dest = MeshRouteBack (hdr->replyRouterID);
+    }
+
+    if (dest == NULL || (dest == srcpib && dest->type == PIB_TYPE_REMOTE))
+    {
+        // requester gone, or no way back to it
+        MSGRTR_COUNT(srcpib->txErrors);
+        failures = 1;
+    }
+    else
+    {
+        MSGRTR_COUNT(srcpib->transmits);
+        if (SendToClient(dest, hdr) == ERROR)
+        {
+            radMsgLog(PRI_HIGH, "RouteReply: %s: SendToClient failed!", dest->name);
+            failures = 1;
+        }
+        else
+        {
+            sent = 1;
+        }
+    }
+
+    if (msgrtrWork.stats != NULL)
+    {
+        msgrtrStatsRecord (msgrtrWork.stats, hdr->msgID, hdr->length, 
+                           sent, failures);
+    }
+    return;
+}
+
+// Route a message from 'srcpib' to its consumers (routing tables must not 
+// change meanwhile):
+static void RouteMessage
+(
+    MSGRTR_HDR      *hdr,
+    MSGRTR_PIB      *srcpib,
+    int             lane,
+    ULONG           *routeMark
+)
+{
+    MSGRTR_PIB      *sockpib = (srcpib->type == PIB_TYPE_REMOTE) ? srcpib : NULL;
+    MSGRTR_PIB      *mcastPeers[MSGRTR_MCAST_MAX_PEERS], **mcast = NULL;
+    MSGRTR_MIIB     *miib;
+    MSGRTR_RANGE_SEG *seg;
+    UINT            ruleFlags;
+    int             sent = 0, failures = 0, numMcast = 0;
+
+    if (msgrtrWork.captureMap != NULL)
+    {
+        CaptureMessage (hdr);
+    }
+
+    // replies go to their requester only:
+    if (hdr->flags & MSGRTR_FLAG_REPLY)
+    {
+        RouteReply (hdr, srcpib);
+        return;
+    }
+
+    // hold it for peers that are out of reach:
+    if (msgrtrWork.numOutages > 0)
+    {
+        SpoolCollect (hdr);
+    }
+
+    ruleFlags = (msgrtrWork.numLvcRules > 0) ? LvcRuleFlags (hdr->msgID, hdr->msgID) : 0;
+
+    // keep the last one for consumers still to come (requests are not 
+    // worth replaying):
+    if ((ruleFlags & MSGRTR_LVC_CACHE) && (hdr->flags & MSGRTR_FLAG_REQUEST) == 0)
+    {
+        LvcUpdate (hdr);
+    }
+
+    // the group already has what came off it:
+    if ((ruleFlags & MSGRTR_LVC_MULTICAST) && msgrtrWork.mcastTxSock != NULL &&
+        (hdr->flags & MSGRTR_FLAG_MULTICAST) == 0)
+    {
+        mcast = mcastPeers;
+    }
+
+    // count the sender's direct deliveries as part of the fan-out:
+    if (hdr->flags & MSGRTR_FLAG_LOCAL_DONE)
+    {
+        sent        = MSGRTR_FLAG_DIRECT_SENT(hdr->flags);
+        failures    = MSGRTR_FLAG_DIRECT_FAILED(hdr->flags);
+    }
+
+    // get the proper MIIB and/or range segment
+    miib = getMIIB (hdr->msgID);
+    if (miib != NULL)
+    {
+        seg = miib->rangeSeg;
+    }
+    else
+    {
+        seg = (msgrtrWork.numRangeSegs > 0) ? RangeFind (hdr->msgID) : NULL;
+    }
+
+    if (miib == NULL && seg == NULL)
+    {
+        // no one to send it to
+        MSGRTR_COUNT(srcpib->txErrors);
+        if (msgrtrWork.stats != NULL)
+        {
+            msgrtrStatsRecord (msgrtrWork.stats, hdr->msgID, hdr->length, 
+                               sent, failures);
+        }
+        ShmHandoffsDone (hdr);
+        return;
+    }
+
+    MSGRTR_COUNT(srcpib->transmits);
+
+    // send it to each consumer once, even if it has exact and range
+    // subscriptions for msgID:
+    (*routeMark) ++;
+    if (miib != NULL)
+    {
+        sent += RouteToConsumers (miib->consumers, miib->numConsumers, hdr, 
+                                  sockpib, lane, *routeMark, &failures,
+                                  mcast, &numMcast);
+    }
+    if (seg != NULL)
+    {
+        sent += RouteToConsumers (seg->consumers, seg->numConsumers, hdr, 
+                                  sockpib, lane, *routeMark, &failures,
+                                  mcast, &numMcast);
+    }
+    if (numMcast > 0)
+    {
+        sent += McastFanOut (hdr, mcastPeers, numMcast, &failures);
+    }
+
+    if (msgrtrWork.stats != NULL)
+    {
+        msgrtrStatsRecord (msgrtrWork.stats, hdr->msgID, hdr->length, 
+                           sent, failures);
+    }
+    ShmHandoffsDone (hdr);
+    return;
+}
+
+// Routing table lock - only taken in threaded mode, where the main thread 
+// is the only one changing the tables:
+static void TableWriteLock (void)
+{
+    if (msgrtrWork.numWorkers > 0)
+    {
+        pthread_rwlock_wrlock (&msgrtrWork.tableLock);
+    }
+}
+
+static void TableWriteUnlock (void)
+{
+    if (msgrtrWork.numWorkers > 0)
+    {
+        pthread_rwlock_unlock (&msgrtrWork.tableLock);
+    }
+}
+
+// Queue a message (system buffer, ownership passes) for the worker that 
+// owns its msgID - waits while that worker is full:
+static void DispatchMessage (MSGRTR_HDR *hdr, MSGRTR_PIB *srcpib)
+{
+    MSGRTR_SHARD        *shard;
+    MSGRTR_JOB          *job;
+
+    shard = &msgrtrWork.shards[msgrtrHash (hdr->msgID, 0x10000) % msgrtrWork.numWorkers];
+    __sync_fetch_and_add (&srcpib->jobRefs, 1);
+
+    pthread_mutex_lock (&shard->lock);
+    while (shard->count == MSGRTR_SHARD_QUEUE_SIZE)
+    {
+        pthread_cond_wait (&shard->notFull, &shard->lock);
+    }
+
+    job = &shard->ring[(shard->head + shard->count) % MSGRTR_SHARD_QUEUE_SIZE];
+    job->hdr        = hdr;
+    job->sockpib    = srcpib;
+    shard->count ++;
+    if (shard->count > shard->peak)
+    {
+        shard->peak = shard->count;
+    }
+
+    pthread_cond_signal (&shard->notEmpty);
+    pthread_mutex_unlock (&shard->lock);
+    return;
+}
+
+// Routing worker thread - routes its msgIDs in arrival order until told to
+// stop and its queue is empty:
+static void RouteWorker (RAD_THREAD_ID threadId, void *threadData)
+{
+    MSGRTR_SHARD        *shard = (MSGRTR_SHARD *)threadData;
+    MSGRTR_JOB          job;
+
+    while (TRUE)
+    {
+        pthread_mutex_lock (&shard->lock);
+        while (shard->count == 0 && ! shard->stop)
+        {
+            pthread_cond_wait (&shard->notEmpty, &shard->lock);
+        }
+        if (shard->count == 0)
+        {
+            pthread_mutex_unlock (&shard->lock);
+            break;
+        }
+
+        job = shard->ring[shard->head];
+        shard->head = (shard->head + 1) % MSGRTR_SHARD_QUEUE_SIZE;
+        shard->count --;
+        pthread_cond_signal (&shard->notFull);
+        pthread_mutex_unlock (&shard->lock);
+
+        pthread_rwlock_rdlock (&msgrtrWork.tableLock);
+        RouteMessage (job.hdr, job.sockpib, shard->lane, &shard->routeMark);
+        pthread_rwlock_unlock (&msgrtrWork.tableLock);
+
+        __sync_fetch_and_sub (&job.sockpib->jobRefs, 1);
+        radBufferRls (job.hdr);
+        shard->jobs ++;
+    }
+
+    return;
+}
+
+// Start the routing workers:
+static int StartWorkers (void)
+{
+    MSGRTR_SHARD        *shard;
+    int                 i;
+
+    for (i = 0; i < msgrtrWork.numWorkers; i ++)
+    {
+        shard = &msgrtrWork.shards[i];
+        memset (shard, 0, sizeof(*shard));
+        shard->lane = i;
+        pthread_mutex_init (&shard->lock, NULL);
+        pthread_cond_init (&shard->notEmpty, NULL);
+        pthread_cond_init (&shard->notFull, NULL);
+
+        shard->ring = (MSGRTR_JOB *)malloc (MSGRTR_SHARD_QUEUE_SIZE * sizeof(MSGRTR_JOB));
+        if (shard->ring == NULL)
+        {
+            radMsgLog(PRI_HIGH, "StartWorkers: malloc failed!");
+            msgrtrWork.numWorkers = i;
+            return ERROR;
+        }
+
+        shard->thread = radthreadCreate (RouteWorker, shard);
+        if (shard->thread == NULL)
+        {
+            radMsgLog(PRI_HIGH, "StartWorkers: radthreadCreate failed!");
+            free (shard->ring);
+            msgrtrWork.numWorkers = i;
+            return ERROR;
+        }
+
+        // workers report through the inbox pipe, give back the wait slot:
+        radthreadSetParentHandler (shard->thread, NULL, NULL);
+    }
+
+    return OK;
+}
+
+// Let the routing workers finish what is queued, then stop them:
+static void StopWorkers (void)
+{
+    MSGRTR_SHARD        *shard;
+    int                 i;
+
+    for (i = 0; i < msgrtrWork.numWorkers; i ++)
+    {
+        shard = &msgrtrWork.shards[i];
+        pthread_mutex_lock (&shard->lock);
+        shard->stop = TRUE;
+        pthread_cond_signal (&shard->notEmpty);
+        pthread_mutex_unlock (&shard->lock);
+
+        radthreadWaitExit (shard->thread);
+        free (shard->ring);
+    }
+
+    return;
+}
+
+// Bytes a state journal record of 'type' takes:
+static ULONG StateRecordLength (ULONG type)
+{
+    ULONG           length = sizeof(MSGRTR_STATE_RECORD);
+
+    if (type == MSGRTR_STATE_CLIENT)
+    {
+        length += sizeof(MSGRTR_STATE_CLIENT_DATA);
+    }
+    else if (type == MSGRTR_STATE_FILTER)
+    {
+        length += sizeof(MSGRTR_FILTER);
+    }
+    return ((length + 7) & ~7);
+}
+
+// Unmap the state journal (what is in it stays for the next run):
+static void StateClose (void)
+{
+    if (msgrtrWork.stateMap == NULL)
+    {
+        return;
+    }
+
+    munmap (msgrtrWork.stateMap, sizeof(MSGRTR_STATE_FILE) + msgrtrWork.stateMap->size);
+    close (msgrtrWork.stateFd);
+    msgrtrWork.stateMap = NULL;
+    return;
+}
+
+// Write one journal record at the end of 'map' (the caller checked room):
+static void StateWrite 
+(
+    MSGRTR_STATE_FILE   *map,
+    ULONG               type,
+    MSGRTR_PIB          *pib,
+    ULONG               first,
+    ULONG               last
+)
+{
+    MSGRTR_STATE_RECORD *record;
+    MSGRTR_STATE_CLIENT_DATA *client;
+    MSGRTR_FILTER       *filter;
+
+    record = (MSGRTR_STATE_RECORD *)((UCHAR *)(map + 1) + map->used);
+    memset (record, 0, StateRecordLength (type));
+    record->recordLength    = StateRecordLength (type);
+    record->type            = type;
+    record->first           = first;
+    record->last            = last;
+    record->pid             = pib->pid;
+    if (type == MSGRTR_STATE_CLIENT)
+    {
+        client = (MSGRTR_STATE_CLIENT_DATA *)(record + 1);
+        strncpy (client->name, pib->name, PROCESS_MAX_NAME_LEN);
+        strncpy (client->queueName, pib->queueName, QUEUE_NAME_LENGTH);
+    }
+    else if (type == MSGRTR_STATE_FILTER && (filter = FilterFind (pib, first)) != NULL)
+    {
+        // no filter left journals as an empty one
+        memcpy (record + 1, filter, sizeof(*filter));
+    }
+
+    // the next run trusts 'used', so it moves only after the record is complete:
+    __sync_synchronize ();
+    map->used += record->recordLength;
+    map->records ++;
+    return;
+}
+
+// Write the live local clients and their registrations to a new state 
+// file and swap it in for the journal (main thread, tables locked):
+static int StateCompact (void)
+{
+    char                name[300];
+    MSGRTR_STATE_FILE   *map;
+    MSGRTR_PIB          *pib;
+    MSGRTR_RANGE        *range;
+    ULONGLONG           size = 0;
+    int                 fd, i;
+
+    for (pib = (MSGRTR_PIB *)radListGetFirst (&msgrtrWork.pibList);
+         pib != NULL;
+         pib = (MSGRTR_PIB *)radListGetNext (&msgrtrWork.pibList, (NODE *)pib))
+    {
+        if (pib->type == PIB_TYPE_LOCAL)
+        {
+            size += StateRecordLength (MSGRTR_STATE_CLIENT) +
+                    pib->numSubs * StateRecordLength (MSGRTR_STATE_ADD_MSGID) +
+                    pib->numFilters * StateRecordLength (MSGRTR_STATE_FILTER);
+        }
+    }
+    size += radListGetNumberOfNodes (&msgrtrWork.rangeList) * 
+            StateRecordLength (MSGRTR_STATE_ADD_RANGE);
+
+    // leave room to journal as much again before the next compaction:
+    size *= 2;
+    if (size < MSGRTR_STATE_MIN_BYTES)
+    {
+        size = MSGRTR_STATE_MIN_BYTES;
+    }
+
+    sprintf (name, "%s.new", msgrtrWork.stateFile);
+    fd = open (name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+    {
+        radMsgLog(PRI_HIGH, "StateCompact: %s: %s", name, strerror(errno));
+        return ERROR;
+    }
+    if (ftruncate (fd, sizeof(MSGRTR_STATE_FILE) + size) == -1)
+    {
+        radMsgLog(PRI_HIGH, "StateCompact: ftruncate %s: %s", name, strerror(errno));
+        close (fd);
+        unlink (name);
+        return ERROR;
+    }
+    map = (MSGRTR_STATE_FILE *)mmap (NULL, sizeof(MSGRTR_STATE_FILE) + size, 
+                                     PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if ((void *)map == MAP_FAILED)
+    {
+        radMsgLog(PRI_HIGH, "StateCompact: mmap %s: %s", name, strerror(errno));
+        close (fd);
+        unlink (name);
+        return ERROR;
+    }
+
+    map->version    = MSGRTR_STATE_VERSION;
+    map->recordSize = sizeof(MSGRTR_STATE_RECORD);
+    map->size       = size;
+    for (pib = (MSGRTR_PIB *)radListGetFirst (&msgrtrWork.pibList);
+         pib != NULL;
+         pib = (MSGRTR_PIB *)radListGetNext (&msgrtrWork.pibList, (NODE *)pib))
+    {
+        if (pib->type != PIB_TYPE_LOCAL)
+        {
+            continue;
+        }
+
+        StateWrite (map, MSGRTR_STATE_CLIENT, pib, 0, 0);
+        for (i = 0; i < pib->numSubs; i ++)
+        {
+            StateWrite (map, MSGRTR_STATE_ADD_MSGID, pib, pib->subs[i], pib->subs[i]);
+        }
+        for (i = 0; i < pib->numFilters; i ++)
+        {
+            StateWrite (map, MSGRTR_STATE_FILTER, pib, 
+                        pib->filters[i].msgID, pib->filters[i].msgID);
+        }
+    }
+    for (range = (MSGRTR_RANGE *)radListGetFirst (&msgrtrWork.rangeList);
+         range != NULL;
+         range = (MSGRTR_RANGE *)radListGetNext (&msgrtrWork.rangeList, (NODE *)range))
+    {
+        if (range->consumer->type == PIB_TYPE_LOCAL)
+        {
+            StateWrite (map, MSGRTR_STATE_ADD_RANGE, range->consumer, 
+                        range->first, range->last);
+        }
+    }
+    __sync_synchronize ();
+    map->magic      = MSGRTR_STATE_MAGIC;
+
+    // the old journal stays valid until the new one replaces it:
+    if (rename (name, msgrtrWork.stateFile) == -1)
+    {
+        radMsgLog(PRI_HIGH, "StateCompact: rename %s: %s", name, strerror(errno));
+        munmap (map, sizeof(MSGRTR_STATE_FILE) + size);
+        close (fd);
+        unlink (name);
+        return ERROR;
+    }
+
+    StateClose ();
+    msgrtrWork.stateFd  = fd;
+    msgrtrWork.stateMap = map;
+    return OK;
+}
+
+// Journal a change to a local client's registrations (main thread, tables 
+// locked, after the tables were changed):
+static void StateAppend (ULONG type, MSGRTR_PIB *pib, ULONG first, ULONG last)
+{
+    if (msgrtrWork.stateMap == NULL || msgrtrWork.stateLoading)
+    {
+        return;
+    }
+
+    if (msgrtrWork.stateMap->used + StateRecordLength (type) > msgrtrWork.stateMap->size)
+    {
+        // full - the compacted tables already include this change:
+        if (StateCompact () == ERROR)
+        {
+            radMsgLog(PRI_HIGH, "state journal full and compaction failed - "
+                                "registrations are no longer persisted!");
+            StateClose ();
+        }
+        return;
+    }
+
+    StateWrite (msgrtrWork.stateMap, type, pib, first, last);
+    return;
+}
+
+// Is the client a journal record names still there to deliver to? Its pid
+// must be alive and its queue must have a reader (so the attach won't block):
+static int StateClientAlive (MSGRTR_STATE_RECORD *record, MSGRTR_STATE_CLIENT_DATA *client)
+{
+    int             fd;
+
+    if (record->pid <= 0 || kill (record->pid, 0) != 0)
+    {
+        return FALSE;
+    }
+
+    fd = open (client->queueName, O_WRONLY | O_NONBLOCK);
+    if (fd == -1)
+    {
+        return FALSE;
+    }
+    close (fd);
+    return TRUE;
+}
+
+// Replay the state journal of a previous run into the tables, keeping only
+// clients still alive, then compact it (main thread, before any traffic):
+static void StateLoad (void)
+{
+    MSGRTR_STATE_FILE   *map;
+    MSGRTR_STATE_RECORD *record;
+    MSGRTR_STATE_CLIENT_DATA *client;
+    MSGRTR_FILTER       *filter;
+    MSGRTR_PIB          *pib;
+    MSGRTR_MIIB         *miib;
+    MSGRTR_RANGE        *range;
+    struct stat         fileData;
+    ULONGLONG           offset, used;
+    int                 fd, i, clients = 0, gone = 0, msgIDs = 0, ranges = 0;
+
+    TableWriteLock ();
+    msgrtrWork.stateLoading = TRUE;
+    if (msgrtrWork.shmTable != NULL)
+    {
+        ShmTableBeginUpdate ();
+    }
+
+    fd = open (msgrtrWork.stateFile, O_RDONLY);
+    if (fd != -1 && fstat (fd, &fileData) == 0 && 
+        fileData.st_size >= (off_t)sizeof(*map))
+    {
+        // private: terminating the names must not touch the file
+        map = (MSGRTR_STATE_FILE *)mmap (NULL, fileData.st_size, 
+                                         PROT_READ | PROT_WRITE, 
+                                         MAP_PRIVATE, fd, 0);
+        if ((void *)map == MAP_FAILED)
+        {
+            radMsgLog(PRI_HIGH, "StateLoad: mmap %s: %s", 
+                       msgrtrWork.stateFile, strerror(errno));
+        }
+        else if (map->magic != MSGRTR_STATE_MAGIC ||
+                 map->version != MSGRTR_STATE_VERSION ||
+                 map->recordSize != sizeof(MSGRTR_STATE_RECORD))
+        {
+            radMsgLog(PRI_MEDIUM, "StateLoad: %s is not a state file of this version - ignored",
+                       msgrtrWork.stateFile);
+            munmap (map, fileData.st_size);
+        }
+        else
+        {
+            used = map->used;
+            if (used > fileData.st_size - sizeof(*map))
+            {
+                used = fileData.st_size - sizeof(*map);
+            }
+
+            for (offset = 0; 
+                 offset + sizeof(*record) <= used; 
+                 offset += record->recordLength)
+            {
+                record = (MSGRTR_STATE_RECORD *)((UCHAR *)(map + 1) + offset);
+                if (record->recordLength < StateRecordLength (record->type) ||
+                    offset + record->recordLength > used)
+                {
+                    radMsgLog(PRI_HIGH, "StateLoad: corrupt record at offset %llu - "
+                                        "the rest is ignored", offset);
+                    break;
+                }
+
+                if (record->type == MSGRTR_STATE_CLIENT)
+                {
+                    client = (MSGRTR_STATE_CLIENT_DATA *)(record + 1);
+                    client->name[PROCESS_MAX_NAME_LEN] = 0;
+                    client->queueName[QUEUE_NAME_LENGTH] = 0;
+                    if (getPIBByPID (record->pid) != NULL)
+                    {
+                        continue;
+                    }
+                    if (! StateClientAlive (record, client) ||
+                        CreateLocalPIB (record->pid, client->name, client->queueName) == NULL)
+                    {
+                        gone ++;
+                    }
+                    continue;
+                }
+
+                // registrations of clients that are gone are skipped here:
+                if ((pib = getPIBByPID (record->pid)) == NULL)
+                {
+                    continue;
+                }
+
+                switch (record->type)
+                {
+                    case MSGRTR_STATE_CLIENT_DEL:
+                        RemoveClientFromAllMsgs (pib);
+                        UnlinkPIB (pib);
+                        radProcessQueueDettach (pib->queueName, QUEUE_GROUP_ALL);
+                        FreePIB (pib);
+                        break;
+
+                    case MSGRTR_STATE_ADD_MSGID:
+                        if ((miib = getMIIB (record->first)) == NULL &&
+                            (miib = CreateMIIB (record->first)) == NULL)
+                        {
+                            radMsgLog(PRI_HIGH, "StateLoad: %lu: malloc MIIB failed!",
+                                       record->first);
+                            break;
+                        }
+                        AddClient (miib, pib);
+                        break;
+
+                    case MSGRTR_STATE_DEL_MSGID:
+                        FilterSet (pib, record->first, NULL, 0);
+                        if ((miib = getMIIB (record->first)) != NULL)
+                        {
+                            RemoveClient (miib, pib);
+                            if (miib->numConsumers == 0)
+                            {
+                                RemoveMIIB (miib);
+                            }
+                        }
+                        break;
+
+                    case MSGRTR_STATE_ADD_RANGE:
+                        if (RangeAdd (record->first, record->last, pib) == ERROR)
+                        {
+                            radMsgLog(PRI_HIGH, "StateLoad: %lu-%lu: malloc range failed!",
+                                       record->first, record->last);
+                        }
+                        break;
+
+                    case MSGRTR_STATE_DEL_RANGE:
+                        RangeRemove (record->first, record->last, pib);
+                        break;
+
+                    case MSGRTR_STATE_FILTER:
+                        filter = (MSGRTR_FILTER *)(record + 1);
+                        if (FilterSet (pib, record->first, filter->terms, 
+                                       filter->numTerms)
+                            == ERROR)
+                        {
+                            radMsgLog(PRI_HIGH, "StateLoad: %lu: bad or unstored filter dropped",
+                                       record->first);
+                        }
+                        ShmTableUpdate (record->first, getMIIB (record->first));
+                        break;
+                }
+            }
+            munmap (map, fileData.st_size);
+        }
+    }
+    if (fd != -1)
+    {
+        close (fd);
+    }
+
+    // our own interest follows from what was restored (peers link later):
+    for (pib = (MSGRTR_PIB *)radListGetFirst (&msgrtrWork.pibList);
+         pib != NULL;
+         pib = (MSGRTR_PIB *)radListGetNext (&msgrtrWork.pibList, (NODE *)pib))
+    {
+        if (pib->type != PIB_TYPE_LOCAL)
+        {
+            continue;
+        }
+        clients ++;
+        msgIDs += pib->numSubs;
+        for (i = 0; i < pib->numSubs; i ++)
+        {
+            InterestLocalUpdate (pib->subs[i], pib->subs[i], NULL, NULL);
+        }
+    }
+    for (range = (MSGRTR_RANGE *)radListGetFirst (&msgrtrWork.rangeList);
+         range != NULL;
+         range = (MSGRTR_RANGE *)radListGetNext (&msgrtrWork.rangeList, (NODE *)range))
+    {
+        ranges ++;
+        InterestLocalUpdate (range->first, range->last, NULL, NULL);
+    }
+
+    if (msgrtrWork.shmTable != NULL)
+    {
+        ShmTableEndUpdate ();
+    }
+    msgrtrWork.stateLoading = FALSE;
+
+    if (clients > 0 || gone > 0)
+    {
+        radMsgLog(PRI_STATUS, "state: restored %d client(s) with %d msgID(s) and %d range(s), "
+                              "%d client(s) gone",
+                   clients, msgIDs, ranges, gone);
+    }
+
+    // start a clean journal of what we have:
+    if (StateCompact () == ERROR)
+    {
+        radMsgLog(PRI_HIGH, "state file %s unavailable - registrations will not be persisted!",
+                   msgrtrWork.stateFile);
+    }
+
+    TableWriteUnlock ();
+    return;
+}
+
+// Router control message handler (routing tables locked for writing):
+static void ControlMsgHandler
+(
+    char                *srcQueueName,
+    MSGRTR_HDR          *hdr,
+    MSGRTR_PIB          *sockpib            // != NULL => from a peer router
+)
+{
+    MSGRTR_INTERNAL_MSG *intMsg = (MSGRTR_INTERNAL_MSG *)hdr->msg;
+    MSGRTR_PIB          *pib;
+    MSGRTR_MIIB         *miib;
+    int                 i;
+
+    switch (intMsg->subMsgID)
+    {
+        case MSGRTR_SUBTYPE_REGISTER:
+        {
+            if (sockpib != NULL)
+            {
+                // We don't handle socket registers here:
+                return;
+            }
+
+            if ((pib = getPIBByPID (hdr->srcpid)) != NULL)
+            {
+                // he already exists, just ACK his funky self
+                SendACK (pib, 0);
+                return;
+            }
+
+            // let's insert this guy
+            pib = CreateLocalPIB (hdr->srcpid, intMsg->name, srcQueueName);
+            if (pib == NULL)
+            {
+                return;
+            }
+            StateAppend (MSGRTR_STATE_CLIENT, pib, 0, 0);
+
+            // finally, ACK 'em
+            SendACK (pib, 0);
+            return;
+        }
+
+        case MSGRTR_SUBTYPE_DEREGISTER:
+        {
+            if (sockpib == NULL)
+            {
+                if ((pib = getPIBByPID (hdr->srcpid)) == NULL)
+                {
+                    // he does not exist
+                    return;
+                }
+            }
+            else
+            {
+                pib = sockpib;
+            }
+
+            // let its queued messages and I/O threads finish first:
+            if (msgrtrWork.numWorkers > 0)
+            {
+                TableWriteUnlock ();
+                QuiescePIB (pib);
+                TableWriteLock ();
+            }
+
+            // withdraw what the mesh learned through him:
+            if (sockpib != NULL)
+            {
+                InterestPeerDown (pib);
+                MeshLinkDown (pib);
+            }
+
+            // first, remove him from the consumer lists
+            RemoveClientFromAllMsgs (pib);
+
+            // remove him from the PIB list
+            UnlinkPIB (pib);
+
+            if (sockpib == NULL)
+            {
+                StateAppend (MSGRTR_STATE_CLIENT_DEL, pib, 0, 0);
+                radProcessQueueDettach(pib->queueName, QUEUE_GROUP_ALL);
+            }
+            else
+            {
+                radSocketDestroy(pib->txclient);
+                radSocketDestroy(pib->rxclient);
+            }
+            FreePIB (pib);
+
+            return;
+        }
+
+    case MSGRTR_SUBTYPE_ENABLE_MSGID:
+    {
+        if (sockpib != NULL)
+        {
+            // peers send interest announcements instead
+            return;
+        }
+        if ((pib = getPIBByPID (hdr->srcpid)) == NULL)
+        {
+            // he does not exist
+            return;
+        }
+
+        // first, get the MIID
+        miib = getMIIB(intMsg->targetMsgID);
+        if (miib == NULL)
+        {
+            // new msgID, create the MIIB
+            miib = CreateMIIB (intMsg->targetMsgID);
+            if (miib == NULL)
+            {
+                radMsgLog(PRI_HIGH, "QueueMsgHandler: %d: malloc MIIB failed!",
+                           intMsg->targetMsgID);
+                return;
+            }
+        }
+
+        // now that we have the MIIB, add this consumer
+        AddClient(miib, pib);
+        StateAppend (MSGRTR_STATE_ADD_MSGID, pib, miib->msgID, miib->msgID);
+        LvcReplay (pib, miib->msgID, miib->msgID);
+
+        // tell the mesh if this is news:
+        InterestLocalChanged (miib->msgID, miib->msgID);
+
+        return;
+    }
+
+    case MSGRTR_SUBTYPE_ENABLE_MSGID_LIST:
+    {
+        MSGRTR_INTERNAL_LIST_MSG    *listMsg = (MSGRTR_INTERNAL_LIST_MSG *)hdr->msg;
+        MSGRTR_ANNOUNCE             add;
+
+        if (sockpib != NULL)
+        {
+            // peers send interest announcements instead
+            return;
+        }
+        if ((pib = getPIBByPID (hdr->srcpid)) == NULL)
+        {
+            // he does not exist
+            return;
+        }
+
+        if (hdr->length < sizeof(*listMsg) ||
+            listMsg->numMsgIDs > MSGRTR_MAX_LIST_MSGIDS ||
+            hdr->length < sizeof(*listMsg) + (listMsg->numMsgIDs * sizeof(ULONG)))
+        {
+            radMsgLog(PRI_HIGH, "QueueMsgHandler: %s: bad msgID list length %u",
+                       pib->name, hdr->length);
+            return;
+        }
+
+        AnnounceBegin (&add, MSGRTR_SUBTYPE_INTEREST_ADD, msgrtrWork.routerID, 1, NULL, NULL);
+
+        // publish the whole batch to the shared table at once:
+        if (msgrtrWork.shmTable != NULL)
+        {
+            ShmTableBeginUpdate ();
+        }
+
+        for (i = 0; i < (int)listMsg->numMsgIDs; i ++)
+        {
+            if (listMsg->msgIDs[i] == 0 || 
+                listMsg->msgIDs[i] == MSGRTR_INTERNAL_MSGID)
+            {
+                continue;
+            }
+
+            miib = getMIIB(listMsg->msgIDs[i]);
+            if (miib == NULL)
+            {
+                miib = CreateMIIB (listMsg->msgIDs[i]);
+                if (miib == NULL)
+                {
+                    radMsgLog(PRI_HIGH, "QueueMsgHandler: %u: malloc MIIB failed!",
+                               listMsg->msgIDs[i]);
+                    continue;
+                }
+            }
+
+            AddClient(miib, pib);
+            StateAppend (MSGRTR_STATE_ADD_MSGID, pib, miib->msgID, miib->msgID);
+            LvcReplay (pib, miib->msgID, miib->msgID);
+            InterestLocalUpdate (miib->msgID, miib->msgID, &add, NULL);
+        }
+
+        if (msgrtrWork.shmTable != NULL)
+        {
+            ShmTableEndUpdate ();
+        }
+
+        // tell the mesh about the new ones in as few messages as possible:
+        AnnounceFlush (&add);
+
+        if (listMsg->ackToken != 0)
+        {
+            SendACK (pib, listMsg->ackToken);
+        }
+
+        return;
+    }
+
+    case MSGRTR_SUBTYPE_ENABLE_MSGID_FILTER:
+    {
+        MSGRTR_INTERNAL_FILTER_MSG  *filterMsg = (MSGRTR_INTERNAL_FILTER_MSG *)hdr->msg;
+        int                         isNew = TRUE;
+
+        if (sockpib != NULL)
+        {
+            // filters are applied where the consumer is
+            return;
+        }
+        if ((pib = getPIBByPID (hdr->srcpid)) == NULL)
+        {
+            // he does not exist
+            return;
+        }
+
+        if (hdr->length < sizeof(*filterMsg) ||
+            filterMsg->numTerms > MSGRTR_MAX_FILTER_TERMS ||
+            hdr->length < sizeof(*filterMsg) + 
+                          filterMsg->numTerms * sizeof(MSGRTR_FILTER_TERM) ||
+            filterMsg->msgID == 0 || filterMsg->msgID == MSGRTR_INTERNAL_MSGID)
+        {
+            radMsgLog(PRI_HIGH, "QueueMsgHandler: %s: bad filter message length %u",
+                       pib->name, hdr->length);
+            return;
+        }
+
+        miib = getMIIB(filterMsg->msgID);
+        if (miib == NULL)
+        {
+            miib = CreateMIIB (filterMsg->msgID);
+            if (miib == NULL)
+            {
+                radMsgLog(PRI_HIGH, "QueueMsgHandler: %u: malloc MIIB failed!",
+                           filterMsg->msgID);
+                return;
+            }
+        }
+        for (i = 0; i < pib->numSubs; i ++)
+        {
+            if (pib->subs[i] == miib->msgID)
+            {
+                isNew = FALSE;
+                break;
+            }
+        }
+
+        // the filter goes first so the shared table leaves him to us:
+        if (FilterSet (pib, miib->msgID, filterMsg->terms, (int)filterMsg->numTerms) 
+            == ERROR)
+        {
+            radMsgLog(PRI_HIGH, "QueueMsgHandler: %s: msgID %u: bad filter or malloc failed!",
+                       pib->name, miib->msgID);
+            if (isNew && miib->numConsumers == 0)
+            {
+                RemoveMIIB (miib);
+            }
+            return;
+        }
+        AddClient(miib, pib);
+        ShmTableUpdate (miib->msgID, miib);
+        StateAppend (MSGRTR_STATE_ADD_MSGID, pib, miib->msgID, miib->msgID);
+        StateAppend (MSGRTR_STATE_FILTER, pib, miib->msgID, miib->msgID);
+        if (isNew)
+        {
+            LvcReplay (pib, miib->msgID, miib->msgID);
+        }
+
+        InterestLocalChanged (miib->msgID, miib->msgID);
+        return;
+    }
+
+    case MSGRTR_SUBTYPE_ENABLE_MSGID_RANGE:
+    case MSGRTR_SUBTYPE_DISABLE_MSGID_RANGE:
+    {
+        if (sockpib != NULL)
+        {
+            // peers send interest announcements instead
+            return;
+        }
+        if ((pib = getPIBByPID (hdr->srcpid)) == NULL)
+        {
+            // he does not exist
+            return;
+        }
+
+        if (intMsg->targetMsgID > intMsg->lastMsgID)
+        {
+            radMsgLog(PRI_HIGH, "QueueMsgHandler: %s: bad msgID range %u-%u",
+                       pib->name, intMsg->targetMsgID, intMsg->lastMsgID);
+            return;
+        }
+
+        if (intMsg->subMsgID == MSGRTR_SUBTYPE_ENABLE_MSGID_RANGE)
+        {
+            if (RangeAdd (intMsg->targetMsgID, intMsg->lastMsgID, pib) == ERROR)
+            {
+                radMsgLog(PRI_HIGH, "QueueMsgHandler: %u-%u: malloc range failed!",
+                           intMsg->targetMsgID, intMsg->lastMsgID);
+                return;
+            }
+            StateAppend (MSGRTR_STATE_ADD_RANGE, pib, 
+                         intMsg->targetMsgID, intMsg->lastMsgID);
+            LvcReplay (pib, intMsg->targetMsgID, intMsg->lastMsgID);
+        }
+        else if (RangeRemove (intMsg->targetMsgID, intMsg->lastMsgID, pib) == ERROR)
+        {
+            return;
+        }
+        else
+        {
+            StateAppend (MSGRTR_STATE_DEL_RANGE, pib, 
+                         intMsg->targetMsgID, intMsg->lastMsgID);
+        }
+
+        // tell the mesh if this is news:
+        InterestLocalChanged (intMsg->targetMsgID, intMsg->lastMsgID);
+        return;
+    }
+
+    case MSGRTR_SUBTYPE_MSGID_IS_REGISTERED:
+    {
+        int     isRegistered = 0;
+
+        if (sockpib == NULL)
+        {
+            if ((pib = getPIBByPID (hdr->srcpid)) == NULL)
+            {
+                // he does not exist
+                return;
+            }
+        }
+        else
+        {
+            pib = sockpib;
+        }
+
+        // first, get the MIID
+        miib = getMIIB(intMsg->targetMsgID);
+        if (miib == NULL)
+        {
+            // an unknown msgId has no consumers, but the client still waits
+            // for the answer:
+            isRegistered = (RangeFind (intMsg->targetMsgID) != NULL);
+        }
+
+        // Are there any consumers?
+        else if (miib->numConsumers > 0 || miib->rangeSeg != NULL)
+        {
+            isRegistered = 1;
+        }
+
+        // Send response:
+        SendIsRegistered (pib, isRegistered);
+
+        return;
+    }
+
+        case MSGRTR_SUBTYPE_DISABLE_MSGID:
+        {
+            if (sockpib != NULL)
+            {
+                // peers send interest announcements instead
+                return;
+            }
+            if ((pib = getPIBByPID (hdr->srcpid)) == NULL)
+            {
+                // he does not exist
+                return;
+            }
+
+            // first, get the MIIB
+            miib = getMIIB(intMsg->targetMsgID);
+            if (miib == NULL)
+            {
+                // msgID does not exist...
+                return;
+            }
+
+            // now that we have the MIIB, remove this consumer
+            RemoveClient(miib, pib);
+            FilterSet (pib, intMsg->targetMsgID, NULL, 0);
+            StateAppend (MSGRTR_STATE_DEL_MSGID, pib, 
+                         intMsg->targetMsgID, intMsg->targetMsgID);
+
+            // Check here to see if there are any more consumers:
+            // If not, remove the MIIB:
+            if (miib->numConsumers == 0)
+            {
+                RemoveMIIB(miib);
+
+                radMsgLog(PRI_STATUS, "QueueMsgHandler: removed empty MIIB for msgID %d",
+                           intMsg->targetMsgID);
+            }
+
+            // withdraw our interest if that was the last local consumer:
+            InterestLocalChanged (intMsg->targetMsgID, intMsg->targetMsgID);
+            return;
+        }
+
+        case MSGRTR_SUBTYPE_MCAST_DEAF:
+        {
+            if (sockpib != NULL && (sockpib->linkFlags & MSGRTR_LINK_MULTICAST))
+            {
+                // he doesn't hear the group, send him everything over TCP
+                sockpib->linkFlags &= ~MSGRTR_LINK_MULTICAST;
+                radMsgLog(PRI_MEDIUM, "multicast: %s does not hear the group - using TCP",
+                           sockpib->name);
+            }
+            return;
+        }
+
+        case MSGRTR_SUBTYPE_INTEREST_ADD:
+        case MSGRTR_SUBTYPE_INTEREST_DEL:
+        {
+            if (sockpib != NULL)
+            {
+                InterestRX (sockpib, 
+                            (MSGRTR_INTERNAL_INTEREST_MSG *)hdr->msg, 
+                            hdr->length);
+            }
+            return;
+        }
+
+        case MSGRTR_SUBTYPE_DUMP_STATS:
+        {
+            radMsgLog(PRI_MEDIUM, "---------- Message Router Totals:  TX:%10.10u  RX:%10.10u ----------",
+                       msgrtrWork.transmits, msgrtrWork.receives);
+            radMsgLog(PRI_MEDIUM, "     Name     \t MSGS TX  \t MSGS RX  \t  TXERRS  \t  RXERRS");
+            radMsgLog(PRI_MEDIUM, "--------------\t----------\t----------\t----------\t----------");
+
+            // loop through the PIBs
+            for (pib = (MSGRTR_PIB *)radListGetFirst (&msgrtrWork.pibList);
+                 pib != NULL;
+                 pib = (MSGRTR_PIB *)radListGetNext (&msgrtrWork.pibList, (NODE *)pib))
+            {
+                radMsgLog(PRI_MEDIUM, "%-14s\t%10u\t%10u\t%10u\t%10u",
+                           pib->name,
+                           pib->transmits, 
+                           pib->receives,
+                           pib->txErrors,
+                           pib->rxErrors);
+            }
+
+            radMsgLog(PRI_MEDIUM, "--------------------------------------------------------------------------");
+            radMsgLog(PRI_MEDIUM, "    Remote    \t Q BYTES  \t Q FRAMES \t Q PEAK   \t  DROPS   \t ROUTER ID");
+            for (pib = (MSGRTR_PIB *)radListGetFirst (&msgrtrWork.pibList);
+                 pib != NULL;
+                 pib = (MSGRTR_PIB *)radListGetNext (&msgrtrWork.pibList, (NODE *)pib))
+            {
+                if (pib->type != PIB_TYPE_REMOTE)
+                {
+                    continue;
+                }
+                radMsgLog(PRI_MEDIUM, "%-14s\t%10d\t%10d\t%10u\t%10u\t%10u",
+                           pib->name,
+                           pib->txQueueBytes + pib->txLength,
+                           pib->txQueueFrames + pib->txFrames,
+                           pib->txQueuePeak,
+                           pib->txDrops,
+                           pib->routerID);
+            }
+            for (pib = (MSGRTR_PIB *)radListGetFirst (&msgrtrWork.pibList);
+                 pib != NULL;
+                 pib = (MSGRTR_PIB *)radListGetNext (&msgrtrWork.pibList, (NODE *)pib))
+            {
+                if (pib->type != PIB_TYPE_REMOTE || 
+                    (! (pib->linkFlags & MSGRTR_LINK_COMPRESS) && pib->zRxBatches == 0))
+                {
+                    continue;
+                }
+                radMsgLog(PRI_MEDIUM, "Compression: %s %s, %lu batches sent, "
+                                      "%llu bytes in %llu (%.2f:1), %lu batches received",
+                           pib->name,
+                           (pib->linkFlags & MSGRTR_LINK_COMPRESS) ? "lz" : "none",
+                           pib->zBatches,
+                           pib->zRawBytes,
+                           pib->zBytes,
+                           (pib->zBytes > 0) ? (double)pib->zRawBytes / pib->zBytes : 1.0,
+                           pib->zRxBatches);
+            }
+            if (msgrtrWork.mcastTxSock != NULL)
+            {
+                radMsgLog(PRI_MEDIUM, "Multicast: %s:%d, %lu datagrams (%llu bytes) for %lu "
+                                      "link sends, %lu NAKs, %lu resent, %lu gone",
+                           msgrtrWork.mcastGroup,
+                           msgrtrWork.mcastPort,
+                           msgrtrWork.mcastSends,
+                           msgrtrWork.mcastBytes,
+                           msgrtrWork.mcastPeerSends,
+                           msgrtrWork.mcastNaksRx,
+                           msgrtrWork.mcastResends,
+                           msgrtrWork.mcastGone);
+            }
+            for (pib = (MSGRTR_PIB *)radListGetFirst (&msgrtrWork.pibList);
+                 pib != NULL;
+                 pib = (MSGRTR_PIB *)radListGetNext (&msgrtrWork.pibList, (NODE *)pib))
+            {
+                if (pib->type != PIB_TYPE_REMOTE || pib->mcastRx == NULL)
+                {
+                    continue;
+                }
+                radMsgLog(PRI_MEDIUM, "Multicast: from %s %s, %lu received, %lu repaired, "
+                                      "%lu lost, %lu NAKs sent",
+                           pib->name,
+                           (pib->linkFlags & MSGRTR_LINK_MULTICAST) ? "on" : "off (TCP)",
+                           pib->mcastRx->received,
+                           pib->mcastRx->repaired,
+                           pib->mcastRx->lost,
+                           pib->mcastRx->naks);
+            }
+            radMsgLog(PRI_MEDIUM, "Mesh: router ID %u, %d interest entries, %u duplicates dropped",
+                       msgrtrWork.routerID,
+                       radListGetNumberOfNodes (&msgrtrWork.interestList),
+                       msgrtrWork.duplicates);
+            radMsgLog(PRI_MEDIUM, "Cache: %d msgIDs cached in %lu bytes, %lu replays",
+                       radListGetNumberOfNodes (&msgrtrWork.lvcList),
+                       msgrtrWork.lvcBytes,
+                       msgrtrWork.lvcReplays);
+            for (i = 0; i < msgrtrWork.numSpools; i ++)
+            {
+                radMsgLog(PRI_MEDIUM, "Spool: router %u %s, %lu held (%llu bytes), "
+                                      "%lu spooled, %lu drained, %lu dropped",
+                           msgrtrWork.spools[i].routerID,
+                           (msgrtrWork.spools[i].state == MSGRTR_SPOOL_OUTAGE) ? "down" :
+                           (msgrtrWork.spools[i].state == MSGRTR_SPOOL_DRAINING) ? "draining" : "up",
+                           msgrtrWork.spools[i].ring->records,
+                           msgrtrWork.spools[i].ring->tail - msgrtrWork.spools[i].ring->head,
+                           msgrtrWork.spools[i].spooled,
+                           msgrtrWork.spools[i].drained,
+                           msgrtrWork.spools[i].ring->drops);
+            }
+            if (msgrtrWork.captureBase[0] != 0)
+            {
+                radMsgLog(PRI_MEDIUM, "Capture: %s segment %lu, %lu records, %lu dropped",
+                           msgrtrWork.captureBase,
+                           msgrtrWork.captureNumber,
+                           msgrtrWork.captureRecords,
+                           msgrtrWork.captureDrops);
+            }
+
+            radMsgLog(PRI_MEDIUM, "--------------------------------------------------------------------------");
+            radMsgLog(PRI_MEDIUM, "    Local     \t   LAG    \t LAG PEAK \t  DROPS   \t CONFLATED");
+            for (pib = (MSGRTR_PIB *)radListGetFirst (&msgrtrWork.pibList);
+                 pib != NULL;
+                 pib = (MSGRTR_PIB *)radListGetNext (&msgrtrWork.pibList, (NODE *)pib))
+            {
+                if (pib->type != PIB_TYPE_LOCAL)
+                {
+                    continue;
+                }
+                radMsgLog(PRI_MEDIUM, "%-14s\t%10d\t%10d\t%10u\t%10u",
+                           pib->name,
+                           pib->spillCount,
+                           pib->spillPeak,
+                           pib->spillDrops,
+                           pib->spillConflated);
+            }
+            for (pib = (MSGRTR_PIB *)radListGetFirst (&msgrtrWork.pibList);
+                 pib != NULL;
+                 pib = (MSGRTR_PIB *)radListGetNext (&msgrtrWork.pibList, (NODE *)pib))
+            {
+                if (pib->type != PIB_TYPE_LOCAL || pib->numFilters == 0)
+                {
+                    continue;
+                }
+                radMsgLog(PRI_MEDIUM, "Filters: %s %d msgID(s) filtered, %lu msgs held back",
+                           pib->name,
+                           pib->numFilters,
+                           pib->filtered);
+            }
+
+            if (msgrtrWork.numWorkers > 0)
+            {
+                radMsgLog(PRI_MEDIUM, "--------------------------------------------------------------------------");
+                radMsgLog(PRI_MEDIUM, "    Worker    	   JOBS   	  QUEUED  	 Q PEAK");
+                for (i = 0; i < msgrtrWork.numWorkers; i ++)
+                {
+                    radMsgLog(PRI_MEDIUM, "%-14d\t%10lu\t%10d\t%10d",
+                               i,
+                               msgrtrWork.shards[i].jobs,
+                               msgrtrWork.shards[i].count,
+                               msgrtrWork.shards[i].peak);
+                }
+            }
+
+            if (msgrtrWork.shmTable != NULL)
+            {
+                radMsgLog(PRI_MEDIUM, "--------------------------------------------------------------------------");
+                radMsgLog(PRI_MEDIUM, "     Name     \t   SLOT   \t DIRECT RX");
+                for (pib = (MSGRTR_PIB *)radListGetFirst (&msgrtrWork.pibList);
+                     pib != NULL;
+                     pib = (MSGRTR_PIB *)radListGetNext (&msgrtrWork.pibList, (NODE *)pib))
+                {
+                    if (pib->shmSlot < 0)
+                    {
+                        continue;
+                    }
+                    radMsgLog(PRI_MEDIUM, "%-14s\t%10d\t%10u",
+                               pib->name,
+                               pib->shmSlot,
+                               msgrtrWork.shmTable->clients[pib->shmSlot].directSends);
+                }
+                if (msgrtrWork.shmTable->overflow)
+                {
+                    radMsgLog(PRI_MEDIUM, "subscription table overflow: some msgIDs are routed");
+                }
+            }
+
+            if (radListGetNumberOfNodes (&msgrtrWork.rangeList) > 0)
+            {
+                MSGRTR_RANGE    *range;
+
+                radMsgLog(PRI_MEDIUM, "--------------------------------------------------------------------------");
+                radMsgLog(PRI_MEDIUM, "     Name     \t  FIRST   \t   LAST   \t(%d segments)",
+                           msgrtrWork.numRangeSegs);
+                for (range = (MSGRTR_RANGE *)radListGetFirst (&msgrtrWork.rangeList);
+                     range != NULL;
+                     range = (MSGRTR_RANGE *)radListGetNext (&msgrtrWork.rangeList, (NODE *)range))
+                {
+                    radMsgLog(PRI_MEDIUM, "%-14s\t%10u\t%10u",
+                               range->consumer->name,
+                               range->first,
+                               range->last);
+                }
+            }
+
+            radMsgLog(PRI_MEDIUM, "--------------------------------------------------------------------------");
+            return;
+        }
+    }
+
+    return;
+}
+
+// radlib message queue receive handler:
+static void QueueMsgHandler
+(
+    char                *srcQueueName,
+    UINT                msgType,
+    void                *msg,
+    UINT                length,
+    void                *userData           // != NULL => socket RX invocation
+)
+{
+    MSGRTR_HDR          *hdr = (MSGRTR_HDR *)msg;
+    MSGRTR_PIB          *sockpib = (MSGRTR_PIB*)userData;
+    MSGRTR_PIB          *pib;
+
+    // Note: This function is called in two different scenarios:
+    // 1) Automatically for internal message RX, in which case sockpib = NULL
+    // 2) By the remote socket RX handler (or, in threaded mode, the main 
+    //    thread's inbox for peer control messages), sockpib = RX PIB
+    // sockpib is used to determine local or remote reception.
+    if (hdr->magicNumber == MSGRTR_MAGIC_NUMBER_V1)
+    {
+        radMsgLog(PRI_HIGH, "QueueMsgHandler: RX old header layout from pid %d "
+                   "- rebuild it against this radlib", hdr->srcpid);
+        return;
+    }
+    if (hdr->magicNumber != MSGRTR_MAGIC_NUMBER)
+    {
+        radMsgLog(PRI_HIGH, "QueueMsgHandler: RX bad magic number 0x%8.8X", 
+                   hdr->magicNumber);
+        return;
+    }
+
+    if (hdr->msgID == MSGRTR_INTERNAL_MSGID)
+    {
+        TableWriteLock ();
+        ControlMsgHandler (srcQueueName, hdr, sockpib);
+        TableWriteUnlock ();
+        return;
+    }
+
+    
+    //// normal message, route it ////
+
+    // get the PIB
+    if (sockpib == NULL)
+    {
+        if ((pib = getPIBByPID (hdr->srcpid)) == NULL)
+        {
+            // he does not exist
+            ShmHandoffsDone (hdr);
+            return;
+        }
+
+        // stamp it so the mesh can route it once to each router:
+        hdr->originID       = msgrtrWork.routerID;
+        hdr->originEpoch    = msgrtrWork.epoch;
+        if (++ msgrtrWork.originSeq == 0)
+        {
+            msgrtrWork.originSeq = 1;
+        }
+        hdr->originSeq      = msgrtrWork.originSeq;
+
+        // and tell responders where to send the answer:
+        if (hdr->flags & MSGRTR_FLAG_REQUEST)
+        {
+            hdr->replyRouterID  = msgrtrWork.routerID;
+            if (hdr->replyPid == 0)
+            {
+                hdr->replyPid   = hdr->srcpid;
+            }
+        }
+    }
+    else
+    {
+        pib = sockpib;
+        if (! MeshAccept (hdr, pib))
+        {
+            return;
+        }
+    }
+
+    MSGRTR_COUNT(msgrtrWork.receives);
+
+    if (msgrtrWork.numWorkers > 0 && sockpib == NULL)
+    {
+        // hand the buffer to the worker owning this msgID:
+        radProcessQueueKeepBuffer ();
+        DispatchMessage (hdr, pib);
+        return;
+    }
+
+    RouteMessage (hdr, pib, 0, &msgrtrWork.routeMark);
+    return;
+}
+
+// Listen socket's connection queue handler:
+static void ServerRXHandler (int fd, void *userData)
+{
+    RADSOCK_ID          newClient;
+    RADSOCK_ID          newServer;
+    MSGRTR_HDR          msgHdr;
+    MSGRTR_INTERNAL_MSG inMsg, outMsg;
+    MSGRTR_PIB*         pib;
+
+    newClient = radSocketServerAcceptConnection((RADSOCK_ID)userData);
+    if (newClient == NULL)
+    {
+        radMsgLog(PRI_HIGH, "ServerRXHandler: radSocketServerAcceptConnection failed!");
+        return;
+    }
+
+    // Wait for the register pkt:
+    if (radSocketReadExact(newClient, &msgHdr, sizeof(msgHdr)) != sizeof(msgHdr))
+    {
+        radMsgLog(PRI_HIGH, "ServerRXHandler: radSocketReadExact HDR failed!");
+        radSocketDestroy(newClient);
+        return;
+    }
+
+    // Do NtoH conversions:
+    HdrNtoH (&msgHdr);
+
+    if (msgHdr.magicNumber == MSGRTR_MAGIC_NUMBER_V1)
+    {
+        radMsgLog(PRI_HIGH, "ServerRXHandler: remote router uses the old "
+                   "header layout - upgrade it!");
+        radSocketDestroy(newClient);
+        return;
+    }
+    if (msgHdr.magicNumber != MSGRTR_MAGIC_NUMBER)
+    {
+        radMsgLog(PRI_HIGH, "ServerRXHandler: HDR magic failed!");
+        radSocketDestroy(newClient);
+        return;
+    }
+
+    if (msgHdr.msgID != MSGRTR_INTERNAL_MSGID)
+    {
+        radMsgLog(PRI_HIGH, "ServerRXHandler: HDR ID not internal!");
+        radSocketDestroy(newClient);
+        return;
+    }
+
+    // Read the rest:
+    if (radSocketReadExact(newClient, &inMsg, sizeof(inMsg)) != sizeof(inMsg))
+    {
+        radMsgLog(PRI_HIGH, "ServerRXHandler: radSocketReadExact inMsg failed!");
+        radSocketDestroy(newClient);
+        return;
+    }
+
+    // Do NtoH conversions:
+    inMsg.subMsgID      = ntohl(inMsg.subMsgID);
+    inMsg.targetMsgID   = ntohl(inMsg.targetMsgID);
+    inMsg.srcPort       = ntohl(inMsg.srcPort);
+    inMsg.socketID      = ntohl(inMsg.socketID);
+    inMsg.maxMsgSize    = ntohl(inMsg.maxMsgSize);
+    inMsg.routerID      = ntohl(inMsg.routerID);
+    inMsg.linkFlags     = ntohl(inMsg.linkFlags);
+
+    if (inMsg.routerID == msgrtrWork.routerID)
+    {
+        radMsgLog(PRI_HIGH, "ServerRXHandler: peer %s has our router ID %u - rejected!",
+                   inMsg.name, inMsg.routerID);
+        radSocketDestroy(newClient);
+        return;
+    }
+
+    if (inMsg.subMsgID == MSGRTR_SUBTYPE_REGISTER)
+    {
+        radMsgLog(PRI_STATUS, "Remote accept RX: %s:%d <== %s:%d",
+                   radSocketGetHost(newClient), 
+                   radSocketGetPort(newClient),
+                   radSocketGetRemoteHost(newClient), 
+                   radSocketGetRemotePort(newClient));
+
+        // Now open the TX side socket (a path if he is on this host):
+        if (inMsg.srcIP[0] == '/')
+        {
+            newServer = radSocketClientCreateUnix(inMsg.srcIP);
+        }
+        else
+        {
+            newServer = radSocketClientCreate(inMsg.srcIP, inMsg.srcPort);
+        }
+        if (newServer == NULL)
+        {
+            radMsgLog(PRI_HIGH, "ServerRXHandler: radSocketClientCreate %s:%d failed!",
+                       inMsg.srcIP, inMsg.srcPort);
+            radSocketDestroy(newClient);
+            return;
+        }
+
+        // Send him an ack on this new socket:
+        msgHdr.magicNumber      = MSGRTR_MAGIC_NUMBER;
+        msgHdr.srcpid           = 0;
+        msgHdr.msgID            = MSGRTR_INTERNAL_MSGID;
+        msgHdr.length           = sizeof(MSGRTR_INTERNAL_MSG);
+        msgHdr.flags            = 0;
+        msgHdr.routerSlots      = 0;
+        msgHdr.originID         = 0;
+        msgHdr.originEpoch      = 0;
+        msgHdr.originSeq        = 0;
+        msgHdr.correlationID    = 0;
+        msgHdr.replyRouterID    = 0;
+        msgHdr.replyPid         = 0;
+
+        memset (&outMsg, 0, sizeof(outMsg));
+        outMsg.subMsgID         = MSGRTR_SUBTYPE_ACK;
+        if (inMsg.srcIP[0] == '/')
+        {
+            snprintf(outMsg.name, sizeof(outMsg.name), "router:local:%d",
+                     inMsg.srcPort);
+        }
+        else
+        {
+            snprintf(outMsg.name, sizeof(outMsg.name), "router:%s",
+                     radSocketGetHost(newServer));
+        }
+        strncpy(outMsg.srcIP, inMsg.srcIP, sizeof(outMsg.srcIP));
+        outMsg.srcPort          = inMsg.srcPort;
+        outMsg.socketID         = inMsg.socketID;
+        outMsg.maxMsgSize       = SYS_BUFFER_LARGEST_SIZE;
+        outMsg.routerID         = msgrtrWork.routerID;
+
+        // the link is compressed both ways if we both want it:
+        outMsg.linkFlags        = inMsg.linkFlags & msgrtrWork.linkFlags;
+
+        // Do HtoN conversions:
+        msgHdr.magicNumber  = htonl(msgHdr.magicNumber);
+        msgHdr.srcpid       = htonl(msgHdr.srcpid);
+        msgHdr.msgID        = htonl(msgHdr.msgID);
+        msgHdr.length       = htonl(msgHdr.length);
+        msgHdr.flags        = htonl(msgHdr.flags);
+        outMsg.subMsgID     = htonl(outMsg.subMsgID);
+        outMsg.targetMsgID  = htonl(outMsg.targetMsgID);
+        outMsg.srcPort      = htonl(outMsg.srcPort);
+        outMsg.socketID     = htonl(outMsg.socketID);
+        outMsg.maxMsgSize   = htonl(outMsg.maxMsgSize);
+        outMsg.routerID     = htonl(outMsg.routerID);
+        outMsg.linkFlags    = htonl(outMsg.linkFlags);
+
+        if (radSocketWriteExact(newServer, &msgHdr, sizeof(msgHdr)) != sizeof(msgHdr))
+        {
+            radMsgLog(PRI_HIGH, "ServerRXHandler: radSocketWriteExact msgHdr failed!");
+            radSocketDestroy(newServer);
+            radSocketDestroy(newClient);
+            return;
+        }
+        if (radSocketWriteExact(newServer, &outMsg, sizeof(outMsg)) != sizeof(outMsg))
+        {
+            radMsgLog(PRI_HIGH, "ServerRXHandler: radSocketWriteExact outMsg failed!");
+            radSocketDestroy(newServer);
+            radSocketDestroy(newClient);
+            return;
+        }
+
+        // OK, we are done, store the sockets in a new PIB:
+        pib = (MSGRTR_PIB *)malloc (sizeof(*pib));
+        if (pib == NULL)
+        {
+            radMsgLog(PRI_HIGH, "ServerRXHandler: %s: malloc PIB failed!",
+                       inMsg.name);
+            radSocketDestroy(newServer);
+            radSocketDestroy(newClient);
+            return;
+        }
+
+        memset (pib, 0, sizeof(*pib));
+        pthread_mutex_init (&pib->lock, NULL);
+        pthread_cond_init (&pib->txCond, NULL);
+        pib->type       = PIB_TYPE_REMOTE;
+        strncpy (pib->name, inMsg.name, PROCESS_MAX_NAME_LEN);
+        pib->rxclient   = newClient;
+        pib->txclient   = newServer;
+        pib->maxMsgSize = inMsg.maxMsgSize;
+        pib->routerID   = inMsg.routerID;
+        pib->linkFlags  = inMsg.linkFlags & msgrtrWork.linkFlags;
+        pib->txWriteId  = -1;
+        radListReset (&pib->txQueue);
+
+        // a stalled peer must never block us, we queue instead:
+        radSocketSetBlocking(pib->txclient, FALSE);
+
+        AddPIB(pib);
+
+        // Now tell him about every interest he can reach through us:
+        InterestSyncPeer(pib);
+
+        // and send him what he missed:
+        TableWriteLock ();
+        SpoolLinkUp (pib);
+        TableWriteUnlock ();
+
+        // Add the RX socket to our wait list (or give it its threads):
+        if (msgrtrWork.numWorkers > 0)
+        {
+            StartPeerThreads (pib);
+        }
+        else
+        {
+            radProcessIORegisterDescriptor(radSocketGetDescriptor(pib->rxclient),
+                                           ClientRXHandler,
+                                           (void*)pib);
+        }
+
+        radMsgLog(PRI_STATUS, "Remote Accept: %s:%d ==> %s:%d",
+                   radSocketGetHost(pib->txclient), 
+                   radSocketGetPort(pib->txclient),
+                   radSocketGetRemoteHost(pib->txclient), 
+                   radSocketGetRemotePort(pib->txclient));
+    }
+    else if (inMsg.subMsgID == MSGRTR_SUBTYPE_ACK)
+    {
+        // Now verify:
+        if (strncmp(radSocketGetHost(newClient), inMsg.srcIP, sizeof(inMsg.srcIP)))
+        {
+            radMsgLog(PRI_HIGH, "ServerRXHandler: ACK local IP:%s does not match %s",
+                       radSocketGetHost(newClient), inMsg.srcIP);
+            radSocketDestroy(newClient);
+            return;
+        }
+        if (msgrtrWork.listenPort != inMsg.srcPort)
+        {
+            radMsgLog(PRI_HIGH, "ServerRXHandler: ACK local port:%d does not match %d",
+                       msgrtrWork.listenPort, inMsg.srcPort);
+            radSocketDestroy(newClient);
+            return;
+        }
+
+        // They match, add the RX socket to the PIB:
+        pib = getPIBBySocket((int)inMsg.socketID);
+        if (pib == NULL)
+        {
+            radMsgLog(PRI_HIGH, "ServerRXHandler: ACK getPIBBySocket failed");
+            radSocketDestroy(newClient);
+            return;
+        }
+        pib->rxclient   = newClient;
+        pib->maxMsgSize = inMsg.maxMsgSize;
+        pib->routerID   = inMsg.routerID;
+        pib->linkFlags  = inMsg.linkFlags & msgrtrWork.linkFlags;
+
+        // Now tell him about every interest he can reach through us:
+        InterestSyncPeer(pib);
+
+        // and send him what he missed:
+        TableWriteLock ();
+        SpoolLinkUp (pib);
+        TableWriteUnlock ();
+
+        // Add to wait list (or give it its threads):
+        if (msgrtrWork.numWorkers > 0)
+        {
+            StartPeerThreads (pib);
+        }
+        else
+        {
+            radProcessIORegisterDescriptor(radSocketGetDescriptor(pib->rxclient),
+                                           ClientRXHandler,
+                                           (void*)pib);
+        }
+
+        radMsgLog(PRI_STATUS, "ACK RX from Remote: %s:%d <== %s:%d",
+                   radSocketGetHost(pib->rxclient), 
+                   radSocketGetPort(pib->rxclient),
+                   radSocketGetRemoteHost(pib->rxclient), 
+                   radSocketGetRemotePort(pib->rxclient));
+    }
+    else
+    {
+        radMsgLog(PRI_HIGH, "ServerRXHandler: unexpected subMsgId %d", 
+                   inMsg.subMsgID);
+        radSocketDestroy(newClient);
+        return;
+    }
+}
+
+// Tear down a remote PIB after a link failure:
+static void CloseRemotePIB (MSGRTR_PIB* pib)
+{
+    int                 IsRemote = FALSE;
+    int                 i;
+
+    if (msgrtrWork.numWorkers > 0)
+    {
+        QuiescePIB (pib);
+    }
+
+    TableWriteLock ();
+
+    // keep what he would have been sent, if we spool:
+    SpoolLinkDown (pib);
+
+    // withdraw what the mesh learned through him:
+    InterestPeerDown (pib);
+    MeshLinkDown (pib);
+
+    RemoveClientFromAllMsgs (pib);
+
+    TableWriteUnlock ();
+
+    // remove him from the PIB list
+    UnlinkPIB (pib);
+
+    for (i = 0; i < msgrtrWork.numPeers; i ++)
+    {
+        if (msgrtrWork.peers[i].remoteServer == pib->txclient)
+        {
+            msgrtrWork.peers[i].remoteServer = NULL;
+            IsRemote = TRUE;
+        }
+    }
+
+    if (msgrtrWork.numWorkers == 0)
+    {
+        radProcessIODeRegisterDescriptorByFd(radSocketGetDescriptor(pib->rxclient));
+    }
+    radSocketDestroy(pib->txclient);
+    radSocketDestroy(pib->rxclient);
+    FreePIB (pib);
+
+    // Restart acquisition timer?
+    if (IsRemote)
+    {
+        radTimerStart(msgrtrWork.remoteConnectTimer, MSGRTR_REMOTE_RETRY_INTERVAL);
+    }
+    return;
+}
+
+// Client RX message handler:
+static UCHAR SocketRXBuffer[sizeof(MSGRTR_HDR) + SYS_BUFFER_LARGEST_SIZE];
+static UCHAR SocketZBuffer[MSGRTR_TX_BUFFER_SIZE];
+static void ClientRXHandler (int fd, void *userData)
+{
+    MSGRTR_PIB*         pib = (MSGRTR_PIB*)userData;
+    MSGRTR_HDR*         msgHdr = (MSGRTR_HDR*)SocketRXBuffer;
+    int                 offset, rawLength;
+
+    // Read the header:
+    if (radSocketReadExact(pib->rxclient, msgHdr, sizeof(MSGRTR_HDR)) 
+        != sizeof(MSGRTR_HDR))
+    {
+        radMsgLog(PRI_HIGH, "ClientRXHandler: radSocketReadExact HDR failed - closing!");
+        CloseRemotePIB (pib);
+        return;
+    }
+
+    // Do NtoH conversions:
+    HdrNtoH (msgHdr);
+
+    if (msgHdr->magicNumber == MSGRTR_MAGIC_NUMBER_V1)
+    {
+        radMsgLog(PRI_HIGH, "ClientRXHandler: %s uses the old header layout "
+                   "- upgrade it, closing!", pib->name);
+        CloseRemotePIB (pib);
+        return;
+    }
+    if (msgHdr->magicNumber != MSGRTR_MAGIC_NUMBER)
+    {
+        radMsgLog(PRI_HIGH, "ClientRXHandler: HDR magic failed - closing!");
+        CloseRemotePIB (pib);
+        return;
+    }
+
+    // Read the rest:
+    if (radSocketReadExact(pib->rxclient, msgHdr->msg, msgHdr->length) 
+        != msgHdr->length)
+    {
+        radMsgLog(PRI_HIGH, "ServerRXHandler: radSocketReadExact payload failed!");
+        CloseRemotePIB (pib);
+        return;
+    }
 
-                // first, get the MIIB
-                miib = getMIIB(intMsg->targetMsgID);
-                if (miib == NULL)
+    if (msgHdr->flags & MSGRTR_FLAG_COMPRESSED)
+    {
+        rawLength = ExpandRemote (pib, msgHdr, SocketZBuffer);
+        if (rawLength == ERROR)
+        {
+            radMsgLog(PRI_HIGH, "ClientRXHandler: %s: bad compressed batch - closing!",
+                       pib->name);
+            CloseRemotePIB (pib);
+            return;
+        }
+
+        // handle each frame as if it came by itself:
+        for (offset = 0; offset < rawLength; offset += sizeof(MSGRTR_HDR) + msgHdr->length)
+        {
+            memcpy (msgHdr, SocketZBuffer + offset, sizeof(MSGRTR_HDR));
+            HdrNtoH (msgHdr);
+            memcpy (msgHdr->msg, SocketZBuffer + offset + sizeof(MSGRTR_HDR), msgHdr->length);
+            QueueMsgHandler(0, msgHdr->msgID, msgHdr, sizeof(MSGRTR_HDR) + msgHdr->length, pib);
+        }
+        return;
+    }
+
+    // Pass the pkt to the queue msg handler (he handles socket data too):
+    QueueMsgHandler(0, msgHdr->msgID, msgHdr, sizeof(MSGRTR_HDR) + msgHdr->length, pib);
+}
+
+// Wake the main thread to look at its inbox (any thread):
+static void InboxWake (void)
+{
+    char                wake = 0;
+
+    // a full pipe already has the main thread's attention:
+    if (write (msgrtrWork.inboxPipe[1], &wake, 1) == -1 && errno != EAGAIN)
+    {
+        radMsgLog(PRI_HIGH, "InboxWake: write failed: %s", strerror(errno));
+    }
+    return;
+}
+
+// Hand work to the main thread (any thread):
+static void InboxPost (MSGRTR_INBOX_TYPE type, MSGRTR_HDR *hdr, MSGRTR_PIB *pib)
+{
+    MSGRTR_INBOX_MSG    *inMsg;
+
+    inMsg = (MSGRTR_INBOX_MSG *)malloc (sizeof(*inMsg));
+    if (inMsg == NULL)
+    {
+        radMsgLog(PRI_HIGH, "InboxPost: malloc failed!");
+        if (hdr != NULL)
+        {
+            radBufferRls (hdr);
+        }
+        return;
+    }
+
+    inMsg->type = type;
+    inMsg->hdr  = hdr;
+    inMsg->pib  = pib;
+
+    pthread_mutex_lock (&msgrtrWork.inboxLock);
+    radListAddToEnd (&msgrtrWork.inbox, (NODE *)inMsg);
+    pthread_mutex_unlock (&msgrtrWork.inboxLock);
+
+    InboxWake ();
+    return;
+}
+
+// Main thread inbox handler - control messages and link failures from the 
+// remote RX threads, spill timer requests from the workers:
+static void InboxRXHandler (int fd, void *userData)
+{
+    MSGRTR_INBOX_MSG    *inMsg;
+    char                wake[64];
+
+    while (read (fd, wake, sizeof(wake)) == sizeof(wake))
+    {
+        // empty the pipe
+    }
+
+    if (__sync_lock_test_and_set (&msgrtrWork.spillWake, FALSE) && 
+        ! msgrtrWork.spillPending)
+    {
+        msgrtrWork.spillPending = TRUE;
+        radTimerStart (msgrtrWork.spillTimer, MSGRTR_SPILL_RETRY_INTERVAL);
+    }
+
+    while (TRUE)
+    {
+        pthread_mutex_lock (&msgrtrWork.inboxLock);
+        inMsg = (MSGRTR_INBOX_MSG *)radListRemoveFirst (&msgrtrWork.inbox);
+        pthread_mutex_unlock (&msgrtrWork.inboxLock);
+        if (inMsg == NULL)
+        {
+            break;
+        }
+
+        switch (inMsg->type)
+        {
+            case MSGRTR_INBOX_CONTROL:
+            {
+                QueueMsgHandler (0, inMsg->hdr->msgID, inMsg->hdr, 
+                                 sizeof(MSGRTR_HDR) + inMsg->hdr->length, 
+                                 inMsg->pib);
+                radBufferRls (inMsg->hdr);
+                break;
+            }
+            case MSGRTR_INBOX_LINK_DOWN:
+            {
+                CloseRemotePIB (inMsg->pib);
+                break;
+            }
+        }
+
+        free (inMsg);
+    }
+
+    return;
+}
+
+// Drop whatever the inbox holds for a PIB about to be freed:
+static void InboxPurge (MSGRTR_PIB *pib)
+{
+    MSGRTR_INBOX_MSG    *inMsg, *next;
+
+    pthread_mutex_lock (&msgrtrWork.inboxLock);
+    for (inMsg = (MSGRTR_INBOX_MSG *)radListGetFirst (&msgrtrWork.inbox);
+         inMsg != NULL;
+         inMsg = next)
+    {
+        next = (MSGRTR_INBOX_MSG *)radListGetNext (&msgrtrWork.inbox, (NODE *)inMsg);
+        if (inMsg->pib == pib)
+        {
+            radListRemove (&msgrtrWork.inbox, (NODE *)inMsg);
+            if (inMsg->hdr != NULL)
+            {
+                radBufferRls (inMsg->hdr);
+            }
+            free (inMsg);
+        }
+    }
+    pthread_mutex_unlock (&msgrtrWork.inboxLock);
+    return;
+}
+
+// Pass on a frame read by a remote RX thread:
+static void PeerRXFrame (MSGRTR_PIB *pib, MSGRTR_HDR *hdr)
+{
+    if (hdr->msgID == MSGRTR_INTERNAL_MSGID)
+    {
+        InboxPost (MSGRTR_INBOX_CONTROL, hdr, pib);
+    }
+    else if (MeshAccept (hdr, pib))
+    {
+        MSGRTR_COUNT(msgrtrWork.receives);
+        DispatchMessage (hdr, pib);
+    }
+    else
+    {
+        radBufferRls (hdr);
+    }
+    return;
+}
+
+// Pass on each frame of a compressed batch read by a remote RX thread 
+// (releases 'hdr'); returns OK or ERROR:
+static int PeerRXExpand (MSGRTR_PIB *pib, MSGRTR_HDR *hdr)
+{
+    MSGRTR_HDR          msgHdr;
+    MSGRTR_HDR*         frame;
+    int                 offset, rawLength = ERROR;
+
+    if (pib->zRxBuffer == NULL)
+    {
+        pib->zRxBuffer = (UCHAR *)malloc (MSGRTR_TX_BUFFER_SIZE);
+    }
+    if (pib->zRxBuffer != NULL)
+    {
+        rawLength = ExpandRemote (pib, hdr, pib->zRxBuffer);
+    }
+    radBufferRls (hdr);
+    if (rawLength == ERROR)
+    {
+        radMsgLog(PRI_HIGH, "PeerRXThread: %s: bad compressed batch - closing!", 
+                   pib->name);
+        return ERROR;
+    }
+
+    for (offset = 0; offset < rawLength; offset += sizeof(msgHdr) + msgHdr.length)
+    {
+        memcpy (&msgHdr, pib->zRxBuffer + offset, sizeof(msgHdr));
+        HdrNtoH (&msgHdr);
+
+        frame = (MSGRTR_HDR *)radBufferGet (sizeof(msgHdr) + msgHdr.length);
+        if (frame == NULL)
+        {
+            radMsgLog(PRI_HIGH, "PeerRXThread: %s: radBufferGet failed - closing!", 
+                       pib->name);
+            return ERROR;
+        }
+
+        *frame = msgHdr;
+        memcpy (frame->msg, pib->zRxBuffer + offset + sizeof(msgHdr), msgHdr.length);
+        PeerRXFrame (pib, frame);
+    }
+
+    return OK;
+}
+
+// Multicast RX (main thread) - one datagram at a time:
+static UCHAR        McastRXBuffer[MSGRTR_MCAST_DATAGRAM_SIZE];
+
+// Find the linked router a group datagram came from, NULL if we don't 
+// share the group with it:
+static MSGRTR_PIB *McastPeerFind (ULONG routerID)
+{
+    MSGRTR_PIB          *pib;
+
+    for (pib = (MSGRTR_PIB *)radListGetFirst (&msgrtrWork.pibList);
+         pib != NULL;
+         pib = (MSGRTR_PIB *)radListGetNext (&msgrtrWork.pibList, (NODE *)pib))
+    {
+        if (pib->type == PIB_TYPE_REMOTE && pib->routerID == routerID &&
+            (pib->linkFlags & MSGRTR_LINK_MULTICAST) && ! pib->txDown)
+        {
+            if (pib->mcastRx == NULL)
+            {
+                pib->mcastRx = (MSGRTR_MCAST_RX *)calloc (1, sizeof(MSGRTR_MCAST_RX));
+                if (pib->mcastRx == NULL)
+                {
+                    return NULL;
+                }
+            }
+            return pib;
+        }
+    }
+
+    return NULL;
+}
+
+// Route a DATA datagram's frame as if it came over the peer's link:
+static void McastDeliver (MSGRTR_PIB *pib, MSGRTR_MCAST_HDR *mhdr, int length)
+{
+    MSGRTR_HDR          *frame = (MSGRTR_HDR *)(mhdr + 1);
+    MSGRTR_HDR          *copy;
+    int                 frameLength = length - sizeof(*mhdr);
+
+    if (frameLength < (int)sizeof(*frame))
+    {
+        return;
+    }
+    HdrNtoH (frame);
+    if (frame->magicNumber != MSGRTR_MAGIC_NUMBER || 
+        frame->length != frameLength - sizeof(*frame) ||
+        frame->msgID == MSGRTR_INTERNAL_MSGID)
+    {
+        radMsgLog(PRI_HIGH, "McastDeliver: %s: bad frame - ignoring", pib->name);
+        return;
+    }
+
+    // the whole group hears it, maybe we have no one for it:
+    if (getMIIB (frame->msgID) == NULL && 
+        (msgrtrWork.numRangeSegs == 0 || RangeFind (frame->msgID) == NULL))
+    {
+        return;
+    }
+
+    frame->flags |= MSGRTR_FLAG_MULTICAST;
+    pib->mcastRx->received ++;
+
+    if (msgrtrWork.numWorkers > 0)
+    {
+        copy = (MSGRTR_HDR *)radBufferGet (frameLength);
+        if (copy == NULL)
+        {
+            radMsgLog(PRI_HIGH, "McastDeliver: radBufferGet failed!");
+            return;
+        }
+        memcpy (copy, frame, frameLength);
+        PeerRXFrame (pib, copy);
+    }
+    else
+    {
+        QueueMsgHandler (NULL, 0, frame, frameLength, pib);
+    }
+    return;
+}
+
+// Deliver what is held in sequence from rx->nextSeq on:
+static void McastRxRelease (MSGRTR_PIB *pib, MSGRTR_MCAST_RX *rx)
+{
+    int                 slot;
+
+    while (rx->numHeld > 0)
+    {
+        slot = rx->nextSeq % MSGRTR_MCAST_HOLD_SLOTS;
+        if (rx->held[slot] == NULL)
+        {
+            break;
+        }
+        McastDeliver (pib, (MSGRTR_MCAST_HDR *)rx->held[slot], rx->heldLength[slot]);
+        free (rx->held[slot]);
+        rx->held[slot] = NULL;
+        rx->numHeld --;
+        rx->nextSeq ++;
+    }
+
+    if (MSGRTR_SEQ_DIFF(rx->highSeq, rx->nextSeq) < 0)
+    {
+        // caught up
+        rx->nakTries = 0;
+    }
+    return;
+}
+
+// Give up on everything before 'upto', delivering what we hold of it:
+static void McastRxSkip (MSGRTR_PIB *pib, MSGRTR_MCAST_RX *rx, UINT upto)
+{
+    int                 slot;
+
+    while (MSGRTR_SEQ_DIFF(upto, rx->nextSeq) > 0 && rx->numHeld > 0)
+    {
+        slot = rx->nextSeq % MSGRTR_MCAST_HOLD_SLOTS;
+        if (rx->held[slot] != NULL)
+        {
+            McastDeliver (pib, (MSGRTR_MCAST_HDR *)rx->held[slot], rx->heldLength[slot]);
+            free (rx->held[slot]);
+            rx->held[slot] = NULL;
+            rx->numHeld --;
+        }
+        else
+        {
+            rx->lost ++;
+        }
+        rx->nextSeq ++;
+    }
+    if (MSGRTR_SEQ_DIFF(upto, rx->nextSeq) > 0)
+    {
+        rx->lost += MSGRTR_SEQ_DIFF(upto, rx->nextSeq);
+        rx->nextSeq = upto;
+    }
+
+    rx->nakTries = 0;
+    McastRxRelease (pib, rx);
+    return;
+}
+
+// Drop what is held and start over at 'seq' of a new (or first) stream:
+static void McastRxSync (MSGRTR_MCAST_RX *rx, ULONG epoch, UINT seq)
+{
+    int                 i;
+
+    for (i = 0; rx->numHeld > 0 && i < MSGRTR_MCAST_HOLD_SLOTS; i ++)
+    {
+        if (rx->held[i] != NULL)
+        {
+            free (rx->held[i]);
+            rx->held[i] = NULL;
+            rx->numHeld --;
+        }
+    }
+    rx->inSync      = TRUE;
+    rx->epoch       = epoch;
+    rx->nextSeq     = seq;
+    rx->highSeq     = seq - 1;
+    rx->nakTries    = 0;
+    return;
+}
+
+// NAK the gaps between what we delivered and the newest seq we know of:
+static void McastNak (MSGRTR_MCAST_RX *rx)
+{
+    UINT                seq, first = 0;
+    ULONG               count = 0;
+    int                 i;
+
+    for (i = 0, seq = rx->nextSeq; 
+         i < MSGRTR_MCAST_HOLD_SLOTS && MSGRTR_SEQ_DIFF(rx->highSeq, seq) >= 0; 
+         i ++, seq ++)
+    {
+        if (rx->held[seq % MSGRTR_MCAST_HOLD_SLOTS] == NULL)
+        {
+            if (count == 0)
+            {
+                first = seq;
+            }
+            count ++;
+        }
+        else if (count > 0)
+        {
+            McastSendControl (MSGRTR_MCAST_NAK, rx->epoch, first, count, &rx->source);
+            rx->naks ++;
+            count = 0;
+        }
+    }
+    if (count > 0)
+    {
+        McastSendControl (MSGRTR_MCAST_NAK, rx->epoch, first, count, &rx->source);
+        rx->naks ++;
+    }
+
+    rx->nakSeq = rx->nextSeq;
+    rx->nakTries ++;
+    return;
+}
+
+// Handle a DATA datagram (off the group or a unicast repair):
+static void McastRXData 
+(
+    MSGRTR_PIB          *pib, 
+    MSGRTR_MCAST_HDR    *mhdr, 
+    int                 length, 
+    int                 isRepair
+)
+{
+    MSGRTR_MCAST_RX     *rx = pib->mcastRx;
+    UINT                seq = mhdr->seq;
+    int                 diff, slot;
+
+    if (! rx->inSync || rx->epoch != mhdr->epoch)
+    {
+        McastRxSync (rx, mhdr->epoch, seq);
+    }
+
+    diff = MSGRTR_SEQ_DIFF(seq, rx->nextSeq);
+    if (diff < 0)
+    {
+        // had it already
+        return;
+    }
+    if (MSGRTR_SEQ_DIFF(seq, rx->highSeq) > 0)
+    {
+        rx->highSeq = seq;
+    }
+    if (diff >= MSGRTR_MCAST_HOLD_SLOTS)
+    {
+        // too far ahead to wait for the gap
+        McastRxSkip (pib, rx, seq - MSGRTR_MCAST_HOLD_SLOTS + 1);
+        diff = MSGRTR_SEQ_DIFF(seq, rx->nextSeq);
+    }
+
+    if (isRepair)
+    {
+        rx->repaired ++;
+    }
+
+    if (diff > 0)
+    {
+        // hold it until the gap is filled
+        slot = seq % MSGRTR_MCAST_HOLD_SLOTS;
+        if (rx->held[slot] == NULL)
+        {
+            rx->held[slot] = (UCHAR *)malloc (length);
+            if (rx->held[slot] == NULL)
+            {
+                return;
+            }
+            memcpy (rx->held[slot], mhdr, length);
+            rx->heldLength[slot] = length;
+            rx->numHeld ++;
+        }
+        if (rx->nakTries == 0)
+        {
+            McastNak (rx);
+        }
+        return;
+    }
+
+    McastDeliver (pib, mhdr, length);
+    rx->nextSeq ++;
+    McastRxRelease (pib, rx);
+    return;
+}
+
+// Multicast socket RX handler (main thread) - reads both the group socket 
+// and our sending socket, where NAKs and repairs arrive:
+static void McastRXHandler (int fd, void *userData)
+{
+    RADUDPSOCK_ID       sock = (RADUDPSOCK_ID)userData;
+    MSGRTR_MCAST_HDR    *mhdr = (MSGRTR_MCAST_HDR *)McastRXBuffer;
+    MSGRTR_MCAST_RX     *rx;
+    MSGRTR_PIB          *pib;
+    struct sockaddr_in  source;
+    int                 i, length;
+
+    for (i = 0; i < MSGRTR_MCAST_RX_BURST; i ++)
+    {
+        length = radUDPSocketReceiveFrom (sock, McastRXBuffer, sizeof(McastRXBuffer), 
+                                          &source);
+        if (length == ERROR)
+        {
+            // drained
+            break;
+        }
+        if (length < (int)sizeof(*mhdr) || ntohl(mhdr->magic) != MSGRTR_MCAST_MAGIC)
+        {
+            continue;
+        }
+
+        mhdr->type      = ntohl(mhdr->type);
+        mhdr->routerID  = ntohl(mhdr->routerID);
+        mhdr->epoch     = ntohl(mhdr->epoch);
+        mhdr->seq       = ntohl(mhdr->seq);
+        mhdr->count     = ntohl(mhdr->count);
+
+        if (mhdr->routerID == msgrtrWork.routerID ||
+            (pib = McastPeerFind (mhdr->routerID)) == NULL)
+        {
+            // our own looped back, or not a router we are linked to
+            continue;
+        }
+
+        rx = pib->mcastRx;
+        rx->source      = source;
+        rx->silentTicks = 0;
+
+        switch (mhdr->type)
+        {
+            case MSGRTR_MCAST_DATA:
+                McastRXData (pib, mhdr, length, (sock == msgrtrWork.mcastTxSock));
+                break;
+
+            case MSGRTR_MCAST_HEARTBEAT:
+                if (! rx->inSync || rx->epoch != mhdr->epoch)
                 {
-                    // msgID does not exist...
-                    return;
+                    // nothing before this is expected of it
+                    McastRxSync (rx, mhdr->epoch, mhdr->seq + 1);
                 }
-
-                // now that we have the MIIB, remove this consumer
-                for (cib = (MSGRTR_CIB *)radListGetFirst (&miib->consumers);
-                     cib != NULL;
-                     cib = (MSGRTR_CIB *)radListGetNext (&miib->consumers, (NODE *)cib))
+                else if (MSGRTR_SEQ_DIFF(mhdr->seq, rx->highSeq) > 0)
                 {
-                    if (cib->pib == pib)
+                    // we missed its latest
+                    rx->highSeq = mhdr->seq;
+                    if (MSGRTR_SEQ_DIFF(rx->highSeq, rx->nextSeq) >= MSGRTR_MCAST_HOLD_SLOTS)
                     {
-                        // remove him
-                        radListRemove (&miib->consumers, (NODE *)cib);
-                        free (cib);
-                        break;
+                        McastRxSkip (pib, rx, rx->highSeq - MSGRTR_MCAST_HOLD_SLOTS + 1);
+                    }
+                    if (rx->nakTries == 0)
+                    {
+                        McastNak (rx);
                     }
                 }
+                break;
 
-                // Check here to see if there are any more consumers:
-                // If not, remove the MIIB and deregister with remote guys:
-                if (radListGetNumberOfNodes(&miib->consumers) == 0)
+            case MSGRTR_MCAST_NAK:
+                if (mhdr->epoch == msgrtrWork.epoch)
                 {
-                    // Deregister RX to all remotes (except possibly the sender):
-                    DeregisterAllRemotesMsgID(intMsg->targetMsgID, sockpib);
-
-                    // Remove the MIIB:
-                    radListRemove(&msgrtrWork.miibList, (NODE *)miib);
+                    McastResend (mhdr->seq, mhdr->count, &source);
+                }
+                break;
 
-                    radMsgLog(PRI_STATUS, "QueueMsgHandler: removed empty MIIB for msgID %d",
-                               intMsg->targetMsgID);
+            case MSGRTR_MCAST_LOST:
+                if (rx->inSync && rx->epoch == mhdr->epoch &&
+                    MSGRTR_SEQ_DIFF(mhdr->seq, rx->nextSeq) <= 0 &&
+                    MSGRTR_SEQ_DIFF(mhdr->seq + mhdr->count, rx->nextSeq) > 0)
+                {
+                    McastRxSkip (pib, rx, mhdr->seq + mhdr->count);
                 }
+                break;
+        }
+    }
 
-                return;
-            }
+    return;
+}
 
-            case MSGRTR_SUBTYPE_DUMP_STATS:
-            {
-                radMsgLog(PRI_MEDIUM, "---------- Message Router Totals:  TX:%10.10u  RX:%10.10u ----------",
-                           msgrtrWork.transmits, msgrtrWork.receives);
-                radMsgLog(PRI_MEDIUM, "     Name     \t MSGS TX  \t MSGS RX  \t  TXERRS  \t  RXERRS");
-                radMsgLog(PRI_MEDIUM, "--------------\t----------\t----------\t----------\t----------");
+// Stop multicasting with a router that doesn't hear the group (tables 
+// locked); it is told so it stops too:
+static void McastPeerDeaf (MSGRTR_PIB *pib)
+{
+    MSGRTR_INTERNAL_MSG     msg;
 
-                // loop through the PIBs
-                for (pib = (MSGRTR_PIB *)radListGetFirst (&msgrtrWork.pibList);
-                     pib != NULL;
-                     pib = (MSGRTR_PIB *)radListGetNext (&msgrtrWork.pibList, (NODE *)pib))
-                {
-                    radMsgLog(PRI_MEDIUM, "%-14s\t%10u\t%10u\t%10u\t%10u",
-                               pib->name,
-                               pib->transmits, 
-                               pib->receives,
-                               pib->txErrors,
-                               pib->rxErrors);
-                }
+    memset (&msg, 0, sizeof(msg));
+    msg.subMsgID    = MSGRTR_SUBTYPE_MCAST_DEAF;
+    msg.routerID    = msgrtrWork.routerID;
+    SendToRemote (pib, MSGRTR_INTERNAL_MSGID, &msg, sizeof(msg), NULL);
 
-                radMsgLog(PRI_MEDIUM, "--------------------------------------------------------------------------");
-                return;
-            }
-        }
+    pib->linkFlags &= ~MSGRTR_LINK_MULTICAST;
+    radMsgLog(PRI_MEDIUM, "multicast: nothing heard from %s - using TCP",
+               pib->name);
+    return;
+}
 
-        return;
-    }
+// Multicast timer - heartbeats, NAK retries and silent peers:
+static void mcastTimerHandler (void *parm)
+{
+    MSGRTR_MCAST_RX     *rx;
+    MSGRTR_PIB          *pib;
+    UINT                seq;
 
-    
-    //// normal message, route it ////
+    pthread_mutex_lock (&msgrtrWork.mcastLock);
+    seq = msgrtrWork.mcastSeq;
+    pthread_mutex_unlock (&msgrtrWork.mcastLock);
 
-    // get the PIB
-    if (sockpib == NULL)
-    {
-        if ((pib = getPIBByPID (hdr->srcpid)) == NULL)
-        {
-            // he does not exist
-            return;
-        }
-    }
-    else
+    if (seq != msgrtrWork.mcastBeatSeq || 
+        ++ msgrtrWork.mcastIdleTicks >= MSGRTR_MCAST_IDLE_TICKS)
     {
-        pib = sockpib;
+        McastSendControl (MSGRTR_MCAST_HEARTBEAT, msgrtrWork.epoch, seq, 0, 
+                          &msgrtrWork.mcastAdrs);
+        msgrtrWork.mcastBeatSeq     = seq;
+        msgrtrWork.mcastIdleTicks   = 0;
     }
 
-    msgrtrWork.receives ++;
-
-    // get the proper MIIB
-    miib = getMIIB (hdr->msgID);
-    if (miib == NULL)
+    for (pib = (MSGRTR_PIB *)radListGetFirst (&msgrtrWork.pibList);
+         pib != NULL;
+         pib = (MSGRTR_PIB *)radListGetNext (&msgrtrWork.pibList, (NODE *)pib))
     {
-        // no one to send it to
-        pib->txErrors ++;
-        return;
-    }
+        if (pib->type != PIB_TYPE_REMOTE || ! (pib->linkFlags & MSGRTR_LINK_MULTICAST) ||
+            pib->txDown)
+        {
+            continue;
+        }
+        if (pib->mcastRx == NULL)
+        {
+            pib->mcastRx = (MSGRTR_MCAST_RX *)calloc (1, sizeof(MSGRTR_MCAST_RX));
+            if (pib->mcastRx == NULL)
+            {
+                continue;
+            }
+        }
+        rx = pib->mcastRx;
 
-    pib->transmits ++;
+        if (++ rx->silentTicks >= MSGRTR_MCAST_DEAF_TICKS)
+        {
+            TableWriteLock ();
+            McastPeerDeaf (pib);
+            TableWriteUnlock ();
+            continue;
+        }
 
-    // loop through the consumer list, sending it to each one of them
-    for (cib = (MSGRTR_CIB *)radListGetFirst (&miib->consumers);
-         cib != NULL;
-         cib = (MSGRTR_CIB *)radListGetNext (&miib->consumers, (NODE *)cib))
-    {
-        if (cib->pib == sockpib)
+        if (! rx->inSync || MSGRTR_SEQ_DIFF(rx->highSeq, rx->nextSeq) < 0)
         {
-            // Don't send it back to the remote source (we allow local loopback):
+            // no gap
             continue;
         }
 
-        // send it to him
-        if (SendToClient(cib->pib, hdr) == ERROR)
+        if (rx->nakSeq != rx->nextSeq)
+        {
+            // repairs are coming in
+            rx->nakTries = 0;
+        }
+        if (rx->nakTries >= MSGRTR_MCAST_NAK_TRIES)
+        {
+            McastRxSkip (pib, rx, rx->highSeq + 1);
+        }
+        else
         {
-            radMsgLog(PRI_HIGH, "QueueMsgHandler: %s: SendToClient failed!",
-                      cib->pib->name);
+            McastNak (rx);
         }
     }
-            
+
+    radTimerStart (msgrtrWork.mcastTimer, MSGRTR_MCAST_TIMER_INTERVAL);
     return;
 }
 
-// Listen socket's connection queue handler:
-static void ServerRXHandler (int fd, void *userData)
+// Join the multicast group and open the sending socket (MULTICAST_GROUP 
+// set); returns OK or ERROR:
+static int McastOpen (void)
 {
-    RADSOCK_ID          newClient;
-    RADSOCK_ID          newServer;
-    MSGRTR_HDR          msgHdr;
-    MSGRTR_INTERNAL_MSG inMsg, outMsg;
-    MSGRTR_PIB*         pib;
+    char                *iface;
+    int                 rcvBuf, rxIO;
 
-    newClient = radSocketServerAcceptConnection(msgrtrWork.server);
-    if (newClient == NULL)
+    iface = (msgrtrWork.mcastInterface[0] != 0) ? msgrtrWork.mcastInterface : "0.0.0.0";
+
+    memset (&msgrtrWork.mcastAdrs, 0, sizeof(msgrtrWork.mcastAdrs));
+    msgrtrWork.mcastAdrs.sin_family = AF_INET;
+    msgrtrWork.mcastAdrs.sin_port   = htons(msgrtrWork.mcastPort);
+    if (inet_aton (msgrtrWork.mcastGroup, &msgrtrWork.mcastAdrs.sin_addr) == 0 ||
+        ! IN_MULTICAST(ntohl(msgrtrWork.mcastAdrs.sin_addr.s_addr)))
     {
-        radMsgLog(PRI_HIGH, "ServerRXHandler: radSocketServerAcceptConnection failed!");
-        return;
+        radMsgLog(PRI_CATASTROPHIC, "McastOpen: %s is not a multicast group IP!",
+                   msgrtrWork.mcastGroup);
+        return ERROR;
     }
 
-    // Wait for the register pkt:
-    if (radSocketReadExact(newClient, &msgHdr, sizeof(msgHdr)) != sizeof(msgHdr))
+    msgrtrWork.mcastHistory = (UCHAR *)malloc (msgrtrWork.mcastHistoryBytes);
+    msgrtrWork.mcastSent    = (MSGRTR_MCAST_SENT *)calloc (MSGRTR_MCAST_HISTORY_SLOTS,
+                                                          sizeof(MSGRTR_MCAST_SENT));
+    if (msgrtrWork.mcastHistory == NULL || msgrtrWork.mcastSent == NULL)
     {
-        radMsgLog(PRI_HIGH, "ServerRXHandler: radSocketReadExact HDR failed!");
-        radSocketDestroy(newClient);
-        return;
+        radMsgLog(PRI_CATASTROPHIC, "McastOpen: history allocation failed!");
+        McastClose ();
+        return ERROR;
     }
 
-    // Do NtoH conversions:
-    msgHdr.magicNumber  = ntohl(msgHdr.magicNumber);
-    msgHdr.srcpid       = ntohl(msgHdr.srcpid);
-    msgHdr.msgID        = ntohl(msgHdr.msgID);
-    msgHdr.length       = ntohl(msgHdr.length);
-
-    if (msgHdr.magicNumber != MSGRTR_MAGIC_NUMBER)
+    // the group port:
+    msgrtrWork.mcastRxSock = radUDPSocketCreate ();
+    if (msgrtrWork.mcastRxSock == NULL ||
+        radUDPSocketBind (msgrtrWork.mcastRxSock, (USHORT)msgrtrWork.mcastPort) == ERROR ||
+        radUDPSocketAddMulticastMembership (msgrtrWork.mcastRxSock, 
+                                            msgrtrWork.mcastGroup, iface) == ERROR)
     {
-        radMsgLog(PRI_HIGH, "ServerRXHandler: HDR magic failed!");
-        radSocketDestroy(newClient);
-        return;
+        radMsgLog(PRI_CATASTROPHIC, "McastOpen: unable to join %s:%d on %s!",
+                   msgrtrWork.mcastGroup, msgrtrWork.mcastPort, iface);
+        McastClose ();
+        return ERROR;
     }
-
-    if (msgHdr.msgID != MSGRTR_INTERNAL_MSGID)
+#ifdef IP_MULTICAST_ALL
     {
-        radMsgLog(PRI_HIGH, "ServerRXHandler: HDR ID not internal!");
-        radSocketDestroy(newClient);
-        return;
+        // only our group, not every group someone joined on this port:
+        int     all = 0;
+        setsockopt (radUDPSocketGetDescriptor (msgrtrWork.mcastRxSock), 
+                    IPPROTO_IP, IP_MULTICAST_ALL, &all, sizeof(all));
     }
-
-    // Read the rest:
-    if (radSocketReadExact(newClient, &inMsg, sizeof(inMsg)) != sizeof(inMsg))
+#endif
+
+    // and our own, which NAKs and repairs are addressed to (routers on this 
+    // host hear our datagrams through the loopback):
+    msgrtrWork.mcastTxSock = radUDPSocketCreate ();
+    if (msgrtrWork.mcastTxSock == NULL ||
+        radUDPSocketBind (msgrtrWork.mcastTxSock, 0) == ERROR ||
+        radUDPSocketSetMulticastTTL (msgrtrWork.mcastTxSock, msgrtrWork.mcastTTL) == ERROR ||
+        radUDPSocketSetMulticastLoopback (msgrtrWork.mcastTxSock, TRUE) == ERROR ||
+        (msgrtrWork.mcastInterface[0] != 0 &&
+         radUDPSocketSetMulticastTXInterface (msgrtrWork.mcastTxSock, 
+                                              msgrtrWork.mcastInterface) == ERROR))
     {
-        radMsgLog(PRI_HIGH, "ServerRXHandler: radSocketReadExact inMsg failed!");
-        radSocketDestroy(newClient);
-        return;
+        radMsgLog(PRI_CATASTROPHIC, "McastOpen: unable to open the sending socket!");
+        McastClose ();
+        return ERROR;
     }
 
-    // Do NtoH conversions:
-    inMsg.subMsgID      = ntohl(inMsg.subMsgID);
-    inMsg.targetMsgID   = ntohl(inMsg.targetMsgID);
-    inMsg.srcPort       = ntohl(inMsg.srcPort);
-    inMsg.socketID      = ntohl(inMsg.socketID);
-    inMsg.maxMsgSize    = ntohl(inMsg.maxMsgSize);
-
-    if (inMsg.subMsgID == MSGRTR_SUBTYPE_REGISTER)
+    msgrtrWork.mcastTimer = radTimerCreate (NULL, mcastTimerHandler, NULL);
+    if (msgrtrWork.mcastTimer == NULL)
     {
-        radMsgLog(PRI_STATUS, "Remote accept RX: %s:%d <== %s:%d",
-                   radSocketGetHost(newClient), 
-                   radSocketGetPort(newClient),
-                   radSocketGetRemoteHost(newClient), 
-                   radSocketGetRemotePort(newClient));
+        radMsgLog(PRI_CATASTROPHIC, "radTimerCreate failed!");
+        McastClose ();
+        return ERROR;
+    }
 
-        // Now open the TX side socket:
-        newServer = radSocketClientCreate(inMsg.srcIP, inMsg.srcPort);
-        if (newServer == NULL)
+    // bursts should not overflow the kernel (the system may cap this):
+    rcvBuf = MSGRTR_MCAST_RCVBUF_BYTES;
+    setsockopt (radUDPSocketGetDescriptor (msgrtrWork.mcastRxSock), 
+                SOL_SOCKET, SO_RCVBUF, &rcvBuf, sizeof(rcvBuf));
+    setsockopt (radUDPSocketGetDescriptor (msgrtrWork.mcastTxSock), 
+                SOL_SOCKET, SO_RCVBUF, &rcvBuf, sizeof(rcvBuf));
+
+    rxIO = radProcessIORegisterDescriptor (radUDPSocketGetDescriptor (msgrtrWork.mcastRxSock),
+                                           McastRXHandler,
+                                           msgrtrWork.mcastRxSock);
+    if (rxIO == ERROR ||
+        radProcessIORegisterDescriptor (radUDPSocketGetDescriptor (msgrtrWork.mcastTxSock),
+                                        McastRXHandler,
+                                        msgrtrWork.mcastTxSock)
+        == ERROR)
+    {
+        radMsgLog(PRI_CATASTROPHIC, "McastOpen: radProcessIORegisterDescriptor failed!");
+        if (rxIO != ERROR)
         {
-            radMsgLog(PRI_HIGH, "ServerRXHandler: radSocketClientCreate %s:%d failed!",
-                       inMsg.srcIP, inMsg.srcPort);
-            radSocketDestroy(newClient);
-            return;
+            radProcessIODeRegisterDescriptor (rxIO);
         }
+        McastClose ();
+        return ERROR;
+    }
+    radTimerStart (msgrtrWork.mcastTimer, MSGRTR_MCAST_TIMER_INTERVAL);
 
-        // Send him an ack on this new socket:
-        msgHdr.magicNumber      = MSGRTR_MAGIC_NUMBER;
-        msgHdr.srcpid           = 0;
-        msgHdr.msgID            = MSGRTR_INTERNAL_MSGID;
-        msgHdr.length           = sizeof(MSGRTR_INTERNAL_MSG);
+    msgrtrWork.linkFlags |= MSGRTR_LINK_MULTICAST;
+    radMsgLog(PRI_STATUS, "multicast: group %s:%d on %s, TTL %d, %lu history bytes",
+               msgrtrWork.mcastGroup, msgrtrWork.mcastPort, iface,
+               msgrtrWork.mcastTTL, msgrtrWork.mcastHistoryBytes);
+    return OK;
+}
 
-        outMsg.subMsgID         = MSGRTR_SUBTYPE_ACK;
-        sprintf(outMsg.name, "router:%s", radSocketGetHost(newServer));
-        strncpy(outMsg.srcIP, inMsg.srcIP, sizeof(outMsg.srcIP));
-        outMsg.srcPort          = inMsg.srcPort;
-        outMsg.socketID         = inMsg.socketID;
-        outMsg.maxMsgSize       = SYS_BUFFER_LARGEST_SIZE;
+// Leave the multicast group (at exit, or McastOpen failing):
+static void McastClose (void)
+{
+    if (msgrtrWork.mcastRxSock != NULL)
+    {
+        radUDPSocketDestroy (msgrtrWork.mcastRxSock);
+        msgrtrWork.mcastRxSock = NULL;
+    }
+    if (msgrtrWork.mcastTxSock != NULL)
+    {
+        radUDPSocketDestroy (msgrtrWork.mcastTxSock);
+        msgrtrWork.mcastTxSock = NULL;
+    }
+    if (msgrtrWork.mcastHistory != NULL)
+    {
+        free (msgrtrWork.mcastHistory);
+        msgrtrWork.mcastHistory = NULL;
+    }
+    if (msgrtrWork.mcastSent != NULL)
+    {
+        free (msgrtrWork.mcastSent);
+        msgrtrWork.mcastSent = NULL;
+    }
+    msgrtrWork.linkFlags &= ~MSGRTR_LINK_MULTICAST;
+    return;
+}
 
-        // Do HtoN conversions:
-        msgHdr.magicNumber  = htonl(msgHdr.magicNumber);
-        msgHdr.srcpid       = htonl(msgHdr.srcpid);
-        msgHdr.msgID        = htonl(msgHdr.msgID);
-        msgHdr.length       = htonl(msgHdr.length);
-        outMsg.subMsgID     = htonl(outMsg.subMsgID);
-        outMsg.targetMsgID  = htonl(outMsg.targetMsgID);
-        outMsg.srcPort      = htonl(outMsg.srcPort);
-        outMsg.socketID     = htonl(outMsg.socketID);
-        outMsg.maxMsgSize   = htonl(outMsg.maxMsgSize);
+// Remote RX thread - reads frames from a peer router; messages go to the 
+// worker owning their msgID, control messages to the main thread:
+static void PeerRXThread (RAD_THREAD_ID threadId, void *threadData)
+{
+    MSGRTR_PIB*         pib = (MSGRTR_PIB*)threadData;
+    MSGRTR_HDR          msgHdr;
+    MSGRTR_HDR*         hdr;
 
-        if (radSocketWriteExact(newServer, &msgHdr, sizeof(msgHdr)) != sizeof(msgHdr))
-        {
-            radMsgLog(PRI_HIGH, "ServerRXHandler: radSocketWriteExact msgHdr failed!");
-            radSocketDestroy(newServer);
-            radSocketDestroy(newClient);
-            return;
-        }
-        if (radSocketWriteExact(newServer, &outMsg, sizeof(outMsg)) != sizeof(outMsg))
+    while (! pib->ioStop)
+    {
+        if (radSocketReadExact(pib->rxclient, &msgHdr, sizeof(msgHdr)) != sizeof(msgHdr))
         {
-            radMsgLog(PRI_HIGH, "ServerRXHandler: radSocketWriteExact outMsg failed!");
-            radSocketDestroy(newServer);
-            radSocketDestroy(newClient);
-            return;
+            break;
         }
 
-        // OK, we are done, store the sockets in a new PIB:
-        pib = (MSGRTR_PIB *)malloc (sizeof(*pib));
-        if (pib == NULL)
+        HdrNtoH (&msgHdr);
+
+        if (msgHdr.magicNumber == MSGRTR_MAGIC_NUMBER_V1)
         {
-            radMsgLog(PRI_HIGH, "ServerRXHandler: %s: malloc PIB failed!",
-                       inMsg.name);
-            radSocketDestroy(newServer);
-            radSocketDestroy(newClient);
-            return;
+            radMsgLog(PRI_HIGH, "PeerRXThread: %s uses the old header layout "
+                       "- upgrade it, closing!", pib->name);
+            break;
         }
-
-        memset (pib, 0, sizeof(*pib));
-        pib->type       = PIB_TYPE_REMOTE;
-        strncpy (pib->name, inMsg.name, PROCESS_MAX_NAME_LEN);
-        pib->rxclient   = newClient;
-        pib->txclient   = newServer;
-        pib->maxMsgSize = inMsg.maxMsgSize;
-
-        // Now register for all messages we are interested in:
-        if (RegisterRemoteMsgID(pib, 0, TRUE) == ERROR)
+        if (msgHdr.magicNumber != MSGRTR_MAGIC_NUMBER || 
+            msgHdr.length > SYS_BUFFER_LARGEST_SIZE)
         {
-            radMsgLog(PRI_HIGH, "ServerRXHandler: RegisterRemoteMsgID failed");
-            radSocketDestroy(pib->rxclient);
-            radSocketDestroy(pib->txclient);
-            free(pib);
-            return;
+            radMsgLog(PRI_HIGH, "PeerRXThread: %s: bad HDR - closing!", pib->name);
+            break;
         }
 
-        radListAddToEnd(&msgrtrWork.pibList, (NODE *)pib);
-
-        // Add the RX socket to our wait list:
-        radProcessIORegisterDescriptor(radSocketGetDescriptor(pib->rxclient),
-                                       ClientRXHandler,
-                                       (void*)pib);
-
-        radMsgLog(PRI_STATUS, "Remote Accept: %s:%d ==> %s:%d",
-                   radSocketGetHost(pib->txclient), 
-                   radSocketGetPort(pib->txclient),
-                   radSocketGetRemoteHost(pib->txclient), 
-                   radSocketGetRemotePort(pib->txclient));
-    }
-    else if (inMsg.subMsgID == MSGRTR_SUBTYPE_ACK)
-    {
-        // Now verify:
-        if (strncmp(radSocketGetHost(newClient), inMsg.srcIP, sizeof(inMsg.srcIP)))
+        hdr = (MSGRTR_HDR *)radBufferGet (sizeof(msgHdr) + msgHdr.length);
+        if (hdr == NULL)
         {
-            radMsgLog(PRI_HIGH, "ServerRXHandler: ACK local IP:%s does not match %s",
-                       radSocketGetHost(newClient), inMsg.srcIP);
-            radSocketDestroy(newClient);
-            return;
+            radMsgLog(PRI_HIGH, "PeerRXThread: %s: radBufferGet failed - closing!", 
+                       pib->name);
+            break;
         }
-        if (msgrtrWork.listenPort != inMsg.srcPort)
+
+        *hdr = msgHdr;
+        if (radSocketReadExact(pib->rxclient, hdr->msg, hdr->length) != (int)hdr->length)
         {
-            radMsgLog(PRI_HIGH, "ServerRXHandler: ACK local port:%d does not match %d",
-                       msgrtrWork.listenPort, inMsg.srcPort);
-            radSocketDestroy(newClient);
-            return;
+            radBufferRls (hdr);
+            break;
         }
 
-        // They match, add the RX socket to the PIB:
-        pib = getPIBBySocket(radSocketGetDescriptor((RADSOCK_ID)inMsg.socketID));
-        if (pib == NULL)
+        if (hdr->flags & MSGRTR_FLAG_COMPRESSED)
         {
-            radMsgLog(PRI_HIGH, "ServerRXHandler: ACK getPIBBySocket failed");
-            radSocketDestroy(newClient);
-            return;
+            if (PeerRXExpand (pib, hdr) == ERROR)
+            {
+                break;
+            }
         }
-        pib->rxclient   = newClient;
-        pib->maxMsgSize = inMsg.maxMsgSize;
-
-        // Now register for all messages we are interested in:
-        if (RegisterRemoteMsgID(pib, 0, TRUE) == ERROR)
+        else
         {
-            radMsgLog(PRI_HIGH, "ServerRXHandler: RegisterRemoteMsgID failed");
-            RemovePIB(pib);
-            return;
+            PeerRXFrame (pib, hdr);
         }
-
-        // Add to wait list:
-        radProcessIORegisterDescriptor(radSocketGetDescriptor(pib->rxclient),
-                                       ClientRXHandler,
-                                       (void*)pib);        
-
-        radMsgLog(PRI_STATUS, "ACK RX from Remote: %s:%d <== %s:%d",
-                   radSocketGetHost(pib->rxclient), 
-                   radSocketGetPort(pib->rxclient),
-                   radSocketGetRemoteHost(pib->rxclient), 
-                   radSocketGetRemotePort(pib->rxclient));
-    }
-    else
-    {
-        radMsgLog(PRI_HIGH, "ServerRXHandler: unexpected subMsgId %d", 
-                   inMsg.subMsgID);
-        radSocketDestroy(newClient);
-        return;
     }
+
+    if (! pib->ioStop)
+    {
+        radMsgLog(PRI_HIGH, "PeerRXThread: %s: read failed - closing!", pib->name);
+        InboxPost (MSGRTR_INBOX_LINK_DOWN, NULL, pib);
+    }
+    return;
 }
 
-// Client RX message handler:
-static UCHAR SocketRXBuffer[sizeof(MSGRTR_HDR) + SYS_BUFFER_LARGEST_SIZE];
-static void ClientRXHandler (int fd, void *userData)
+// Remote TX thread - writes staged frames after the flush delay and drains
+// what the socket refused as it becomes writable:
+static void PeerTXThread (RAD_THREAD_ID threadId, void *threadData)
 {
-    MSGRTR_PIB*         pib = (MSGRTR_PIB*)userData;
-    MSGRTR_HDR*         msgHdr = (MSGRTR_HDR*)SocketRXBuffer;
-    MSGRTR_INTERNAL_MSG inMsg;
-    int                 IsRemote = FALSE;
+    MSGRTR_PIB*         pib = (MSGRTR_PIB*)threadData;
+    struct pollfd       pfd;
+    struct timespec     due;
 
-    // Read the header:
-    if (radSocketReadExact(pib->rxclient, msgHdr, sizeof(MSGRTR_HDR)) 
-        != sizeof(MSGRTR_HDR))
+    pthread_mutex_lock (&pib->lock);
+    while (! pib->ioStop)
     {
-        radMsgLog(PRI_HIGH, "ClientRXHandler: radSocketReadExact HDR failed - closing!");
-        RemoveClientFromAllMsgs (pib);
-
-        // remove him from the PIB list
-        radListRemove (&msgrtrWork.pibList, (NODE *)pib);
-
-        if (msgrtrWork.remoteServer == pib->txclient)
+        if (radListGetNumberOfNodes(&pib->txQueue) > 0)
         {
-            IsRemote = TRUE;
+            DrainRemote (pib);
+            if (radListGetNumberOfNodes(&pib->txQueue) > 0)
+            {
+                pfd.fd      = radSocketGetDescriptor(pib->txclient);
+                pfd.events  = POLLOUT;
+                pthread_mutex_unlock (&pib->lock);
+                poll (&pfd, 1, MSGRTR_TX_POLL_INTERVAL);
+                pthread_mutex_lock (&pib->lock);
+                continue;
+            }
         }
 
-        radProcessIODeRegisterDescriptorByFd(radSocketGetDescriptor(pib->rxclient));
-        radSocketDestroy(pib->txclient);
-        radSocketDestroy(pib->rxclient);
-        free (pib);
-
-        // Restart acquisition timer?
-        if (IsRemote)
+        if (pib->txLength > 0)
         {
-            msgrtrWork.remoteServer = NULL;
-            radTimerStart(msgrtrWork.remoteConnectTimer, MSGRTR_REMOTE_RETRY_INTERVAL);
+            // give the frames behind this one the flush delay to arrive:
+            clock_gettime (CLOCK_REALTIME, &due);
+            due.tv_nsec += msgrtrWork.txFlushDelay * 1000000L;
+            due.tv_sec  += due.tv_nsec / 1000000000L;
+            due.tv_nsec %= 1000000000L;
+            while (! pib->ioStop && pib->txLength > 0 &&
+                   pthread_cond_timedwait (&pib->txCond, &pib->lock, &due) == 0)
+            {
+                // woken early, keep waiting
+            }
+
+            FlushRemote (pib);
+            continue;
         }
-        return;
+
+        pthread_cond_wait (&pib->txCond, &pib->lock);
     }
+    pthread_mutex_unlock (&pib->lock);
+    return;
+}
 
-    // Do NtoH conversions:
-    msgHdr->magicNumber  = ntohl(msgHdr->magicNumber);
-    msgHdr->srcpid       = ntohl(msgHdr->srcpid);
-    msgHdr->msgID        = ntohl(msgHdr->msgID);
-    msgHdr->length       = ntohl(msgHdr->length);
+// Start a remote PIB's I/O threads once both of its sockets are up:
+static int StartPeerThreads (MSGRTR_PIB *pib)
+{
+    pib->rxThread = radthreadCreate (PeerRXThread, pib);
+    if (pib->rxThread == NULL)
+    {
+        radMsgLog(PRI_HIGH, "%s: radthreadCreate RX failed!", pib->name);
+        return ERROR;
+    }
+    radthreadSetParentHandler (pib->rxThread, NULL, NULL);
 
-    if (msgHdr->magicNumber != MSGRTR_MAGIC_NUMBER)
+    pib->txThread = radthreadCreate (PeerTXThread, pib);
+    if (pib->txThread == NULL)
     {
-        radMsgLog(PRI_HIGH, "ClientRXHandler: HDR magic failed - closing!");
-        RemoveClientFromAllMsgs (pib);
+        radMsgLog(PRI_HIGH, "%s: radthreadCreate TX failed!", pib->name);
+        return ERROR;
+    }
+    radthreadSetParentHandler (pib->txThread, NULL, NULL);
 
-        // remove him from the PIB list
-        radListRemove (&msgrtrWork.pibList, (NODE *)pib);
+    return OK;
+}
 
-        radProcessIODeRegisterDescriptorByFd(radSocketGetDescriptor(pib->rxclient));
-        radSocketDestroy(pib->txclient);
-        radSocketDestroy(pib->rxclient);
-        free (pib);
-        return;
-    }
+// Make sure no other thread still uses a PIB about to be unlinked and freed:
+// stop its I/O threads and wait for the workers to route its messages 
+// (threaded mode, routing tables not locked by us):
+static void QuiescePIB (MSGRTR_PIB *pib)
+{
+    pthread_mutex_lock (&pib->lock);
+    pib->ioStop = TRUE;
+    pthread_cond_signal (&pib->txCond);
+    pthread_mutex_unlock (&pib->lock);
 
-    // Read the rest:
-    if (radSocketReadExact(pib->rxclient, msgHdr->msg, msgHdr->length) 
-        != msgHdr->length)
+    if (pib->rxThread != NULL)
     {
-        radMsgLog(PRI_HIGH, "ServerRXHandler: radSocketReadExact payload failed!");
-        RemoveClientFromAllMsgs (pib);
+        // wake it from its read:
+        shutdown (radSocketGetDescriptor(pib->rxclient), SHUT_RDWR);
+        radthreadWaitExit (pib->rxThread);
+        pib->rxThread = NULL;
+    }
+    if (pib->txThread != NULL)
+    {
+        radthreadWaitExit (pib->txThread);
+        pib->txThread = NULL;
+    }
 
-        // remove him from the PIB list
-        radListRemove (&msgrtrWork.pibList, (NODE *)pib);
+    InboxPurge (pib);
 
-        radProcessIODeRegisterDescriptorByFd(radSocketGetDescriptor(pib->rxclient));
-        radSocketDestroy(pib->txclient);
-        radSocketDestroy(pib->rxclient);
-        free (pib);
-        return;
+    while (__sync_fetch_and_add (&pib->jobRefs, 0) > 0)
+    {
+        radUtilsSleep (1);
     }
-
-    // Pass the pkt to the queue msg handler (he handles socket data too):
-    QueueMsgHandler(0, msgHdr->msgID, msgHdr, sizeof(MSGRTR_HDR) + msgHdr->length, pib);
+    return;
 }
 
 // radlib event handler (not used):
@@ -1213,21 +7283,73 @@ static void EventHandler
     return;
 }
 
-// Remote connection timer handler:
-static void connectTimerHandler(void *parm)
+// Is 'host' (name or IP) one of this host's addresses?
+static int IsLocalHost (char *host)
+{
+    struct ifaddrs      *ifList, *ifa;
+    struct hostent      *hostentptr;
+    struct in_addr      adrs;
+    int                 isLocal = FALSE;
+
+    if (inet_aton (host, &adrs) == 0)
+    {
+        hostentptr = gethostbyname (host);
+        if (hostentptr == NULL || hostentptr->h_addrtype != AF_INET)
+        {
+            return FALSE;
+        }
+        adrs = *((struct in_addr *)hostentptr->h_addr);
+    }
+
+    if ((ntohl(adrs.s_addr) >> 24) == 127)
+    {
+        // loopback
+        return TRUE;
+    }
+
+    if (getifaddrs (&ifList) == -1)
+    {
+        return FALSE;
+    }
+    for (ifa = ifList; ifa != NULL; ifa = ifa->ifa_next)
+    {
+        if (ifa->ifa_addr != NULL && ifa->ifa_addr->sa_family == AF_INET &&
+            ((struct sockaddr_in *)ifa->ifa_addr)->sin_addr.s_addr == adrs.s_addr)
+        {
+            isLocal = TRUE;
+            break;
+        }
+    }
+    freeifaddrs (ifList);
+    return isLocal;
+}
+
+// Connect to a configured peer router (the ACK arrives on our listen socket):
+static int ConnectPeer (MSGRTR_PEER *peer)
 {
     MSGRTR_HDR          msgHdr;
     MSGRTR_INTERNAL_MSG outMsg;
     MSGRTR_PIB*         pib;
+    char                path[256];
 
     radMsgLog(PRI_STATUS, "msgRouter: trying remote server %s:%d...", 
-               msgrtrWork.remoteIP, msgrtrWork.remotePort);
+               peer->remoteIP, peer->remotePort);
 
-    msgrtrWork.remoteServer = radSocketClientCreate(msgrtrWork.remoteIP, msgrtrWork.remotePort);
-    if (msgrtrWork.remoteServer == NULL)
+    peer->remoteServer = NULL;
+    if (msgrtrWork.localServer != NULL && IsLocalHost (peer->remoteIP))
     {
-        radTimerStart(msgrtrWork.remoteConnectTimer, MSGRTR_REMOTE_RETRY_INTERVAL);
-        return;
+        // he is on this host - use his Unix-domain socket if he has one:
+        snprintf (path, sizeof(path), "%s/" MSGRTR_LOCAL_LINK_NAME, 
+                  msgrtrWork.localLinkDir, peer->remotePort);
+        peer->remoteServer = radSocketClientCreateUnix (path);
+    }
+    if (peer->remoteServer == NULL)
+    {
+        peer->remoteServer = radSocketClientCreate(peer->remoteIP, peer->remotePort);
+        if (peer->remoteServer == NULL)
+        {
+            return ERROR;
+        }
     }
 
     // Build the register pkt:
@@ -1235,36 +7357,62 @@ static void connectTimerHandler(void *parm)
     msgHdr.srcpid           = 0;
     msgHdr.msgID            = MSGRTR_INTERNAL_MSGID;
     msgHdr.length           = sizeof(MSGRTR_INTERNAL_MSG);
-
+    msgHdr.flags            = 0;
+    msgHdr.routerSlots      = 0;
+    msgHdr.originID         = 0;
+    msgHdr.originEpoch      = 0;
+    msgHdr.originSeq        = 0;
+    msgHdr.correlationID    = 0;
+    msgHdr.replyRouterID    = 0;
+    msgHdr.replyPid         = 0;
+
+    memset (&outMsg, 0, sizeof(outMsg));
     outMsg.subMsgID         = MSGRTR_SUBTYPE_REGISTER;
-    sprintf(outMsg.name, "router:%s", radSocketGetHost(msgrtrWork.remoteServer));
-    strncpy(outMsg.srcIP, radSocketGetHost(msgrtrWork.remoteServer), sizeof(outMsg.srcIP));
+    if (radSocketGetPort(peer->remoteServer) == 0)
+    {
+        // he connects back to our Unix-domain socket
+        strncpy(outMsg.srcIP, msgrtrWork.localPath, sizeof(outMsg.srcIP) - 1);
+        snprintf(outMsg.name, sizeof(outMsg.name), "router:local:%d",
+                 msgrtrWork.listenPort);
+    }
+    else
+    {
+        strncpy(outMsg.srcIP, radSocketGetHost(peer->remoteServer), sizeof(outMsg.srcIP) - 1);
+        snprintf(outMsg.name, sizeof(outMsg.name), "router:%s", outMsg.srcIP);
+    }
     outMsg.srcPort          = msgrtrWork.listenPort;
-    outMsg.socketID         = (ULONG)msgrtrWork.remoteServer;
+    outMsg.socketID         = radSocketGetDescriptor(peer->remoteServer);
     outMsg.maxMsgSize       = SYS_BUFFER_LARGEST_SIZE;
+    outMsg.routerID         = msgrtrWork.routerID;
+    outMsg.linkFlags        = msgrtrWork.linkFlags;
 
     // Do HtoN conversions:
     msgHdr.magicNumber  = htonl(msgHdr.magicNumber);
     msgHdr.srcpid       = htonl(msgHdr.srcpid);
     msgHdr.msgID        = htonl(msgHdr.msgID);
     msgHdr.length       = htonl(msgHdr.length);
+    msgHdr.flags        = htonl(msgHdr.flags);
     outMsg.subMsgID     = htonl(outMsg.subMsgID);
     outMsg.targetMsgID  = htonl(outMsg.targetMsgID);
     outMsg.srcPort      = htonl(outMsg.srcPort);
     outMsg.socketID     = htonl(outMsg.socketID);
     outMsg.maxMsgSize   = htonl(outMsg.maxMsgSize);
+    outMsg.routerID     = htonl(outMsg.routerID);
+    outMsg.linkFlags    = htonl(outMsg.linkFlags);
 
-    if (radSocketWriteExact(msgrtrWork.remoteServer, &msgHdr, sizeof(msgHdr)) != sizeof(msgHdr))
+    if (radSocketWriteExact(peer->remoteServer, &msgHdr, sizeof(msgHdr)) != sizeof(msgHdr))
     {
         radMsgLog(PRI_HIGH, "radSocketWriteExact msgHdr failed!");
-        radSocketDestroy(msgrtrWork.remoteServer);
-        return;
+        radSocketDestroy(peer->remoteServer);
+        peer->remoteServer = NULL;
+        return ERROR;
     }
-    if (radSocketWriteExact(msgrtrWork.remoteServer, &outMsg, sizeof(outMsg)) != sizeof(outMsg))
+    if (radSocketWriteExact(peer->remoteServer, &outMsg, sizeof(outMsg)) != sizeof(outMsg))
     {
         radMsgLog(PRI_HIGH, "radSocketWriteExact outMsg failed!");
-        radSocketDestroy(msgrtrWork.remoteServer);
-        return;
+        radSocketDestroy(peer->remoteServer);
+        peer->remoteServer = NULL;
+        return ERROR;
     }
 
     // Add him to the PIB list:
@@ -1272,21 +7420,90 @@ static void connectTimerHandler(void *parm)
     if (pib == NULL)
     {
         radMsgLog(PRI_HIGH, "%s: malloc PIB failed!", outMsg.name);
-        radSocketDestroy(msgrtrWork.remoteServer);
-        return;
+        radSocketDestroy(peer->remoteServer);
+        peer->remoteServer = NULL;
+        return ERROR;
     }
 
     memset (pib, 0, sizeof(*pib));
+    pthread_mutex_init (&pib->lock, NULL);
+    pthread_cond_init (&pib->txCond, NULL);
     pib->type       = PIB_TYPE_REMOTE;
     strncpy (pib->name, outMsg.name, PROCESS_MAX_NAME_LEN);
-    pib->txclient   = msgrtrWork.remoteServer;
-    radListAddToEnd(&msgrtrWork.pibList, (NODE *)pib);
+    pib->txclient   = peer->remoteServer;
+    pib->txWriteId  = -1;
+    radListReset (&pib->txQueue);
+    radSocketSetBlocking(pib->txclient, FALSE);
+    AddPIB(pib);
 
     radMsgLog(PRI_STATUS, "Remote server TX: %s:%d ==> %s:%d",
-               radSocketGetHost(msgrtrWork.remoteServer), 
-               radSocketGetPort(msgrtrWork.remoteServer),
-               radSocketGetRemoteHost(msgrtrWork.remoteServer), 
-               radSocketGetRemotePort(msgrtrWork.remoteServer));
+               radSocketGetHost(peer->remoteServer), 
+               radSocketGetPort(peer->remoteServer),
+               radSocketGetRemoteHost(peer->remoteServer), 
+               radSocketGetRemotePort(peer->remoteServer));
+
+    return OK;
+}
+
+// Remote connection timer handler - retry every peer not connected:
+static void connectTimerHandler(void *parm)
+{
+    int                 i, retry = FALSE;
+
+    for (i = 0; i < msgrtrWork.numPeers; i ++)
+    {
+        if (msgrtrWork.peers[i].remoteServer == NULL &&
+            ConnectPeer (&msgrtrWork.peers[i]) == ERROR)
+        {
+            retry = TRUE;
+        }
+    }
+
+    if (retry)
+    {
+        radTimerStart(msgrtrWork.remoteConnectTimer, MSGRTR_REMOTE_RETRY_INTERVAL);
+    }
+    return;
+}
+
+// Remote output flush timer handler:
+static void txFlushTimerHandler(void *parm)
+{
+    MSGRTR_PIB*         pib;
+    int                 restart = FALSE;
+
+    msgrtrWork.txFlushPending = FALSE;
+
+    for (pib = (MSGRTR_PIB*)radListGetFirst(&msgrtrWork.pibList);
+         pib != NULL;
+         pib = (MSGRTR_PIB*)radListGetNext(&msgrtrWork.pibList, (NODE*)pib))
+    {
+        if (pib->type != PIB_TYPE_REMOTE)
+        {
+            continue;
+        }
+
+        // a broken link is closed by its RX handler:
+        pthread_mutex_lock (&pib->lock);
+        if (pib->txWriteId == -1 && radListGetNumberOfNodes(&pib->txQueue) > 0)
+        {
+            // no write-ready registration, drain it from here:
+            DrainRemote(pib);
+        }
+        FlushRemote(pib);
+
+        if (pib->txWriteId == -1 && radListGetNumberOfNodes(&pib->txQueue) > 0)
+        {
+            restart = TRUE;
+        }
+        pthread_mutex_unlock (&pib->lock);
+    }
+
+    if (restart)
+    {
+        msgrtrWork.txFlushPending = TRUE;
+        radTimerStart(msgrtrWork.txFlushTimer, MSGRTR_TX_FLUSH_DELAY);
+    }
 
     return;
 }
@@ -1295,12 +7512,12 @@ static void connectTimerHandler(void *parm)
 static void USAGE (void)
 {
     printf ("%s: invalid arguments:\n", PROC_NAME_MSGRTR);
-    printf ("USAGE: [prefix]/%s radSystemID workingDirectory <listenPort> <remoteIP:remotePort>\n", PROC_NAME_MSGRTR);
+    printf ("USAGE: [prefix]/%s radSystemID workingDirectory <listenPort> <remoteIP:remotePort> ...\n", PROC_NAME_MSGRTR);
     
     printf ("    radSystemID           1-255, same system ID used by other processes in this group\n");
     printf ("    workingDirectory      where to store FIFO and pid files for radmrouted\n");
     printf ("    listenPort            (optional) socket sever listen port to accept remote connections\n");
-    printf ("    remoteIP:remotePort   (optional) remote host IP:port to connect to\n");
+    printf ("    remoteIP:remotePort   (optional) remote host IP:port to connect to, may be repeated\n");
 }
 
 
@@ -1311,7 +7528,7 @@ int main (int argc, char *argv[])
     int                 retVal;
     FILE                *pidfile;
     int                 radSysID;
-    char                *word;
+    int                 i;
 
     // We must have radSysID and working directory as a minimum:
     if (argc < 3)
@@ -1330,6 +7547,9 @@ int main (int argc, char *argv[])
     memset (&msgrtrWork, 0, sizeof (msgrtrWork));
     radListReset (&msgrtrWork.pibList);
     radListReset (&msgrtrWork.miibList);
+    radListReset (&msgrtrWork.rangeList);
+    radListReset (&msgrtrWork.interestList);
+    radListReset (&msgrtrWork.lvcList);
 
     // initialize some system stuff first
     retVal = msgrtrSysInit (&msgrtrWork, argv[2]);
@@ -1349,34 +7569,6 @@ int main (int argc, char *argv[])
         msgrtrWork.listenPort = atoi(argv[3]);
     }
 
-    // Connecting to a remote router?
-    if (argc > 4)
-    {
-        word = strtok(argv[4], ":");
-        if (word == NULL)
-        {
-            radMsgLogInit (PROC_NAME_MSGRTR, FALSE, TRUE);
-            radMsgLog(PRI_CATASTROPHIC, "bad remoteIP:remotePort given - ignoring!");
-            radMsgLogExit ();
-        }
-        else
-        {
-            strncpy(msgrtrWork.remoteIP, word, sizeof(msgrtrWork.remoteIP));
-            word = strtok(NULL, ":");
-            if (word == NULL)
-            {
-                msgrtrWork.remoteIP[0] = 0;
-                radMsgLogInit (PROC_NAME_MSGRTR, FALSE, TRUE);
-                radMsgLog(PRI_CATASTROPHIC, "bad remoteIP:remotePort given - ignoring!");
-                radMsgLogExit ();
-            }
-            else
-            {
-                msgrtrWork.remotePort = atoi(word);
-            }
-        }
-    }
-
     /*  ... call the global radlib system init function
     */
     if (radSystemInit (msgrtrWork.radSystemID) == ERROR)
@@ -1434,6 +7626,205 @@ int main (int argc, char *argv[])
         exit (1);
     }
 
+    // Create our remote output flush timer:
+    msgrtrWork.txFlushTimer = radTimerCreate(NULL, txFlushTimerHandler, NULL);
+    if (msgrtrWork.txFlushTimer == NULL)
+    {
+        radMsgLog(PRI_CATASTROPHIC, "radTimerCreate failed!");
+        radProcessExit ();
+        radSystemExit (msgrtrWork.radSystemID);
+        exit (1);
+    }
+
+    // Create our local spill retry timer:
+    msgrtrWork.spillTimer = radTimerCreate(NULL, spillTimerHandler, NULL);
+    if (msgrtrWork.spillTimer == NULL)
+    {
+        radMsgLog(PRI_CATASTROPHIC, "radTimerCreate failed!");
+        radProcessExit ();
+        radSystemExit (msgrtrWork.radSystemID);
+        exit (1);
+    }
+
+    // Create our peer spool drain timer:
+    msgrtrWork.spoolTimer = radTimerCreate(NULL, spoolTimerHandler, NULL);
+    if (msgrtrWork.spoolTimer == NULL)
+    {
+        radMsgLog(PRI_CATASTROPHIC, "radTimerCreate failed!");
+        radProcessExit ();
+        radSystemExit (msgrtrWork.radSystemID);
+        exit (1);
+    }
+
+    // Connecting to remote routers (conf file PEERs are added to these)?
+    for (i = 4; i < argc; i ++)
+    {
+        AddPeer (&msgrtrWork, argv[i]);
+    }
+
+    msgrtrReadConfig (&msgrtrWork, argv[2]);
+    radMsgLog(PRI_STATUS, "remote output: flush at %d bytes or %d msecs, queue up to %d bytes",
+               msgrtrWork.txFlushBytes, msgrtrWork.txFlushDelay, msgrtrWork.txQueueLimit);
+    radMsgLog(PRI_STATUS, "local output: spill up to %d messages per consumer",
+               msgrtrWork.spillLimit);
+    if (msgrtrWork.routerID == 0)
+    {
+        msgrtrWork.routerID = 1;
+    }
+    radMsgLog(PRI_STATUS, "mesh: router ID %u, %d peer(s)",
+               msgrtrWork.routerID, msgrtrWork.numPeers);
+
+    // Threaded routing locks (the tables favor the main thread's updates):
+#ifdef __GLIBC__
+    {
+        pthread_rwlockattr_t    rwAttr;
+
+        pthread_rwlockattr_init (&rwAttr);
+        pthread_rwlockattr_setkind_np (&rwAttr, 
+                                       PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+        pthread_rwlock_init (&msgrtrWork.tableLock, &rwAttr);
+        pthread_rwlockattr_destroy (&rwAttr);
+    }
+#else
+    pthread_rwlock_init (&msgrtrWork.tableLock, NULL);
+#endif
+    pthread_mutex_init (&msgrtrWork.originLock, NULL);
+    pthread_mutex_init (&msgrtrWork.lvcLock, NULL);
+    pthread_mutex_init (&msgrtrWork.captureLock, NULL);
+    pthread_mutex_init (&msgrtrWork.inboxLock, NULL);
+    pthread_mutex_init (&msgrtrWork.mcastLock, NULL);
+    radListReset (&msgrtrWork.inbox);
+
+    if (msgrtrWork.numWorkers > 0)
+    {
+        // the other threads reach the main thread through this pipe:
+        if (pipe (msgrtrWork.inboxPipe) == -1)
+        {
+            radMsgLog(PRI_CATASTROPHIC, "pipe failed: %s", strerror(errno));
+            radProcessExit ();
+            radSystemExit (msgrtrWork.radSystemID);
+            exit (1);
+        }
+        fcntl (msgrtrWork.inboxPipe[0], F_SETFL, O_NONBLOCK);
+        fcntl (msgrtrWork.inboxPipe[1], F_SETFL, O_NONBLOCK);
+        if (radProcessIORegisterDescriptor (msgrtrWork.inboxPipe[0],
+                                            InboxRXHandler,
+                                            NULL)
+            == ERROR)
+        {
+            radMsgLog(PRI_CATASTROPHIC, "inbox radProcessIORegisterDescriptor failed!");
+            radProcessExit ();
+            radSystemExit (msgrtrWork.radSystemID);
+            exit (1);
+        }
+
+        if (StartWorkers () == ERROR)
+        {
+            radMsgLog(PRI_CATASTROPHIC, "StartWorkers failed!");
+            StopWorkers ();
+            radProcessExit ();
+            radSystemExit (msgrtrWork.radSystemID);
+            exit (1);
+        }
+        radMsgLog(PRI_STATUS, "routing: %d worker thread(s), remote links threaded",
+                   msgrtrWork.numWorkers);
+    }
+
+    // Publish the subscription table for direct local delivery:
+    if (radShmemIfExist (KEY_MSGRTR_SHMEM))
+    {
+        // left over from a previous instance, start clean (withdrawing it 
+        // from clients still attached to it):
+        msgrtrWork.shmId = radShmemInit (KEY_MSGRTR_SHMEM, 
+                                         SEM_INDEX_MSGRTR, 
+                                         sizeof(MSGRTR_SHM_TABLE));
+        if (msgrtrWork.shmId != NULL)
+        {
+            ((MSGRTR_SHM_TABLE *)radShmemGet (msgrtrWork.shmId))->magic = 0;
+            radShmemExitAndDestroy (msgrtrWork.shmId);
+        }
+    }
+    if (msgrtrWork.captureBase[0] != 0)
+    {
+        // the capture must see every message:
+        msgrtrWork.shmId = NULL;
+        if (CaptureSegmentOpen (0) == ERROR)
+        {
+            radMsgLog(PRI_HIGH, "capture to %s failed!", msgrtrWork.captureBase);
+        }
+        else
+        {
+            radMsgLog(PRI_STATUS, "capturing to %s.* - all messages will be routed",
+                       msgrtrWork.captureBase);
+        }
+    }
+    else
+    {
+        msgrtrWork.shmId = radShmemInit (KEY_MSGRTR_SHMEM, 
+                                         SEM_INDEX_MSGRTR, 
+                                         sizeof(MSGRTR_SHM_TABLE));
+        if (msgrtrWork.shmId == NULL)
+        {
+            radMsgLog(PRI_HIGH, "radShmemInit failed - all messages will be routed!");
+        }
+    }
+    if (msgrtrWork.shmId != NULL)
+    {
+        msgrtrWork.shmTable = (MSGRTR_SHM_TABLE *)radShmemGet (msgrtrWork.shmId);
+        memset (msgrtrWork.shmTable, 0, sizeof(MSGRTR_SHM_TABLE));
+        msgrtrWork.shmTable->routerPid = getpid ();
+        __sync_synchronize ();
+        msgrtrWork.shmTable->magic = MSGRTR_SHM_MAGIC;
+    }
+
+    // Publish the traffic statistics block:
+    if (radShmemIfExist (KEY_MSGRTR_STATS_SHMEM))
+    {
+        msgrtrWork.statsId = radShmemInit (KEY_MSGRTR_STATS_SHMEM, 
+                                           SEM_INDEX_MSGRTR_STATS, 
+                                           sizeof(MSGRTR_STATS_BLOCK));
+        if (msgrtrWork.statsId != NULL)
+        {
+            ((MSGRTR_STATS_BLOCK *)radShmemGet (msgrtrWork.statsId))->magic = 0;
+            radShmemExitAndDestroy (msgrtrWork.statsId);
+        }
+    }
+    msgrtrWork.statsHistory = (MSGRTR_STATS_HISTORY *)
+        malloc (MSGRTR_STATS_MSGIDS * sizeof(MSGRTR_STATS_HISTORY));
+    msgrtrWork.statsTimer = radTimerCreate (NULL, statsTimerHandler, NULL);
+    msgrtrWork.statsId = radShmemInit (KEY_MSGRTR_STATS_SHMEM, 
+                                       SEM_INDEX_MSGRTR_STATS, 
+                                       sizeof(MSGRTR_STATS_BLOCK));
+    if (msgrtrWork.statsId == NULL || msgrtrWork.statsHistory == NULL ||
+        msgrtrWork.statsTimer == NULL)
+    {
+        radMsgLog(PRI_HIGH, "stats block setup failed - no traffic statistics!");
+    }
+    else
+    {
+        msgrtrWork.stats = (MSGRTR_STATS_BLOCK *)radShmemGet (msgrtrWork.statsId);
+        memset (msgrtrWork.stats, 0, sizeof(MSGRTR_STATS_BLOCK));
+        memset (msgrtrWork.statsHistory, 0, 
+                MSGRTR_STATS_MSGIDS * sizeof(MSGRTR_STATS_HISTORY));
+        msgrtrWork.stats->routerPid = getpid ();
+        msgrtrWork.stats->window    = MSGRTR_STATS_WINDOW;
+        __sync_synchronize ();
+        msgrtrWork.stats->magic     = MSGRTR_STATS_MAGIC;
+        radTimerStart (msgrtrWork.statsTimer, MSGRTR_STATS_INTERVAL);
+    }
+
+    // Pick up the local clients of our previous run:
+    if (msgrtrWork.persistState)
+    {
+        StateLoad ();
+    }
+
+    // Join the multicast group linked routers fan out on:
+    if (msgrtrWork.mcastGroup[0] != 0 && McastOpen () == ERROR)
+    {
+        radMsgLog(PRI_HIGH, "multicast setup failed - remote routers use TCP only!");
+    }
+
     // Do we need to initialize remote services?
     if (msgrtrWork.listenPort > 0)
     {
@@ -1448,13 +7839,61 @@ int main (int argc, char *argv[])
         }
 
         // Add him to our wait list:
-        radProcessIORegisterDescriptor(radSocketGetDescriptor(msgrtrWork.server),
-                                       ServerRXHandler,
-                                       NULL);
+        if (radProcessIORegisterDescriptor(radSocketGetDescriptor(msgrtrWork.server),
+                                           ServerRXHandler,
+                                           msgrtrWork.server)
+            == ERROR)
+        {
+            radMsgLog(PRI_CATASTROPHIC, "server radProcessIORegisterDescriptor failed!");
+            radProcessSetExitFlag ();
+            StopWorkers ();
+            msgrtrSysExit (&msgrtrWork);
+            radProcessExit ();
+            radSystemExit(msgrtrWork.radSystemID);
+            exit (1);
+        }
+
+        // and the Unix-domain one routers on this host connect to:
+        if (msgrtrWork.localLinks)
+        {
+            if (strlen (msgrtrWork.localLinkDir) + 32 > sizeof(msgrtrWork.localPath))
+            {
+                radMsgLog(PRI_HIGH, "LOCAL_LINK_DIR %s too long - local links use TCP",
+                           msgrtrWork.localLinkDir);
+            }
+            else
+            {
+                sprintf (msgrtrWork.localPath, "%s/" MSGRTR_LOCAL_LINK_NAME,
+                         msgrtrWork.localLinkDir, msgrtrWork.listenPort);
+                msgrtrWork.localServer = radSocketServerCreateUnix (msgrtrWork.localPath);
+            }
+            if (msgrtrWork.localServer == NULL)
+            {
+                radMsgLog(PRI_HIGH, "Unix-domain listen socket failed - local links use TCP");
+            }
+            else if (radProcessIORegisterDescriptor(radSocketGetDescriptor(msgrtrWork.localServer),
+                                                    ServerRXHandler,
+                                                    msgrtrWork.localServer)
+                     == ERROR)
+            {
+                radMsgLog(PRI_CATASTROPHIC, "local radProcessIORegisterDescriptor failed!");
+                radProcessSetExitFlag ();
+                StopWorkers ();
+                msgrtrSysExit (&msgrtrWork);
+                radProcessExit ();
+                radSystemExit(msgrtrWork.radSystemID);
+                exit (1);
+            }
+            else
+            {
+                radMsgLog(PRI_STATUS, "local links: listening on %s",
+                           msgrtrWork.localPath);
+            }
+        }
     }
 
-    // Do we need to connect to a remote router?
-    if (strlen(msgrtrWork.remoteIP) > 0)
+    // Do we need to connect to remote routers?
+    if (msgrtrWork.numPeers > 0)
     {
         // yes, just start the timer:
         radTimerStart(msgrtrWork.remoteConnectTimer, 50);
@@ -1480,6 +7919,7 @@ int main (int argc, char *argv[])
     radMsgLog(PRI_STATUS, "exiting normally...");
 
     radProcessSetExitFlag ();
+    StopWorkers ();
     msgrtrSysExit (&msgrtrWork);
     radProcessExit ();
     radSystemExit (msgrtrWork.radSystemID);
@@ -0,0 +1,429 @@
+/*---------------------------------------------------------------------------
+
+  FILENAME:
+        radmreplay.c
+
+  PURPOSE:
+        Re-inject a radmrouted traffic capture (CAPTURE_FILE) through a
+        running message router.
+
+  REVISION HISTORY:
+        Date            Engineer        Revision        Remarks
+        10/18/2026      radlib          0               Original
+
+  NOTES:
+        USAGE: radmreplay radSystemID workingDirectory capturePrefix <speed>
+
+            speed   1 (default) replays at the captured pace, 2 twice as
+                    fast, 0.5 half as fast and so on; 0 or "max" sends as
+                    fast as the router takes them
+
+        Segments "capturePrefix.NNNNNN" are replayed in order. Messages are
+        sent with 'radMsgRouterMessageSend' and requests with
+        'radMsgRouterRequest' (replies are discarded); captured replies are
+        skipped as their requesters are gone. The capture must come from a
+        host with the same byte order and word size.
+
+  LICENSE:
+        Copyright 2001-2005 Mark S. Teel. All rights reserved.
+
+        Redistribution and use in source and binary forms, with or without
+        modification, are permitted provided that the following conditions
+        are met:
+
+        1. Redistributions of source code must retain the above copyright
+           notice, this list of conditions and the following disclaimer.
+        2. Redistributions in binary form must reproduce the above copyright
+           notice, this list of conditions and the following disclaimer in the
+           documentation and/or other materials provided with the distribution.
+
+        THIS SOFTWARE IS PROVIDED BY Mark Teel ``AS IS'' AND ANY EXPRESS OR
+        IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+        WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+        DISCLAIMED. IN NO EVENT SHALL MARK TEEL OR CONTRIBUTORS BE LIABLE FOR
+        ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+        OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+        HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+        STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+        IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+        POSSIBILITY OF SUCH DAMAGE.
+
+----------------------------------------------------------------------------*/
+
+//  System include files
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+
+//  Library include files
+#include <radsysdefs.h>
+#include <radsystem.h>
+#include <radprocess.h>
+#include <radmsgRouter.h>
+
+//  Local include files
+
+//  static (local) memory declarations:
+
+// At full speed, read replies and run request timeouts this often (usecs):
+#define REPLAY_POLL_US          50000
+
+typedef struct
+{
+    double          speed;              // 0 => as fast as possible
+    ULONGLONG       firstCaptured;      // usecs, 0 until the first message
+    ULONGLONG       firstSent;
+    ULONGLONG       lastPoll;
+    ULONG           messages;
+    ULONG           requests;
+    ULONG           outstanding;        // requests still waiting for a reply
+    ULONG           unanswered;         // requests that failed or timed out
+    ULONGLONG       bytes;
+    ULONG           skipped;
+    ULONG           errors;
+} REPLAY_WORK;
+
+static REPLAY_WORK  replayWork;
+
+
+static void msgHandler
+(
+    char        *srcQueueName,
+    UINT        msgType,
+    void        *msg,
+    UINT        length,
+    void        *userData
+)
+{
+    // nothing is registered, replies go to replyHandler
+    (void) srcQueueName;
+    (void) msgType;
+    (void) msg;
+    (void) length;
+    (void) userData;
+    return;
+}
+
+static void evtHandler
+(
+    UINT        eventsRx,
+    UINT        rxData,
+    void        *userData
+)
+{
+    (void) eventsRx;
+    (void) rxData;
+    (void) userData;
+    return;
+}
+
+static void replyHandler
+(
+    int         status,
+    ULONG       msgID,
+    void        *reply,
+    ULONG       length,
+    void        *userData
+)
+{
+    // the reply itself is discarded
+    (void) msgID;
+    (void) reply;
+    (void) length;
+    (void) userData;
+
+    replayWork.outstanding --;
+    if (status != OK)
+    {
+        replayWork.unanswered ++;
+    }
+    return;
+}
+
+static ULONGLONG timeUS (void)
+{
+    struct timeval  tv;
+
+    gettimeofday (&tv, NULL);
+    return (ULONGLONG)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void USAGE (void)
+{
+    printf ("USAGE: radmreplay radSystemID workingDirectory capturePrefix <speed>\n");
+    printf ("           radSystemID       - radlib system ID (1-255) of the router\n");
+    printf ("           workingDirectory  - radmrouted working directory\n");
+    printf ("           capturePrefix     - radmrouted.conf CAPTURE_FILE of the capture\n");
+    printf ("           speed             - (optional) 1 = captured pace (default), 2 = twice\n");
+    printf ("                               as fast, 0.5 = half, 0 or max = full speed\n");
+    return;
+}
+
+// Handle whatever has arrived and any due timers without blocking
+// (radProcessWait (0) would wait for the next one):
+static void replayPoll (void)
+{
+    while (radProcessWait (1) == OK)
+    {
+        ;
+    }
+    replayWork.lastPoll = timeUS ();
+    return;
+}
+
+// Hold a message until its (scaled) capture time comes around:
+static void replayPace (ULONGLONG captured)
+{
+    ULONGLONG       due, now;
+
+    if (replayWork.firstCaptured == 0)
+    {
+        replayWork.firstCaptured = captured;
+        replayWork.firstSent     = timeUS ();
+        replayWork.lastPoll      = replayWork.firstSent;
+        return;
+    }
+    if (replayWork.speed <= 0)
+    {
+        // nothing else gives the process a turn at full speed:
+        if (timeUS () - replayWork.lastPoll >= REPLAY_POLL_US)
+        {
+            replayPoll ();
+        }
+        return;
+    }
+    if (captured <= replayWork.firstCaptured)
+    {
+        return;
+    }
+
+    due = replayWork.firstSent +
+          (ULONGLONG)((captured - replayWork.firstCaptured) / replayWork.speed);
+    while ((now = timeUS ()) < due)
+    {
+        if (due - now >= 1000)
+        {
+            // also lets request timeouts run:
+            radProcessWait ((int)((due - now) / 1000));
+        }
+        else
+        {
+            usleep ((useconds_t)(due - now));
+        }
+    }
+    return;
+}
+
+// Replay the records of one segment file:
+static int replaySegment (char *name)
+{
+    MSGRTR_CAPTURE_SEGMENT  *segment;
+    MSGRTR_CAPTURE_RECORD   *record;
+    MSGRTR_HDR              *hdr;
+    struct stat             fileData;
+    ULONGLONG               offset, used;
+    int                     fd, retVal = OK;
+
+    fd = open (name, O_RDONLY);
+    if (fd == -1 || fstat (fd, &fileData) == -1)
+    {
+        printf ("%s: %s\n", name, strerror(errno));
+        if (fd != -1)
+        {
+            close (fd);
+        }
+        return ERROR;
+    }
+    if (fileData.st_size < (off_t)sizeof(*segment))
+    {
+        printf ("%s: not a capture segment\n", name);
+        close (fd);
+        return ERROR;
+    }
+
+    segment = (MSGRTR_CAPTURE_SEGMENT *)mmap (NULL, fileData.st_size, PROT_READ,
+                                              MAP_SHARED, fd, 0);
+    close (fd);
+    if ((void *)segment == MAP_FAILED)
+    {
+        printf ("%s: mmap: %s\n", name, strerror(errno));
+        return ERROR;
+    }
+
+    if (segment->magic != MSGRTR_CAPTURE_MAGIC ||
+        segment->version != MSGRTR_CAPTURE_VERSION ||
+        segment->hdrSize != sizeof(MSGRTR_HDR))
+    {
+        printf ("%s: not a capture segment of this radlib version\n", name);
+        munmap (segment, fileData.st_size);
+        return ERROR;
+    }
+
+    used = segment->used;
+    if (used > (ULONGLONG)fileData.st_size)
+    {
+        used = fileData.st_size;
+    }
+
+    for (offset = sizeof(*segment);
+         offset + sizeof(*record) + sizeof(*hdr) <= used;
+         offset += record->recordLength)
+    {
+        record  = (MSGRTR_CAPTURE_RECORD *)((UCHAR *)segment + offset);
+        hdr     = (MSGRTR_HDR *)(record + 1);
+        if (record->recordLength < sizeof(*record) + sizeof(*hdr) + hdr->length ||
+            offset + record->recordLength > used)
+        {
+            printf ("%s: corrupt record at offset %llu\n", name, offset);
+            retVal = ERROR;
+            break;
+        }
+
+        if (hdr->msgID == MSGRTR_INTERNAL_MSGID || (hdr->flags & MSGRTR_FLAG_REPLY))
+        {
+            replayWork.skipped ++;
+            continue;
+        }
+
+        replayPace (record->timestamp);
+
+        if (hdr->flags & MSGRTR_FLAG_REQUEST)
+        {
+            if (radMsgRouterRequest (hdr->msgID, hdr->msg, hdr->length,
+                                     MSGRTR_MAX_ACK_WAIT, replyHandler, NULL)
+                == ERROR)
+            {
+                replayWork.errors ++;
+                continue;
+            }
+            replayWork.requests ++;
+            replayWork.outstanding ++;
+        }
+        else if (radMsgRouterMessageSend (hdr->msgID, hdr->msg, hdr->length) == ERROR)
+        {
+            replayWork.errors ++;
+            continue;
+        }
+
+        replayWork.messages ++;
+        replayWork.bytes += hdr->length;
+    }
+
+    munmap (segment, fileData.st_size);
+    return retVal;
+}
+
+int main (int argc, char *argv[])
+{
+    char            qname[256], pattern[300];
+    glob_t          segments;
+    ULONGLONG       elapsed;
+    size_t          i;
+    int             sysID;
+
+    if (argc < 4)
+    {
+        USAGE ();
+        return 1;
+    }
+    sysID = atoi (argv[1]);
+    if (sysID < 1 || sysID > 255)
+    {
+        printf ("Invalid system ID!\n");
+        USAGE ();
+        return 1;
+    }
+
+    memset (&replayWork, 0, sizeof(replayWork));
+    replayWork.speed = 1.0;
+    if (argc > 4)
+    {
+        replayWork.speed = (! strcmp (argv[4], "max")) ? 0 : atof (argv[4]);
+    }
+
+    sprintf (pattern, "%s.[0-9][0-9][0-9][0-9][0-9][0-9]", argv[3]);
+    if (glob (pattern, 0, NULL, &segments) != 0 || segments.gl_pathc == 0)
+    {
+        printf ("No capture segments %s.NNNNNN found!\n", argv[3]);
+        return 1;
+    }
+
+    if (radSystemInit ((UCHAR)sysID) == ERROR)
+    {
+        printf ("Unable to attach to radlib system %d!\n", sysID);
+        globfree (&segments);
+        return 1;
+    }
+
+    sprintf (qname, "%s/radmreplayFIFO.%d", argv[2], getpid ());
+    if (radProcessInit ("radmreplay",
+                        qname,
+                        1,                          // request timeouts
+                        FALSE,                      // FALSE => not as daemon
+                        msgHandler,
+                        evtHandler,
+                        NULL)
+        == ERROR)
+    {
+        printf ("radProcessInit failed\n");
+        radSystemExit ((UCHAR)sysID);
+        globfree (&segments);
+        return 1;
+    }
+
+    if (radMsgRouterInit (argv[2]) == ERROR)
+    {
+        printf ("Invalid msg router work directory %s given or router not running!\n",
+                argv[2]);
+        radProcessExit ();
+        radSystemExit ((UCHAR)sysID);
+        globfree (&segments);
+        return 1;
+    }
+
+    // glob sorts them, and the numbers are zero padded:
+    for (i = 0; i < segments.gl_pathc; i ++)
+    {
+        printf ("replaying %s\n", segments.gl_pathv[i]);
+        if (replaySegment (segments.gl_pathv[i]) == ERROR)
+        {
+            break;
+        }
+    }
+    globfree (&segments);
+
+    elapsed = (replayWork.firstSent != 0) ? timeUS () - replayWork.firstSent : 0;
+    printf ("replayed %lu messages (%lu requests), %llu bytes in %llu.%3.3llu secs",
+            replayWork.messages, replayWork.requests, replayWork.bytes,
+            elapsed / 1000000, (elapsed / 1000) % 1000);
+    if (elapsed > 0)
+    {
+        printf (" (%.0f msgs/sec)", replayWork.messages * 1000000.0 / elapsed);
+    }
+    printf ("; %lu skipped, %lu failed\n", replayWork.skipped, replayWork.errors);
+
+    // let the requests still out get their replies or time out (the
+    // request timer bounds the wait):
+    while (replayWork.outstanding > 0 && radProcessWait (0) != ERROR)
+    {
+        ;
+    }
+    if (replayWork.requests > 0)
+    {
+        printf ("%lu of %lu requests unanswered\n", replayWork.unanswered, replayWork.requests);
+    }
+
+    radMsgRouterExit ();
+    radProcessExit ();
+    unlink (qname);
+    radSystemExit ((UCHAR)sysID);
+    return 0;
+}
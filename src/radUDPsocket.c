@@ -430,6 +430,35 @@ int radUDPSocketSendTo
 }
 
 
+/*  ... Send a datagram to an address already resolved (no name lookup, 
+    ... so it may be used from several threads at once)
+*/
+int radUDPSocketSendToAddress
+(
+    RADUDPSOCK_ID       id,
+    struct sockaddr_in  *destAdrs,
+    void                *data,
+    int                 length
+)
+{
+    if (sendto (id->sockfd, data, length, 0, 
+                (struct sockaddr *)destAdrs, sizeof (*destAdrs)) == -1)
+    {
+        radMsgLog(PRI_HIGH, "radUDPSocketSendToAddress: sendto failed: %s", strerror(errno));
+        return ERROR;
+    }
+
+    if (id->debug)
+    {
+        radMsgLog(PRI_STATUS, ">>>>>>>>>>>>>>>> radUDPSocketSendToAddress >>>>>>>>>>>>>>>>>>");
+        radMsgLogData (data, length);
+        radMsgLog(PRI_STATUS, ">>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>");
+    }
+
+    return OK;
+}
+
+
 /*  ... Set the socket for blocking or non-blocking IO -
     ... it is the user's responsibility to handle blocking/non-blocking IO
     ... properly (EAGAIN and EINTR errno's);
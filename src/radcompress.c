@@ -0,0 +1,254 @@
+/*---------------------------------------------------------------------------
+ 
+  FILENAME:
+        radcompress.c
+ 
+  PURPOSE:
+        Provide a fast LZ77-class block compressor.
+ 
+  REVISION HISTORY:
+        Date            Engineer        Revision        Remarks
+        10/18/2026      radlib          0               Original
+ 
+  NOTES:
+        See radcompress.h for the stream format.
+ 
+  LICENSE:
+        Copyright 2001-2005 Mark S. Teel. All rights reserved.
+ 
+        Redistribution and use in source and binary forms, with or without 
+        modification, are permitted provided that the following conditions 
+        are met:
+ 
+        1. Redistributions of source code must retain the above copyright 
+           notice, this list of conditions and the following disclaimer.
+        2. Redistributions in binary form must reproduce the above copyright 
+           notice, this list of conditions and the following disclaimer in the 
+           documentation and/or other materials provided with the distribution.
+ 
+        THIS SOFTWARE IS PROVIDED BY Mark Teel ``AS IS'' AND ANY EXPRESS OR 
+        IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+        WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+        DISCLAIMED. IN NO EVENT SHALL MARK TEEL OR CONTRIBUTORS BE LIABLE FOR 
+        ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS 
+        OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+        HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, 
+        STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING 
+        IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+        POSSIBILITY OF SUCH DAMAGE.
+  
+----------------------------------------------------------------------------*/
+
+/*  ... System include files
+*/
+#include <sys/types.h>
+#include <string.h>
+
+/*  ... Library include files
+*/
+#include <radcompress.h>
+
+/*  ... Local include files
+*/
+
+/*  ... global memory declarations
+*/
+
+/*  ... global memory referenced
+*/
+
+/*  ... static (local) memory declarations
+*/
+
+// Hash the 3 bytes at 'p' into the match table:
+static UINT lzHash (UCHAR *p)
+{
+    UINT        key = ((UINT)p[0] << 16) | ((UINT)p[1] << 8) | p[2];
+
+    return (key * 2654435761U) >> (32 - RADLZ_HASH_BITS);
+}
+
+
+/* ... methods
+*/
+/*  ... compress 'inLength' bytes at 'in' into at most 'outSize' bytes at
+    ... 'out';
+    ... returns the compressed length, or 0 if the data did not fit in
+    ... 'outSize' bytes (callers then send it uncompressed)
+*/
+int radCompressLZ (void *in, int inLength, void *out, int outSize)
+{
+    UINT        table[RADLZ_HASH_SIZE];     // input offset + 1, 0 => empty
+    UCHAR       *base = (UCHAR *)in;
+    UCHAR       *ip = base;
+    UCHAR       *inEnd = base + inLength;
+    UCHAR       *op = (UCHAR *)out;
+    UCHAR       *outEnd = op + outSize;
+    UCHAR       *ref;
+    UINT        hash, offset, entry;
+    int         lit = 0, len, maxLen;
+
+    if (inLength <= 0 || outSize <= 1)
+    {
+        return 0;
+    }
+
+    memset (table, 0, sizeof(table));
+
+    // each literal run is led by a control byte filled in when it ends:
+    op ++;
+
+    while (ip < inEnd)
+    {
+        if (inEnd - ip >= RADLZ_MIN_MATCH)
+        {
+            hash        = lzHash (ip);
+            entry       = table[hash];
+            table[hash] = (UINT)(ip - base) + 1;
+
+            if (entry != 0)
+            {
+                ref     = base + entry - 1;
+                offset  = (UINT)(ip - ref) - 1;
+                if (offset < RADLZ_MAX_OFFSET &&
+                    ref[0] == ip[0] && ref[1] == ip[1] && ref[2] == ip[2])
+                {
+                    maxLen = inEnd - ip;
+                    if (maxLen > RADLZ_MAX_MATCH)
+                    {
+                        maxLen = RADLZ_MAX_MATCH;
+                    }
+                    for (len = RADLZ_MIN_MATCH; len < maxLen && ref[len] == ip[len]; len ++)
+                    {
+                    }
+
+                    // up to 3 bytes of copy plus the next run's control byte:
+                    if (outEnd - op < 4)
+                    {
+                        return 0;
+                    }
+
+                    // close the literal run, or take back its control byte:
+                    if (lit > 0)
+                    {
+                        op[-lit-1] = (UCHAR)(lit - 1);
+                    }
+                    else
+                    {
+                        op --;
+                    }
+                    lit = 0;
+
+                    if (len - 2 < 7)
+                    {
+                        *op++ = (UCHAR)((offset >> 8) + ((len - 2) << 5));
+                    }
+                    else
+                    {
+                        *op++ = (UCHAR)((offset >> 8) + (7 << 5));
+                        *op++ = (UCHAR)(len - 2 - 7);
+                    }
+                    *op++ = (UCHAR)(offset & 0xFF);
+                    op ++;
+
+                    ip += len;
+                    continue;
+                }
+            }
+        }
+
+        // copy a literal:
+        if (op >= outEnd)
+        {
+            return 0;
+        }
+        *op++ = *ip++;
+        if (++lit == RADLZ_MAX_LITERALS)
+        {
+            op[-lit-1] = (UCHAR)(lit - 1);
+            lit = 0;
+            op ++;
+        }
+    }
+
+    if (lit > 0)
+    {
+        op[-lit-1] = (UCHAR)(lit - 1);
+    }
+    else
+    {
+        op --;
+    }
+
+    if (op > outEnd)
+    {
+        return 0;
+    }
+
+    return (int)(op - (UCHAR *)out);
+}
+
+/*  ... expand 'inLength' compressed bytes at 'in' into at most 'outSize'
+    ... bytes at 'out';
+    ... returns the expanded length or ERROR if the data is corrupt or
+    ... expands past 'outSize' bytes
+*/
+int radDecompressLZ (void *in, int inLength, void *out, int outSize)
+{
+    UCHAR       *ip = (UCHAR *)in;
+    UCHAR       *inEnd = ip + inLength;
+    UCHAR       *op = (UCHAR *)out;
+    UCHAR       *outEnd = op + outSize;
+    UCHAR       *ref;
+    UINT        ctrl, offset;
+    int         len;
+
+    while (ip < inEnd)
+    {
+        ctrl = *ip++;
+
+        if (ctrl < RADLZ_MAX_LITERALS)
+        {
+            len = ctrl + 1;
+            if (len > inEnd - ip || len > outEnd - op)
+            {
+                return ERROR;
+            }
+            memcpy (op, ip, len);
+            op += len;
+            ip += len;
+            continue;
+        }
+
+        len = ctrl >> 5;
+        if (len == 7)
+        {
+            if (ip >= inEnd)
+            {
+                return ERROR;
+            }
+            len += *ip++;
+        }
+        len += 2;
+
+        if (ip >= inEnd)
+        {
+            return ERROR;
+        }
+        offset = ((ctrl & 0x1F) << 8) + *ip++ + 1;
+        if (offset > (UINT)(op - (UCHAR *)out) || len > outEnd - op)
+        {
+            return ERROR;
+        }
+
+        // byte by byte - the copy may overlap what it produces:
+        for (ref = op - offset; len > 0; len --)
+        {
+            *op++ = *ref++;
+        }
+    }
+
+    return (int)(op - (UCHAR *)out);
+}
+
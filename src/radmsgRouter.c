@@ -46,6 +46,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <errno.h>
+#include <signal.h>
 
 //  Library include files
 #include <radmsgRouter.h>
@@ -62,7 +63,213 @@ static MSGRTR_LOCAL_WORK    msgRtrLocalWork;
 
 
 // local utilities for the local process API calls
-static int waitForRouterAck (void)
+
+// Complete the async registration waiting on 'ackToken'; returns TRUE if
+// there was one:
+static int asyncComplete (ULONG ackToken, int status)
+{
+    MSGRTR_ASYNC_REGISTER   *async;
+
+    for (async = (MSGRTR_ASYNC_REGISTER *)radListGetFirst (&msgRtrLocalWork.asyncList);
+         async != NULL;
+         async = (MSGRTR_ASYNC_REGISTER *)radListGetNext (&msgRtrLocalWork.asyncList, 
+                                                          (NODE *)async))
+    {
+        if (async->ackToken == ackToken)
+        {
+            radListRemove (&msgRtrLocalWork.asyncList, (NODE *)async);
+            (*async->doneHandler) (status, async->userData);
+            free (async);
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+// Queue handler prepended for async registrations - consumes their ACKs:
+static void asyncAckHandler
+(
+    char                *srcQueueName,
+    UINT                msgType,
+    void                *msg,
+    UINT                length,
+    void                *userData
+)
+{
+    MSGRTR_HDR          *rtrHdr = (MSGRTR_HDR *)msg;
+    MSGRTR_INTERNAL_MSG *rtrMsg;
+
+    if (msgType != MSGRTR_INTERNAL_MSGID ||
+        length < sizeof(*rtrHdr) + sizeof(*rtrMsg) ||
+        rtrHdr->magicNumber != MSGRTR_MAGIC_NUMBER ||
+        rtrHdr->msgID != MSGRTR_INTERNAL_MSGID)
+    {
+        return;
+    }
+
+    rtrMsg = (MSGRTR_INTERNAL_MSG *)rtrHdr->msg;
+    if (rtrMsg->subMsgID == MSGRTR_SUBTYPE_ACK &&
+        rtrMsg->targetMsgID != 0 &&
+        asyncComplete (rtrMsg->targetMsgID, OK))
+    {
+        // it was ours, the application need not see it:
+        radProcessQueueStopHandlerList ();
+    }
+
+    return;
+}
+
+// (Re)arm the request timer for the earliest pending deadline:
+static void requestTimerRestart (void)
+{
+    MSGRTR_PENDING_REQUEST  *pending;
+    ULONGLONG               now;
+
+    pending = (MSGRTR_PENDING_REQUEST *)radListGetFirst (&msgRtrLocalWork.requestList);
+    if (pending == NULL)
+    {
+        radTimerStop (msgRtrLocalWork.requestTimer);
+        return;
+    }
+
+    now = radTimeGetMSSinceEpoch ();
+    radTimerStart (msgRtrLocalWork.requestTimer, 
+                   (pending->deadline > now) ? (ULONG)(pending->deadline - now) : 1);
+    return;
+}
+
+// Request timer handler - time out every request past its deadline:
+static void requestTimerHandler (void *parm)
+{
+    MSGRTR_PENDING_REQUEST  *pending;
+    ULONGLONG               now = radTimeGetMSSinceEpoch ();
+
+    // other threads add requests, hold the lock except in the handler:
+    radthreadLock();
+    while ((pending = (MSGRTR_PENDING_REQUEST *)radListGetFirst (&msgRtrLocalWork.requestList))
+           != NULL &&
+           pending->deadline <= now)
+    {
+        radListRemove (&msgRtrLocalWork.requestList, (NODE *)pending);
+        radthreadUnlock();
+        (*pending->replyHandler) (TIMEOUT, pending->msgID, NULL, 0, pending->userData);
+        free (pending);
+        radthreadLock();
+    }
+
+    requestTimerRestart ();
+    radthreadUnlock();
+    return;
+}
+
+// Queue handler prepended at init - consumes requests and replies, which the
+// router delivers whole (header included) as MSGRTR_INTERNAL_MSGID messages:
+static void rpcMsgHandler
+(
+    char                *srcQueueName,
+    UINT                msgType,
+    void                *msg,
+    UINT                length,
+    void                *userData
+)
+{
+    MSGRTR_HDR              *rtrHdr = (MSGRTR_HDR *)msg;
+    MSGRTR_PENDING_REQUEST  *pending;
+    MSGRTR_REQUEST_ID       requestID;
+
+    if (msgType != MSGRTR_INTERNAL_MSGID ||
+        length < sizeof(*rtrHdr) ||
+        rtrHdr->magicNumber != MSGRTR_MAGIC_NUMBER ||
+        rtrHdr->msgID == MSGRTR_INTERNAL_MSGID ||
+        (rtrHdr->flags & MSGRTR_FLAG_RPC) == 0 ||
+        rtrHdr->length > length - sizeof(*rtrHdr))
+    {
+        return;
+    }
+
+    // the application never sees these:
+    radProcessQueueStopHandlerList ();
+
+    if (rtrHdr->flags & MSGRTR_FLAG_REPLY)
+    {
+        radthreadLock();
+        for (pending = (MSGRTR_PENDING_REQUEST *)radListGetFirst (&msgRtrLocalWork.requestList);
+             pending != NULL;
+             pending = (MSGRTR_PENDING_REQUEST *)radListGetNext (&msgRtrLocalWork.requestList, 
+                                                                 (NODE *)pending))
+        {
+            if (pending->correlationID == rtrHdr->correlationID)
+            {
+                break;
+            }
+        }
+
+        if (pending == NULL)
+        {
+            // timed out already, or a second responder
+            radthreadUnlock();
+            return;
+        }
+
+        radListRemove (&msgRtrLocalWork.requestList, (NODE *)pending);
+        requestTimerRestart ();
+        radthreadUnlock();
+        (*pending->replyHandler) (OK, pending->msgID, rtrHdr->msg, rtrHdr->length, 
+                                  pending->userData);
+        free (pending);
+        return;
+    }
+
+    if (msgRtrLocalWork.requestHandler == NULL)
+    {
+        return;
+    }
+
+    requestID.msgID         = rtrHdr->msgID;
+    requestID.correlationID = rtrHdr->correlationID;
+    requestID.replyRouterID = rtrHdr->replyRouterID;
+    requestID.replyPid      = rtrHdr->replyPid;
+    (*msgRtrLocalWork.requestHandler) (rtrHdr->msgID, rtrHdr->msg, rtrHdr->length, 
+                                       &requestID, msgRtrLocalWork.requestUserData);
+    return;
+}
+
+// Set aside a message read while waiting on the router so radProcessWait
+// still delivers it:
+static void deferQueueMsg (char *srcQName, UINT msgType, void *recvBfr, UINT length)
+{
+    if (radProcessQueueDefer (srcQName, msgType, recvBfr, length) == ERROR)
+    {
+        radMsgLog(PRI_HIGH, "radMsgRouter: radProcessQueueDefer failed - "
+                            "message type %u dropped!", msgType);
+        if (length > 0 && recvBfr)
+        {
+            radBufferRls (recvBfr);
+        }
+    }
+
+    return;
+}
+
+// Wait up to 'msecs' for something in our queue (radQueueRecv blocks):
+static int queueReadable (int msecs)
+{
+    fd_set              readFds;
+    struct timeval      tv;
+    int                 fd = radQueueGetFD (radProcessQueueGetID ());
+
+    FD_ZERO (&readFds);
+    FD_SET (fd, &readFds);
+    tv.tv_sec   = msecs / 1000;
+    tv.tv_usec  = (msecs % 1000) * 1000;
+
+    return (select (fd + 1, &readFds, NULL, NULL, &tv) > 0);
+}
+
+// Wait for the router ACK carrying 'ackToken'; other messages are deferred
+// to radProcessWait:
+static int waitForRouterAck (ULONG ackToken)
 {
     char                srcQName[QUEUE_NAME_LENGTH+1];
     UINT                msgType;
@@ -82,7 +289,10 @@ static int waitForRouterAck (void)
             return FALSE;
         }
 
-        radUtilsSleep (25);
+        if (! queueReadable (MSGRTR_MAX_ACK_POLL))
+        {
+            continue;
+        }
 
         if ((retVal = radQueueRecv (radProcessQueueGetID (),
                                     srcQName,
@@ -107,26 +317,34 @@ static int waitForRouterAck (void)
             if (rtrHdr->magicNumber != MSGRTR_MAGIC_NUMBER ||
                 rtrHdr->msgID != MSGRTR_INTERNAL_MSGID)
             {
-                radBufferRls (recvBfr);
+                // routed traffic - maybe for msgIDs registered already
+                deferQueueMsg (srcQName, msgType, recvBfr, length);
                 continue;
             }
 
             rtrMsg = (MSGRTR_INTERNAL_MSG *)rtrHdr->msg;
             if (rtrMsg->subMsgID == MSGRTR_SUBTYPE_ACK)
             {
-                // this is what we were wanting...
+                if (rtrMsg->targetMsgID == ackToken)
+                {
+                    // this is what we were wanting...
+                    radBufferRls (recvBfr);
+                    return TRUE;
+                }
+
+                // an async registration may be waiting on this one:
+                asyncComplete (rtrMsg->targetMsgID, OK);
                 radBufferRls (recvBfr);
-                return TRUE;
+                continue;
             }
         }
-        else
-        {
-            // just toss the received buffer
-            radBufferRls (recvBfr);
-        }
+
+        deferQueueMsg (srcQName, msgType, recvBfr, length);
     }
 }
 
+// Wait for the router's IS_REGISTERED answer; other messages are deferred
+// to radProcessWait:
 static int waitForRouterAnswer (void)
 {
     char                srcQName[QUEUE_NAME_LENGTH+1];
@@ -147,7 +365,10 @@ static int waitForRouterAnswer (void)
             return ERROR;
         }
 
-        radUtilsSleep (25);
+        if (! queueReadable (MSGRTR_MAX_ACK_POLL))
+        {
+            continue;
+        }
 
         if ((retVal = radQueueRecv (radProcessQueueGetID (),
                                     srcQName,
@@ -169,31 +390,35 @@ static int waitForRouterAnswer (void)
         {
             // Yes - make sure it is from the router
             rtrHdr = (MSGRTR_HDR *)recvBfr;
-            if (rtrHdr->magicNumber != MSGRTR_MAGIC_NUMBER ||
-                rtrHdr->msgID != MSGRTR_INTERNAL_MSGID)
-            {
-                radBufferRls (recvBfr);
-                continue;
-            }
-
-            rtrMsg = (MSGRTR_INTERNAL_MSG *)rtrHdr->msg;
-            if (rtrMsg->subMsgID == MSGRTR_SUBTYPE_MSGID_IS_REGISTERED)
+            if (rtrHdr->magicNumber == MSGRTR_MAGIC_NUMBER &&
+                rtrHdr->msgID == MSGRTR_INTERNAL_MSGID)
             {
-                // this is what we were wanting...
-                retVal = rtrMsg->isRegistered;
-                radBufferRls (recvBfr);
-                return retVal;
+                rtrMsg = (MSGRTR_INTERNAL_MSG *)rtrHdr->msg;
+                if (rtrMsg->subMsgID == MSGRTR_SUBTYPE_MSGID_IS_REGISTERED)
+                {
+                    // this is what we were wanting...
+                    retVal = rtrMsg->isRegistered;
+                    radBufferRls (recvBfr);
+                    return retVal;
+                }
             }
         }
-        else
-        {
-            // just toss the received buffer
-            radBufferRls (recvBfr);
-        }
+
+        // not the answer - radProcessWait delivers it:
+        deferQueueMsg (srcQName, msgType, recvBfr, length);
     }
 }
 
-static int sendToRouter (ULONG msgID, void *data, int length)
+// Send a request or reply (or, with 'rpc' NULL, any message) to the router:
+static int sendRpcToRouter 
+(
+    ULONG               msgID, 
+    void                *data, 
+    int                 length, 
+    ULONG               flags,
+    ULONG               routerSlots,
+    MSGRTR_REQUEST_ID   *rpc
+)
 {
     MSGRTR_HDR          *msg;
 
@@ -208,6 +433,23 @@ static int sendToRouter (ULONG msgID, void *data, int length)
     msg->srcpid             = getpid ();
     msg->msgID              = msgID;
     msg->length             = length;
+    msg->flags              = flags;
+    msg->routerSlots        = routerSlots;
+    msg->originID           = 0;            // the router stamps these
+    msg->originEpoch        = 0;
+    msg->originSeq          = 0;
+    if (rpc != NULL)
+    {
+        msg->correlationID  = rpc->correlationID;
+        msg->replyRouterID  = rpc->replyRouterID;   // 0 => the router fills it in
+        msg->replyPid       = rpc->replyPid;
+    }
+    else
+    {
+        msg->correlationID  = 0;
+        msg->replyRouterID  = 0;
+        msg->replyPid       = 0;
+    }
     memcpy (msg->msg, data, length);
 
     if (radProcessQueueSend (msgRtrLocalWork.rtrQueueName,
@@ -224,6 +466,76 @@ static int sendToRouter (ULONG msgID, void *data, int length)
     return OK;
 }
 
+static int sendToRouter (ULONG msgID, void *data, int length, ULONG flags)
+{
+    return sendRpcToRouter (msgID, data, length, flags, 0, NULL);
+}
+
+// Send 'count' msgIDs to the router in list messages, asking for an ACK
+// with 'ackToken' after the last one:
+static int sendMsgIDList (ULONG *msgIDs, int count, ULONG ackToken)
+{
+    ULONG                       bfr[(sizeof(MSGRTR_INTERNAL_LIST_MSG)/sizeof(ULONG))
+                                    + MSGRTR_MAX_LIST_MSGIDS];
+    MSGRTR_INTERNAL_LIST_MSG    *listMsg = (MSGRTR_INTERNAL_LIST_MSG *)bfr;
+    int                         numMsgIDs;
+
+    while (count > 0)
+    {
+        numMsgIDs = (count > MSGRTR_MAX_LIST_MSGIDS) ? MSGRTR_MAX_LIST_MSGIDS : count;
+
+        listMsg->subMsgID   = MSGRTR_SUBTYPE_ENABLE_MSGID_LIST;
+        listMsg->ackToken   = (numMsgIDs == count) ? ackToken : 0;
+        listMsg->numMsgIDs  = numMsgIDs;
+        memcpy (listMsg->msgIDs, msgIDs, numMsgIDs * sizeof(ULONG));
+
+        if (sendToRouter (MSGRTR_INTERNAL_MSGID, 
+                          listMsg, 
+                          sizeof(*listMsg) + (numMsgIDs * sizeof(ULONG)), 
+                          0)
+            == ERROR)
+        {
+            return ERROR;
+        }
+
+        msgIDs += numMsgIDs;
+        count  -= numMsgIDs;
+    }
+
+    return OK;
+}
+
+// Check a batch of msgIDs before it is sent:
+static int checkMsgIDList (ULONG *msgIDs, int count)
+{
+    int                 i;
+
+    if (msgIDs == NULL || count <= 0)
+    {
+        return ERROR;
+    }
+
+    for (i = 0; i < count; i ++)
+    {
+        if (msgIDs[i] == 0 || msgIDs[i] == MSGRTR_INTERNAL_MSGID)
+        {
+            return ERROR;
+        }
+    }
+
+    return OK;
+}
+
+static ULONG nextAckToken (void)
+{
+    if (++ msgRtrLocalWork.lastAckToken == 0)
+    {
+        // 0 is the ACK for radMsgRouterInit
+        msgRtrLocalWork.lastAckToken = 1;
+    }
+    return msgRtrLocalWork.lastAckToken;
+}
+
 static int sendPidToRouter (int pid, ULONG msgID, void *data, int length)
 {
     MSGRTR_HDR          *msg;
@@ -239,6 +551,14 @@ static int sendPidToRouter (int pid, ULONG msgID, void *data, int length)
     msg->srcpid             = pid;
     msg->msgID              = msgID;
     msg->length             = length;
+    msg->flags              = 0;
+    msg->routerSlots        = 0;
+    msg->originID           = 0;
+    msg->originEpoch        = 0;
+    msg->originSeq          = 0;
+    msg->correlationID      = 0;
+    msg->replyRouterID      = 0;
+    msg->replyPid           = 0;
     memcpy (msg->msg, data, length);
 
     if (radProcessQueueSend (msgRtrLocalWork.rtrQueueName,
@@ -255,137 +575,886 @@ static int sendPidToRouter (int pid, ULONG msgID, void *data, int length)
     return OK;
 }
 
-
-//  API methods
-
-//  Register the message router API for the running process
-//  - will instantiate the message router process if it does not exist for the
-//  - given 'radlibSystemID'
-//  - 'workingDir' specifies where the pid file and FIFOs for the message 
-//    router process are to be maintained
-//  - returns OK or ERROR
-//  Note: 'radSystemInit' and 'radProcessInit' must have been called prior to 
-//        calling this function
-int radMsgRouterInit (char *workingDir)
+// Attach the router's subscription table if it is published:
+static void shmTableAttach (void)
 {
-    struct stat             fileData;
-    char                    temp[128];
-    MSGRTR_INTERNAL_MSG     rtrMsg;
-
-    sprintf (temp, "%s/%s", workingDir, MSGRTR_LOCK_FILE_NAME);
+    SHMEM_ID            id;
+    MSGRTR_SHM_TABLE    *table;
 
-    // check for the msg router pid file, fail if it isn't there
-    if (stat (temp, &fileData) != 0)
+    if (! radShmemIfExist (KEY_MSGRTR_SHMEM))
     {
-        radMsgLog(PRI_HIGH, "radMsgRouterInit: radmrouted not running!");
-        return ERROR;
+        return;
     }
 
-    // set up the local work area
-    sprintf (msgRtrLocalWork.rtrQueueName, "%s/%s", workingDir, MSGRTR_QUEUE_NAME);
+    id = radShmemInit (KEY_MSGRTR_SHMEM, SEM_INDEX_MSGRTR, sizeof(MSGRTR_SHM_TABLE));
+    if (id == NULL)
+    {
+        return;
+    }
 
-    //  ... attach to the router's queue
-    if (radProcessQueueAttach (msgRtrLocalWork.rtrQueueName, QUEUE_GROUP_ALL) == ERROR)
+    table = (MSGRTR_SHM_TABLE *)radShmemGet (id);
+    if (table->magic != MSGRTR_SHM_MAGIC)
     {
-        radMsgLog(PRI_HIGH, "radMsgRouterInit: radProcessQueueAttach failed!");
-        memset (msgRtrLocalWork.rtrQueueName, 0, QUEUE_NAME_LENGTH+1);
-        return ERROR;
+        radShmemExit (id);
+        return;
     }
 
-    // register with the message router
-    rtrMsg.subMsgID     = MSGRTR_SUBTYPE_REGISTER;
-    strncpy (rtrMsg.name, radProcessGetName(temp), sizeof(rtrMsg.name));
-    if (sendToRouter(MSGRTR_INTERNAL_MSGID, &rtrMsg, sizeof(rtrMsg)) == ERROR)
+    memset (msgRtrLocalWork.slotPid, 0, sizeof(msgRtrLocalWork.slotPid));
+    msgRtrLocalWork.shmId       = id;
+    msgRtrLocalWork.shmTable    = table;
+    return;
+}
+
+static void shmTableDetach (void)
+{
+    int                 i;
+
+    if (msgRtrLocalWork.shmTable == NULL)
     {
-        radMsgLog(PRI_HIGH, "radMsgRouterInit: sendToRouter failed!");
-        memset (msgRtrLocalWork.rtrQueueName, 0, QUEUE_NAME_LENGTH);
-        return ERROR;
+        return;
     }
 
-    // wait for the ACK here
-    if (waitForRouterAck() != TRUE)
+    for (i = 0; i < MSGRTR_MAX_CLIENTS; i ++)
     {
-        radMsgLog(PRI_HIGH, "radMsgRouterInit: waitForRouterAck failed!");
-        memset (msgRtrLocalWork.rtrQueueName, 0, QUEUE_NAME_LENGTH);
-        return ERROR;
+        if (msgRtrLocalWork.slotPid[i] != 0)
+        {
+            radProcessQueueDettach (msgRtrLocalWork.slotQueue[i], QUEUE_GROUP_ALL);
+            msgRtrLocalWork.slotPid[i] = 0;
+        }
     }
 
-    return OK;
+    radShmemExit (msgRtrLocalWork.shmId);
+    msgRtrLocalWork.shmTable = NULL;
+    return;
 }
 
-
-//  Deregister the message router API for the running process
-void radMsgRouterExit (void)
+// Attach the router's traffic statistics block if it is published:
+static void statsAttach (void)
 {
-    MSGRTR_INTERNAL_MSG     rtrMsg;
+    SHMEM_ID            id;
+    MSGRTR_STATS_BLOCK  *stats;
 
-    // de-register with the message router
-    rtrMsg.subMsgID     = MSGRTR_SUBTYPE_DEREGISTER;
+    if (! radShmemIfExist (KEY_MSGRTR_STATS_SHMEM))
+    {
+        return;
+    }
 
-    if (sendToRouter (MSGRTR_INTERNAL_MSGID, &rtrMsg, sizeof(rtrMsg)) == ERROR)
+    id = radShmemInit (KEY_MSGRTR_STATS_SHMEM, 
+                       SEM_INDEX_MSGRTR_STATS, 
+                       sizeof(MSGRTR_STATS_BLOCK));
+    if (id == NULL)
     {
-        radMsgLog(PRI_HIGH, "radMsgRouterExit: sendToRouter failed!");
         return;
     }
 
-    radProcessQueueDettach (msgRtrLocalWork.rtrQueueName, QUEUE_GROUP_ALL);
-    memset (msgRtrLocalWork.rtrQueueName, 0, QUEUE_NAME_LENGTH+1);
+    stats = (MSGRTR_STATS_BLOCK *)radShmemGet (id);
+    if (stats->magic != MSGRTR_STATS_MAGIC)
+    {
+        radShmemExit (id);
+        return;
+    }
 
+    msgRtrLocalWork.statsId = id;
+    msgRtrLocalWork.stats   = stats;
     return;
 }
 
-
-//  Deregister the message router API for the given process id
-void radMsgRouterProcessExit (int pid)
+static void statsDetach (void)
 {
-    MSGRTR_INTERNAL_MSG     rtrMsg;
-
-    // de-register with the message router
-    rtrMsg.subMsgID     = MSGRTR_SUBTYPE_DEREGISTER;
-
-    if (sendPidToRouter (pid, MSGRTR_INTERNAL_MSGID, &rtrMsg, sizeof(rtrMsg)) == ERROR)
+    if (msgRtrLocalWork.stats == NULL)
     {
-        radMsgLog(PRI_HIGH, "radMsgRouterExit: sendPidToRouter failed!");
+        return;
     }
 
+    radShmemExit (msgRtrLocalWork.statsId);
+    msgRtrLocalWork.stats = NULL;
     return;
 }
 
-
-//  Request to receive 'msgID' messages
-int radMsgRouterMessageRegister (ULONG msgID)
+// Find (or claim) the stats row for msgID, NULL if none is left:
+static MSGRTR_STATS_MSGID *statsRowGet (MSGRTR_STATS_BLOCK *stats, ULONG msgID)
 {
-    MSGRTR_INTERNAL_MSG     rtrMsg;
+    MSGRTR_STATS_MSGID  *row;
+    UINT                index = MSGRTR_STATS_INDEX(msgID);
+    int                 tries;
 
-    if (msgRtrLocalWork.rtrQueueName[0] == 0)
+    for (tries = 0; tries < MSGRTR_STATS_MAX_TRIES; tries ++)
     {
-        // we have not successfully registered yet
-        return ERROR;
+        row = &stats->msgIDs[(index + tries) & (MSGRTR_STATS_MSGIDS - 1)];
+        if (row->msgID == msgID)
+        {
+            return row;
+        }
+        if (row->msgID == 0 &&
+            (__sync_bool_compare_and_swap (&row->msgID, 0, msgID) ||
+             row->msgID == msgID))
+        {
+            // ours now (or another sender just claimed it for msgID):
+            return row;
+        }
     }
 
-    if (msgID == 0)
-    {
-        // user cannot receive msgID 0
-        return ERROR;
-    }
+    return NULL;
+}
 
-    // register with the message router for msgID
-    rtrMsg.subMsgID     = MSGRTR_SUBTYPE_ENABLE_MSGID;
-    rtrMsg.targetMsgID  = msgID;
+// Count one message for msgID in the shared stats block:
+void msgrtrStatsRecord
+(
+    MSGRTR_STATS_BLOCK  *stats,
+    ULONG               msgID,
+    ULONG               length,
+    int                 fanOut,
+    int                 failures
+)
+{
+    MSGRTR_STATS_MSGID  *row;
+    int                 bucket, limit;
 
-    if (sendToRouter(MSGRTR_INTERNAL_MSGID, &rtrMsg, sizeof(rtrMsg)) == ERROR)
+    row = statsRowGet (stats, msgID);
+    if (row == NULL)
     {
-        radMsgLog(PRI_HIGH, "radMsgRouterMessageRegister: sendToRouter failed!");
-        return ERROR;
+        __sync_fetch_and_add (&stats->unrecorded, 1);
+        return;
     }
 
-    return OK;
-}
-
+    // 0, 1 and 2 have their own buckets, then powers of 2:
+    if (fanOut <= 2)
+    {
+        bucket = fanOut;
+    }
+    else
+    {
+        for (bucket = 3, limit = 4; 
+             fanOut > limit && bucket < MSGRTR_STATS_FANOUT_BUCKETS - 1; 
+             bucket ++, limit <<= 1)
+        {
+            // find the bucket
+        }
+    }
+
+    __sync_fetch_and_add (&row->msgs, 1);
+    __sync_fetch_and_add (&row->bytes, length);
+    __sync_fetch_and_add (&row->fanOut[bucket], 1);
+    if (failures > 0)
+    {
+        __sync_fetch_and_add (&row->failures, failures);
+    }
+    return;
+}
+
+// Find the published range segment holding msgID (binary search):
+static MSGRTR_SHM_RANGE *shmRangeFind (MSGRTR_SHM_TABLE *table, ULONG msgID)
+{
+    MSGRTR_SHM_RANGE    *range;
+    int                 low = 0, high, mid;
+
+    high = table->numRanges - 1;
+    if (high >= MSGRTR_SHM_MAX_RANGES)
+    {
+        high = MSGRTR_SHM_MAX_RANGES - 1;
+    }
+
+    while (low <= high)
+    {
+        mid = (low + high) / 2;
+        range = &table->ranges[mid];
+        if (msgID < range->first)
+        {
+            high = mid - 1;
+        }
+        else if (msgID > range->last)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            return range;
+        }
+    }
+
+    return NULL;
+}
+
+// Take a consistent snapshot of the table entry for msgID plus the pids of
+// its local consumers (exact entries include covering ranges, a range
+// segment answers for msgIDs with no live entry);
+// returns TRUE if found, FALSE if msgID has no consumers or ERROR if the
+// table can't answer (withdrawn, busy or overflowed) and the router must:
+static int shmTableLookup (ULONG msgID, MSGRTR_SHM_ENTRY *result, int *pids)
+{
+    MSGRTR_SHM_TABLE    *table = msgRtrLocalWork.shmTable;
+    MSGRTR_SHM_ENTRY    *entry;
+    MSGRTR_SHM_RANGE    *range;
+    UINT                seq, index;
+    int                 tries, probes, i, overflow;
+
+    index = MSGRTR_SHM_INDEX(msgID);
+    for (tries = 0; tries < MSGRTR_SHM_MAX_TRIES; tries ++)
+    {
+        seq = table->sequence;
+        if (seq & 1)
+        {
+            // router is mid-update
+            continue;
+        }
+        __sync_synchronize ();
+
+        if (table->magic != MSGRTR_SHM_MAGIC)
+        {
+            return ERROR;
+        }
+
+        memset (result, 0, sizeof(*result));
+        for (probes = 0; probes < MSGRTR_SHM_TABLE_SIZE; probes ++)
+        {
+            entry = &table->entries[(index + probes) & (MSGRTR_SHM_TABLE_SIZE - 1)];
+            if (entry->msgID == msgID)
+            {
+                *result = *entry;
+                break;
+            }
+            if (entry->msgID == 0)
+            {
+                break;
+            }
+        }
+
+        if (result->localMask == 0 && result->flags == 0 &&
+            (range = shmRangeFind (table, msgID)) != NULL)
+        {
+            result->msgID       = msgID;
+            result->localMask   = range->localMask;
+            result->flags       = range->flags;
+        }
+
+        for (i = 0; i < MSGRTR_MAX_CLIENTS; i ++)
+        {
+            pids[i] = ((result->localMask & (1U << i)) ? table->clients[i].pid : 0);
+        }
+        overflow = table->overflow;
+
+        __sync_synchronize ();
+        if (table->sequence != seq)
+        {
+            continue;
+        }
+
+        if (result->msgID == msgID)
+        {
+            return TRUE;
+        }
+        return (overflow ? ERROR : FALSE);
+    }
+
+    return ERROR;
+}
+
+// Make sure we are attached to the queue of the consumer in 'slot':
+static int shmSlotRefresh (int slot, int pid)
+{
+    MSGRTR_SHM_TABLE    *table = msgRtrLocalWork.shmTable;
+    char                name[QUEUE_NAME_LENGTH+1];
+    UINT                seq;
+
+    if (msgRtrLocalWork.slotPid[slot] == pid)
+    {
+        return OK;
+    }
+
+    if (msgRtrLocalWork.slotPid[slot] != 0)
+    {
+        // slot was reused:
+        radProcessQueueDettach (msgRtrLocalWork.slotQueue[slot], QUEUE_GROUP_ALL);
+        msgRtrLocalWork.slotPid[slot] = 0;
+    }
+
+    seq = table->sequence;
+    __sync_synchronize ();
+    memcpy (name, table->clients[slot].queueName, QUEUE_NAME_LENGTH);
+    name[QUEUE_NAME_LENGTH] = 0;
+    __sync_synchronize ();
+    if ((seq & 1) || table->sequence != seq || table->clients[slot].pid != pid)
+    {
+        return ERROR;
+    }
+
+    // don't block opening the FIFO of a consumer that is gone:
+    if (kill (pid, 0) != 0)
+    {
+        return ERROR;
+    }
+
+    if (radProcessQueueAttach (name, QUEUE_GROUP_ALL) == ERROR)
+    {
+        return ERROR;
+    }
+
+    // a consumer that falls behind must not stall the producer, its
+    // overflow goes to the router instead:
+    if (radProcessQueueSetSendBlocking (name, FALSE) == ERROR)
+    {
+        radProcessQueueDettach (name, QUEUE_GROUP_ALL);
+        return ERROR;
+    }
+
+    strncpy (msgRtrLocalWork.slotQueue[slot], name, QUEUE_NAME_LENGTH);
+    msgRtrLocalWork.slotPid[slot] = pid;
+    return OK;
+}
+
+// TRUE if the router holds messages for the consumer in 'slot' that a 
+// direct send would overtake (his backlog or what we left to the router):
+static int shmSlotBehind (int slot)
+{
+    MSGRTR_SHM_CLIENT   *client = &msgRtrLocalWork.shmTable->clients[slot];
+    ULONG               done;
+
+    // the router marks a backlog before it counts the message done:
+    done = client->handoffsDone;
+    __sync_synchronize ();
+    return (client->spilling || (long)(client->handoffs - done) > 0);
+}
+
+// The slots of every local consumer, for a message whose consumers the 
+// table could not tell us:
+static ULONG shmSlotsInUse (void)
+{
+    ULONG               slots = 0;
+    int                 i;
+
+    for (i = 0; i < MSGRTR_MAX_CLIENTS; i ++)
+    {
+        if (msgRtrLocalWork.shmTable->clients[i].pid != 0)
+        {
+            slots |= (1U << i);
+        }
+    }
+    return slots;
+}
+
+// Count (or, with 'count' negative, take back) messages left to the router
+// for the slots in 'routerSlots':
+static void shmSlotHandoffs (ULONG routerSlots, int count)
+{
+    int                 i;
+
+    for (i = 0; i < MSGRTR_MAX_CLIENTS; i ++)
+    {
+        if (routerSlots & (1U << i))
+        {
+            __sync_fetch_and_add (&msgRtrLocalWork.shmTable->clients[i].handoffs, count);
+        }
+    }
+    return;
+}
+
+// Deliver to the local consumers in 'pids' without involving the router;
+// returns the number delivered, sets 'failed' to the number that failed and
+// adds the slots whose queue was full to 'routerSlots':
+static int sendDirect 
+(
+    ULONG           msgID, 
+    void            *data, 
+    ULONG           length, 
+    int             *pids, 
+    int             *failed,
+    ULONG           *routerSlots
+)
+{
+    UCHAR               *sendBfr;
+    int                 i, retVal, sent = 0;
+
+    *failed = 0;
+
+    for (i = 0; i < MSGRTR_MAX_CLIENTS; i ++)
+    {
+        if (pids[i] == 0)
+        {
+            continue;
+        }
+
+        sendBfr = (UCHAR *)radBufferGet (length);
+        if (sendBfr == NULL)
+        {
+            radMsgLog(PRI_HIGH, "sendDirect: radBufferGet failed!");
+            (*failed) ++;
+            continue;
+        }
+        memcpy (sendBfr, data, length);
+
+        retVal = radProcessQueueSend (msgRtrLocalWork.slotQueue[i], msgID, sendBfr, length);
+        if (retVal == BUSY)
+        {
+            // the router queues it for him (or drops per its policy):
+            radBufferRls (sendBfr);
+            *routerSlots |= (1U << i);
+            continue;
+        }
+        if (retVal != OK)
+        {
+            radMsgLog(PRI_HIGH, "sendDirect: %s: radProcessQueueSend failed!",
+                       msgRtrLocalWork.slotQueue[i]);
+            radBufferRls (sendBfr);
+            if (retVal == ERROR_ABORT)
+            {
+                radProcessQueueDettach (msgRtrLocalWork.slotQueue[i], QUEUE_GROUP_ALL);
+                msgRtrLocalWork.slotPid[i] = 0;
+            }
+            __sync_fetch_and_add (&msgRtrLocalWork.shmTable->clients[i].directFailures, 1);
+            (*failed) ++;
+            continue;
+        }
+
+        __sync_fetch_and_add (&msgRtrLocalWork.shmTable->clients[i].directSends, 1);
+        __sync_fetch_and_add (&msgRtrLocalWork.shmTable->clients[i].directBytes, length);
+        sent ++;
+    }
+
+    return sent;
+}
+
+
+//  API methods
+
+//  Register the message router API for the running process
+//  - will instantiate the message router process if it does not exist for the
+//  - given 'radlibSystemID'
+//  - 'workingDir' specifies where the pid file and FIFOs for the message 
+//    router process are to be maintained
+//  - returns OK or ERROR
+//  Note: 'radSystemInit' and 'radProcessInit' must have been called prior to 
+//        calling this function
+int radMsgRouterInit (char *workingDir)
+{
+    struct stat             fileData;
+    char                    temp[128];
+    MSGRTR_INTERNAL_MSG     rtrMsg;
+
+    sprintf (temp, "%s/%s", workingDir, MSGRTR_LOCK_FILE_NAME);
+
+    // check for the msg router pid file, fail if it isn't there
+    if (stat (temp, &fileData) != 0)
+    {
+        radMsgLog(PRI_HIGH, "radMsgRouterInit: radmrouted not running!");
+        return ERROR;
+    }
+
+    // set up the local work area
+    sprintf (msgRtrLocalWork.rtrQueueName, "%s/%s", workingDir, MSGRTR_QUEUE_NAME);
+    if (msgRtrLocalWork.asyncHandlerId == 0)
+    {
+        radListReset (&msgRtrLocalWork.asyncList);
+    }
+    if (msgRtrLocalWork.rpcHandlerId == 0)
+    {
+        radListReset (&msgRtrLocalWork.requestList);
+    }
+
+    //  ... attach to the router's queue
+    if (radProcessQueueAttach (msgRtrLocalWork.rtrQueueName, QUEUE_GROUP_ALL) == ERROR)
+    {
+        radMsgLog(PRI_HIGH, "radMsgRouterInit: radProcessQueueAttach failed!");
+        memset (msgRtrLocalWork.rtrQueueName, 0, QUEUE_NAME_LENGTH+1);
+        return ERROR;
+    }
+
+    // register with the message router
+    rtrMsg.subMsgID     = MSGRTR_SUBTYPE_REGISTER;
+    strncpy (rtrMsg.name, radProcessGetName(temp), sizeof(rtrMsg.name));
+    if (sendToRouter(MSGRTR_INTERNAL_MSGID, &rtrMsg, sizeof(rtrMsg), 0) == ERROR)
+    {
+        radMsgLog(PRI_HIGH, "radMsgRouterInit: sendToRouter failed!");
+        memset (msgRtrLocalWork.rtrQueueName, 0, QUEUE_NAME_LENGTH);
+        return ERROR;
+    }
+
+    // wait for the ACK here
+    if (waitForRouterAck(0) != TRUE)
+    {
+        radMsgLog(PRI_HIGH, "radMsgRouterInit: waitForRouterAck failed!");
+        memset (msgRtrLocalWork.rtrQueueName, 0, QUEUE_NAME_LENGTH);
+        return ERROR;
+    }
+
+    // use the router's subscription table for direct delivery if we can:
+    shmTableDetach ();
+    shmTableAttach ();
+    statsDetach ();
+    statsAttach ();
+    msgRtrLocalWork.shmRetryTime = 0;
+
+    // catch requests and replies before the application's queue handler:
+    if (msgRtrLocalWork.rpcHandlerId == 0)
+    {
+        msgRtrLocalWork.rpcHandlerId = radProcessQueuePrependHandler (rpcMsgHandler, NULL);
+        if (msgRtrLocalWork.rpcHandlerId == (long)ERROR)
+        {
+            radMsgLog(PRI_HIGH, "radMsgRouterInit: radProcessQueuePrependHandler failed!");
+            msgRtrLocalWork.rpcHandlerId = 0;
+        }
+    }
+
+    return OK;
+}
+
+
+//  Deregister the message router API for the running process
+void radMsgRouterExit (void)
+{
+    MSGRTR_INTERNAL_MSG     rtrMsg;
+    MSGRTR_ASYNC_REGISTER   *async;
+    MSGRTR_PENDING_REQUEST  *pending;
+
+    // de-register with the message router
+    rtrMsg.subMsgID     = MSGRTR_SUBTYPE_DEREGISTER;
+
+    if (sendToRouter (MSGRTR_INTERNAL_MSGID, &rtrMsg, sizeof(rtrMsg), 0) == ERROR)
+    {
+        radMsgLog(PRI_HIGH, "radMsgRouterExit: sendToRouter failed!");
+        return;
+    }
+
+    shmTableDetach ();
+    statsDetach ();
+
+    // fail any async registrations still waiting:
+    if (msgRtrLocalWork.asyncHandlerId != 0)
+    {
+        while ((async = (MSGRTR_ASYNC_REGISTER *)radListGetFirst (&msgRtrLocalWork.asyncList)) 
+               != NULL)
+        {
+            asyncComplete (async->ackToken, ERROR);
+        }
+        radProcessQueueRemoveHandler (msgRtrLocalWork.asyncHandlerId);
+        msgRtrLocalWork.asyncHandlerId = 0;
+    }
+
+    // and any requests still waiting for a reply:
+    if (msgRtrLocalWork.rpcHandlerId != 0)
+    {
+        while ((pending = (MSGRTR_PENDING_REQUEST *)
+                          radListRemoveFirst (&msgRtrLocalWork.requestList)) 
+               != NULL)
+        {
+            (*pending->replyHandler) (ERROR, pending->msgID, NULL, 0, pending->userData);
+            free (pending);
+        }
+        if (msgRtrLocalWork.requestTimer != NULL)
+        {
+            radTimerDelete (msgRtrLocalWork.requestTimer);
+            msgRtrLocalWork.requestTimer = NULL;
+        }
+        radProcessQueueRemoveHandler (msgRtrLocalWork.rpcHandlerId);
+        msgRtrLocalWork.rpcHandlerId = 0;
+        msgRtrLocalWork.requestHandler = NULL;
+    }
+
+    radProcessQueueDettach (msgRtrLocalWork.rtrQueueName, QUEUE_GROUP_ALL);
+    memset (msgRtrLocalWork.rtrQueueName, 0, QUEUE_NAME_LENGTH+1);
+
+    return;
+}
+
+
+//  Deregister the message router API for the given process id
+void radMsgRouterProcessExit (int pid)
+{
+    MSGRTR_INTERNAL_MSG     rtrMsg;
+
+    // de-register with the message router
+    rtrMsg.subMsgID     = MSGRTR_SUBTYPE_DEREGISTER;
+
+    if (sendPidToRouter (pid, MSGRTR_INTERNAL_MSGID, &rtrMsg, sizeof(rtrMsg)) == ERROR)
+    {
+        radMsgLog(PRI_HIGH, "radMsgRouterExit: sendPidToRouter failed!");
+    }
+
+    return;
+}
+
+
+//  Request to receive 'msgID' messages
+int radMsgRouterMessageRegister (ULONG msgID)
+{
+    MSGRTR_INTERNAL_MSG     rtrMsg;
+
+    if (msgRtrLocalWork.rtrQueueName[0] == 0)
+    {
+        // we have not successfully registered yet
+        return ERROR;
+    }
+
+    if (msgID == 0)
+    {
+        // user cannot receive msgID 0
+        return ERROR;
+    }
+
+    // register with the message router for msgID
+    rtrMsg.subMsgID     = MSGRTR_SUBTYPE_ENABLE_MSGID;
+    rtrMsg.targetMsgID  = msgID;
+
+    if (sendToRouter(MSGRTR_INTERNAL_MSGID, &rtrMsg, sizeof(rtrMsg), 0) == ERROR)
+    {
+        radMsgLog(PRI_HIGH, "radMsgRouterMessageRegister: sendToRouter failed!");
+        return ERROR;
+    }
+
+    return OK;
+}
+
+//  Request to receive all 'count' msgIDs in 'msgIDs' with one ACK
+int radMsgRouterMessageRegisterMany (ULONG *msgIDs, int count)
+{
+    ULONG                   ackToken;
+
+    if (msgRtrLocalWork.rtrQueueName[0] == 0)
+    {
+        // we have not successfully registered yet
+        return ERROR;
+    }
+
+    if (checkMsgIDList (msgIDs, count) == ERROR)
+    {
+        return ERROR;
+    }
+
+    ackToken = nextAckToken ();
+    if (sendMsgIDList (msgIDs, count, ackToken) == ERROR)
+    {
+        radMsgLog(PRI_HIGH, "radMsgRouterMessageRegisterMany: sendToRouter failed!");
+        return ERROR;
+    }
+
+    if (waitForRouterAck (ackToken) != TRUE)
+    {
+        radMsgLog(PRI_HIGH, "radMsgRouterMessageRegisterMany: waitForRouterAck failed!");
+        return ERROR;
+    }
+
+    return OK;
+}
+
+//  Asynchronous radMsgRouterMessageRegisterMany, completed in radProcessWait
+int radMsgRouterMessageRegisterManyAsync
+(
+    ULONG           *msgIDs,
+    int             count,
+    void            (*doneHandler) (int status, void *userData),
+    void            *userData
+)
+{
+    MSGRTR_ASYNC_REGISTER   *async;
+
+    if (msgRtrLocalWork.rtrQueueName[0] == 0)
+    {
+        // we have not successfully registered yet
+        return ERROR;
+    }
+
+    if (doneHandler == NULL || checkMsgIDList (msgIDs, count) == ERROR)
+    {
+        return ERROR;
+    }
+
+    // catch our ACKs before the application's queue handler does:
+    if (msgRtrLocalWork.asyncHandlerId == 0)
+    {
+        msgRtrLocalWork.asyncHandlerId = 
+            radProcessQueuePrependHandler (asyncAckHandler, NULL);
+        if (msgRtrLocalWork.asyncHandlerId == (long)ERROR)
+        {
+            radMsgLog(PRI_HIGH, "radMsgRouterMessageRegisterManyAsync: "
+                                "radProcessQueuePrependHandler failed!");
+            msgRtrLocalWork.asyncHandlerId = 0;
+            return ERROR;
+        }
+    }
+
+    async = (MSGRTR_ASYNC_REGISTER *)malloc (sizeof(*async));
+    if (async == NULL)
+    {
+        return ERROR;
+    }
+    async->ackToken     = nextAckToken ();
+    async->doneHandler  = doneHandler;
+    async->userData     = userData;
+
+    if (sendMsgIDList (msgIDs, count, async->ackToken) == ERROR)
+    {
+        radMsgLog(PRI_HIGH, "radMsgRouterMessageRegisterManyAsync: sendToRouter failed!");
+        free (async);
+        return ERROR;
+    }
+
+    radListAddToEnd (&msgRtrLocalWork.asyncList, (NODE *)async);
+    return OK;
+}
+
+// Convert msgID/prefixBits to its msgID range:
+static int prefixToRange (ULONG msgID, int prefixBits, ULONG *first, ULONG *last)
+{
+    UINT                mask;
+
+    if (prefixBits < 0 || prefixBits > 32)
+    {
+        return ERROR;
+    }
+
+    mask    = (prefixBits == 0) ? 0 : (0xFFFFFFFFU << (32 - prefixBits));
+    *first  = (ULONG)((UINT)msgID & mask);
+    *last   = (ULONG)(*first | ~mask);
+    return OK;
+}
+
+// Send a range (de)registration to the router; msgIDs 0 and
+// MSGRTR_INTERNAL_MSGID are trimmed from the ends:
+static int sendRangeToRouter (ULONG subMsgID, ULONG first, ULONG last)
+{
+    MSGRTR_INTERNAL_MSG     rtrMsg;
+
+    if (msgRtrLocalWork.rtrQueueName[0] == 0)
+    {
+        // we have not successfully registered yet
+        return ERROR;
+    }
+
+    if (first == 0)
+    {
+        first = 1;
+    }
+    if (last == MSGRTR_INTERNAL_MSGID)
+    {
+        last --;
+    }
+    if (first > last)
+    {
+        return ERROR;
+    }
+
+    memset (&rtrMsg, 0, sizeof(rtrMsg));
+    rtrMsg.subMsgID     = subMsgID;
+    rtrMsg.targetMsgID  = first;
+    rtrMsg.lastMsgID    = last;
+
+    return sendToRouter(MSGRTR_INTERNAL_MSGID, &rtrMsg, sizeof(rtrMsg), 0);
+}
+
+//  Request to receive every msgID from 'firstMsgID' to 'lastMsgID'
+int radMsgRouterMessageRegisterRange (ULONG firstMsgID, ULONG lastMsgID)
+{
+    if (sendRangeToRouter (MSGRTR_SUBTYPE_ENABLE_MSGID_RANGE, firstMsgID, lastMsgID)
+        == ERROR)
+    {
+        radMsgLog(PRI_HIGH, "radMsgRouterMessageRegisterRange: sendToRouter failed!");
+        return ERROR;
+    }
+
+    return OK;
+}
+
+//  Request to receive every msgID matching msgID/prefixBits
+int radMsgRouterMessageRegisterPrefix (ULONG msgID, int prefixBits)
+{
+    ULONG                   first, last;
+
+    if (prefixToRange (msgID, prefixBits, &first, &last) == ERROR)
+    {
+        return ERROR;
+    }
+
+    return radMsgRouterMessageRegisterRange (first, last);
+}
+
+//  Request to NOT receive the msgIDs from 'firstMsgID' to 'lastMsgID'
+int radMsgRouterMessageDeregisterRange (ULONG firstMsgID, ULONG lastMsgID)
+{
+    if (sendRangeToRouter (MSGRTR_SUBTYPE_DISABLE_MSGID_RANGE, firstMsgID, lastMsgID)
+        == ERROR)
+    {
+        radMsgLog(PRI_HIGH, "radMsgRouterMessageDeregisterRange: sendToRouter failed!");
+        return ERROR;
+    }
+
+    return OK;
+}
+
+//  Request to NOT receive the msgIDs matching msgID/prefixBits
+int radMsgRouterMessageDeregisterPrefix (ULONG msgID, int prefixBits)
+{
+    ULONG                   first, last;
+
+    if (prefixToRange (msgID, prefixBits, &first, &last) == ERROR)
+    {
+        return ERROR;
+    }
+
+    return radMsgRouterMessageDeregisterRange (first, last);
+}
+
+//  Request to receive only the 'msgID' messages that pass a filter
+int radMsgRouterMessageRegisterFilter
+(
+    ULONG               msgID,
+    MSGRTR_FILTER_TERM  *terms,
+    int                 numTerms
+)
+{
+    ULONG                       bfr[(sizeof(MSGRTR_INTERNAL_FILTER_MSG) + 
+                                     MSGRTR_MAX_FILTER_TERMS*sizeof(MSGRTR_FILTER_TERM))/sizeof(ULONG)];
+    MSGRTR_INTERNAL_FILTER_MSG  *rtrMsg = (MSGRTR_INTERNAL_FILTER_MSG *)bfr;
+    int                         i;
+
+    if (msgRtrLocalWork.rtrQueueName[0] == 0)
+    {
+        // we have not successfully registered yet
+        return ERROR;
+    }
+
+    if (msgID == 0 || msgID == MSGRTR_INTERNAL_MSGID || 
+        numTerms < 0 || numTerms > MSGRTR_MAX_FILTER_TERMS ||
+        (numTerms > 0 && terms == NULL))
+    {
+        return ERROR;
+    }
+
+    // the router drops filters it can't evaluate, so catch them here:
+    for (i = 0; i < numTerms; i ++)
+    {
+        if ((terms[i].width != 1 && terms[i].width != 2 && 
+             terms[i].width != 4 && terms[i].width != 8) ||
+            terms[i].op < MSGRTR_FILTER_EQ || terms[i].op > MSGRTR_FILTER_ALL_BITS)
+        {
+            radMsgLog(PRI_HIGH, "radMsgRouterMessageRegisterFilter: bad term %d", i);
+            return ERROR;
+        }
+    }
+
+    rtrMsg->subMsgID    = MSGRTR_SUBTYPE_ENABLE_MSGID_FILTER;
+    rtrMsg->msgID       = msgID;
+    rtrMsg->numTerms    = numTerms;
+    if (numTerms > 0)
+    {
+        memcpy (rtrMsg->terms, terms, numTerms * sizeof(MSGRTR_FILTER_TERM));
+    }
+
+    if (sendToRouter(MSGRTR_INTERNAL_MSGID, rtrMsg, 
+                     sizeof(*rtrMsg) + numTerms * sizeof(MSGRTR_FILTER_TERM), 0)
+        == ERROR)
+    {
+        radMsgLog(PRI_HIGH, "radMsgRouterMessageRegisterFilter: sendToRouter failed!");
+        return ERROR;
+    }
+
+    return OK;
+}
+
 //  Request if there are any subscribers to 'msgID' messages
 int radMsgRouterMessageIsRegistered (ULONG msgID)
 {
     MSGRTR_INTERNAL_MSG     rtrMsg;
+    MSGRTR_SHM_ENTRY        entry;
+    int                     pids[MSGRTR_MAX_CLIENTS];
     int                     retVal = FALSE;
 
     if (msgID == 0)
@@ -394,11 +1463,26 @@ int radMsgRouterMessageIsRegistered (ULONG msgID)
         return FALSE;
     }
 
+    // the subscription table can usually answer this without a round trip:
+    if (msgRtrLocalWork.shmTable != NULL)
+    {
+        retVal = shmTableLookup (msgID, &entry, pids);
+        if (retVal == TRUE)
+        {
+            return ((entry.localMask != 0 || entry.flags != 0) ? TRUE : FALSE);
+        }
+        else if (retVal == FALSE)
+        {
+            return FALSE;
+        }
+        retVal = FALSE;
+    }
+
     // ask if there are registrants for msgID
     rtrMsg.subMsgID     = MSGRTR_SUBTYPE_MSGID_IS_REGISTERED;
     rtrMsg.targetMsgID  = msgID;
 
-    if (sendToRouter(MSGRTR_INTERNAL_MSGID, &rtrMsg, sizeof(rtrMsg)) == ERROR)
+    if (sendToRouter(MSGRTR_INTERNAL_MSGID, &rtrMsg, sizeof(rtrMsg), 0) == ERROR)
     {
         radMsgLog(PRI_HIGH, "radMsgRouterMessageIsRegistered: sendToRouter failed!");
         return FALSE;
@@ -436,7 +1520,7 @@ int radMsgRouterMessageDeregister (ULONG msgID)
     rtrMsg.subMsgID     = MSGRTR_SUBTYPE_DISABLE_MSGID;
     rtrMsg.targetMsgID  = msgID;
 
-    if (sendToRouter(MSGRTR_INTERNAL_MSGID, &rtrMsg, sizeof(rtrMsg)) == ERROR)
+    if (sendToRouter(MSGRTR_INTERNAL_MSGID, &rtrMsg, sizeof(rtrMsg), 0) == ERROR)
     {
         radMsgLog(PRI_HIGH, "radMsgRouterMessageDeregister: sendToRouter failed!");
         return ERROR;
@@ -451,6 +1535,11 @@ int radMsgRouterMessageDeregister (ULONG msgID)
 //  transferred but remains with the caller
 int radMsgRouterMessageSend (ULONG msgID, void *msg, ULONG length)
 {
+    MSGRTR_SHM_ENTRY        entry;
+    int                     pids[MSGRTR_MAX_CLIENTS];
+    ULONG                   flags = 0, routerSlots = 0;
+    int                     i, sent, failed, found = FALSE;
+
     if (msgRtrLocalWork.rtrQueueName[0] == 0)
     {
         // we have not successfully registered yet
@@ -465,8 +1554,90 @@ int radMsgRouterMessageSend (ULONG msgID, void *msg, ULONG length)
 
     radthreadLock();
 
-    if (sendToRouter(msgID, msg, length) == ERROR)
+    // the router withdrew its table (it exited or restarted); route 
+    // through it and look for a new one now and then:
+    if (msgRtrLocalWork.shmTable != NULL && 
+        msgRtrLocalWork.shmTable->magic != MSGRTR_SHM_MAGIC)
+    {
+        shmTableDetach ();
+        statsDetach ();
+        msgRtrLocalWork.shmRetryTime = radTimeGetMSSinceEpoch ();
+    }
+    else if (msgRtrLocalWork.shmTable == NULL && msgRtrLocalWork.shmRetryTime != 0 &&
+             radTimeGetMSSinceEpoch () - msgRtrLocalWork.shmRetryTime >= MSGRTR_SHM_RETRY_INTERVAL)
+    {
+        shmTableAttach ();
+        statsDetach ();
+        statsAttach ();
+        msgRtrLocalWork.shmRetryTime = 
+            (msgRtrLocalWork.shmTable == NULL) ? radTimeGetMSSinceEpoch () : 0;
+    }
+
+    // deliver straight to local consumers when the table knows them all:
+    if (msgRtrLocalWork.shmTable != NULL)
+    {
+        found = shmTableLookup (msgID, &entry, pids);
+    }
+    if (found == TRUE &&
+        entry.localMask != 0 &&
+        (entry.flags & MSGRTR_SHM_ROUTER_CONFLATES) == 0)
+    {
+        for (i = 0; i < MSGRTR_MAX_CLIENTS; i ++)
+        {
+            if (pids[i] == 0)
+            {
+                continue;
+            }
+            if (shmSlotBehind (i))
+            {
+                // he is behind, stay in line after what the router holds:
+                pids[i] = 0;
+                routerSlots |= (1U << i);
+                continue;
+            }
+            if (shmSlotRefresh (i, pids[i]) == ERROR)
+            {
+                break;
+            }
+        }
+
+        if (i == MSGRTR_MAX_CLIENTS)
+        {
+            sent = sendDirect (msgID, msg, length, pids, &failed, &routerSlots);
+            if (routerSlots == 0 &&
+                (entry.flags & (MSGRTR_SHM_ROUTER_DELIVERS | MSGRTR_SHM_ROUTER_CACHES)) == 0)
+            {
+                // no one else to send it to
+                if (msgRtrLocalWork.stats != NULL)
+                {
+                    msgrtrStatsRecord (msgRtrLocalWork.stats, msgID, length, 
+                                       sent, failed);
+                }
+                radthreadUnlock();
+                return OK;
+            }
+
+            // the router only needs to deliver to the rest (and count it):
+            flags = MSGRTR_FLAG_LOCAL_DONE | MSGRTR_FLAG_DIRECT(sent, failed);
+        }
+        else
+        {
+            // the router delivers to all of them:
+            routerSlots = entry.localMask;
+        }
+        shmSlotHandoffs (routerSlots, 1);
+    }
+    else if (found == ERROR && msgRtrLocalWork.shmTable != NULL)
+    {
+        // the table is busy: the router delivers, and the next message 
+        // direct to any consumer must not overtake this one:
+        routerSlots = shmSlotsInUse ();
+        shmSlotHandoffs (routerSlots, 1);
+    }
+
+    if (sendRpcToRouter(msgID, msg, length, flags, routerSlots, NULL) == ERROR)
     {
+        shmSlotHandoffs (routerSlots, -1);
         radMsgLog(PRI_HIGH, "radMsgRouterMessageSend: sendToRouter failed!");
         radthreadUnlock();
         return ERROR;
@@ -476,6 +1647,154 @@ int radMsgRouterMessageSend (ULONG msgID, void *msg, ULONG length)
     return OK;
 }
 
+//  Send a request through the message router; 'replyHandler' gets the first
+//  reply or TIMEOUT
+int radMsgRouterRequest
+(
+    ULONG           msgID,
+    void            *request,
+    ULONG           length,
+    ULONG           timeoutMS,
+    void            (*replyHandler) (int status, ULONG msgID, void *reply, 
+                                     ULONG length, void *userData),
+    void            *userData
+)
+{
+    MSGRTR_PENDING_REQUEST  *pending, *next;
+    MSGRTR_REQUEST_ID       rpc;
+
+    if (msgRtrLocalWork.rtrQueueName[0] == 0 || msgRtrLocalWork.rpcHandlerId == 0)
+    {
+        // we have not successfully registered yet
+        return ERROR;
+    }
+
+    if (msgID == 0 || msgID == MSGRTR_INTERNAL_MSGID || replyHandler == NULL)
+    {
+        return ERROR;
+    }
+
+    if (msgRtrLocalWork.requestTimer == NULL)
+    {
+        msgRtrLocalWork.requestTimer = radTimerCreate (NULL, requestTimerHandler, NULL);
+        if (msgRtrLocalWork.requestTimer == NULL)
+        {
+            radMsgLog(PRI_HIGH, "radMsgRouterRequest: radTimerCreate failed!");
+            return ERROR;
+        }
+    }
+
+    pending = (MSGRTR_PENDING_REQUEST *)malloc (sizeof(*pending));
+    if (pending == NULL)
+    {
+        return ERROR;
+    }
+
+    radthreadLock();
+
+    if (++ msgRtrLocalWork.lastCorrelationID == 0)
+    {
+        msgRtrLocalWork.lastCorrelationID = 1;
+    }
+    pending->correlationID  = msgRtrLocalWork.lastCorrelationID;
+    pending->msgID          = msgID;
+    pending->deadline       = radTimeGetMSSinceEpoch () + timeoutMS;
+    pending->replyHandler   = replyHandler;
+    pending->userData       = userData;
+
+    // requests always go through the router, which knows where we are:
+    rpc.msgID               = msgID;
+    rpc.correlationID       = pending->correlationID;
+    rpc.replyRouterID       = 0;
+    rpc.replyPid            = getpid ();
+
+    if (sendRpcToRouter (msgID, request, length, MSGRTR_FLAG_REQUEST, 0, &rpc) == ERROR)
+    {
+        radMsgLog(PRI_HIGH, "radMsgRouterRequest: sendToRouter failed!");
+        radthreadUnlock();
+        free (pending);
+        return ERROR;
+    }
+
+    // keep the pending list in deadline order:
+    for (next = (MSGRTR_PENDING_REQUEST *)radListGetFirst (&msgRtrLocalWork.requestList);
+         next != NULL && next->deadline <= pending->deadline;
+         next = (MSGRTR_PENDING_REQUEST *)radListGetNext (&msgRtrLocalWork.requestList, 
+                                                          (NODE *)next))
+    {
+        ;
+    }
+
+    if (next == NULL)
+    {
+        radListAddToEnd (&msgRtrLocalWork.requestList, (NODE *)pending);
+    }
+    else
+    {
+        radListInsertBefore (&msgRtrLocalWork.requestList, (NODE *)next, (NODE *)pending);
+    }
+
+    if ((NODE *)pending == radListGetFirst (&msgRtrLocalWork.requestList))
+    {
+        requestTimerRestart ();
+    }
+
+    radthreadUnlock();
+    return OK;
+}
+
+//  Set the handler for requests to our registered msgIDs
+int radMsgRouterRequestHandlerSet
+(
+    void            (*requestHandler) (ULONG msgID, void *request, ULONG length,
+                                       MSGRTR_REQUEST_ID *requestID, void *userData),
+    void            *userData
+)
+{
+    if (msgRtrLocalWork.rpcHandlerId == 0)
+    {
+        // we have not successfully registered yet
+        return ERROR;
+    }
+
+    msgRtrLocalWork.requestHandler  = requestHandler;
+    msgRtrLocalWork.requestUserData = userData;
+    return OK;
+}
+
+//  Reply to a request - the router sends it back to the requester only
+int radMsgRouterReply
+(
+    MSGRTR_REQUEST_ID   *requestID,
+    void                *reply,
+    ULONG               length
+)
+{
+    if (msgRtrLocalWork.rtrQueueName[0] == 0)
+    {
+        // we have not successfully registered yet
+        return ERROR;
+    }
+
+    if (requestID == NULL || requestID->correlationID == 0 || requestID->replyPid == 0)
+    {
+        return ERROR;
+    }
+
+    radthreadLock();
+
+    if (sendRpcToRouter (requestID->msgID, reply, length, MSGRTR_FLAG_REPLY, 0, requestID) 
+        == ERROR)
+    {
+        radMsgLog(PRI_HIGH, "radMsgRouterReply: sendToRouter failed!");
+        radthreadUnlock();
+        return ERROR;
+    }
+
+    radthreadUnlock();
+    return OK;
+}
+
 //  instruct the message router to dump statistics to the log file
 int radMsgRouterStatsDump (void)
 {
@@ -490,7 +1809,7 @@ int radMsgRouterStatsDump (void)
     // dump stats
     rtrMsg.subMsgID     = MSGRTR_SUBTYPE_DUMP_STATS;
 
-    if (sendToRouter(MSGRTR_INTERNAL_MSGID, &rtrMsg, sizeof(rtrMsg)) == ERROR)
+    if (sendToRouter(MSGRTR_INTERNAL_MSGID, &rtrMsg, sizeof(rtrMsg), 0) == ERROR)
     {
         radMsgLog(PRI_HIGH, "radMsgRouterStatsDump: sendToRouter failed!");
         return ERROR;
@@ -499,3 +1818,97 @@ int radMsgRouterStatsDump (void)
     return OK;
 }
 
+
+//  print the router's live traffic statistics from its shared stats block
+//  - returns OK or ERROR if radmrouted is not publishing statistics
+int radMsgRouterStatsPrint (FILE *out)
+{
+    SHMEM_ID                id;
+    MSGRTR_STATS_BLOCK      *stats;
+    MSGRTR_STATS_MSGID      *row;
+    MSGRTR_STATS_CONSUMER   consumers[MSGRTR_STATS_MAX_CONSUMERS];
+    int                     numConsumers, i, j, tries;
+    UINT                    sequence;
+
+    if (! radShmemIfExist (KEY_MSGRTR_STATS_SHMEM))
+    {
+        return ERROR;
+    }
+
+    id = radShmemInit (KEY_MSGRTR_STATS_SHMEM, 
+                       SEM_INDEX_MSGRTR_STATS, 
+                       sizeof(MSGRTR_STATS_BLOCK));
+    if (id == NULL)
+    {
+        return ERROR;
+    }
+
+    stats = (MSGRTR_STATS_BLOCK *)radShmemGet (id);
+    if (stats->magic != MSGRTR_STATS_MAGIC)
+    {
+        radShmemExit (id);
+        return ERROR;
+    }
+
+    fprintf (out, "Message router %d traffic, rates over the last %u secs:\n", 
+             stats->routerPid, stats->window);
+    fprintf (out, "     msgID          MSGS         BYTES    MSGS/s   BYTES/s     FAILS   FAN-OUT 0/1/2/3-4/5-8/9-16/17-32/33+\n");
+    for (i = 0; i < MSGRTR_STATS_MSGIDS; i ++)
+    {
+        row = &stats->msgIDs[i];
+        if (row->msgID == 0)
+        {
+            continue;
+        }
+
+        fprintf (out, "%10lu  %12lu  %12lu  %8u  %8u  %8lu   ",
+                 row->msgID, row->msgs, row->bytes, 
+                 row->msgRate, row->byteRate, row->failures);
+        for (j = 0; j < MSGRTR_STATS_FANOUT_BUCKETS; j ++)
+        {
+            fprintf (out, "%s%lu", (j > 0) ? "/" : "", row->fanOut[j]);
+        }
+        fprintf (out, "\n");
+    }
+    if (stats->unrecorded > 0)
+    {
+        fprintf (out, "(%lu msgs not recorded - no free msgID rows)\n", 
+                 stats->unrecorded);
+    }
+
+    // copy the consumer rows while the router is not rewriting them:
+    for (tries = 0; tries < MSGRTR_SHM_MAX_TRIES; tries ++)
+    {
+        sequence = stats->sequence;
+        __sync_synchronize ();
+        if (sequence & 1)
+        {
+            continue;
+        }
+        numConsumers = stats->numConsumers;
+        if (numConsumers > MSGRTR_STATS_MAX_CONSUMERS)
+        {
+            numConsumers = MSGRTR_STATS_MAX_CONSUMERS;
+        }
+        memcpy (consumers, stats->consumers, numConsumers * sizeof(consumers[0]));
+        __sync_synchronize ();
+        if (stats->sequence == sequence)
+        {
+            break;
+        }
+    }
+
+    fprintf (out, "\n    Consumer         PID          MSGS         BYTES    MSGS/s   BYTES/s     FAILS     DROPS       LAG\n");
+    for (i = 0; tries < MSGRTR_SHM_MAX_TRIES && i < numConsumers; i ++)
+    {
+        fprintf (out, "%-14s  %8d  %12lu  %12lu  %8u  %8u  %8lu  %8lu  %8d\n",
+                 consumers[i].name, consumers[i].pid, 
+                 consumers[i].msgs, consumers[i].bytes, 
+                 consumers[i].msgRate, consumers[i].byteRate,
+                 consumers[i].failures, consumers[i].drops, consumers[i].lag);
+    }
+
+    radShmemExit (id);
+    return OK;
+}
+
@@ -68,7 +68,8 @@ static PROCESS_DATA     procData;
 /*  ... static utilities
 */
 
-/*  ... allocate an IO block;
+/*  ... allocate an IO block, watching 'fd' for input or (if 'forWrite')
+    ... for output space;
     ... returns OK or ERROR
 */
 static int procAllocIOBlock
@@ -76,7 +77,8 @@ static int procAllocIOBlock
     int     fdIndex,
     int     fd,
     void    (*ioCallback) (int fd, void *user),
-    void    *userData
+    void    *userData,
+    int     forWrite
 )
 {
     if (fdIndex < PROC_FD_PIPE_READ || fdIndex > PROC_FD_USER_LAST)
@@ -86,6 +88,7 @@ static int procAllocIOBlock
 
     procData.ioIDs[fdIndex].ioCallback  = ioCallback;
     procData.ioIDs[fdIndex].userData    = userData;
+    procData.ioIDs[fdIndex].forWrite    = forWrite;
 
     procData.fds[fdIndex] = fd;
 
@@ -93,7 +96,14 @@ static int procAllocIOBlock
     {
         procData.fdMax = fd;
     }
-    FD_SET(fd, &procData.fdSet);
+    if (forWrite)
+    {
+        FD_SET(fd, &procData.writeFdSet);
+    }
+    else
+    {
+        FD_SET(fd, &procData.fdSet);
+    }
 
     return OK;
 }
@@ -104,7 +114,14 @@ static void procFreeIOBlock (int fdIndex)
 {
     int         i;
 
-    FD_CLR(procData.fds[fdIndex], &procData.fdSet);
+    if (procData.ioIDs[fdIndex].forWrite)
+    {
+        FD_CLR(procData.fds[fdIndex], &procData.writeFdSet);
+    }
+    else
+    {
+        FD_CLR(procData.fds[fdIndex], &procData.fdSet);
+    }
     if (procData.fdMax == procData.fds[fdIndex])
     {
         /*      ... reset the max fd
@@ -151,33 +168,20 @@ static void procPipeReadCB (int fd, void *userData)
     return;
 }
 
-static void procQueueReadCB (int fd, void *userData)
+/*  ... pass a received queue message to the events or the message queue
+    ... handlers, then release it
+*/
+static void procQueueDispatch
+(
+    char                *srcQName,
+    UINT                msgType,
+    void                *recvBfr,
+    UINT                length
+)
 {
-    char                srcQName[QUEUE_NAME_LENGTH+1];
-    UINT                msgType;
-    UINT                length;
-    void                *recvBfr;
-    int                 retVal;
     EVENTS_MSG          *evtMsg;
     PROC_MSGQ_HANDLER   *node;
 
-    if ((retVal = radQueueRecv (procData.myQueue,
-                                srcQName,
-                                &msgType,
-                                &recvBfr,
-                                &length))
-            == FALSE)
-    {
-        radMsgLog(PRI_STATUS, "procQueueReadCB: woke on queue - no msg there!");
-        return;
-    }
-    else if (retVal == ERROR)
-    {
-        radMsgLog(PRI_STATUS, "procQueueReadCB: queue is closed!");
-        procData.exitFlag = TRUE;
-        return;
-    }
-
     /*  ... is this an EVENT message (msgType == 0)?
     */
     if (msgType == 0)
@@ -230,6 +234,57 @@ static void procQueueReadCB (int fd, void *userData)
     return;
 }
 
+static void procQueueReadCB (int fd, void *userData)
+{
+    char                srcQName[QUEUE_NAME_LENGTH+1];
+    UINT                msgType;
+    UINT                length;
+    void                *recvBfr;
+    int                 retVal;
+
+    if ((retVal = radQueueRecv (procData.myQueue,
+                                srcQName,
+                                &msgType,
+                                &recvBfr,
+                                &length))
+            == FALSE)
+    {
+        radMsgLog(PRI_STATUS, "procQueueReadCB: woke on queue - no msg there!");
+        return;
+    }
+    else if (retVal == ERROR)
+    {
+        radMsgLog(PRI_STATUS, "procQueueReadCB: queue is closed!");
+        procData.exitFlag = TRUE;
+        return;
+    }
+
+    procQueueDispatch (srcQName, msgType, recvBfr, length);
+    return;
+}
+
+/*  ... dispatch the messages set aside by radProcessQueueDefer (not any
+    ... deferred while doing so, they wait for the next call)
+*/
+static void procDeferredDispatch (void)
+{
+    PROC_MSGQ_DEFERRED  *deferred;
+    int                 count;
+
+    count = radListGetNumberOfNodes (&procData.msgqDeferredList);
+    while (count-- > 0 && ! procData.exitFlag)
+    {
+        deferred = (PROC_MSGQ_DEFERRED *)radListRemoveFirst (&procData.msgqDeferredList);
+        procQueueDispatch (deferred->srcQueueName, 
+                           deferred->msgType,
+                           deferred->msg,
+                           deferred->length);
+        free (deferred);
+    }
+
+    return;
+}
+
 
 /*  ... initialize process management; called once during process init;
     ... automatically sets up the following utilities for a new process:
@@ -325,11 +380,13 @@ int radProcessInit
     procData.userData = userData;
 
     radListReset (&procData.msgqHandlerList);
+    radListReset (&procData.msgqDeferredList);
     procData.defaultMsgQID = radProcessQueuePrependHandler (messageHandler, userData);
 
     /*  ... init the file descriptor set
     */
     FD_ZERO(&procData.fdSet);
+    FD_ZERO(&procData.writeFdSet);
 
 
     /*  ... create the notification pipes
@@ -344,7 +401,8 @@ int radProcessInit
     if (procAllocIOBlock (PROC_FD_PIPE_READ,
                           procData.fds[PROC_FD_PIPE_READ],
                           procPipeReadCB,
-                          &procData)
+                          &procData,
+                          FALSE)
         == ERROR)
     {
         radMsgLog(PRI_CATASTROPHIC, "radProcessInit: procAllocIOBlock failed!\n");
@@ -371,7 +429,8 @@ int radProcessInit
     if (procAllocIOBlock (PROC_FD_MSG_QUEUE,
                           radQueueGetFD (procData.myQueue),
                           procQueueReadCB,
-                          &procData)
+                          &procData,
+                          FALSE)
         == ERROR)
     {
         radMsgLog(PRI_CATASTROPHIC, "radProcessInit: procAllocIOBlock failed!\n");
@@ -427,6 +486,18 @@ int radProcessInit
 
 void radProcessExit (void)
 {
+    PROC_MSGQ_DEFERRED  *deferred;
+
+    while ((deferred = (PROC_MSGQ_DEFERRED *)radListRemoveFirst (&procData.msgqDeferredList))
+           != NULL)
+    {
+        if (deferred->length > 0 && deferred->msg)
+        {
+            radBufferRls (deferred->msg);
+        }
+        free (deferred);
+    }
+
     radProcessQueueRemoveHandler (procData.defaultMsgQID);
     radTimerListDelete ();
     radEventsExit (procData.events);
@@ -459,7 +530,7 @@ int radProcessGetExitFlag (void)
 */
 int radProcessWait (int timeout)
 {
-    fd_set          readFds;
+    fd_set          readFds, writeFds;
     int             i, retVal;
     struct timeval  tv;
 
@@ -469,17 +540,26 @@ int radProcessWait (int timeout)
         return ERROR;
     }
 
+    /*  ... messages set aside while someone else read the queue go first
+    */
+    if (radListGetNumberOfNodes (&procData.msgqDeferredList) > 0)
+    {
+        procDeferredDispatch ();
+        return OK;
+    }
+
     readFds = procData.fdSet;
+    writeFds = procData.writeFdSet;
 
     if (timeout > 0)
     {
         tv.tv_sec   = timeout/1000;
         tv.tv_usec  = (timeout%1000) * 1000;
-        retVal = select (procData.fdMax+1, &readFds, NULL, NULL, &tv);
+        retVal = select (procData.fdMax+1, &readFds, &writeFds, NULL, &tv);
     }
     else
     {
-        retVal = select (procData.fdMax+1, &readFds, NULL, NULL, NULL);
+        retVal = select (procData.fdMax+1, &readFds, &writeFds, NULL, NULL);
     }
 
     if (retVal == -1)
@@ -517,7 +597,8 @@ int radProcessWait (int timeout)
         {
             continue;
         }
-        if (FD_ISSET(procData.fds[i], &readFds))
+        if (FD_ISSET(procData.fds[i], 
+                     (procData.ioIDs[i].forWrite ? &writeFds : &readFds)))
         {
             /* ... run the IO callback
             */
@@ -585,7 +666,7 @@ PROC_IO_ID radProcessIORegisterDescriptor
             continue;
         }
 
-        retVal = procAllocIOBlock (i, fd, ioCallback, userData);
+        retVal = procAllocIOBlock (i, fd, ioCallback, userData, FALSE);
         if (retVal != OK)
         {
             return ERROR;
@@ -599,6 +680,41 @@ PROC_IO_ID radProcessIORegisterDescriptor
     return ERROR;
 }
 
+/*  ... register your file descriptor for "radProcessWait" output space;
+    ... 'ioCallback' will be executed when 'fd' can be written without 
+    ... blocking (or has an error) until the descriptor is de-registered;
+    ... 'userData' will be passed to 'ioCallback';
+    ... returns PROC_IO_ID or ERROR
+*/
+PROC_IO_ID radProcessIORegisterWriteDescriptor
+(
+    int         fd,
+    void        (*ioCallback) (int fd, void *userData),
+    void        *userData
+)
+{
+    int         i;
+
+    for (i = PROC_FD_USER_FIRST; i <= PROC_FD_USER_LAST; i ++)
+    {
+        if (procData.fds[i] != -1)
+        {
+            continue;
+        }
+
+        if (procAllocIOBlock (i, fd, ioCallback, userData, TRUE) != OK)
+        {
+            return ERROR;
+        }
+        else
+        {
+            return i;
+        }
+    }
+
+    return ERROR;
+}
+
 /*  ... de-register your file descriptor for "radProcessWait" inclusion;
     ... returns OK or ERROR
 */
@@ -656,7 +772,7 @@ PROC_IO_ID radProcessIORegisterSTDIN
             continue;
         }
 
-        retVal = procAllocIOBlock (i, STDIN_FILENO, ioCallback, userData);
+        retVal = procAllocIOBlock (i, STDIN_FILENO, ioCallback, userData, FALSE);
         if (retVal != OK)
         {
             return ERROR;
@@ -925,10 +1041,23 @@ int radProcessQueueQuitGroup
     return (radQueueQuitGroup (procData.myQueue, groupNumber));
 }
 
+/*  ... set blocking or non-blocking writes to an attached queue;
+    ... returns OK or ERROR
+*/
+int radProcessQueueSetSendBlocking
+(
+    char        *destQueueName,
+    int         isBlocking
+)
+{
+    return (radQueueSetSendBlocking (procData.myQueue, destQueueName, isBlocking));
+}
+
 /*  ... write to a queue;
     ... assumes sysBuffer is a valid pointer to a system buffer;
     ... system buffer ownership is transfered to the receiving queue;
-    ... returns OK, ERROR, or ERROR_ABORT if the dest queue is gone;
+    ... returns OK, ERROR, ERROR_ABORT if the dest queue is gone or BUSY if
+    ... the dest is non-blocking and full;
     ... user should dettach from a dest on ERROR_ABORT!
 */
 int radProcessQueueSend
@@ -1006,6 +1135,37 @@ int radProcessQueueStopHandlerList
     procData.stopMsqQHandlerTraversal = TRUE;
 }
 
+/*  ... set aside a message read from the process queue outside of the
+    ... handlers so the next 'radProcessWait' dispatches it, ahead of anything
+    ... still in the queue; ownership of 'msg' passes to radProcessWait;
+    ... returns OK or ERROR (the caller keeps 'msg')
+*/
+int radProcessQueueDefer
+(
+    char            *srcQueueName,
+    UINT            msgType,
+    void            *msg,
+    UINT            length
+)
+{
+    PROC_MSGQ_DEFERRED  *deferred;
+
+    deferred = (PROC_MSGQ_DEFERRED *)malloc (sizeof (*deferred));
+    if (deferred == NULL)
+    {
+        return ERROR;
+    }
+
+    strncpy (deferred->srcQueueName, srcQueueName, QUEUE_NAME_LENGTH);
+    deferred->srcQueueName[QUEUE_NAME_LENGTH] = 0;
+    deferred->msgType   = msgType;
+    deferred->msg       = msg;
+    deferred->length    = length;
+
+    radListAddToEnd (&procData.msgqDeferredList, (NODE_PTR)deferred);
+    return OK;
+}
+
 /*  ... prepend an additional message queue handler to the existing list of 
     ... message handlers; this allows other utilities/objects/etc. to insert
     ... a message handler to process specific utility messages without the 
@@ -66,6 +66,7 @@ static int insertAscending
     void            *args,
     int             priority,
     pid_t           pid,
+    RAD_PLACEMENT   *placement,
     int             startNow
 )
 {
@@ -84,6 +85,11 @@ static int insertAscending
     newNode->entry      = entry;
     newNode->args       = args;
     newNode->pid        = pid;
+    if (placement != NULL)
+    {
+        newNode->placed     = TRUE;
+        newNode->placement  = *placement;
+    }
 
     /*  ... insert in ascending order
     */
@@ -219,7 +225,31 @@ int radPlistAdd
         return ERROR;
     }
 
-    return (insertAscending (plistId, entry, args, priority, 0, FALSE));
+    return (insertAscending (plistId, entry, args, priority, 0, NULL, FALSE));
+}
+
+
+/*  ... radPlistAddPlaced
+    ... as radPlistAdd, with the process started under <placement>;
+    ... returns - OK or ERROR
+*/
+int radPlistAddPlaced
+(
+    PROC_LIST_ID    plistId,
+    int             (*entry) (void *pargs),
+    void            *args,
+    int             priority,
+    RAD_PLACEMENT   *placement
+)
+{
+    if (priority < 1 || priority > 100)
+    {
+        radMsgLog(PRI_MEDIUM, "%s: process priority out of range!",
+                   plistId->pName);
+        return ERROR;
+    }
+
+    return (insertAscending (plistId, entry, args, priority, 0, placement, FALSE));
 }
 
 
@@ -257,7 +287,14 @@ int radPlistStart
     {
         /*      ... start the process ...
         */
-        node->pid = radStartProcess (node->entry, node->args);
+        node->pid = radStartProcessPlaced (node->entry, node->args,
+                                           (node->placed ? &node->placement : NULL));
+        if (node->pid == ERROR)
+        {
+            radMsgLog(PRI_HIGH, "%s: process start failed, continuing...",
+                       plistId->pName);
+            continue;
+        }
 
         /*      ... then wait for the process to signal he's ready
         */
@@ -382,7 +419,7 @@ int radPlistAddPid
     pid_t           pid
 )
 {
-    return (insertAscending (plistId, NULL, NULL, 101, pid, FALSE));
+    return (insertAscending (plistId, NULL, NULL, 101, pid, NULL, FALSE));
 }
 
 
@@ -437,7 +474,7 @@ int radPlistAddandStart
 {
     int             retVal;
 
-    retVal = insertAscending (plistId, entry, args, 101, 0, TRUE);
+    retVal = insertAscending (plistId, entry, args, 101, 0, NULL, TRUE);
 
     /*      ... then wait for the process to signal he's ready
     */
@@ -42,6 +42,11 @@
 
 /*  ... System include files
 */
+#include <stdlib.h>
+#include <ctype.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
 
 /*  ... Library include files
 */
@@ -59,6 +64,84 @@
 
 /*  ... static (local) memory declarations
 */
+#ifndef MPOL_BIND
+#define MPOL_DEFAULT    0               // from linux/mempolicy.h
+#define MPOL_BIND       2
+#endif
+
+#define ULONG_BITS      (sizeof(ULONG) * 8)
+
+/*  ... parse a list like "0-3,8" into bit mask 'mask' of 'maxBits' bits
+*/
+static int parseList (char *list, ULONG *mask, int maxBits)
+{
+    char            *next;
+    long            first, last, i;
+
+    while (*list != 0)
+    {
+        first = strtol (list, &next, 10);
+        if (next == list || first < 0 || first >= maxBits)
+        {
+            return ERROR;
+        }
+        last = first;
+        list = next;
+
+        if (*list == '-')
+        {
+            last = strtol (list + 1, &next, 10);
+            if (next == list + 1 || last < first || last >= maxBits)
+            {
+                return ERROR;
+            }
+            list = next;
+        }
+
+        for (i = first; i <= last; i ++)
+        {
+            mask[i / ULONG_BITS] |= 1UL << (i % ULONG_BITS);
+        }
+
+        while (isspace ((int)*list))
+        {
+            list ++;
+        }
+        if (*list == ',')
+        {
+            list ++;
+        }
+        else if (*list != 0)
+        {
+            return ERROR;
+        }
+    }
+
+    return OK;
+}
+
+
+/*  ... put back what radPlacementApply changed before a later step failed
+    ... (NULL: not changed), keeping the failing step's errno
+*/
+static void placementUndo (cpu_set_t *oldCpus, int *oldMode, ULONG *oldNodes)
+{
+    int             saveErrno = errno;
+
+    if (oldMode != NULL)
+    {
+        syscall (SYS_set_mempolicy, *oldMode,
+                 (*oldMode == MPOL_DEFAULT) ? NULL : oldNodes,
+                 (*oldMode == MPOL_DEFAULT) ? 0 : RAD_PLACEMENT_MAX_NODES + 1);
+    }
+    if (oldCpus != NULL)
+    {
+        sched_setaffinity (0, sizeof (*oldCpus), oldCpus);
+    }
+
+    errno = saveErrno;
+    return;
+}
 
 
 /* ... methods
@@ -66,12 +149,132 @@
 
 int radStartProcess (int (*entryPoint) (void * pargs), void *args)
 {
-    pid_t       newPid;
+    return radStartProcessPlaced (entryPoint, args, NULL);
+}
+
+int radPlacementInit
+(
+    RAD_PLACEMENT   *placement,
+    char            *cpuList,
+    int             fifoPriority,
+    char            *nodeList
+)
+{
+    memset (placement, 0, sizeof (*placement));
+
+    if (cpuList != NULL &&
+        parseList (cpuList, placement->cpus, RAD_PLACEMENT_MAX_CPUS) == ERROR)
+    {
+        return ERROR;
+    }
+    if (nodeList != NULL &&
+        parseList (nodeList, &placement->memoryNodes, RAD_PLACEMENT_MAX_NODES)
+        == ERROR)
+    {
+        return ERROR;
+    }
+    if (fifoPriority < 0 ||
+        (fifoPriority > 0 &&
+         (fifoPriority < sched_get_priority_min (SCHED_FIFO) ||
+          fifoPriority > sched_get_priority_max (SCHED_FIFO))))
+    {
+        return ERROR;
+    }
+
+    placement->fifoPriority = fifoPriority;
+    return OK;
+}
+
+int radPlacementApply (RAD_PLACEMENT *placement)
+{
+    cpu_set_t           cpus, oldCpus;
+    ULONG               oldNodes = 0;
+    struct sched_param  param;
+    int                 i, anyCPU = FALSE, oldMode = MPOL_DEFAULT;
+
+    CPU_ZERO (&cpus);
+    for (i = 0; i < RAD_PLACEMENT_MAX_CPUS; i ++)
+    {
+        if (placement->cpus[i / ULONG_BITS] & (1UL << (i % ULONG_BITS)))
+        {
+            CPU_SET (i, &cpus);
+            anyCPU = TRUE;
+        }
+    }
+
+    // note what is changed so a failure can put it back:
+    if (anyCPU && sched_getaffinity (0, sizeof (oldCpus), &oldCpus) == -1)
+    {
+        return ERROR;
+    }
+    if (placement->memoryNodes != 0 &&
+        syscall (SYS_get_mempolicy, &oldMode, &oldNodes,
+                 RAD_PLACEMENT_MAX_NODES + 1, NULL, 0)
+        == -1)
+    {
+        return ERROR;
+    }
+
+    if (anyCPU && sched_setaffinity (0, sizeof (cpus), &cpus) == -1)
+    {
+        return ERROR;
+    }
+
+    if (placement->memoryNodes != 0)
+    {
+        // the kernel reads one bit less than 'maxnode':
+        if (syscall (SYS_set_mempolicy, MPOL_BIND, &placement->memoryNodes,
+                     RAD_PLACEMENT_MAX_NODES + 1)
+            == -1)
+        {
+            placementUndo ((anyCPU ? &oldCpus : NULL), NULL, NULL);
+            return ERROR;
+        }
+    }
+
+    if (placement->fifoPriority > 0)
+    {
+        memset (&param, 0, sizeof (param));
+        param.sched_priority = placement->fifoPriority;
+        if (sched_setscheduler (0, SCHED_FIFO, &param) == -1)
+        {
+            placementUndo ((anyCPU ? &oldCpus : NULL),
+                           ((placement->memoryNodes != 0) ? &oldMode : NULL),
+                           &oldNodes);
+            return ERROR;
+        }
+    }
+
+    return OK;
+}
+
+int radStartProcessPlaced
+(
+    int             (*entryPoint) (void * pargs),
+    void            *args,
+    RAD_PLACEMENT   *placement
+)
+{
+    pid_t           newPid;
+    int             report[2], status = 0, retVal;
+
+    /*  ... the child reports its placement back, like radthreadCreatePlaced
+    */
+    if (placement != NULL && pipe (report) == -1)
+    {
+        radMsgLog(PRI_HIGH, "PID %d: placement pipe failed: %s", getpid (), strerror (errno));
+        return ERROR;
+    }
 
     newPid = fork ();
     if (newPid == -1)
     {
         radMsgLog(PRI_HIGH, "PID %d: fork failed: %s", getpid (), strerror (errno));
+        if (placement != NULL)
+        {
+            close (report[0]);
+            close (report[1]);
+        }
         return ERROR;
     }
 
@@ -79,6 +282,18 @@ int radStartProcess (int (*entryPoint) (void * pargs), void *args)
     {
         /*      ... we are the child
         */
+        if (placement != NULL)
+        {
+            close (report[0]);
+            status = (radPlacementApply (placement) == OK) ? 0 : errno;
+            retVal = write (report[1], &status, sizeof (status));
+            close (report[1]);
+            if (status != 0 || retVal != sizeof (status))
+            {
+                exit (1);
+            }
+        }
+
         if ((*entryPoint) (args) == ERROR)
         {
             exit (1);
@@ -92,6 +307,30 @@ int radStartProcess (int (*entryPoint) (void * pargs), void *args)
     {
         /*      ... parent
         */
+        if (placement != NULL)
+        {
+            close (report[1]);
+            while ((retVal = read (report[0], &status, sizeof (status))) == -1 &&
+                   errno == EINTR)
+            {
+                ;
+            }
+            close (report[0]);
+            if (retVal != sizeof (status))
+            {
+                status = ECHILD;
+            }
+
+            if (status != 0)
+            {
+                radMsgLog(PRI_MEDIUM, "PID %d: placement of child %d failed: %s",
+                          getpid (), newPid, strerror (status));
+                waitpid (newPid, NULL, 0);
+                errno = status;
+                return ERROR;
+            }
+        }
+
         return newPid;
     }
 }
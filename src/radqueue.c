@@ -61,8 +61,6 @@
 
 /*  ... global memory declarations
 */
-static int          sigPipeFlag;
-
 static T_QUEUE      queueWork;
 
 
@@ -72,11 +70,12 @@ static T_QUEUE      queueWork;
 /*  ... local utilities to administer the global queue database
 */
 
+/*  ... the write that raised SIGPIPE fails with EPIPE, so the writer
+    ... (whichever thread it is) sees it in its own errno
+*/
 static void sigPipeHandler (int sigNum)
 {
     signal (SIGPIPE, sigPipeHandler);
-
-    sigPipeFlag = TRUE;
     return;
 }
 
@@ -404,7 +403,9 @@ static void dummyChild (char *myName)
 {
     int         pipeFD, reflectFD;
     char        buffer[256];
-    int         bytesWritten, bytesRead, retVal;
+    QMSG_HDR    hdr;
+    UCHAR       *hPtr = (UCHAR *)&hdr;
+    int         bytesWritten, bytesRead, retVal, hdrBytes = 0;
 
     sprintf (buffer, "%sREF", myName);
 
@@ -422,12 +423,14 @@ static void dummyChild (char *myName)
 
     /*  ... sign up for the SIGPIPE signal (reader leaves writers hanging)
     */
-    sigPipeFlag = 0;
     signal (SIGPIPE, sigPipeHandler);
 
     for (;;)
     {
-        bytesRead = read (reflectFD, buffer, sizeof (buffer));
+        /*  ... reflect whole headers only, a split one would interleave with
+            ... the other writers to my pipe
+        */
+        bytesRead = read (reflectFD, hPtr + hdrBytes, sizeof (hdr) - hdrBytes);
         if (bytesRead == -1)
         {
             if (errno == EINTR)
@@ -446,17 +449,23 @@ static void dummyChild (char *myName)
             exit (0);
         }
 
+        hdrBytes += bytesRead;
+        if (hdrBytes < sizeof (hdr))
+        {
+            continue;
+        }
+        hdrBytes = 0;
+
         /* reflect data back to my master process
         */
         bytesWritten = 0;
-        while (bytesWritten < bytesRead)
+        while (bytesWritten < sizeof (hdr))
         {
             retVal = write (pipeFD,
-                            (void *)&buffer[bytesWritten],
-                            bytesRead - bytesWritten);
-            if (sigPipeFlag)
+                            (void *)(hPtr + bytesWritten),
+                            sizeof (hdr) - bytesWritten);
+            if (retVal == -1 && errno == EPIPE)
             {
-                sigPipeFlag = 0;
                 printf ("dummyChild: reader gone on fd %d", pipeFD);
                 close (pipeFD);
                 close (reflectFD);
@@ -744,6 +753,45 @@ int radQueueDettach
     return ERROR;
 }
 
+/*  ... set blocking or non-blocking writes to an attached queue;
+    ... returns OK or ERROR
+*/
+int radQueueSetSendBlocking
+(
+    T_QUEUE_ID  tqid,
+    char        *destQueueName,
+    int         isBlocking
+)
+{
+    int         destFD, flags;
+
+    if ((destFD = qSendListGetFD (tqid, destQueueName)) == -1)
+    {
+        return ERROR;
+    }
+
+    if ((flags = fcntl (destFD, F_GETFL, 0)) < 0)
+    {
+        return ERROR;
+    }
+
+    if (!isBlocking)
+    {
+        flags |= O_NONBLOCK;
+    }
+    else
+    {
+        flags &= ~O_NONBLOCK;
+    }
+
+    if (fcntl (destFD, F_SETFL, flags) < 0)
+    {
+        return ERROR;
+    }
+
+    return OK;
+}
+
 /*  ... add my queue to a group
     ... returns OK or ERROR
 */
@@ -870,7 +918,8 @@ int radQueueRecv
 /*  ... write to a queue
     ... assumes sysBuffer is a valid pointer to a system buffer
     ... system buffer ownership is transfered to the receiving queue
-    ... returns OK, ERROR, or ERROR_ABORT if the dest queue is gone
+    ... returns OK, ERROR, ERROR_ABORT if the dest queue is gone or BUSY if
+    ... the dest is non-blocking and full
     ... user should dettach from a dest on ERROR_ABORT!
 */
 int radQueueSend
@@ -908,12 +957,17 @@ int radQueueSend
     }
 
     retVal = write (destFD, (void *)&hdr, sizeof (hdr));
-    if (sigPipeFlag)
+    if (retVal == -1 && errno == EPIPE)
     {
-        sigPipeFlag = 0;
         radMsgLog(PRI_MEDIUM, "radQueueSend: reader gone on fd %d", destFD);
         return ERROR_ABORT;
     }
+    else if (retVal == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        /*  ... non-blocking dest is full, nothing was written
+        */
+        return BUSY;
+    }
     else if (retVal == -1)
     {
         radMsgLog(PRI_MEDIUM, "radQueueSend: write failed on fd %d: %s", destFD, strerror (errno));
@@ -210,10 +210,12 @@ RADSOCK_ID radSocketServerCreate (int port)
 
 RADSOCK_ID radSocketServerAcceptConnection (RADSOCK_ID id)
 {
-    socklen_t           adrsLen = sizeof (struct sockaddr_in);
+    socklen_t           adrsLen = sizeof (struct sockaddr_storage);
     int                 retVal;
     UINT                tempIP;
-    struct sockaddr_in  newAddr, newAddr1;
+    struct sockaddr_storage newStorage;
+    struct sockaddr_in  *newAddrPtr = (struct sockaddr_in *)&newStorage;
+    struct sockaddr_in  newAddr1;
     socklen_t           newLength;
     RADSOCK_ID          newId;
 
@@ -226,7 +228,7 @@ RADSOCK_ID radSocketServerAcceptConnection (RADSOCK_ID id)
     memset (newId, 0, sizeof (*newId));
 
     if ((newId->sockfd = accept (id->sockfd, 
-                                 (struct sockaddr *)&newAddr, 
+                                 (struct sockaddr *)&newStorage, 
                                  &adrsLen)) 
         == -1)
     {
@@ -235,6 +237,13 @@ RADSOCK_ID radSocketServerAcceptConnection (RADSOCK_ID id)
         return NULL;
     }
 
+    if (newStorage.ss_family == AF_UNIX)
+    {
+        // same host: the path we listen on, the far end is unnamed
+        strncpy (newId->host, id->host, RADSOCK_MAX_HOST_LENGTH);
+        strcpy (newId->remoteHost, "unix");
+        return newId;
+    }
 
     // Get local info:
     newLength = sizeof(newAddr1);
@@ -244,8 +253,8 @@ RADSOCK_ID radSocketServerAcceptConnection (RADSOCK_ID id)
     inet_ntop(AF_INET, &newAddr1.sin_addr, newId->host, INET_ADDRSTRLEN);
 
     // Get remote info:
-    newId->remotePort = (int)ntohs(newAddr.sin_port);
-    inet_ntop(AF_INET, &newAddr.sin_addr, newId->remoteHost, INET_ADDRSTRLEN);
+    newId->remotePort = (int)ntohs(newAddrPtr->sin_port);
+    inet_ntop(AF_INET, &newAddrPtr->sin_addr, newId->remoteHost, INET_ADDRSTRLEN);
 
 
     // turn off the transmit algorithm
@@ -495,6 +504,117 @@ RADSOCK_ID radSocketClientCreateAny (char *hostNameOrIP, int port)
 }
 
 
+/*	... Create a socket server to listen on the AF_UNIX socket "path";
+	... returns RADSOCK_ID or NULL if ERROR
+*/
+RADSOCK_ID radSocketServerCreateUnix (char *path)
+{
+    RADSOCK_ID          newId;
+    struct sockaddr_un  sadrs;
+
+    if (strlen (path) >= sizeof(sadrs.sun_path) || 
+        strlen (path) >= RADSOCK_MAX_HOST_LENGTH)
+    {
+        radMsgLog(PRI_HIGH, "radSocketServerCreateUnix: path %s too long", path);
+        return NULL;
+    }
+
+    // first get our new object
+    newId = (RADSOCK_ID) malloc (sizeof (*newId));
+    if (newId == NULL)
+    {
+        return NULL;
+    }
+    memset (newId, 0, sizeof (*newId));
+    strncpy (newId->host, path, RADSOCK_MAX_HOST_LENGTH - 1);
+
+    // create our listen socket
+    newId->sockfd = socket (PF_UNIX, SOCK_STREAM, 0);
+    if (newId->sockfd == -1)
+    {
+        free (newId);
+        return NULL;
+    }
+
+    // a socket file left by a previous instance would fail the bind:
+    unlink (path);
+
+    memset (&sadrs, 0, sizeof(sadrs));
+    sadrs.sun_family = AF_UNIX;
+    strcpy (sadrs.sun_path, path);
+
+    if (bind (newId->sockfd, (struct sockaddr *)&sadrs, sizeof (sadrs)) == -1)
+    {
+        radMsgLog(PRI_HIGH, "radSocketServerCreateUnix: bind %s failed: %s", 
+                  path, strerror(errno));
+        close (newId->sockfd);
+        free (newId);
+        return NULL;
+    }
+
+    // set the queue size of pending connections
+    if (listen (newId->sockfd, 10) == -1)
+    {
+        close (newId->sockfd);
+        unlink (path);
+        free (newId);
+        return NULL;
+    }
+
+    return newId;
+}
+
+
+/*	... Create a socket client that connects to the AF_UNIX socket "path";
+	... returns RADSOCK_ID or NULL if ERROR
+*/
+RADSOCK_ID radSocketClientCreateUnix (char *path)
+{
+    RADSOCK_ID          newId;
+    struct sockaddr_un  sadrs;
+
+    if (strlen (path) >= sizeof(sadrs.sun_path) || 
+        strlen (path) >= RADSOCK_MAX_HOST_LENGTH)
+    {
+        radMsgLog(PRI_HIGH, "radSocketClientCreateUnix: path %s too long", path);
+        return NULL;
+    }
+
+    // first get our new object
+    newId = (RADSOCK_ID) malloc (sizeof (*newId));
+    if (newId == NULL)
+    {
+        return NULL;
+    }
+    memset (newId, 0, sizeof (*newId));
+    strcpy (newId->host, "unix");
+    strncpy (newId->remoteHost, path, RADSOCK_MAX_HOST_LENGTH - 1);
+
+    // create our client socket
+    newId->sockfd = socket (PF_UNIX, SOCK_STREAM, 0);
+    if (newId->sockfd == -1)
+    {
+        radMsgLog(PRI_HIGH, "radSocketClientCreateUnix: socket failed: %s", strerror(errno));
+        free (newId);
+        return NULL;
+    }
+
+    memset (&sadrs, 0, sizeof(sadrs));
+    sadrs.sun_family = AF_UNIX;
+    strcpy (sadrs.sun_path, path);
+
+    // local connects complete (or fail) right away:
+    if (connect (newId->sockfd, (struct sockaddr *)&sadrs, sizeof(sadrs)) == -1)
+    {
+        close (newId->sockfd);
+        free (newId);
+        return NULL;
+    }
+
+    return newId;
+}
+
+
 /* ... Close connection and cleanup resources;
  ... returns OK or ERROR
 */
@@ -619,6 +739,59 @@ int radSocketWriteExact
     return bytesWritten;
 }
 
+int radSocketWriteVectorExact
+(
+    RADSOCK_ID      id,
+    struct iovec    *iov,
+    int             iovCount
+)
+{
+    int             retVal, bytesWritten = 0;
+
+    while (iovCount > 0)
+    {
+        // skip any buffers already written:
+        if (iov->iov_len == 0)
+        {
+            iov ++;
+            iovCount --;
+            continue;
+        }
+
+        retVal = writev (id->sockfd, iov, iovCount);
+
+        if (retVal <= 0)
+        {
+            /*  ... write error
+            */
+            return retVal;
+        }
+
+        bytesWritten += retVal;
+
+        // advance past what was written:
+        while (iovCount > 0 && retVal >= (int)iov->iov_len)
+        {
+            retVal -= iov->iov_len;
+            iov ++;
+            iovCount --;
+        }
+        if (iovCount > 0)
+        {
+            iov->iov_base = (UCHAR *)iov->iov_base + retVal;
+            iov->iov_len -= retVal;
+        }
+    }
+
+    if (id->debug)
+    {
+        radMsgLog(PRI_STATUS, ">>>>>>>>>>>>>>>> radSocketWriteVectorExact: %d bytes", 
+                  bytesWritten);
+    }
+
+    return bytesWritten;
+}
+
 int radSocketSetBlocking (RADSOCK_ID id, int isBlocking)
 {
     int             flags;
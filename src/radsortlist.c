@@ -56,6 +56,87 @@ static long slDefaultKey (void *data)
     return ((long)data);
 }
 
+/*  ... pick an express height for a new node: 0 (no index entry) with
+    ... probability 1 - 1/SORTLIST_BRANCH, 1 with 1/SORTLIST_BRANCH of the
+    ... rest and so on
+*/
+static int slRandomHeight (SORTLIST_ID id)
+{
+    ULONG       bits;
+    int         height = 0;
+
+    /*  ... xorshift, even 32 bits is plenty for SORTLIST_MAX_LEVEL draws
+    */
+    bits = id->seed;
+    bits ^= bits << 13;
+    bits ^= bits >> 7;
+    bits ^= bits << 17;
+    id->seed = bits;
+
+    while (height < SORTLIST_MAX_LEVEL && (bits % SORTLIST_BRANCH) == 0)
+    {
+        height ++;
+        bits /= SORTLIST_BRANCH;
+    }
+
+    return height;
+}
+
+/*  ... descend the express levels; for each level store in update[] the
+    ... last index entry whose key is < key (or <= key if 'orEqual'), NULL
+    ... if there is none; returns the list node to start the level 0 walk
+    ... from (NULL to start at the first node)
+*/
+static NODE_PTR slDescend
+(
+    SORTLIST_ID     id,
+    long            key,
+    int             orEqual,
+    SORTLIST_INDEX  **update
+)
+{
+    SORTLIST_INDEX  *entry = NULL, *next;
+    int             level;
+
+    for (level = id->levels - 1; level >= 0; level --)
+    {
+        for (next = (entry == NULL) ? id->head[level] : entry->next[level];
+             next != NULL && (next->key < key || (orEqual && next->key == key));
+             next = next->next[level])
+        {
+            entry = next;
+        }
+
+        if (update != NULL)
+        {
+            update[level] = entry;
+        }
+    }
+
+    return (entry == NULL) ? NULL : entry->node;
+}
+
+/*  ... walk level 0 from 'node' (NULL for the first) to the first node
+    ... whose key is >= key (> key if 'orEqual')
+*/
+static NODE_PTR slWalk (SORTLIST_ID id, NODE_PTR node, long key, int orEqual)
+{
+    long        nodeKey;
+
+    for (node = radListGetNext (&id->list, node);
+            node != NULL;
+            node = radListGetNext (&id->list, node))
+    {
+        nodeKey = (*id->keyFunc)(node);
+        if (nodeKey > key || (! orEqual && nodeKey == key))
+        {
+            break;
+        }
+    }
+
+    return node;
+}
+
 
 /*  ... define methods here
 */
@@ -72,6 +153,7 @@ SORTLIST_ID radSortListInit (long (*getKey)(void *data))
     memset (newId, 0, sizeof (*newId));
 
     radListReset (&newId->list);
+    newId->seed = (0x9E3779B9UL ^ (ULONG)newId) | 1;
 
     if (getKey == NULL)
     {
@@ -87,13 +169,20 @@ SORTLIST_ID radSortListInit (long (*getKey)(void *data))
 
 void radSortListExit (SORTLIST_ID id)
 {
-    NODE_PTR node;
+    NODE_PTR        node;
+    SORTLIST_INDEX  *entry, *next;
 
     if (id == NULL)
     {
         return;
     }
 
+    for (entry = id->head[0]; entry != NULL; entry = next)
+    {
+        next = entry->next[0];
+        free (entry);
+    }
+
     for (node = radListGetFirst (&id->list);
             node != NULL;
             node = radListGetFirst (&id->list))
@@ -108,55 +197,183 @@ void radSortListExit (SORTLIST_ID id)
 
 int radSortListInsert (SORTLIST_ID id, NODE_PTR newNode)
 {
-    NODE_PTR node;
+    SORTLIST_INDEX  *update[SORTLIST_MAX_LEVEL];
+    SORTLIST_INDEX  *entry = NULL;
+    NODE_PTR        node;
+    long            key = (*id->keyFunc)(newNode);
+    int             height, level;
 
-    for (node = radListGetFirst (&id->list);
-            node != NULL;
-            node = radListGetNext (&id->list, node))
+    height = slRandomHeight (id);
+    if (height > 0)
     {
-        if ((*id->keyFunc)(node) > (*id->keyFunc)(newNode))
+        entry = (SORTLIST_INDEX *) malloc (sizeof (*entry) +
+                                           (height - 1) * sizeof (entry->next[0]));
+        if (entry == NULL)
         {
-            radListInsertBefore (&id->list, node, newNode);
-            return OK;
+            return ERROR;
         }
+        entry->key  = key;
+        entry->node = newNode;
+    }
+
+    /*  ... new nodes go after any with an equal key
+    */
+    node = slDescend (id, key, TRUE, update);
+    node = slWalk (id, node, key, TRUE);
+    if (node != NULL)
+    {
+        radListInsertBefore (&id->list, node, newNode);
+    }
+    else
+    {
+        radListAddToEnd (&id->list, newNode);
+    }
+
+    for (level = 0; level < height; level ++)
+    {
+        if (level >= id->levels)
+        {
+            update[level] = NULL;
+        }
+
+        if (update[level] == NULL)
+        {
+            entry->next[level] = id->head[level];
+            id->head[level] = entry;
+        }
+        else
+        {
+            entry->next[level] = update[level]->next[level];
+            update[level]->next[level] = entry;
+        }
+    }
+    if (height > id->levels)
+    {
+        id->levels = height;
     }
 
-    radListAddToEnd (&id->list, newNode);
     return OK;
 }
 
 int radSortListRemove (SORTLIST_ID id, NODE_PTR fnode)
 {
-    NODE_PTR node;
+    SORTLIST_INDEX  *update[SORTLIST_MAX_LEVEL];
+    SORTLIST_INDEX  *entry, *prev, *found = NULL;
+    NODE_PTR        node;
+    long            key = (*id->keyFunc)(fnode);
+    int             level;
 
-    for (node = radListGetFirst (&id->list);
-            node != NULL;
+    /*  ... make sure it is on the list: look through the nodes with its key
+    */
+    node = slDescend (id, key, FALSE, update);
+    for (node = slWalk (id, node, key, FALSE);
+            node != NULL && node != fnode;
             node = radListGetNext (&id->list, node))
     {
-        if (node == fnode)
+        if ((*id->keyFunc)(node) != key)
+        {
+            return ERROR;
+        }
+    }
+    if (node == NULL)
+    {
+        return ERROR;
+    }
+
+    /*  ... unlink its index entry, if it has one, from each level it is on
+    */
+    for (level = 0; level < id->levels; level ++)
+    {
+        prev  = update[level];
+        entry = (prev == NULL) ? id->head[level] : prev->next[level];
+        while (entry != NULL && entry->key == key && entry->node != fnode)
         {
-            radListRemove (&id->list, node);
-            return OK;
+            prev  = entry;
+            entry = entry->next[level];
         }
+        if (entry == NULL || entry->node != fnode)
+        {
+            break;
+        }
+
+        if (prev == NULL)
+        {
+            id->head[level] = entry->next[level];
+        }
+        else
+        {
+            prev->next[level] = entry->next[level];
+        }
+        found = entry;
+    }
+    if (found != NULL)
+    {
+        free (found);
     }
 
-    return ERROR;
+    while (id->levels > 0 && id->head[id->levels - 1] == NULL)
+    {
+        id->levels --;
+    }
+
+    radListRemove (&id->list, fnode);
+    return OK;
 }
 
 NODE_PTR radSortListFind (SORTLIST_ID id, long key)
 {
     NODE_PTR node;
 
-    for (node = radListGetFirst (&id->list);
-            node != NULL;
+    node = radSortListLowerBound (id, key);
+    if (node != NULL && (*id->keyFunc)(node) == key)
+    {
+        return node;
+    }
+
+    return NULL;
+}
+
+NODE_PTR radSortListLowerBound (SORTLIST_ID id, long key)
+{
+    NODE_PTR node;
+
+    node = slDescend (id, key, FALSE, NULL);
+    return slWalk (id, node, key, FALSE);
+}
+
+NODE_PTR radSortListGetFirst (SORTLIST_ID id)
+{
+    return radListGetFirst (&id->list);
+}
+
+NODE_PTR radSortListGetNext (SORTLIST_ID id, NODE_PTR node)
+{
+    return radListGetNext (&id->list, node);
+}
+
+int radSortListExecRange
+(
+    SORTLIST_ID     id,
+    long            minKey,
+    long            maxKey,
+    int             (*execFunction) (NODE_PTR node, void *data),
+    void            *data
+)
+{
+    NODE_PTR        node;
+    int             count = 0;
+
+    for (node = radSortListLowerBound (id, minKey);
+            node != NULL && (*id->keyFunc)(node) <= maxKey;
             node = radListGetNext (&id->list, node))
     {
-        if ((*id->keyFunc)(node) == key)
+        count ++;
+        if (! (*execFunction) (node, data))
         {
-            return node;
+            break;
         }
     }
 
-    return NULL;
+    return count;
 }
 
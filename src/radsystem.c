@@ -72,6 +72,8 @@ UINT    KEY_MSGQ;
 UINT    KEY_SEMAPHORES;
 UINT    KEY_BUFFERS_SHMEM;
 UINT    KEY_CONFIG_SHMEM;
+UINT    KEY_MSGRTR_SHMEM;
+UINT    KEY_MSGRTR_STATS_SHMEM;
 
 
 /*  ... local utilities
@@ -237,6 +239,8 @@ int radSystemInitBuffers (UCHAR systemID, int *bufferCounts)
     KEY_SEMAPHORES      = systemWork.share->systems[systemID].keyBase + 0xF002;
     KEY_BUFFERS_SHMEM   = systemWork.share->systems[systemID].keyBase + 0xF003;
     KEY_CONFIG_SHMEM    = systemWork.share->systems[systemID].keyBase + 0xF004;
+    KEY_MSGRTR_SHMEM    = systemWork.share->systems[systemID].keyBase + 0xF005;
+    KEY_MSGRTR_STATS_SHMEM = systemWork.share->systems[systemID].keyBase + 0xF006;
 
 
     /*  ... are we the first here?
@@ -4,14 +4,15 @@
         radtextsearch.c
  
   PURPOSE:
-        Provide methods for the red-black tree based text matching utility.
+        Provide methods for the radix tree based text matching utility.
  
   REVISION HISTORY:
         Date            Engineer        Revision        Remarks
         1/7/2009        MST             0               Original
+        10/18/2026      radlib          1               Adaptive radix tree
  
   NOTES:
-        The inspiration for these algorithms was taken from Julienne Walker.
+        See radtextsearch.h for the structure of the tree.
  
   LICENSE:
         Copyright 2001-2009 Mark S. Teel. All rights reserved.
@@ -43,6 +44,7 @@
 // System header files:
 #include <stdlib.h>
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
 
 // Local header files:
@@ -51,341 +53,1050 @@
 #include <radtextsearch.h>
 
 
+#define PREFIX_KEPT(n)      (((n)->prefixLen < SEARCH_PREFIX_MAX) ? \
+                             (n)->prefixLen : SEARCH_PREFIX_MAX)
 
-static SEARCH_NODE* makeNode (const char* text, int ordinal)
+#define IS_LEAF(n)          ((n)->type == SEARCH_NODE_LEAF)
+
+
+static UINT leafSize (UINT length)
+{
+    return ((offsetof(SEARCH_LEAF, key) + length + 7) & ~7);
+}
+
+static SEARCH_LEAF* makeLeaf
+(
+    TEXT_SEARCH_ID  id,
+    const char*     text,
+    UINT            length,
+    int             ordinal
+)
+{
+    SEARCH_ARENA*   arena = id->arena;
+    SEARCH_LEAF*    leaf;
+    UINT            size = leafSize(length), chunk;
+
+    if (arena == NULL || arena->size - arena->used < size)
+    {
+        chunk = ((size > SEARCH_ARENA_SIZE) ? size : SEARCH_ARENA_SIZE);
+        arena = malloc(sizeof(SEARCH_ARENA) + chunk);
+        if (arena == NULL)
+        {
+            return NULL;
+        }
+        arena->size = chunk;
+        arena->used = 0;
+
+        if (size > SEARCH_ARENA_SIZE && id->arena != NULL)
+        {
+            // Keep filling the current chunk:
+            arena->next = id->arena->next;
+            id->arena->next = arena;
+        }
+        else
+        {
+            arena->next = id->arena;
+            id->arena = arena;
+        }
+    }
+
+    leaf = (SEARCH_LEAF*)(arena->data + arena->used);
+    arena->used     += size;
+    id->arenaBytes  += size;
+
+    leaf->type      = SEARCH_NODE_LEAF;
+    leaf->length    = length;
+    leaf->ordinal   = ordinal;
+    memcpy(leaf->key, text, length);
+    return leaf;
+}
+
+static int leafMatches (SEARCH_LEAF* leaf, const UCHAR* key, UINT length)
+{
+    return (leaf->length == length && memcmp(leaf->key, key, length) == 0);
+}
+
+static SEARCH_NODE* makeNode (int type)
 {
     SEARCH_NODE*    newNode;
+    size_t          size;
 
-    newNode = malloc(sizeof(SEARCH_NODE));
+    switch (type)
+    {
+        case SEARCH_NODE_4:
+            size = sizeof(SEARCH_NODE4);
+            break;
+        case SEARCH_NODE_16:
+            size = sizeof(SEARCH_NODE16);
+            break;
+        case SEARCH_NODE_48:
+            size = sizeof(SEARCH_NODE48);
+            break;
+        default:
+            size = sizeof(SEARCH_NODE256);
+            break;
+    }
+
+    newNode = calloc(1, size);
     if (newNode == NULL)
     {
         return NULL;
     }
 
-    memset(newNode, 0, sizeof(SEARCH_NODE));
-    newNode->red        = 1;
-    newNode->ordinal    = ordinal;
-    strncpy(newNode->text, text, SEARCH_TEXT_MAX);
+    newNode->type = type;
     return newNode;
 }
 
-static SEARCH_NODE* rotateSingle (SEARCH_NODE *root, int dir)
+static void copyHeader (SEARCH_NODE* to, SEARCH_NODE* from)
 {
-    SEARCH_NODE*    save = root->link[!dir];
-
-    root->link[!dir] = save->link[dir];
-    save->link[dir] = root;
-
-    root->red = 1;
-    save->red = 0;
-
-    return save;
+    to->count       = from->count;
+    to->prefixLen   = from->prefixLen;
+    memcpy(to->prefix, from->prefix, PREFIX_KEPT(from));
 }
 
-static SEARCH_NODE* rotateDouble (SEARCH_NODE *root, int dir)
+// Get the key and child arrays of a 4 or 16 child node:
+static void smallArrays (SEARCH_NODE* node, UCHAR** keys, SEARCH_NODE*** child)
 {
-    root->link[!dir] = rotateSingle(root->link[!dir], !dir);
-    return rotateSingle(root, dir);
+    if (node->type == SEARCH_NODE_4)
+    {
+        *keys   = ((SEARCH_NODE4*)node)->keys;
+        *child  = ((SEARCH_NODE4*)node)->child;
+    }
+    else
+    {
+        *keys   = ((SEARCH_NODE16*)node)->keys;
+        *child  = ((SEARCH_NODE16*)node)->child;
+    }
 }
 
-static int nodeIsRed (SEARCH_NODE* root)
+static SEARCH_NODE** findChild (SEARCH_NODE* node, UCHAR byte)
 {
-    return (root != NULL && root->red == 1);
+    UCHAR*          keys;
+    SEARCH_NODE**   child;
+    int             i;
+
+    switch (node->type)
+    {
+        case SEARCH_NODE_4:
+        case SEARCH_NODE_16:
+            smallArrays(node, &keys, &child);
+            for (i = 0; i < node->count && keys[i] <= byte; i ++)
+            {
+                if (keys[i] == byte)
+                {
+                    return &child[i];
+                }
+            }
+            return NULL;
+
+        case SEARCH_NODE_48:
+            i = ((SEARCH_NODE48*)node)->index[byte];
+            return ((i != 0) ? &((SEARCH_NODE48*)node)->child[i - 1] : NULL);
+
+        default:
+            child = &((SEARCH_NODE256*)node)->child[byte];
+            return ((*child != NULL) ? child : NULL);
+    }
 }
 
+// Step through the children of "node" in key order, "position" starting at 0:
+// Returns the next child reference or NULL when done:
+static SEARCH_NODE** nextChild (SEARCH_NODE* node, int* position)
+{
+    SEARCH_NODE48*  node48;
+    SEARCH_NODE256* node256;
+    UCHAR*          keys;
+    SEARCH_NODE**   child;
+    int             byte;
 
-// Public methods:
+    switch (node->type)
+    {
+        case SEARCH_NODE_4:
+        case SEARCH_NODE_16:
+            smallArrays(node, &keys, &child);
+            if (*position < node->count)
+            {
+                return &child[(*position) ++];
+            }
+            return NULL;
 
-TEXT_SEARCH_ID radtextsearchInit (void)
+        case SEARCH_NODE_48:
+            node48 = (SEARCH_NODE48*)node;
+            while (*position < 256)
+            {
+                byte = (*position) ++;
+                if (node48->index[byte] != 0)
+                {
+                    return &node48->child[node48->index[byte] - 1];
+                }
+            }
+            return NULL;
+
+        default:
+            node256 = (SEARCH_NODE256*)node;
+            while (*position < 256)
+            {
+                byte = (*position) ++;
+                if (node256->child[byte] != NULL)
+                {
+                    return &node256->child[byte];
+                }
+            }
+            return NULL;
+    }
+}
+
+static SEARCH_LEAF* minLeaf (SEARCH_NODE* node)
 {
-    TEXT_SEARCH_ID  newId;
+    int             position;
 
-    newId = malloc(sizeof(*newId));
-    if (newId == NULL)
+    while (! IS_LEAF(node))
     {
-        return NULL;
+        position = 0;
+        node = *nextChild(node, &position);
     }
 
-    newId->root = NULL;
-    return newId;
+    return (SEARCH_LEAF*)node;
 }
 
-
-void radtextsearchExit (TEXT_SEARCH_ID id)
+// Add "newChild" under "byte", growing "node" (referenced by "ref") if full:
+static int addChild
+(
+    SEARCH_NODE**   ref,
+    SEARCH_NODE*    node,
+    UCHAR           byte,
+    SEARCH_NODE*    newChild
+)
 {
-    // Empty the tree:
-    while (radtextsearchRemove(id, NULL) == OK)
-        ;
+    SEARCH_NODE*    newNode;
+    SEARCH_NODE48*  node48;
+    SEARCH_NODE256* node256;
+    UCHAR           *keys, *newKeys;
+    SEARCH_NODE     **child, **newChildren;
+    int             i, capacity;
 
-    // Delete ID:
-    free(id);
+    switch (node->type)
+    {
+        case SEARCH_NODE_4:
+        case SEARCH_NODE_16:
+            smallArrays(node, &keys, &child);
+            capacity = ((node->type == SEARCH_NODE_4) ? 4 : 16);
+            if (node->count < capacity)
+            {
+                for (i = 0; i < node->count && keys[i] < byte; i ++)
+                    ;
+                memmove(&keys[i + 1], &keys[i], node->count - i);
+                memmove(&child[i + 1], &child[i], (node->count - i) * sizeof(SEARCH_NODE*));
+                keys[i]     = byte;
+                child[i]    = newChild;
+                node->count ++;
+                return OK;
+            }
 
-    return;
-}
+            newNode = makeNode(node->type + 1);
+            if (newNode == NULL)
+            {
+                return ERROR;
+            }
+            copyHeader(newNode, node);
+            if (node->type == SEARCH_NODE_4)
+            {
+                smallArrays(newNode, &newKeys, &newChildren);
+                memcpy(newKeys, keys, node->count);
+                memcpy(newChildren, child, node->count * sizeof(SEARCH_NODE*));
+            }
+            else
+            {
+                node48 = (SEARCH_NODE48*)newNode;
+                for (i = 0; i < node->count; i ++)
+                {
+                    node48->index[keys[i]]  = i + 1;
+                    node48->child[i]        = child[i];
+                }
+            }
+            break;
 
+        case SEARCH_NODE_48:
+            node48 = (SEARCH_NODE48*)node;
+            if (node->count < 48)
+            {
+                // Slots are kept packed:
+                node48->child[node->count] = newChild;
+                node48->index[byte] = ++ node->count;
+                return OK;
+            }
 
-int radtextsearchInsert (TEXT_SEARCH_ID id, const char* text, int ordinal)
+            newNode = makeNode(SEARCH_NODE_256);
+            if (newNode == NULL)
+            {
+                return ERROR;
+            }
+            copyHeader(newNode, node);
+            node256 = (SEARCH_NODE256*)newNode;
+            for (i = 0; i < 256; i ++)
+            {
+                if (node48->index[i] != 0)
+                {
+                    node256->child[i] = node48->child[node48->index[i] - 1];
+                }
+            }
+            break;
+
+        default:
+            ((SEARCH_NODE256*)node)->child[byte] = newChild;
+            node->count ++;
+            return OK;
+    }
+
+    free(node);
+    *ref = newNode;
+    return addChild(ref, newNode, byte, newChild);
+}
+
+// Replace "node" (referenced by "ref") with its only child, merging the
+// skipped bytes into the child:
+static void collapseNode (SEARCH_NODE** ref, SEARCH_NODE* node)
 {
-    SEARCH_NODE     head = {0};         /* False tree root */
-    SEARCH_NODE     *parent, *gparent;  /* Grandparent & parent */
-    SEARCH_NODE     *t, *q;             /* Iterators */
-    int             dir = 0, last;
+    SEARCH_NODE4*   node4 = (SEARCH_NODE4*)node;
+    SEARCH_NODE*    only = node4->child[0];
+    UCHAR           prefix[SEARCH_PREFIX_MAX];
+    UINT            i, kept = 0;
 
-    if (id->root == NULL)
+    if (! IS_LEAF(only))
     {
-        // Empty tree:
-        id->root = makeNode(text, ordinal);
-        if (id->root == NULL)
+        for (i = 0; i < PREFIX_KEPT(node) && kept < SEARCH_PREFIX_MAX; i ++)
         {
-            return ERROR;
+            prefix[kept ++] = node->prefix[i];
         }
+        if (kept < SEARCH_PREFIX_MAX)
+        {
+            prefix[kept ++] = node4->keys[0];
+        }
+        for (i = 0; i < PREFIX_KEPT(only) && kept < SEARCH_PREFIX_MAX; i ++)
+        {
+            prefix[kept ++] = only->prefix[i];
+        }
+
+        only->prefixLen += node->prefixLen + 1;
+        memcpy(only->prefix, prefix, kept);
     }
-    else
-    {
-        // Set up pointers:
-        t = &head;
-        gparent = parent = NULL;
-        q = t->link[1] = id->root;
 
-        // Search down the tree:
-        for ( ; ; )
-        {
-            if (q == NULL)
+    free(node);
+    *ref = only;
+}
+
+// Remove the child under "byte", shrinking "node" (referenced by "ref") when
+// it gets sparse; shrinking is skipped if the smaller node cannot be allocated:
+static void removeChild (SEARCH_NODE** ref, SEARCH_NODE* node, UCHAR byte)
+{
+    SEARCH_NODE*    newNode;
+    SEARCH_NODE48*  node48;
+    SEARCH_NODE256* node256;
+    UCHAR           *keys, *newKeys;
+    SEARCH_NODE     **child, **newChildren;
+    int             i, slot, last;
+
+    switch (node->type)
+    {
+        case SEARCH_NODE_4:
+        case SEARCH_NODE_16:
+            smallArrays(node, &keys, &child);
+            for (i = 0; keys[i] != byte; i ++)
+                ;
+            memmove(&keys[i], &keys[i + 1], node->count - i - 1);
+            memmove(&child[i], &child[i + 1], (node->count - i - 1) * sizeof(SEARCH_NODE*));
+            node->count --;
+
+            if (node->type == SEARCH_NODE_4)
             {
-                // Insert new node at the bottom:
-                parent->link[dir] = q = makeNode(text, ordinal);
-                if (q == NULL)
+                if (node->count == 1)
                 {
-                    return ERROR;
+                    collapseNode(ref, node);
                 }
+                return;
             }
-            else if (nodeIsRed(q->link[0]) && nodeIsRed(q->link[1]))
+            if (node->count > 3 || (newNode = makeNode(SEARCH_NODE_4)) == NULL)
             {
-                // Color flip:
-                q->red = 1;
-                q->link[0]->red = 0;
-                q->link[1]->red = 0;
+                return;
             }
-
-            // Fix red violation:
-            if (nodeIsRed(q) && nodeIsRed(parent))
+            copyHeader(newNode, node);
+            smallArrays(newNode, &newKeys, &newChildren);
+            memcpy(newKeys, keys, node->count);
+            memcpy(newChildren, child, node->count * sizeof(SEARCH_NODE*));
+            break;
+
+        case SEARCH_NODE_48:
+            node48 = (SEARCH_NODE48*)node;
+            slot = node48->index[byte] - 1;
+            last = node->count - 1;
+            node48->index[byte] = 0;
+            if (slot != last)
             {
-                int dir2 = t->link[1] == gparent;
+                // Move the last slot into the hole:
+                node48->child[slot] = node48->child[last];
+                for (i = 0; node48->index[i] != last + 1; i ++)
+                    ;
+                node48->index[i] = slot + 1;
+            }
+            node48->child[last] = NULL;
+            node->count --;
 
-                if (q == parent->link[last])
-                    t->link[dir2] = rotateSingle(gparent, !last);
-                else
-                    t->link[dir2] = rotateDouble(gparent, !last);
+            if (node->count > 12 || (newNode = makeNode(SEARCH_NODE_16)) == NULL)
+            {
+                return;
             }
+            copyHeader(newNode, node);
+            smallArrays(newNode, &newKeys, &newChildren);
+            for (i = 0, slot = 0; i < 256; i ++)
+            {
+                if (node48->index[i] != 0)
+                {
+                    newKeys[slot]       = i;
+                    newChildren[slot ++]= node48->child[node48->index[i] - 1];
+                }
+            }
+            break;
+
+        default:
+            node256 = (SEARCH_NODE256*)node;
+            node256->child[byte] = NULL;
+            node->count --;
 
-            // Stop if found:
-            if (! strncmp(q->text, text, SEARCH_TEXT_MAX))
+            if (node->count > 37 || (newNode = makeNode(SEARCH_NODE_48)) == NULL)
             {
-                break;
+                return;
+            }
+            copyHeader(newNode, node);
+            node48 = (SEARCH_NODE48*)newNode;
+            for (i = 0, slot = 0; i < 256; i ++)
+            {
+                if (node256->child[i] != NULL)
+                {
+                    node48->child[slot]  = node256->child[i];
+                    node48->index[i]     = ++ slot;
+                }
             }
+            break;
+    }
 
-            last = dir;
-            dir = ((strncmp(text, q->text, SEARCH_TEXT_MAX) > 0) ? 1 : 0);
+    free(node);
+    *ref = newNode;
+}
 
-            // Update pointers:
-            if (gparent != NULL)
-                t = gparent;
-            gparent = parent, parent = q;
-            q = q->link[dir];
-        }
+// Returns the number of bytes of the prefix of "node" matching the key at
+// "depth":
+static UINT prefixMatch
+(
+    SEARCH_NODE*    node,
+    const UCHAR*    key,
+    UINT            length,
+    UINT            depth
+)
+{
+    SEARCH_LEAF*    leaf;
+    UINT            i;
 
-        // Update root:
-        id->root = head.link[1];
+    for (i = 0; i < PREFIX_KEPT(node); i ++)
+    {
+        if (depth + i >= length || node->prefix[i] != key[depth + i])
+        {
+            return i;
+        }
     }
 
-    // Make root black:
-    id->root->red = 0;
+    if (node->prefixLen > SEARCH_PREFIX_MAX)
+    {
+        // The rest of the prefix is in every key below:
+        leaf = minLeaf(node);
+        for (; i < node->prefixLen; i ++)
+        {
+            if (depth + i >= length || (UCHAR)leaf->key[depth + i] != key[depth + i])
+            {
+                return i;
+            }
+        }
+    }
 
-    return OK;
+    return i;
 }
 
-int radtextsearchRemove (TEXT_SEARCH_ID id, const char* text)
+static int insertAt
+(
+    TEXT_SEARCH_ID  id,
+    SEARCH_NODE**   ref,
+    const UCHAR*    key,
+    UINT            length,
+    UINT            depth,
+    int             ordinal
+)
 {
-    SEARCH_NODE     head = {0};                 /* False tree root */
-    SEARCH_NODE     *q, *parent, *gparent;
-    SEARCH_NODE     *found = NULL;
-    int             retVal, last, dir = 1;
+    SEARCH_NODE     *node = *ref, *newNode;
+    SEARCH_NODE**   child;
+    SEARCH_LEAF     *leaf, *oldLeaf;
+    UINT            i, matched;
+    UCHAR           branch;
 
-    if (id->root == NULL)
+    if (node == NULL)
     {
-        return ERROR;
+        leaf = makeLeaf(id, (const char*)key, length, ordinal);
+        if (leaf == NULL)
+        {
+            return ERROR;
+        }
+        *ref = (SEARCH_NODE*)leaf;
+        id->members ++;
+        return OK;
     }
 
-    // Set up pointers:
-    q = &head;
-    gparent = parent = NULL;
-    q->link[1] = id->root;
-
-    // Search and push a red down:
-    while (q->link[dir] != NULL)
+    if (IS_LEAF(node))
     {
-        last = dir;
-
-        gparent = parent, parent = q;
-        q = q->link[dir];
-
-        // Allow for NULL text specified:
-        if (text == NULL)
+        oldLeaf = (SEARCH_LEAF*)node;
+        if (leafMatches(oldLeaf, key, length))
         {
-            dir = 0;
+            // Already a member:
+            return OK;
+        }
 
-            // Just remove the first node we come to:
-            found = q;
+        // Branch where the keys differ (the NULs guarantee they do):
+        newNode = makeNode(SEARCH_NODE_4);
+        if (newNode == NULL)
+        {
+            return ERROR;
         }
-        else
+        leaf = makeLeaf(id, (const char*)key, length, ordinal);
+        if (leaf == NULL)
         {
-            retVal = strncmp(text, q->text, SEARCH_TEXT_MAX);
-            dir = ((retVal > 0) ? 1 : 0);
-
-            // Save found node:
-            if (retVal == 0)
-            {
-                found = q;
-            }
+            free(newNode);
+            return ERROR;
         }
 
-        // Push the red node down:
-        if (!nodeIsRed(q) && !nodeIsRed(q->link[dir]))
+        for (i = depth; (UCHAR)oldLeaf->key[i] == key[i]; i ++)
+            ;
+        newNode->prefixLen = i - depth;
+        memcpy(newNode->prefix, &key[depth], PREFIX_KEPT(newNode));
+        addChild(ref, newNode, oldLeaf->key[i], node);
+        addChild(ref, newNode, key[i], (SEARCH_NODE*)leaf);
+        *ref = newNode;
+        id->members ++;
+        return OK;
+    }
+
+    if (node->prefixLen > 0)
+    {
+        matched = prefixMatch(node, key, length, depth);
+        if (matched < node->prefixLen)
         {
-            if (nodeIsRed(q->link[!dir]))
+            // Split the prefix where the key leaves it:
+            newNode = makeNode(SEARCH_NODE_4);
+            if (newNode == NULL)
             {
-                parent = parent->link[last] = rotateSingle(q, dir);
+                return ERROR;
             }
-            else if (!nodeIsRed(q->link[!dir]))
+            leaf = makeLeaf(id, (const char*)key, length, ordinal);
+            if (leaf == NULL)
             {
-                SEARCH_NODE *s = parent->link[!last];
+                free(newNode);
+                return ERROR;
+            }
 
-                if (s != NULL)
-                {
-                    if (!nodeIsRed(s->link[!last]) && !nodeIsRed(s->link[last]))
-                    {
-                        // Color flip:
-                        parent->red = 0;
-                        s->red = 1;
-                        q->red = 1;
-                    }
-                    else
-                    {
-                        int dir2 = gparent->link[1] == parent;
-
-                        if (nodeIsRed(s->link[last]))
-                            gparent->link[dir2] = rotateDouble(parent, last);
-                        else if (nodeIsRed(s->link[!last]))
-                            gparent->link[dir2] = rotateSingle(parent, last);
-
-                        // Ensure correct coloring:
-                        q->red = gparent->link[dir2]->red = 1;
-                        gparent->link[dir2]->link[0]->red = 0;
-                        gparent->link[dir2]->link[1]->red = 0;
-                    }
-                }
+            newNode->prefixLen = matched;
+            memcpy(newNode->prefix, &key[depth], PREFIX_KEPT(newNode));
+
+            if (node->prefixLen <= SEARCH_PREFIX_MAX)
+            {
+                branch = node->prefix[matched];
+                node->prefixLen -= matched + 1;
+                memmove(node->prefix, &node->prefix[matched + 1], node->prefixLen);
+            }
+            else
+            {
+                oldLeaf = minLeaf(node);
+                branch = oldLeaf->key[depth + matched];
+                node->prefixLen -= matched + 1;
+                memcpy(node->prefix,
+                       &oldLeaf->key[depth + matched + 1],
+                       PREFIX_KEPT(node));
             }
+
+            addChild(ref, newNode, branch, node);
+            addChild(ref, newNode, key[depth + matched], (SEARCH_NODE*)leaf);
+            *ref = newNode;
+            id->members ++;
+            return OK;
         }
+
+        depth += node->prefixLen;
     }
 
-    // Replace and remove if found:
-    if (found != NULL)
+    child = findChild(node, key[depth]);
+    if (child != NULL)
     {
-        strncpy(found->text, q->text, SEARCH_TEXT_MAX);
-        found->ordinal = q->ordinal;
-        parent->link[parent->link[1] == q] = q->link[q->link[0] == NULL];
-        free(q);
+        return insertAt(id, child, key, length, depth + 1, ordinal);
     }
 
-    // Update root and make it black:
-    id->root = head.link[1];
-    if (id->root != NULL)
+    leaf = makeLeaf(id, (const char*)key, length, ordinal);
+    if (leaf == NULL)
+    {
+        return ERROR;
+    }
+    if (addChild(ref, node, key[depth], (SEARCH_NODE*)leaf) == ERROR)
     {
-        id->root->red = 0;
+        id->freeBytes += leafSize(length);
+        return ERROR;
     }
 
+    id->members ++;
     return OK;
 }
 
+// Move every leaf below "ref" into the current arena:
+static int moveLeaves (TEXT_SEARCH_ID id, SEARCH_NODE** ref)
+{
+    SEARCH_LEAF     *leaf, *newLeaf;
+    SEARCH_NODE**   child;
+    int             position = 0;
 
-int radtextsearchFind (TEXT_SEARCH_ID id, const char* text, int* ordinalStore)
+    if (IS_LEAF(*ref))
+    {
+        leaf = (SEARCH_LEAF*)*ref;
+        newLeaf = makeLeaf(id, leaf->key, leaf->length, leaf->ordinal);
+        if (newLeaf == NULL)
+        {
+            return ERROR;
+        }
+        *ref = (SEARCH_NODE*)newLeaf;
+        return OK;
+    }
+
+    while ((child = nextChild(*ref, &position)) != NULL)
+    {
+        if (moveLeaves(id, child) == ERROR)
+        {
+            return ERROR;
+        }
+    }
+
+    return OK;
+}
+
+static void freeArena (SEARCH_ARENA* arena)
 {
-    register SEARCH_NODE    *q;
-    int                     retVal, dir;
+    SEARCH_ARENA*   next;
 
-    if (id->root == NULL)
+    for (; arena != NULL; arena = next)
+    {
+        next = arena->next;
+        free(arena);
+    }
+}
+
+// Copy the members into fresh arena chunks, dropping removed ones:
+static void compactArena (TEXT_SEARCH_ID id)
+{
+    SEARCH_ARENA    *oldArena = id->arena, *last;
+    ULONG           oldBytes = id->arenaBytes, oldFree = id->freeBytes;
+
+    id->arena       = NULL;
+    id->arenaBytes  = 0;
+    id->freeBytes   = 0;
+
+    if (id->root == NULL || moveLeaves(id, &id->root) == OK)
+    {
+        freeArena(oldArena);
+        return;
+    }
+
+    // Out of memory part way: members now live in both, keep both:
+    if (id->arena == NULL)
+    {
+        id->arena = oldArena;
+    }
+    else
+    {
+        for (last = id->arena; last->next != NULL; last = last->next)
+            ;
+        last->next = oldArena;
+    }
+    id->freeBytes   = oldFree + id->arenaBytes;
+    id->arenaBytes += oldBytes;
+}
+
+static void releaseLeaf (TEXT_SEARCH_ID id, SEARCH_LEAF* leaf)
+{
+    id->members --;
+    id->freeBytes += leafSize(leaf->length);
+
+    if (id->freeBytes >= SEARCH_ARENA_SIZE && id->freeBytes > id->arenaBytes / 2)
+    {
+        compactArena(id);
+    }
+}
+
+static int removeAt
+(
+    TEXT_SEARCH_ID  id,
+    SEARCH_NODE**   ref,
+    const UCHAR*    key,
+    UINT            length,
+    UINT            depth
+)
+{
+    SEARCH_NODE     *node = *ref;
+    SEARCH_NODE**   child;
+    SEARCH_LEAF*    leaf;
+
+    if (node == NULL)
     {
         return ERROR;
     }
 
-    q = id->root;
+    if (IS_LEAF(node))
+    {
+        // Only the root is reached here:
+        if (! leafMatches((SEARCH_LEAF*)node, key, length))
+        {
+            return ERROR;
+        }
+        *ref = NULL;
+        releaseLeaf(id, (SEARCH_LEAF*)node);
+        return OK;
+    }
 
-    // Search:
-    while (q != NULL)
+    if (node->prefixLen > 0)
+    {
+        if (prefixMatch(node, key, length, depth) < node->prefixLen)
+        {
+            return ERROR;
+        }
+        depth += node->prefixLen;
+    }
+
+    child = findChild(node, key[depth]);
+    if (child == NULL)
     {
-        retVal = strncmp(text, q->text, SEARCH_TEXT_MAX);
-        dir = ((retVal > 0) ? 1 : 0);
+        return ERROR;
+    }
 
-        if (retVal == 0)
+    if (IS_LEAF(*child))
+    {
+        leaf = (SEARCH_LEAF*)*child;
+        if (! leafMatches(leaf, key, length))
         {
+            return ERROR;
+        }
+        removeChild(ref, node, key[depth]);
+        releaseLeaf(id, leaf);
+        return OK;
+    }
+
+    return removeAt(id, child, key, length, depth + 1);
+}
+
+static void freeNodes (SEARCH_NODE* node)
+{
+    SEARCH_NODE**   child;
+    int             position = 0;
+
+    if (node == NULL || IS_LEAF(node))
+    {
+        return;
+    }
+
+    while ((child = nextChild(node, &position)) != NULL)
+    {
+        freeNodes(*child);
+    }
+
+    free(node);
+}
+
+// Returns FALSE if "execFunction" stopped the walk:
+static int execNodes
+(
+    SEARCH_NODE*    node,
+    int             (*execFunction) (const char* text, int ordinal, void* data),
+    void*           data,
+    int*            count
+)
+{
+    SEARCH_LEAF*    leaf;
+    SEARCH_NODE**   child;
+    int             position = 0;
+
+    if (IS_LEAF(node))
+    {
+        leaf = (SEARCH_LEAF*)node;
+        (*count) ++;
+        return (*execFunction)(leaf->key, leaf->ordinal, data);
+    }
+
+    while ((child = nextChild(node, &position)) != NULL)
+    {
+        if (! execNodes(*child, execFunction, data, count))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+
+// Public methods:
+
+TEXT_SEARCH_ID radtextsearchInit (void)
+{
+    TEXT_SEARCH_ID  newId;
+
+    newId = malloc(sizeof(*newId));
+    if (newId == NULL)
+    {
+        return NULL;
+    }
+
+    memset(newId, 0, sizeof(*newId));
+    return newId;
+}
+
+
+void radtextsearchExit (TEXT_SEARCH_ID id)
+{
+    // Empty the tree:
+    freeNodes(id->root);
+    freeArena(id->arena);
+
+    // Delete ID:
+    free(id);
+
+    return;
+}
+
+
+int radtextsearchInsert (TEXT_SEARCH_ID id, const char* text, int ordinal)
+{
+    return insertAt(id, &id->root, (const UCHAR*)text, strlen(text) + 1, 0, ordinal);
+}
+
+
+int radtextsearchRemove (TEXT_SEARCH_ID id, const char* text)
+{
+    if (text == NULL)
+    {
+        if (id->root == NULL)
+        {
+            return ERROR;
+        }
+        text = minLeaf(id->root)->key;
+    }
+
+    return removeAt(id, &id->root, (const UCHAR*)text, strlen(text) + 1, 0);
+}
+
+
+int radtextsearchFind (TEXT_SEARCH_ID id, const char* text, int* ordinalStore)
+{
+    register SEARCH_NODE    *node = id->root;
+    SEARCH_NODE**           child;
+    const UCHAR*            key = (const UCHAR*)text;
+    UINT                    length = strlen(text) + 1, depth = 0, i;
+
+    // Search:
+    while (node != NULL)
+    {
+        if (IS_LEAF(node))
+        {
+            if (! leafMatches((SEARCH_LEAF*)node, key, length))
+            {
+                return ERROR;
+            }
+
             // Found it - return the ordinal:
-            *ordinalStore = q->ordinal;
+            *ordinalStore = ((SEARCH_LEAF*)node)->ordinal;
             return OK;
         }
 
-        q = q->link[dir];
+        // Check the prefix bytes kept in the node, the leaf compare covers
+        // the rest:
+        for (i = 0; i < PREFIX_KEPT(node); i ++)
+        {
+            if (depth + i >= length || node->prefix[i] != key[depth + i])
+            {
+                return ERROR;
+            }
+        }
+        depth += node->prefixLen;
+        if (depth >= length)
+        {
+            return ERROR;
+        }
+
+        child = findChild(node, key[depth ++]);
+        if (child == NULL)
+        {
+            return ERROR;
+        }
+        node = *child;
     }
 
     // If we are here, not found:
     return ERROR;
 }
 
+
+int radtextsearchPrefix
+(
+    TEXT_SEARCH_ID  id,
+    const char*     prefix,
+    int             (*execFunction) (const char* text, int ordinal, void* data),
+    void*           data
+)
+{
+    SEARCH_NODE     *node = id->root;
+    SEARCH_NODE**   child;
+    SEARCH_LEAF*    leaf;
+    const UCHAR*    key = (const UCHAR*)prefix;
+    UINT            length = strlen(prefix), depth = 0, i;
+    UCHAR           byte;
+    int             count = 0;
+
+    // Find the subtree holding the keys that begin with "prefix":
+    while (node != NULL && depth < length)
+    {
+        if (IS_LEAF(node))
+        {
+            leaf = (SEARCH_LEAF*)node;
+            if (leaf->length <= length || memcmp(leaf->key, key, length) != 0)
+            {
+                return 0;
+            }
+            break;
+        }
+
+        leaf = NULL;
+        for (i = 0; i < node->prefixLen && depth + i < length; i ++)
+        {
+            if (i < SEARCH_PREFIX_MAX)
+            {
+                byte = node->prefix[i];
+            }
+            else
+            {
+                if (leaf == NULL)
+                {
+                    leaf = minLeaf(node);
+                }
+                byte = leaf->key[depth + i];
+            }
+
+            if (byte != key[depth + i])
+            {
+                return 0;
+            }
+        }
+        depth += node->prefixLen;
+        if (depth >= length)
+        {
+            break;
+        }
+
+        child = findChild(node, key[depth ++]);
+        node = ((child != NULL) ? *child : NULL);
+    }
+
+    if (node != NULL)
+    {
+        execNodes(node, execFunction, data, &count);
+    }
+
+    return count;
+}
+
+
+int radtextsearchExecAll
+(
+    TEXT_SEARCH_ID  id,
+    int             (*execFunction) (const char* text, int ordinal, void* data),
+    void*           data
+)
+{
+    return radtextsearchPrefix(id, "", execFunction, data);
+}
+
+
+int radtextsearchCount (TEXT_SEARCH_ID id)
+{
+    return (int)id->members;
+}
+
+
 int radtextsearchDebug (SEARCH_NODE* root)
 {
-    int             lh, rh;
-    int             numNodes = 0;
-    SEARCH_NODE     *ln, *rn;
+    SEARCH_NODE**   child;
+    UCHAR*          keys;
+    SEARCH_NODE**   children;
+    int             i, position = 0, numChildren = 0, slots = 0;
 
-    if (root == NULL)
+    if (root == NULL || IS_LEAF(root))
         return 1;
-    else
+
+    /* Child count out of range for the node type */
+    if (root->count < 2 ||
+        (root->type == SEARCH_NODE_4 && root->count > 4) ||
+        (root->type == SEARCH_NODE_16 && root->count > 16) ||
+        (root->type == SEARCH_NODE_48 && root->count > 48) ||
+        root->type > SEARCH_NODE_256)
     {
-        ln = root->link[0];
-        rn = root->link[1];
+        radMsgLog(PRI_MEDIUM, "radtextsearchDebug: Node size violation!");
+        return 0;
+    }
 
-        /* Consecutive red links */
-        if (nodeIsRed(root))
+    /* Unsorted or duplicate key bytes */
+    if (root->type == SEARCH_NODE_4 || root->type == SEARCH_NODE_16)
+    {
+        smallArrays(root, &keys, &children);
+        for (i = 1; i < root->count; i ++)
         {
-            if (nodeIsRed(ln) || nodeIsRed(rn))
+            if (keys[i - 1] >= keys[i])
             {
-                radMsgLog(PRI_MEDIUM, "radtextsearchDebug: Red violation!");
+                radMsgLog(PRI_MEDIUM, "radtextsearchDebug: Key order violation!");
                 return 0;
             }
         }
-
-        lh = radtextsearchDebug(ln);
-        rh = radtextsearchDebug(rn);
-
-        /* Invalid binary search tree */
-        if ((ln != NULL && strncmp(ln->text, root->text, SEARCH_TEXT_MAX) >= 0) || 
-            (rn != NULL && strncmp(root->text, rn->text, SEARCH_TEXT_MAX) >= 0))
+    }
+    else if (root->type == SEARCH_NODE_48)
+    {
+        for (i = 0; i < 256; i ++)
         {
-            radMsgLog(PRI_MEDIUM, "radtextsearchDebug: Binary tree violation!");
+            if (((SEARCH_NODE48*)root)->index[i] > root->count)
+            {
+                radMsgLog(PRI_MEDIUM, "radtextsearchDebug: Index violation!");
+                return 0;
+            }
+            slots += (((SEARCH_NODE48*)root)->index[i] != 0);
+        }
+        if (slots != root->count)
+        {
+            radMsgLog(PRI_MEDIUM, "radtextsearchDebug: Index violation!");
             return 0;
         }
+    }
 
-        /* Black height mismatch */
-        if (lh != 0 && rh != 0 && lh != rh)
+    while ((child = nextChild(root, &position)) != NULL)
+    {
+        if (*child == NULL || ! radtextsearchDebug(*child))
         {
-            radMsgLog(PRI_MEDIUM, "radtextsearchDebug: Black violation!");
             return 0;
         }
+        numChildren ++;
+    }
 
-        /* Only count black links */
-        if (lh != 0 && rh != 0)
-            return ((nodeIsRed(root)) ? lh : lh + 1);
-        else
-            return 0;
+    /* Count does not match the children */
+    if (numChildren != root->count)
+    {
+        radMsgLog(PRI_MEDIUM, "radtextsearchDebug: Child count violation!");
+        return 0;
     }
+
+    return 1;
 }
 
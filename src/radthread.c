@@ -44,10 +44,16 @@
 */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
 
 /*  ... Local header files
 */
 #include <radsysdefs.h>
+#include <radprocess.h>
 #include "radthread.h"
 
 // Synchronization for all process threads:
@@ -58,29 +64,347 @@ pthread_mutex_t     threadMutex = PTHREAD_MUTEX_INITIALIZER;
 static void* ThreadStub(void* args)
 {
     RAD_THREAD_ARGS*    pArgs = (RAD_THREAD_ARGS*)args;
+    void                (*Entry)(RAD_THREAD_ID threadId, void* threadData);
+    RAD_THREAD_ID       id = pArgs->id;
+    void*               data = pArgs->data;
+    int                 status;
 
-    // Call the user entry point:
-    (*(pArgs->Entry))(pArgs->id, pArgs->data);
+    Entry = pArgs->Entry;
+    if (pArgs->placement == NULL)
+    {
+        // Delete the args so parent doesn't have to:
+        free(pArgs);
+    }
+    else
+    {
+        // Place ourself, the parent waits for the result and frees the args:
+        status = (radPlacementApply(pArgs->placement) == OK) ? 0 : errno;
+        pthread_mutex_lock(&pArgs->mutex);
+        pArgs->status = status;
+        pArgs->started = TRUE;
+        pthread_cond_signal(&pArgs->condition);
+        pthread_mutex_unlock(&pArgs->mutex);
+        if (status != 0)
+        {
+            return 0;
+        }
+    }
 
-    // Delete the args so parent doesn't have to:
-    free(pArgs);
+    // Call the user entry point:
+    (*Entry)(id, data);
 
     return 0;
 }
 
+// "notify" gives the channel an eventfd for consumers in radProcessWait:
+static int ChannelInit(RAD_THREAD_CHANNEL* channel, int notify)
+{
+    memset(channel, 0, sizeof(*channel));
+    channel->notifyFD = -1;
+    if (notify)
+    {
+        channel->notifyFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (channel->notifyFD == -1)
+        {
+            return ERROR;
+        }
+    }
 
-// API methods:
+    channel->head = (RAD_THREAD_RING*)malloc(sizeof(RAD_THREAD_RING));
+    if (channel->head == NULL)
+    {
+        if (channel->notifyFD != -1)
+        {
+            close(channel->notifyFD);
+        }
+        return ERROR;
+    }
+    memset(channel->head, 0, sizeof(RAD_THREAD_RING));
+    channel->tail = channel->head;
 
-// To create and start a thread:
-RAD_THREAD_ID radthreadCreate
+    pthread_mutex_init(&channel->mutex, NULL);
+    pthread_cond_init(&channel->condition, NULL);
+    return OK;
+}
+
+// Producer: queue a buffer, waking the consumer only if it sleeps:
+static int ChannelPush
 (
-    void    (*ThreadEntry)(RAD_THREAD_ID threadId, void* threadData), 
-    void*   threadData
+    RAD_THREAD_CHANNEL* channel, 
+    int                 type, 
+    void*               data, 
+    int                 length
+)
+{
+    RAD_THREAD_RING*    ring;
+    RAD_THREAD_SLOT*    slot;
+    uint64_t            one = 1;
+
+    if (channel->tailIndex == RADTHREAD_RING_SLOTS)
+    {
+        // Chain a new ring, reusing the one the consumer last drained:
+        ring = __sync_lock_test_and_set(&channel->spare, NULL);
+        if (ring == NULL)
+        {
+            ring = (RAD_THREAD_RING*)malloc(sizeof(RAD_THREAD_RING));
+            if (ring == NULL)
+            {
+                return ERROR;
+            }
+        }
+        memset(ring, 0, sizeof(RAD_THREAD_RING));
+        __sync_synchronize();
+        channel->tail->next = ring;
+        channel->tail = ring;
+        channel->tailIndex = 0;
+    }
+
+    // The data pointer is published last, it marks the slot full:
+    slot = &channel->tail->slot[channel->tailIndex++];
+    slot->type = type;
+    slot->length = length;
+    __sync_synchronize();
+    slot->data = data;
+
+    // Pairs with the consumer setting "waiting" before its last look:
+    __sync_synchronize();
+
+    // Only the first send after the consumer emptied the channel writes:
+    if (channel->notifyFD != -1 && 
+        ! __sync_lock_test_and_set(&channel->notified, TRUE))
+    {
+        if (write(channel->notifyFD, &one, sizeof(one)) != sizeof(one))
+        {
+            // only fails if the counter is saturated, it is readable anyway
+        }
+    }
+
+    if (channel->waiting)
+    {
+        pthread_mutex_lock(&channel->mutex);
+        pthread_cond_signal(&channel->condition);
+        pthread_mutex_unlock(&channel->mutex);
+    }
+
+    return OK;
+}
+
+// Consumer: dequeue the next buffer if there is one:
+// Returns: TRUE if a message was dequeued, else FALSE
+static int ChannelPop
+(
+    RAD_THREAD_CHANNEL* channel, 
+    int*                type, 
+    void**              data, 
+    int*                length
+)
+{
+    RAD_THREAD_RING*    ring;
+    RAD_THREAD_SLOT*    slot;
+
+    if (channel->headIndex == RADTHREAD_RING_SLOTS)
+    {
+        if (channel->head->next == NULL)
+        {
+            return FALSE;
+        }
+        __sync_synchronize();
+        ring = channel->head;
+        channel->head = ring->next;
+        channel->headIndex = 0;
+
+        // Hand the drained ring back to the producer:
+        __sync_synchronize();
+        ring = __sync_lock_test_and_set(&channel->spare, ring);
+        if (ring != NULL)
+        {
+            free(ring);
+        }
+    }
+
+    slot = &channel->head->slot[channel->headIndex];
+    if (slot->data == NULL)
+    {
+        return FALSE;
+    }
+    __sync_synchronize();
+
+    *type = slot->type;
+    *length = slot->length;
+    *data = slot->data;
+    channel->headIndex ++;
+    return TRUE;
+}
+
+// Consumer: dequeue, sleeping while the channel is empty if "blocking";
+// a set "*abortFlag" ends the wait:
+static int ChannelReceive
+(
+    RAD_THREAD_CHANNEL* channel, 
+    void**              data,
+    int*                length,
+    int                 blocking,
+    volatile int*       abortFlag
+)
+{
+    int                 type, found;
+    uint64_t            count;
+
+    for (;;)
+    {
+        if (ChannelPop(channel, &type, data, length))
+        {
+            return type;
+        }
+
+        if (channel->notifyFD != -1)
+        {
+            // Empty - reset the descriptor and re-arm the sender's write, 
+            // then look again for a send that found it still armed:
+            if (read(channel->notifyFD, &count, sizeof(count)) != sizeof(count))
+            {
+                // nothing was written since the last reset
+            }
+            channel->notified = FALSE;
+            __sync_synchronize();
+            if (ChannelPop(channel, &type, data, length))
+            {
+                return type;
+            }
+        }
+
+        if (! blocking || (abortFlag != NULL && *abortFlag))
+        {
+            return ERROR_ABORT;
+        }
+
+        // Announce the sleep then look again - a racing send either is seen
+        // here or sees "waiting" and signals us:
+        pthread_mutex_lock(&channel->mutex);
+        channel->waiting = TRUE;
+        __sync_synchronize();
+        found = ChannelPop(channel, &type, data, length);
+        if (! found && (abortFlag == NULL || ! *abortFlag))
+        {
+            pthread_cond_wait(&channel->condition, &channel->mutex);
+        }
+        channel->waiting = FALSE;
+        pthread_mutex_unlock(&channel->mutex);
+
+        if (found)
+        {
+            return type;
+        }
+    }
+}
+
+// Release anything still queued along with the channel rings:
+static void ChannelDestroy(RAD_THREAD_CHANNEL* channel)
+{
+    void*               data;
+    int                 type, length;
+
+    while (ChannelPop(channel, &type, &data, &length))
+    {
+        radBufferRls(data);
+    }
+
+    free(channel->head);
+    if (channel->spare != NULL)
+    {
+        free(channel->spare);
+    }
+    if (channel->notifyFD != -1)
+    {
+        close(channel->notifyFD);
+    }
+    pthread_cond_destroy(&channel->condition);
+    pthread_mutex_destroy(&channel->mutex);
+    return;
+}
+
+// Copy "data" into a radsysBuffer and queue it:
+static int ChannelSendCopy
+(
+    RAD_THREAD_CHANNEL* channel, 
+    int                 type, 
+    void*               data, 
+    int                 length
+)
+{
+    void*               buffer;
+
+    buffer = radBufferGet(length);
+    if (buffer == NULL)
+    {
+        return ERROR;
+    }
+    memcpy(buffer, data, length);
+
+    if (ChannelPush(channel, type, buffer, length) == ERROR)
+    {
+        radBufferRls(buffer);
+        return ERROR;
+    }
+
+    return OK;
+}
+
+// radProcessWait callback for a thread's notify descriptor:
+static void ParentIOCallback(int fd, void* userData)
+{
+    RAD_THREAD_ID       threadId = (RAD_THREAD_ID)userData;
+    void*               data;
+    int                 type, length, count;
+    uint64_t            value;
+
+    if (threadId->parentHandler == NULL)
+    {
+        // No handler - just wake radProcessWait; the data stays queued for
+        // radthreadReceiveFromThread, which re-arms the descriptor when it
+        // finds the channel empty:
+        if (read(fd, &value, sizeof(value)) != sizeof(value))
+        {
+            // already reset
+        }
+        return;
+    }
+
+    // Bound the batch so one busy thread can't starve the process, the 
+    // descriptor stays readable until the channel is drained:
+    for (count = 0; count < RADTHREAD_RING_SLOTS; count ++)
+    {
+        type = ChannelReceive(&threadId->ToParent, &data, &length, FALSE, NULL);
+        if (type == ERROR_ABORT)
+        {
+            break;
+        }
+
+        (*(threadId->parentHandler))(threadId, type, data, length, 
+                                     threadId->parentData);
+
+        // The handler may have stopped the dispatch:
+        if (threadId->parentHandler == NULL)
+        {
+            break;
+        }
+    }
+
+    return;
+}
+
+
+static RAD_THREAD_ID ThreadCreate
+(
+    void            (*ThreadEntry)(RAD_THREAD_ID threadId, void* threadData), 
+    void*           threadData,
+    RAD_PLACEMENT*  placement
 )
 {
     RAD_THREAD_ID   newId;
     pthread_attr_t  Attributes;
     RAD_THREAD_ARGS *args;
+    int             status;
 
     pthread_mutex_lock(&threadMutex);
 
@@ -100,37 +424,134 @@ RAD_THREAD_ID radthreadCreate
     }
 
     newId->exitFlag = FALSE;
-    radListReset(&newId->ToThreadQueue);
-    pthread_cond_init(&newId->ToThreadCondition, NULL);
-    pthread_mutex_init(&newId->ToThreadMutex, NULL);
-    radListReset(&newId->ToParentQueue);
-    pthread_cond_init(&newId->ToParentCondition, NULL);
-    pthread_mutex_init(&newId->ToParentMutex, NULL);
+    newId->parentHandler = NULL;
+    newId->parentData = NULL;
+    newId->parentIO = ERROR;
+    if (ChannelInit(&newId->ToThread, FALSE) == ERROR)
+    {
+        free(args);
+        free(newId);
+        pthread_mutex_unlock(&threadMutex);
+        return NULL;
+    }
+    if (ChannelInit(&newId->ToParent, TRUE) == ERROR)
+    {
+        ChannelDestroy(&newId->ToThread);
+        free(args);
+        free(newId);
+        pthread_mutex_unlock(&threadMutex);
+        return NULL;
+    }
 
-    args->Entry = ThreadEntry;
-    args->id    = newId;
-    args->data  = threadData;
+    args->Entry     = ThreadEntry;
+    args->id        = newId;
+    args->data      = threadData;
+    args->placement = placement;
+    if (placement != NULL)
+    {
+        pthread_mutex_init(&args->mutex, NULL);
+        pthread_cond_init(&args->condition, NULL);
+        args->started = FALSE;
+    }
 
     // Create the new thread:
     pthread_attr_init(&Attributes);
     pthread_attr_setdetachstate(&Attributes, PTHREAD_CREATE_JOINABLE);
-    pthread_create(&newId->thread, &Attributes, ThreadStub, args); 
-
+    status = pthread_create(&newId->thread, &Attributes, ThreadStub, args); 
+    pthread_attr_destroy(&Attributes);
     pthread_mutex_unlock(&threadMutex);
+
+    if (status == 0 && placement != NULL)
+    {
+        // Wait for him to place himself:
+        pthread_mutex_lock(&args->mutex);
+        while (! args->started)
+        {
+            pthread_cond_wait(&args->condition, &args->mutex);
+        }
+        pthread_mutex_unlock(&args->mutex);
+
+        status = args->status;
+        if (status != 0)
+        {
+            pthread_join(newId->thread, NULL);
+        }
+    }
+
+    if (placement != NULL)
+    {
+        pthread_cond_destroy(&args->condition);
+        pthread_mutex_destroy(&args->mutex);
+        free(args);
+    }
+
+    if (status != 0)
+    {
+        if (placement == NULL)
+        {
+            free(args);
+        }
+        ChannelDestroy(&newId->ToThread);
+        ChannelDestroy(&newId->ToParent);
+        free(newId);
+        errno = status;
+        return NULL;
+    }
+
+    // Have radProcessWait wake for data from him if this process uses it
+    // (not an error if it doesn't or all of its descriptors are taken):
+    newId->parentIO = radProcessIORegisterDescriptor(newId->ToParent.notifyFD,
+                                                     ParentIOCallback,
+                                                     newId);
     return newId;
 }
+
+
+// API methods:
+
+// To create and start a thread:
+RAD_THREAD_ID radthreadCreate
+(
+    void    (*ThreadEntry)(RAD_THREAD_ID threadId, void* threadData), 
+    void*   threadData
+)
+{
+    return ThreadCreate(ThreadEntry, threadData, NULL);
+}
+
+// To create and start a thread under a placement:
+RAD_THREAD_ID radthreadCreatePlaced
+(
+    void            (*ThreadEntry)(RAD_THREAD_ID threadId, void* threadData), 
+    void*           threadData,
+    RAD_PLACEMENT*  placement
+)
+{
+    if (placement == NULL)
+    {
+        return NULL;
+    }
+
+    return ThreadCreate(ThreadEntry, threadData, placement);
+}
         
 // To set exit flag and wait for thread to exit:
 void radthreadWaitExit(RAD_THREAD_ID threadId)
 {
-    pthread_mutex_lock(&threadMutex);
     threadId->exitFlag = TRUE;
-    pthread_cond_broadcast(&threadId->ToThreadCondition);
-    pthread_mutex_unlock(&threadMutex);
+    __sync_synchronize();
+
+    // Wake him if he is blocked in radthreadReceiveFromParent:
+    pthread_mutex_lock(&threadId->ToThread.mutex);
+    pthread_cond_broadcast(&threadId->ToThread.condition);
+    pthread_mutex_unlock(&threadId->ToThread.mutex);
 
     // Wait for him to exit:
     pthread_join(threadId->thread, NULL);
 
+    radthreadSetParentHandler(threadId, NULL, NULL);
+    ChannelDestroy(&threadId->ToThread);
+    ChannelDestroy(&threadId->ToParent);
     free(threadId);
 
     return;
@@ -139,13 +560,9 @@ void radthreadWaitExit(RAD_THREAD_ID threadId)
 // To test for exit command from parent:
 int radthreadShouldExit(RAD_THREAD_ID threadId)
 {
-    int     flag;
-
-    pthread_mutex_lock(&threadMutex);
-    flag = threadId->exitFlag;
-    pthread_mutex_unlock(&threadMutex);
-
-    return flag;
+    // The flag only goes from FALSE to TRUE, no lock is needed to read it:
+    __sync_synchronize();
+    return threadId->exitFlag;
 }
 
 // Parent: To send data to the thread:
@@ -157,23 +574,24 @@ int radthreadSendToThread
     int                 length
 )
 {
-    RAD_THREAD_NODE*    newNode;
+    return ChannelSendCopy(&threadId->ToThread, type, data, length);
+}
 
-    newNode = (RAD_THREAD_NODE*)radBufferGet(sizeof(*newNode) + length);
-    if (newNode == NULL)
+// Parent: To pass a radsysBuffer to the thread without copying it:
+int radthreadSendBufferToThread
+(
+    RAD_THREAD_ID       threadId, 
+    int                 type, 
+    void*               buffer, 
+    int                 length
+)
+{
+    if (buffer == NULL)
     {
         return ERROR;
     }
-    newNode->type = type;
-    newNode->length = length;
-    memcpy(newNode->data, data, length);
-
-    pthread_mutex_lock(&threadId->ToThreadMutex);
-    radListAddToEnd(&threadId->ToThreadQueue, (NODE_PTR)newNode); 
-    pthread_cond_broadcast(&threadId->ToThreadCondition);
-    pthread_mutex_unlock(&threadId->ToThreadMutex);
 
-    return OK;
+    return ChannelPush(&threadId->ToThread, type, buffer, length);
 }
 
 // Parent: To receive data from the thread:
@@ -185,42 +603,54 @@ int radthreadReceiveFromThread
     int                 blocking
 )
 {
-    RAD_THREAD_NODE*    newNode = NULL;
-    void*               pretData;
-    int                 retVal;
+    return ChannelReceive(&threadId->ToParent, data, length, blocking, NULL);
+}
 
-    pthread_mutex_lock(&threadId->ToParentMutex);
-    if (radListGetNumberOfNodes(&threadId->ToParentQueue) == 0)
+// Parent: To have radProcessWait dispatch data from the thread:
+int radthreadSetParentHandler
+(
+    RAD_THREAD_ID       threadId, 
+    void                (*handler)(RAD_THREAD_ID threadId, 
+                                   int type, 
+                                   void* data, 
+                                   int length, 
+                                   void* userData),
+    void*               userData
+)
+{
+    threadId->parentHandler = handler;
+    threadId->parentData = userData;
+    if (handler == NULL)
     {
-        if (blocking)
+        // Release the descriptor:
+        if (threadId->parentIO != ERROR)
         {
-            pthread_cond_wait(&threadId->ToParentCondition, 
-                              &threadId->ToParentMutex);
-        }
-        else
-        {
-            pthread_mutex_unlock(&threadId->ToParentMutex);
-            return ERROR_ABORT;
+            radProcessIODeRegisterDescriptor(threadId->parentIO);
+            threadId->parentIO = ERROR;
         }
+        return OK;
     }
 
-    newNode = (RAD_THREAD_NODE*)radListRemoveFirst(&threadId->ToParentQueue);
-    pthread_mutex_unlock(&threadId->ToParentMutex);
-
-    pretData = radBufferGet(newNode->length);
-    if (pretData == NULL)
+    if (threadId->parentIO == ERROR)
     {
-        radBufferRls(newNode);
-        return ERROR;
+        // Not registered at create time:
+        threadId->parentIO = radProcessIORegisterDescriptor(threadId->ToParent.notifyFD,
+                                                            ParentIOCallback,
+                                                            threadId);
+        if (threadId->parentIO == ERROR)
+        {
+            threadId->parentHandler = NULL;
+            return ERROR;
+        }
     }
 
-    memcpy(pretData, newNode->data, newNode->length);
-    retVal = newNode->type;
-    *length = newNode->length;
-    *data = pretData;
-    radBufferRls(newNode);
+    return OK;
+}
 
-    return(retVal);
+// Parent: To get the thread's notify descriptor:
+int radthreadGetNotifyFD(RAD_THREAD_ID threadId)
+{
+    return threadId->ToParent.notifyFD;
 }
 
 // Thread: To send data to the parent:
@@ -232,23 +662,24 @@ int radthreadSendToParent
     int                 length
 )
 {
-    RAD_THREAD_NODE*    newNode;
+    return ChannelSendCopy(&threadId->ToParent, type, data, length);
+}
 
-    newNode = (RAD_THREAD_NODE*)radBufferGet(sizeof(*newNode) + length);
-    if (newNode == NULL)
+// Thread: To pass a radsysBuffer to the parent without copying it:
+int radthreadSendBufferToParent
+(
+    RAD_THREAD_ID       threadId, 
+    int                 type, 
+    void*               buffer, 
+    int                 length
+)
+{
+    if (buffer == NULL)
     {
         return ERROR;
     }
-    newNode->type = type;
-    newNode->length = length;
-    memcpy(newNode->data, data, length);
 
-    pthread_mutex_lock(&threadId->ToParentMutex);
-    radListAddToEnd(&threadId->ToParentQueue, (NODE_PTR)newNode); 
-    pthread_cond_broadcast(&threadId->ToParentCondition);
-    pthread_mutex_unlock(&threadId->ToParentMutex);
-
-    return OK;
+    return ChannelPush(&threadId->ToParent, type, buffer, length);
 }
 
 // Thread: To receive data from the parent:
@@ -260,42 +691,8 @@ int radthreadReceiveFromParent
     int             blocking
 )
 {
-    RAD_THREAD_NODE*    newNode = NULL;
-    void*               pretData;
-    int                 retVal;
-
-    pthread_mutex_lock(&threadId->ToThreadMutex);
-    if (radListGetNumberOfNodes(&threadId->ToThreadQueue) == 0)
-    {
-        if (blocking)
-        {
-            pthread_cond_wait(&threadId->ToThreadCondition, 
-                              &threadId->ToThreadMutex);
-        }
-        else
-        {
-            pthread_mutex_unlock(&threadId->ToThreadMutex);
-            return ERROR_ABORT;
-        }
-    }
-
-    newNode = (RAD_THREAD_NODE*)radListRemoveFirst(&threadId->ToThreadQueue);
-    pthread_mutex_unlock(&threadId->ToThreadMutex);
-
-    pretData = radBufferGet(newNode->length);
-    if (pretData == NULL)
-    {
-        radBufferRls(newNode);
-        return ERROR;
-    }
-
-    memcpy(pretData, newNode->data, newNode->length);
-    retVal = newNode->type;
-    *length = newNode->length;
-    *data = pretData;
-    radBufferRls(newNode);
-
-    return(retVal);
+    return ChannelReceive(&threadId->ToThread, data, length, blocking, 
+                          &threadId->exitFlag);
 }
 
 // To lock the thread mutex:
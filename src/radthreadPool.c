@@ -0,0 +1,615 @@
+/*---------------------------------------------------------------------------
+ 
+  FILENAME:
+        radthreadPool.c
+ 
+  PURPOSE:
+        Provide a work-stealing thread pool for radlib processes.
+ 
+  REVISION HISTORY:
+        Date            Engineer        Revision        Remarks
+        10/18/2026      radlib          0               Original
+ 
+  NOTES:
+        See the header file.
+ 
+  LICENSE:
+        Copyright 2011 Mark S. Teel. All rights reserved.
+
+        Redistribution and use in source and binary forms, with or without 
+        modification, are permitted provided that the following conditions 
+        are met:
+
+        1. Redistributions of source code must retain the above copyright 
+           notice, this list of conditions and the following disclaimer.
+        2. Redistributions in binary form must reproduce the above copyright 
+           notice, this list of conditions and the following disclaimer in the 
+           documentation and/or other materials provided with the distribution.
+
+        THIS SOFTWARE IS PROVIDED BY Mark Teel ``AS IS'' AND ANY EXPRESS OR 
+        IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+        WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+        DISCLAIMED. IN NO EVENT SHALL MARK TEEL OR CONTRIBUTORS BE LIABLE FOR 
+        ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS 
+        OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) 
+        HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, 
+        STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING 
+        IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+        POSSIBILITY OF SUCH DAMAGE.
+  
+----------------------------------------------------------------------------*/
+
+/*  ... System header files
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+
+/*  ... Local header files
+*/
+#include <radsysdefs.h>
+#include <radprocess.h>
+#include "radthreadPool.h"
+
+// An index range for radthreadPoolParallelFor:
+typedef struct
+{
+    void                (*Body)(int index, void* data);
+    void*               data;
+    int                 first;
+    int                 last;
+} RAD_THREAD_RANGE;
+
+
+// Local methods:
+
+// Queue a task at the newest end of a worker deque:
+static int DequePush(RAD_THREAD_WORKER* worker, RAD_THREAD_TASK* task)
+{
+    RAD_THREAD_TASK**   tasks;
+    UINT                i, count;
+
+    pthread_mutex_lock(&worker->mutex);
+    count = worker->tail - worker->head;
+    if (count == (UINT)worker->size)
+    {
+        // Full - double it, keeping the order:
+        tasks = (RAD_THREAD_TASK**)malloc(2 * worker->size * sizeof(RAD_THREAD_TASK*));
+        if (tasks == NULL)
+        {
+            pthread_mutex_unlock(&worker->mutex);
+            return ERROR;
+        }
+        for (i = 0; i < count; i ++)
+        {
+            tasks[i] = worker->tasks[(worker->head + i) & (worker->size - 1)];
+        }
+        free(worker->tasks);
+        worker->tasks = tasks;
+        worker->size *= 2;
+        __atomic_store_n(&worker->head, 0, __ATOMIC_RELEASE);
+        __atomic_store_n(&worker->tail, count, __ATOMIC_RELEASE);
+    }
+
+    worker->tasks[worker->tail & (worker->size - 1)] = task;
+    __atomic_store_n(&worker->tail, worker->tail + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&worker->mutex);
+    return OK;
+}
+
+// Take the newest task (the owner) or the oldest (a thief):
+static RAD_THREAD_TASK* DequeTake(RAD_THREAD_WORKER* worker, int newest)
+{
+    RAD_THREAD_TASK*    task = NULL;
+
+    // Skip empty deques without the lock, a racing push keeps the pool's
+    // "queued" count up so it is found on the next pass:
+    if (__atomic_load_n(&worker->tail, __ATOMIC_ACQUIRE) == 
+        __atomic_load_n(&worker->head, __ATOMIC_ACQUIRE))
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&worker->mutex);
+    if (worker->tail != worker->head)
+    {
+        if (newest)
+        {
+            __atomic_store_n(&worker->tail, worker->tail - 1, __ATOMIC_RELEASE);
+            task = worker->tasks[worker->tail & (worker->size - 1)];
+        }
+        else
+        {
+            task = worker->tasks[worker->head & (worker->size - 1)];
+            __atomic_store_n(&worker->head, worker->head + 1, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&worker->mutex);
+
+    return task;
+}
+
+// Find a task for "self" (NULL if not a worker) - its own newest, else the
+// oldest of the next worker that has one:
+static RAD_THREAD_TASK* PoolFind(RAD_THREAD_POOL_ID pool, RAD_THREAD_WORKER* self)
+{
+    RAD_THREAD_TASK*    task = NULL;
+    int                 i, start = 0;
+
+    if (self != NULL)
+    {
+        task = DequeTake(self, TRUE);
+        start = self->index + 1;
+    }
+    for (i = 0; task == NULL && i < pool->numWorkers; i ++)
+    {
+        task = DequeTake(&pool->workers[(start + i) % pool->numWorkers], FALSE);
+    }
+
+    if (task != NULL)
+    {
+        __sync_fetch_and_sub(&pool->queued, 1);
+    }
+    return task;
+}
+
+// Count down "pending", waking those waiting on it when it reaches zero:
+static void PoolCountDown(RAD_THREAD_POOL_ID pool, volatile int* pending)
+{
+    if (__sync_sub_and_fetch(pending, 1) != 0)
+    {
+        return;
+    }
+
+    // Pairs with a waiter counting itself before its last look:
+    __sync_synchronize();
+    if (__atomic_load_n(&pool->waiters, __ATOMIC_ACQUIRE) > 0)
+    {
+        pthread_mutex_lock(&pool->mutex);
+        pthread_cond_broadcast(&pool->doneCondition);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+    return;
+}
+
+// Run a task and queue its completion for the parent:
+static void PoolRun(RAD_THREAD_POOL_ID pool, RAD_THREAD_TASK* task)
+{
+    RAD_THREAD_TASK*    old;
+    volatile int*       pending = task->pending;
+    uint64_t            one = 1;
+
+    (*(task->Task))(task->taskData);
+
+    if (task->Done == NULL)
+    {
+        free(task);
+    }
+    else
+    {
+        do
+        {
+            old = __atomic_load_n(&pool->completed, __ATOMIC_ACQUIRE);
+            task->next = old;
+        } while (! __sync_bool_compare_and_swap(&pool->completed, old, task));
+
+        // Only the first completion since the last dispatch writes:
+        if (old == NULL && 
+            write(pool->notifyFD, &one, sizeof(one)) != sizeof(one))
+        {
+            // only fails if the counter is saturated, it is readable anyway
+        }
+    }
+
+    PoolCountDown(pool, pending);
+    return;
+}
+
+// Run tasks until "*pending" reaches zero, sleeping when there are none;
+// any queued task may run here, on the caller's stack (the acquire load of
+// "*pending" orders the waiter after the tasks it waited for):
+static void PoolHelp(RAD_THREAD_POOL_ID pool, volatile int* pending)
+{
+    RAD_THREAD_WORKER*  self;
+    RAD_THREAD_TASK*    task;
+
+    self = (RAD_THREAD_WORKER*)pthread_getspecific(pool->workerKey);
+
+    while (__atomic_load_n(pending, __ATOMIC_ACQUIRE) > 0)
+    {
+        task = PoolFind(pool, self);
+        if (task != NULL)
+        {
+            PoolRun(pool, task);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->mutex);
+        __atomic_add_fetch(&pool->waiters, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(pending, __ATOMIC_ACQUIRE) > 0 && 
+            __atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0)
+        {
+            pthread_cond_wait(&pool->doneCondition, &pool->mutex);
+        }
+        __atomic_sub_fetch(&pool->waiters, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    return;
+}
+
+// Call completion callbacks in the order the tasks finished:
+static void PoolDispatch(RAD_THREAD_POOL_ID pool)
+{
+    RAD_THREAD_TASK     *task, *next, *ordered = NULL;
+    uint64_t            count;
+
+    // Reset the descriptor before taking the list, a later completion
+    // writes it again:
+    if (read(pool->notifyFD, &count, sizeof(count)) != sizeof(count))
+    {
+        // nothing was written since the last dispatch
+    }
+
+    task = __sync_lock_test_and_set(&pool->completed, NULL);
+    for (/* no init */; task != NULL; task = next)
+    {
+        next = task->next;
+        task->next = ordered;
+        ordered = task;
+    }
+
+    for (task = ordered; task != NULL; task = next)
+    {
+        next = task->next;
+        (*(task->Done))(task->taskData);
+        free(task);
+    }
+
+    return;
+}
+
+static void PoolIOCallback(int fd, void* userData)
+{
+    PoolDispatch((RAD_THREAD_POOL_ID)userData);
+    return;
+}
+
+// Allocate and queue a task, counting it in "pending":
+static int PoolQueue
+(
+    RAD_THREAD_POOL_ID  pool,
+    void                (*Task)(void* taskData),
+    void                (*Done)(void* taskData),
+    void*               taskData,
+    volatile int*       pending
+)
+{
+    RAD_THREAD_TASK*    task;
+    RAD_THREAD_WORKER*  worker;
+
+    task = (RAD_THREAD_TASK*)malloc(sizeof(RAD_THREAD_TASK));
+    if (task == NULL)
+    {
+        return ERROR;
+    }
+    task->next = NULL;
+    task->Task = Task;
+    task->Done = Done;
+    task->taskData = taskData;
+    task->pending = pending;
+
+    // Workers keep their own tasks, the parent's are spread round robin:
+    worker = (RAD_THREAD_WORKER*)pthread_getspecific(pool->workerKey);
+    if (worker == NULL)
+    {
+        worker = &pool->workers[__sync_fetch_and_add(&pool->nextWorker, 1) % 
+                                (UINT)pool->numWorkers];
+    }
+
+    __sync_fetch_and_add(pending, 1);
+    __sync_fetch_and_add(&pool->queued, 1);
+    if (DequePush(worker, task) == ERROR)
+    {
+        __sync_fetch_and_sub(&pool->queued, 1);
+        PoolCountDown(pool, pending);
+        free(task);
+        return ERROR;
+    }
+
+    // Pairs with a worker counting itself a sleeper before its last look
+    // (the fetch and add above is a full barrier):
+    if (__atomic_load_n(&pool->sleepers, __ATOMIC_ACQUIRE) > 0)
+    {
+        pthread_mutex_lock(&pool->mutex);
+        pthread_cond_signal(&pool->workCondition);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    return OK;
+}
+
+static void WorkerEntry(RAD_THREAD_ID threadId, void* threadData)
+{
+    RAD_THREAD_WORKER*  worker = (RAD_THREAD_WORKER*)threadData;
+    RAD_THREAD_POOL_ID  pool = worker->pool;
+    RAD_THREAD_TASK*    task;
+
+    pthread_setspecific(pool->workerKey, worker);
+
+    while (! __atomic_load_n(&pool->exiting, __ATOMIC_ACQUIRE))
+    {
+        task = PoolFind(pool, worker);
+        if (task != NULL)
+        {
+            PoolRun(pool, task);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->mutex);
+        __atomic_add_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0 && 
+               ! __atomic_load_n(&pool->exiting, __ATOMIC_ACQUIRE))
+        {
+            pthread_cond_wait(&pool->workCondition, &pool->mutex);
+        }
+        __atomic_sub_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    return;
+}
+
+static void RangeTask(void* taskData)
+{
+    RAD_THREAD_RANGE*   range = (RAD_THREAD_RANGE*)taskData;
+    int                 index;
+
+    for (index = range->first; index < range->last; index ++)
+    {
+        (*(range->Body))(index, range->data);
+    }
+
+    return;
+}
+
+// Stop any started workers and release a (possibly partly built) pool:
+static void PoolFree(RAD_THREAD_POOL_ID pool)
+{
+    int                 i;
+
+    __atomic_store_n(&pool->exiting, TRUE, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&pool->mutex);
+    pthread_cond_broadcast(&pool->workCondition);
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (pool->workers != NULL)
+    {
+        for (i = 0; i < pool->numWorkers; i ++)
+        {
+            if (pool->workers[i].thread != NULL)
+            {
+                radthreadWaitExit(pool->workers[i].thread);
+            }
+            if (pool->workers[i].tasks != NULL)
+            {
+                free(pool->workers[i].tasks);
+            }
+            pthread_mutex_destroy(&pool->workers[i].mutex);
+        }
+        free(pool->workers);
+    }
+
+    if (pool->notifyIO != ERROR)
+    {
+        radProcessIODeRegisterDescriptor(pool->notifyIO);
+    }
+    if (pool->notifyFD != -1)
+    {
+        close(pool->notifyFD);
+    }
+
+    pthread_key_delete(pool->workerKey);
+    pthread_cond_destroy(&pool->doneCondition);
+    pthread_cond_destroy(&pool->workCondition);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool);
+    return;
+}
+
+
+// API methods:
+
+// To create a pool and start its workers:
+RAD_THREAD_POOL_ID radthreadPoolCreate(int numWorkers)
+{
+    RAD_THREAD_POOL_ID  pool;
+    RAD_THREAD_WORKER*  worker;
+    int                 i;
+
+    if (numWorkers <= 0)
+    {
+        numWorkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if (numWorkers <= 0)
+        {
+            numWorkers = 1;
+        }
+    }
+
+    pool = (RAD_THREAD_POOL_ID)malloc(sizeof(*pool));
+    if (pool == NULL)
+    {
+        return NULL;
+    }
+    memset(pool, 0, sizeof(*pool));
+    pool->numWorkers = numWorkers;
+    pool->notifyIO = ERROR;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->workCondition, NULL);
+    pthread_cond_init(&pool->doneCondition, NULL);
+    if (pthread_key_create(&pool->workerKey, NULL) != 0)
+    {
+        pthread_cond_destroy(&pool->doneCondition);
+        pthread_cond_destroy(&pool->workCondition);
+        pthread_mutex_destroy(&pool->mutex);
+        free(pool);
+        return NULL;
+    }
+
+    pool->notifyFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    pool->workers = (RAD_THREAD_WORKER*)calloc(numWorkers, sizeof(RAD_THREAD_WORKER));
+    if (pool->notifyFD == -1 || pool->workers == NULL)
+    {
+        PoolFree(pool);
+        return NULL;
+    }
+
+    for (i = 0; i < numWorkers; i ++)
+    {
+        worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->index = i;
+        pthread_mutex_init(&worker->mutex, NULL);
+    }
+    for (i = 0; i < numWorkers; i ++)
+    {
+        worker = &pool->workers[i];
+        worker->size = RADTHREAD_POOL_DEQUE_SIZE;
+        worker->tasks = (RAD_THREAD_TASK**)malloc(worker->size * sizeof(RAD_THREAD_TASK*));
+        if (worker->tasks == NULL)
+        {
+            PoolFree(pool);
+            return NULL;
+        }
+    }
+
+    pool->notifyIO = radProcessIORegisterDescriptor(pool->notifyFD, 
+                                                    PoolIOCallback, 
+                                                    pool);
+    if (pool->notifyIO == ERROR)
+    {
+        PoolFree(pool);
+        return NULL;
+    }
+
+    for (i = 0; i < numWorkers; i ++)
+    {
+        pool->workers[i].thread = radthreadCreate(WorkerEntry, &pool->workers[i]);
+        if (pool->workers[i].thread == NULL)
+        {
+            PoolFree(pool);
+            return NULL;
+        }
+
+        // Workers send nothing to the parent, free their descriptor slots:
+        radthreadSetParentHandler(pool->workers[i].thread, NULL, NULL);
+    }
+
+    return pool;
+}
+
+// To wait for all submitted tasks and call their completion callbacks:
+void radthreadPoolWait(RAD_THREAD_POOL_ID pool)
+{
+    // Completion callbacks may submit more:
+    while (__atomic_load_n(&pool->outstanding, __ATOMIC_ACQUIRE) > 0 || 
+           __atomic_load_n(&pool->completed, __ATOMIC_ACQUIRE) != NULL)
+    {
+        PoolHelp(pool, &pool->outstanding);
+        PoolDispatch(pool);
+    }
+
+    return;
+}
+
+// To finish all tasks, stop the workers and free the pool:
+void radthreadPoolDestroy(RAD_THREAD_POOL_ID pool)
+{
+    radthreadPoolWait(pool);
+    PoolFree(pool);
+    return;
+}
+
+// To queue a task:
+int radthreadPoolSubmit
+(
+    RAD_THREAD_POOL_ID  pool,
+    void                (*Task)(void* taskData),
+    void                (*Done)(void* taskData),
+    void*               taskData
+)
+{
+    if (Task == NULL)
+    {
+        return ERROR;
+    }
+
+    return PoolQueue(pool, Task, Done, taskData, &pool->outstanding);
+}
+
+// To run a function over an index range in parallel:
+int radthreadPoolParallelFor
+(
+    RAD_THREAD_POOL_ID  pool,
+    int                 first,
+    int                 last,
+    int                 grain,
+    void                (*Body)(int index, void* data),
+    void*               data
+)
+{
+    RAD_THREAD_RANGE*   ranges;
+    volatile int        pending = 0;
+    int                 i, numRanges, count;
+
+    if (Body == NULL)
+    {
+        return ERROR;
+    }
+    if (last <= first)
+    {
+        return OK;
+    }
+
+    count = last - first;
+    if (grain <= 0)
+    {
+        grain = count / (pool->numWorkers * RADTHREAD_POOL_SPLIT);
+        if (grain < 1)
+        {
+            grain = 1;
+        }
+    }
+    numRanges = count / grain + ((count % grain) ? 1 : 0);
+
+    ranges = (RAD_THREAD_RANGE*)malloc(numRanges * sizeof(RAD_THREAD_RANGE));
+    if (ranges == NULL)
+    {
+        return ERROR;
+    }
+
+    for (i = 0; i < numRanges; i ++)
+    {
+        ranges[i].Body = Body;
+        ranges[i].data = data;
+        ranges[i].first = first;
+        ranges[i].last = (last - first > grain) ? first + grain : last;
+        first = ranges[i].last;
+
+        // The last range runs here, as does any the pool can't queue:
+        if (i == numRanges - 1 || 
+            PoolQueue(pool, RangeTask, NULL, &ranges[i], &pending) == ERROR)
+        {
+            RangeTask(&ranges[i]);
+        }
+    }
+
+    PoolHelp(pool, &pending);
+    free(ranges);
+    return OK;
+}
+
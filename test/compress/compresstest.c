@@ -0,0 +1,162 @@
+/*---------------------------------------------------------------------------
+ 
+  FILENAME:
+        compresstest.c
+ 
+  PURPOSE:
+        Check that radCompressLZ/radDecompressLZ round-trip and reject 
+        what they must.
+ 
+  REVISION HISTORY:
+        Date            Engineer        Revision        Remarks
+        10/19/2026      radlib          0               Original
+ 
+  NOTES:
+        Exits 0 if every check passes, 1 otherwise.
+ 
+----------------------------------------------------------------------------*/
+
+// System include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// radlib include files
+#include <radsysdefs.h>
+#include <radcompress.h>
+
+// Local include files
+#include "testcheck.h"
+
+
+#define TEST_MAX_BYTES          (64*1024)
+
+static UCHAR            inBfr[TEST_MAX_BYTES];
+static UCHAR            zBfr[TEST_MAX_BYTES + TEST_MAX_BYTES/32 + 16];
+static UCHAR            outBfr[TEST_MAX_BYTES];
+
+
+// compress and expand 'length' bytes of inBfr, returns the compressed 
+// length (0 if it did not compress) or ERROR if it did not come back intact:
+static int RoundTrip (int length)
+{
+    int         zLength, outLength;
+
+    zLength = radCompressLZ (inBfr, length, zBfr, sizeof(zBfr));
+    if (zLength == 0)
+    {
+        return 0;
+    }
+
+    outLength = radDecompressLZ (zBfr, zLength, outBfr, sizeof(outBfr));
+    if (outLength != length || memcmp (inBfr, outBfr, length) != 0)
+    {
+        return ERROR;
+    }
+
+    return zLength;
+}
+
+static void FillText (int length)
+{
+    static char *words[] = 
+        { "radlib ", "message ", "router ", "queue ", "buffer ", "0x59E723F3 " };
+    int         i = 0, w;
+
+    while (i < length)
+    {
+        w = rand () % 6;
+        strncpy ((char *)inBfr + i, words[w], length - i);
+        i += strlen (words[w]);
+    }
+}
+
+static void FillRandom (int length)
+{
+    int         i;
+
+    for (i = 0; i < length; i ++)
+    {
+        inBfr[i] = (UCHAR)rand ();
+    }
+}
+
+
+int main (int argc, char *argv[])
+{
+    int         i, zLength, outLength, bad;
+    char        what[128];
+
+    srand (1);
+
+    // sizes around the literal run and match limits:
+    for (i = 1; i <= 300; i ++)
+    {
+        FillText (i);
+        zLength = RoundTrip (i);
+        if (zLength == ERROR)
+        {
+            break;
+        }
+    }
+    Check (i > 300, "text of 1..300 bytes round-trips");
+
+    FillText (TEST_MAX_BYTES);
+    zLength = RoundTrip (TEST_MAX_BYTES);
+    sprintf (what, "64K of text round-trips and shrinks (%d bytes)", zLength);
+    Check (zLength > 0 && zLength < TEST_MAX_BYTES/2, what);
+
+    // runs longer than RADLZ_MAX_MATCH and overlapping copies:
+    memset (inBfr, 'A', TEST_MAX_BYTES);
+    zLength = RoundTrip (TEST_MAX_BYTES);
+    Check (zLength > 0 && zLength < TEST_MAX_BYTES/64, "a 64K run round-trips");
+
+    for (i = 0; i < TEST_MAX_BYTES; i ++)
+    {
+        inBfr[i] = (UCHAR)(i % 7);
+    }
+    Check (RoundTrip (TEST_MAX_BYTES) > 0, "a short repeating pattern round-trips");
+
+    // repeats further back than RADLZ_MAX_OFFSET:
+    FillRandom (RADLZ_MAX_OFFSET + 100);
+    memcpy (inBfr + RADLZ_MAX_OFFSET + 100, inBfr, RADLZ_MAX_OFFSET + 100);
+    Check (RoundTrip (2 * (RADLZ_MAX_OFFSET + 100)) > 0, 
+           "repeats beyond the match window round-trip");
+
+    // random data must either round-trip or decline:
+    FillRandom (TEST_MAX_BYTES);
+    zLength = RoundTrip (TEST_MAX_BYTES);
+    Check (zLength != ERROR, "random data round-trips (or is declined)");
+    Check (radCompressLZ (inBfr, 4096, zBfr, 4096) == 0, 
+           "random data does not fit in its own length");
+
+    Check (radCompressLZ (inBfr, 0, zBfr, sizeof(zBfr)) == 0, 
+           "empty input compresses to nothing");
+
+    // expanding into too small a buffer or from damaged input:
+    FillText (4096);
+    zLength = radCompressLZ (inBfr, 4096, zBfr, sizeof(zBfr));
+    Check (radDecompressLZ (zBfr, zLength, outBfr, 4095) == ERROR, 
+           "expanding past outSize is refused");
+
+    bad = 0;
+    for (i = 1; i < zLength; i ++)
+    {
+        // every truncation either fails or yields a prefix:
+        outLength = radDecompressLZ (zBfr, i, outBfr, sizeof(outBfr));
+        if (outLength != ERROR && 
+            (outLength > 4096 || memcmp (inBfr, outBfr, outLength) != 0))
+        {
+            bad ++;
+        }
+    }
+    Check (bad == 0, "truncated input fails or expands to a prefix");
+
+    zBfr[0] = 0xE0;         // a copy before any output
+    zBfr[1] = 0;
+    zBfr[2] = 0;
+    Check (radDecompressLZ (zBfr, 3, outBfr, sizeof(outBfr)) == ERROR, 
+           "a copy reaching before the output is refused");
+
+    return CheckSummary ();
+}
@@ -91,6 +91,19 @@ static void SendResponse(char* rqstid)
     radMsgRouterMessageSend(ROUTETEST_MSGID_USER_RESPONSE, &msg, sizeof(msg));
 }
 
+static void SelfTestReceive (UINT msgType, void *msg, UINT length)
+{
+    if (msgType >= ROUTETEST_MSGID_SELFTEST_BASE && 
+        msgType < ROUTETEST_MSGID_SELFTEST_BASE + ROUTETEST_SELFTEST_IDS)
+    {
+        routetestWork.rxCount[msgType - ROUTETEST_MSGID_SELFTEST_BASE] ++;
+    }
+    if (length == sizeof(int) && routetestWork.numValues < ROUTETEST_SELFTEST_VALUES)
+    {
+        routetestWork.rxValue[routetestWork.numValues ++] = *(int *)msg;
+    }
+}
+
 static void msgHandler
 (
     char        *srcQueueName,
@@ -100,6 +113,12 @@ static void msgHandler
     void        *userData
 )
 {
+    if (routetestWork.selfTest)
+    {
+        SelfTestReceive (msgType, msg, length);
+        return;
+    }
+
     switch(msgType)
     {
         case ROUTETEST_MSGID_USER_REQUEST:
@@ -148,6 +167,342 @@ static void timer1Handler (void *parm)
 }
 
 
+// self test helpers - the test sends to itself through radmrouted:
+static void SelfTestCheck (int passed, char *what)
+{
+    printf ("%s: %s\n", (passed ? "PASS" : "FAIL"), what);
+    if (! passed)
+    {
+        routetestWork.failures ++;
+    }
+}
+
+static void SelfTestReset (void)
+{
+    memset (routetestWork.rxCount, 0, sizeof(routetestWork.rxCount));
+    routetestWork.numValues = 0;
+}
+
+static void SelfTestSend (ULONG msgID, int value)
+{
+    radMsgRouterMessageSend (msgID, &value, sizeof(value));
+}
+
+// run radProcessWait until ROUTETEST_SELFTEST_WAIT msecs pass:
+static void SelfTestCollect (void)
+{
+    ULONGLONG       start = radTimeGetMSSinceEpoch ();
+
+    while (radTimeGetMSSinceEpoch () - start < ROUTETEST_SELFTEST_WAIT)
+    {
+        radProcessWait (ROUTETEST_SELFTEST_WAIT / 10);
+    }
+}
+
+static int SelfTestCount (ULONG msgID)
+{
+    return routetestWork.rxCount[msgID - ROUTETEST_MSGID_SELFTEST_BASE];
+}
+
+static void SelfTestAsyncDone (int status, void *userData)
+{
+    routetestWork.asyncDone ++;
+    routetestWork.asyncStatus = status;
+    if (userData != &routetestWork)
+    {
+        routetestWork.asyncStatus = ERROR;
+    }
+}
+
+// batched registration, synchronous and asynchronous:
+static void SelfTestRegisterMany (void)
+{
+    ULONG           ids[600];
+    int             i;
+
+    for (i = 0; i < 600; i ++)
+    {
+        ids[i] = ROUTETEST_MSGID_SELFTEST_MANY + i;
+    }
+
+    // this one comes back while RegisterMany waits for its ACK:
+    SelfTestReset ();
+    radMsgRouterMessageRegister (ROUTETEST_MSGID_SELFTEST_DURING);
+    SelfTestSend (ROUTETEST_MSGID_SELFTEST_DURING, 1);
+    SelfTestCheck (radMsgRouterMessageRegisterMany (ids, 600) == OK, 
+                   "radMsgRouterMessageRegisterMany is ACKed");
+    SelfTestCollect ();
+    SelfTestCheck (SelfTestCount (ROUTETEST_MSGID_SELFTEST_DURING) == 1,
+                   "a message received while waiting for the ACK is delivered");
+
+    SelfTestCheck (radMsgRouterMessageIsRegistered (ROUTETEST_MSGID_SELFTEST_MANY) &&
+                   radMsgRouterMessageIsRegistered (ROUTETEST_MSGID_SELFTEST_MANY + 599),
+                   "the whole batch is registered");
+
+    SelfTestReset ();
+    SelfTestSend (ROUTETEST_MSGID_SELFTEST_MANY, 1);
+    SelfTestSend (ROUTETEST_MSGID_SELFTEST_MANY + 299, 1);
+    SelfTestSend (ROUTETEST_MSGID_SELFTEST_MANY + 599, 1);
+    SelfTestSend (ROUTETEST_MSGID_SELFTEST_MANY + 600, 1);
+    SelfTestCollect ();
+    SelfTestCheck (SelfTestCount (ROUTETEST_MSGID_SELFTEST_MANY) == 1 &&
+                   SelfTestCount (ROUTETEST_MSGID_SELFTEST_MANY + 299) == 1 &&
+                   SelfTestCount (ROUTETEST_MSGID_SELFTEST_MANY + 599) == 1 &&
+                   SelfTestCount (ROUTETEST_MSGID_SELFTEST_MANY + 600) == 0,
+                   "batch msgIDs are delivered, others are not");
+
+    for (i = 0; i < 100; i ++)
+    {
+        ids[i] = ROUTETEST_MSGID_SELFTEST_ASYNC + i;
+    }
+    routetestWork.asyncDone = 0;
+    SelfTestCheck (radMsgRouterMessageRegisterManyAsync (ids, 100, SelfTestAsyncDone, 
+                                                         &routetestWork) 
+                   == OK,
+                   "radMsgRouterMessageRegisterManyAsync is sent");
+    SelfTestCollect ();
+    SelfTestCheck (routetestWork.asyncDone == 1 && routetestWork.asyncStatus == OK,
+                   "the async batch completes once from radProcessWait");
+
+    SelfTestReset ();
+    SelfTestSend (ROUTETEST_MSGID_SELFTEST_ASYNC + 50, 1);
+    SelfTestCollect ();
+    SelfTestCheck (SelfTestCount (ROUTETEST_MSGID_SELFTEST_ASYNC + 50) == 1,
+                   "async batch msgIDs are delivered");
+}
+
+// range and prefix registration, alone and overlapping exact msgIDs:
+static void SelfTestRanges (void)
+{
+    ULONG           first = ROUTETEST_MSGID_SELFTEST_RANGE;
+    ULONG           last = ROUTETEST_MSGID_SELFTEST_RANGE + 99;
+    ULONG           prefix = ROUTETEST_MSGID_SELFTEST_PREFIX;
+
+    SelfTestCheck (radMsgRouterMessageRegisterRange (first, last) == OK,
+                   "radMsgRouterMessageRegisterRange");
+    SelfTestCheck (radMsgRouterMessageRegisterRange (last, first) == ERROR,
+                   "a reversed range is refused");
+
+    SelfTestReset ();
+    SelfTestSend (first - 1, 1);
+    SelfTestSend (first, 1);
+    SelfTestSend (first + 50, 1);
+    SelfTestSend (last, 1);
+    SelfTestSend (last + 1, 1);
+    SelfTestCollect ();
+    SelfTestCheck (SelfTestCount (first - 1) == 0 && SelfTestCount (first) == 1 &&
+                   SelfTestCount (first + 50) == 1 && SelfTestCount (last) == 1 &&
+                   SelfTestCount (last + 1) == 0,
+                   "a range delivers first through last only");
+    SelfTestCheck (radMsgRouterMessageIsRegistered (first + 50) == TRUE &&
+                   radMsgRouterMessageIsRegistered (last + 1) == FALSE,
+                   "radMsgRouterMessageIsRegistered answers for ranges");
+
+    // one copy however many subscriptions match:
+    radMsgRouterMessageRegister (first + 50);
+    radMsgRouterMessageRegisterRange (first + 40, first + 60);
+    SelfTestCollect ();
+    SelfTestReset ();
+    SelfTestSend (first + 50, 1);
+    SelfTestSend (first + 45, 1);
+    SelfTestCollect ();
+    SelfTestCheck (SelfTestCount (first + 50) == 1 && SelfTestCount (first + 45) == 1,
+                   "overlapping subscriptions deliver one copy");
+
+    SelfTestCheck (radMsgRouterMessageRegisterPrefix (prefix | 0x12, 24) == OK,
+                   "radMsgRouterMessageRegisterPrefix");
+    SelfTestCollect ();
+    SelfTestReset ();
+    SelfTestSend (prefix - 1, 1);
+    SelfTestSend (prefix, 1);
+    SelfTestSend (prefix + 0x80, 1);
+    SelfTestSend (prefix + 0xFF, 1);
+    SelfTestSend (prefix + 0x100, 1);
+    SelfTestCollect ();
+    SelfTestCheck (SelfTestCount (prefix - 1) == 0 && SelfTestCount (prefix) == 1 &&
+                   SelfTestCount (prefix + 0x80) == 1 && SelfTestCount (prefix + 0xFF) == 1 &&
+                   SelfTestCount (prefix + 0x100) == 0,
+                   "a prefix delivers the msgIDs under it only");
+
+    // removing one subscription leaves the others:
+    SelfTestCheck (radMsgRouterMessageDeregisterRange (first, last) == OK &&
+                   radMsgRouterMessageDeregisterPrefix (prefix | 0x12, 24) == OK,
+                   "radMsgRouterMessageDeregisterRange/Prefix");
+    SelfTestCollect ();
+    SelfTestReset ();
+    SelfTestSend (first + 20, 1);
+    SelfTestSend (first + 45, 1);
+    SelfTestSend (first + 50, 1);
+    SelfTestSend (prefix + 0x80, 1);
+    SelfTestCollect ();
+    SelfTestCheck (SelfTestCount (first + 20) == 0 && SelfTestCount (first + 45) == 1 &&
+                   SelfTestCount (first + 50) == 1 && SelfTestCount (prefix + 0x80) == 0,
+                   "deregistering a range keeps overlapping subscriptions");
+}
+
+static int SelfTestValuesAre (int *values, int numValues)
+{
+    return (routetestWork.numValues == numValues &&
+            ! memcmp (routetestWork.rxValue, values, numValues * sizeof(int)));
+}
+
+// content filters - "value < 10 (signed), or value == 42":
+static void SelfTestFilters (void)
+{
+    MSGRTR_FILTER_TERM  terms[2];
+    int                 sent[5] = { -5, 3, 10, 42, 100 };
+    int                 passed[3] = { -5, 3, 42 };
+    int                 i;
+
+    memset (terms, 0, sizeof(terms));
+    terms[0].offset = 0;
+    terms[0].width  = sizeof(int);
+    terms[0].op     = MSGRTR_FILTER_LT;
+    terms[0].flags  = MSGRTR_FILTER_SIGNED;
+    terms[0].value  = 10;
+    terms[1].offset = 0;
+    terms[1].width  = sizeof(int);
+    terms[1].op     = MSGRTR_FILTER_EQ;
+    terms[1].flags  = MSGRTR_FILTER_OR;
+    terms[1].value  = 42;
+
+    SelfTestCheck (radMsgRouterMessageRegisterFilter (ROUTETEST_MSGID_SELFTEST_FILTER, 
+                                                      terms, 2) 
+                   == OK,
+                   "radMsgRouterMessageRegisterFilter");
+    SelfTestCollect ();
+    SelfTestCheck (radMsgRouterMessageIsRegistered (ROUTETEST_MSGID_SELFTEST_FILTER),
+                   "a filter registers its msgID");
+
+    SelfTestReset ();
+    for (i = 0; i < 5; i ++)
+    {
+        SelfTestSend (ROUTETEST_MSGID_SELFTEST_FILTER, sent[i]);
+    }
+    SelfTestCollect ();
+    SelfTestCheck (SelfTestValuesAre (passed, 3),
+                   "a filter passes matching messages only, in order");
+
+    // other msgIDs are not filtered:
+    SelfTestReset ();
+    SelfTestSend (ROUTETEST_MSGID_SELFTEST_DURING, 100);
+    SelfTestCollect ();
+    SelfTestCheck (SelfTestCount (ROUTETEST_MSGID_SELFTEST_DURING) == 1,
+                   "a filter applies to its own msgID only");
+
+    SelfTestCheck (radMsgRouterMessageRegisterFilter (ROUTETEST_MSGID_SELFTEST_FILTER, 
+                                                      NULL, 0) 
+                   == OK,
+                   "radMsgRouterMessageRegisterFilter with no terms");
+    SelfTestCollect ();
+    SelfTestReset ();
+    for (i = 0; i < 5; i ++)
+    {
+        SelfTestSend (ROUTETEST_MSGID_SELFTEST_FILTER, sent[i]);
+    }
+    SelfTestCollect ();
+    SelfTestCheck (SelfTestValuesAre (sent, 5),
+                   "removing the filter delivers every message");
+}
+
+// answers value + 1, negative values are left to time out:
+static void SelfTestRequestHandler
+(
+    ULONG               msgID,
+    void                *request,
+    ULONG               length,
+    MSGRTR_REQUEST_ID   *requestID,
+    void                *userData
+)
+{
+    int                 value;
+
+    if (length != sizeof(int) || *(int *)request < 0)
+    {
+        return;
+    }
+
+    value = *(int *)request + 1;
+    radMsgRouterReply (requestID, &value, sizeof(value));
+}
+
+// userData is the request's slot:
+static void SelfTestReplyHandler
+(
+    int                 status,
+    ULONG               msgID,
+    void                *reply,
+    ULONG               length,
+    void                *userData
+)
+{
+    int                 slot = (int)(long)userData;
+
+    routetestWork.replyCount[slot] ++;
+    routetestWork.replyStatus[slot] = status;
+    routetestWork.replyValue[slot] = 
+        (status == OK && length == sizeof(int)) ? *(int *)reply : -1;
+}
+
+static int SelfTestRequest (ULONG msgID, int value, int slot, ULONG timeoutMS)
+{
+    routetestWork.replyCount[slot] = 0;
+    routetestWork.replyStatus[slot] = ERROR;
+    return radMsgRouterRequest (msgID, &value, sizeof(value), timeoutMS,
+                                SelfTestReplyHandler, (void *)(long)slot);
+}
+
+// requests to ourselves - each reply finds its own request, the rest time out:
+static void SelfTestRequests (void)
+{
+    int                 i;
+
+    SelfTestCheck (radMsgRouterRequestHandlerSet (SelfTestRequestHandler, NULL) == OK,
+                   "radMsgRouterRequestHandlerSet");
+    radMsgRouterMessageRegister (ROUTETEST_MSGID_SELFTEST_REQUEST);
+    SelfTestCollect ();
+
+    for (i = 0; i < 3; i ++)
+    {
+        SelfTestRequest (ROUTETEST_MSGID_SELFTEST_REQUEST, 10 * (i + 1), i, 
+                         ROUTETEST_SELFTEST_WAIT * 4);
+    }
+    SelfTestCollect ();
+    SelfTestCheck (routetestWork.replyCount[0] == 1 && routetestWork.replyValue[0] == 11 &&
+                   routetestWork.replyCount[1] == 1 && routetestWork.replyValue[1] == 21 &&
+                   routetestWork.replyCount[2] == 1 && routetestWork.replyValue[2] == 31,
+                   "each reply reaches its own request once");
+
+    // unanswered and unsubscribed requests time out, once:
+    SelfTestRequest (ROUTETEST_MSGID_SELFTEST_REQUEST, -1, 0, ROUTETEST_SELFTEST_WAIT / 5);
+    SelfTestRequest (ROUTETEST_MSGID_SELFTEST_NOBODY, 1, 1, ROUTETEST_SELFTEST_WAIT / 5);
+    SelfTestCollect ();
+    SelfTestCheck (routetestWork.replyCount[0] == 1 && 
+                   routetestWork.replyStatus[0] == TIMEOUT,
+                   "an unanswered request times out");
+    SelfTestCheck (routetestWork.replyCount[1] == 1 && 
+                   routetestWork.replyStatus[1] == TIMEOUT,
+                   "a request nobody subscribes to times out");
+
+    radMsgRouterRequestHandlerSet (NULL, NULL);
+}
+
+// returns the number of failed checks:
+static int SelfTestRun (void)
+{
+    routetestWork.selfTest = TRUE;
+
+    SelfTestRegisterMany ();
+    SelfTestRanges ();
+    SelfTestFilters ();
+    SelfTestRequests ();
+
+    printf ("\n%s: %d failure(s)\n", 
+            (routetestWork.failures ? "FAILED" : "PASSED"), routetestWork.failures);
+    return routetestWork.failures;
+}
+
+
 // process initialization
 static int routetestSysInit (int radID)
 {
@@ -263,7 +618,7 @@ int main (int argc, char *argv[])
 {
     void            (*alarmHandler)(int);
     STIM            stim;
-    int             i, radSysID;
+    int             i, radSysID, selfTest;
     char            qname[256];
     char            pidName[256];
     char            workdir[128];
@@ -276,6 +631,7 @@ int main (int argc, char *argv[])
         exit(1);
     }
     radSysID = atoi(argv[1]);
+    selfTest = (argc > 2 && !strcmp(argv[2], "selftest"));
 
     // initialize some system stuff first
     if (routetestSysInit(radSysID) == -1)
@@ -376,6 +732,19 @@ int main (int argc, char *argv[])
         exit (1);
     }
 
+    if (selfTest)
+    {
+        i = SelfTestRun ();
+
+        radMsgRouterExit ();
+        radTimerDelete (routetestWork.timerNum1);
+        routetestSysExit (radSysID);
+
+        radProcessExit ();
+        radSystemExit ((UCHAR)radSysID);
+        exit ((i == 0) ? 0 : 1);
+    }
+
     radMsgRouterMessageRegister(ROUTETEST_MSGID_USER_REQUEST);
     radMsgRouterMessageRegister(ROUTETEST_MSGID_USER_RESPONSE);
 
@@ -50,6 +50,11 @@
 
 #define ROUTETEST_TIMER1_PERIOD     15000           // 15 seconds
 
+#define ROUTETEST_SELFTEST_WAIT     500             // msecs to collect replies
+#define ROUTETEST_SELFTEST_IDS      4000            // msgIDs counted
+#define ROUTETEST_SELFTEST_VALUES   64              // payloads kept
+#define ROUTETEST_SELFTEST_REQUESTS 4               // requests outstanding
+
 
 
 // the "routetest" process work area
@@ -60,6 +65,16 @@ typedef struct
     char            myID[128];
     TIMER_ID        timerNum1;
     int             exiting;
+    int             selfTest;                   // TRUE => run the self test
+    int             failures;
+    int             asyncDone;
+    int             asyncStatus;
+    int             rxCount[ROUTETEST_SELFTEST_IDS];
+    int             rxValue[ROUTETEST_SELFTEST_VALUES];
+    int             numValues;
+    int             replyCount[ROUTETEST_SELFTEST_REQUESTS];
+    int             replyStatus[ROUTETEST_SELFTEST_REQUESTS];
+    int             replyValue[ROUTETEST_SELFTEST_REQUESTS];
 } ROUTETEST_WORK;
 
 
@@ -67,7 +82,18 @@ typedef struct
 enum
 {
     ROUTETEST_MSGID_USER_REQUEST     = 100,
-    ROUTETEST_MSGID_USER_RESPONSE    = 101
+    ROUTETEST_MSGID_USER_RESPONSE    = 101,
+
+    // the self test loops these back to itself:
+    ROUTETEST_MSGID_SELFTEST_BASE    = 1000,
+    ROUTETEST_MSGID_SELFTEST_MANY    = 1000,    // 1000 - 1599 in one batch
+    ROUTETEST_MSGID_SELFTEST_ASYNC   = 1700,    // 1700 - 1799 asynchronously
+    ROUTETEST_MSGID_SELFTEST_DURING  = 1999,    // arrives during the batch
+    ROUTETEST_MSGID_SELFTEST_RANGE   = 2100,    // 2100 - 2199 as a range
+    ROUTETEST_MSGID_SELFTEST_PREFIX  = 0x0A00,  // 0x0A00 - 0x0AFF as a prefix
+    ROUTETEST_MSGID_SELFTEST_FILTER  = 3000,    // content filtered
+    ROUTETEST_MSGID_SELFTEST_REQUEST = 3100,    // answered by ourselves
+    ROUTETEST_MSGID_SELFTEST_NOBODY  = 3101     // never answered
 };
 
 // define the USER_REQUEST message
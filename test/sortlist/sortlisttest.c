@@ -0,0 +1,261 @@
+/*---------------------------------------------------------------------------
+ 
+  FILENAME:
+        sortlisttest.c
+ 
+  PURPOSE:
+        Check radSortList ordering, lookups and range walks across inserts
+        and removals.
+ 
+  REVISION HISTORY:
+        Date            Engineer        Revision        Remarks
+        10/19/2026      radlib          0               Original
+ 
+  NOTES:
+        Exits 0 if every check passes, 1 otherwise.
+ 
+----------------------------------------------------------------------------*/
+
+// System include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// radlib include files
+#include <radsysdefs.h>
+#include <radlist.h>
+#include <radsortlist.h>
+
+// Local include files
+#include "testcheck.h"
+
+
+#define TEST_NUM_NODES          20000
+#define TEST_KEY_RANGE          5000            // plenty of equal keys
+
+typedef struct
+{
+    NODE            node;
+    long            key;
+    int             seq;                        // insert order
+    int             listed;
+} TEST_NODE;
+
+static TEST_NODE        *nodes[TEST_NUM_NODES];
+
+
+static long GetKey (void *data)
+{
+    return ((TEST_NODE *)data)->key;
+}
+
+// walk the list: keys must not descend, equal keys stay in insert order
+// and exactly the listed nodes must be there:
+static int CheckOrder (SORTLIST_ID list)
+{
+    TEST_NODE       *node, *prev = NULL;
+    int             i, count = 0, listed = 0;
+
+    for (node = (TEST_NODE *)radSortListGetFirst (list);
+         node != NULL;
+         node = (TEST_NODE *)radSortListGetNext (list, (NODE_PTR)node))
+    {
+        if (! node->listed)
+        {
+            return FALSE;
+        }
+        if (prev != NULL && 
+            (prev->key > node->key || (prev->key == node->key && prev->seq > node->seq)))
+        {
+            return FALSE;
+        }
+        prev = node;
+        count ++;
+    }
+
+    for (i = 0; i < TEST_NUM_NODES; i ++)
+    {
+        listed += nodes[i]->listed;
+    }
+
+    return (count == listed);
+}
+
+// the smallest listed key >= key, or -1:
+static long LowestFrom (long key)
+{
+    long            best = -1;
+    int             i;
+
+    for (i = 0; i < TEST_NUM_NODES; i ++)
+    {
+        if (nodes[i]->listed && nodes[i]->key >= key && (best == -1 || nodes[i]->key < best))
+        {
+            best = nodes[i]->key;
+        }
+    }
+    return best;
+}
+
+static int CheckLookups (SORTLIST_ID list)
+{
+    TEST_NODE       *node;
+    long            key, expected;
+
+    for (key = -1; key <= TEST_KEY_RANGE + 1; key += 7)
+    {
+        expected = LowestFrom (key);
+        node = (TEST_NODE *)radSortListLowerBound (list, key);
+        if ((node == NULL) != (expected == -1) || 
+            (node != NULL && (! node->listed || node->key != expected)))
+        {
+            return FALSE;
+        }
+
+        node = (TEST_NODE *)radSortListFind (list, key);
+        if ((node == NULL) != (expected != key) || 
+            (node != NULL && (! node->listed || node->key != key)))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+typedef struct
+{
+    long            lastKey;
+    int             inOrder;
+    int             stopAfter;
+    int             calls;
+} RANGE_STATE;
+
+static int RangeVisit (NODE_PTR node, void *data)
+{
+    RANGE_STATE     *state = (RANGE_STATE *)data;
+
+    if (((TEST_NODE *)node)->key < state->lastKey)
+    {
+        state->inOrder = FALSE;
+    }
+    state->lastKey = ((TEST_NODE *)node)->key;
+
+    return (++ state->calls != state->stopAfter);
+}
+
+static int CheckRange (SORTLIST_ID list, long minKey, long maxKey)
+{
+    RANGE_STATE     state;
+    int             i, expected = 0, calls;
+
+    for (i = 0; i < TEST_NUM_NODES; i ++)
+    {
+        if (nodes[i]->listed && nodes[i]->key >= minKey && nodes[i]->key <= maxKey)
+        {
+            expected ++;
+        }
+    }
+
+    memset (&state, 0, sizeof(state));
+    state.lastKey = minKey;
+    state.inOrder = TRUE;
+    calls = radSortListExecRange (list, minKey, maxKey, RangeVisit, &state);
+    if (calls != expected || state.calls != expected || ! state.inOrder ||
+        (expected > 0 && state.lastKey > maxKey))
+    {
+        return FALSE;
+    }
+
+    // returning FALSE stops the walk:
+    if (expected > 1)
+    {
+        memset (&state, 0, sizeof(state));
+        state.lastKey = minKey;
+        state.inOrder = TRUE;
+        state.stopAfter = 1;
+        if (radSortListExecRange (list, minKey, maxKey, RangeVisit, &state) != 1)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+
+int main (int argc, char *argv[])
+{
+    SORTLIST_ID     list;
+    int             i, removed;
+
+    srand (1);
+
+    list = radSortListInit (GetKey);
+    Check (list != NULL, "radSortListInit");
+    if (list == NULL)
+    {
+        return 1;
+    }
+
+    Check (radSortListGetFirst (list) == NULL && radSortListFind (list, 0) == NULL &&
+           radSortListLowerBound (list, 0) == NULL, 
+           "an empty list finds nothing");
+
+    for (i = 0; i < TEST_NUM_NODES; i ++)
+    {
+        nodes[i] = (TEST_NODE *)malloc (sizeof(TEST_NODE));
+        nodes[i]->key       = rand () % TEST_KEY_RANGE;
+        nodes[i]->seq       = i;
+        nodes[i]->listed    = TRUE;
+        if (radSortListInsert (list, (NODE_PTR)nodes[i]) != OK)
+        {
+            break;
+        }
+    }
+    Check (i == TEST_NUM_NODES, "radSortListInsert");
+    Check (CheckOrder (list), "inserted nodes are in key, then insert, order");
+    Check (CheckLookups (list), "radSortListFind/LowerBound after inserts");
+    Check (CheckRange (list, 100, 200) && CheckRange (list, -10, 10) &&
+           CheckRange (list, TEST_KEY_RANGE - 3, TEST_KEY_RANGE + 3) && 
+           CheckRange (list, 0, TEST_KEY_RANGE), 
+           "radSortListExecRange after inserts");
+
+    // remove every key below 1000 and a random half of the rest:
+    for (i = 0, removed = 0; i < TEST_NUM_NODES; i ++)
+    {
+        if (nodes[i]->key < 1000 || (rand () & 1))
+        {
+            if (radSortListRemove (list, (NODE_PTR)nodes[i]) != OK)
+            {
+                break;
+            }
+            nodes[i]->listed = FALSE;
+            removed ++;
+        }
+    }
+    Check (i == TEST_NUM_NODES, "radSortListRemove");
+    Check (CheckOrder (list), "remaining nodes stay in order after removals");
+    Check (CheckLookups (list), "radSortListFind/LowerBound after removals");
+    Check (CheckRange (list, 0, 1500) && CheckRange (list, 990, 1010) &&
+           CheckRange (list, 0, 999), 
+           "radSortListExecRange after removals");
+
+    // put them back, equal keys now go after those still listed:
+    for (i = 0; i < TEST_NUM_NODES; i ++)
+    {
+        if (! nodes[i]->listed)
+        {
+            nodes[i]->seq       = TEST_NUM_NODES + i;
+            nodes[i]->listed    = TRUE;
+            radSortListInsert (list, (NODE_PTR)nodes[i]);
+        }
+    }
+    Check (CheckOrder (list), "re-inserted nodes follow equal keys");
+    Check (CheckLookups (list), "radSortListFind/LowerBound after re-inserts");
+
+    // frees the nodes as well:
+    radSortListExit (list);
+
+    return CheckSummary ();
+}
@@ -0,0 +1,46 @@
+#ifndef INC_testcheckh
+#define INC_testcheckh
+/*---------------------------------------------------------------------------
+
+  FILENAME:
+        testcheck.h
+
+  PURPOSE:
+        Pass/fail reporting shared by the library unit tests.
+
+  REVISION HISTORY:
+        Date            Engineer        Revision        Remarks
+        10/19/2026      radlib          0               Original
+
+  NOTES:
+        Include it in the one source file of a test (it defines the
+        failure count); the test Makefiles add the parent directory to
+        the include path. Check prints a PASS or FAIL line per check and
+        CheckSummary prints the total and returns the exit status, 0 if
+        every check passed.
+
+----------------------------------------------------------------------------*/
+
+// System include files
+#include <stdio.h>
+
+
+static int              checkFailures;
+
+
+static void Check (int passed, char *what)
+{
+    printf ("%s: %s\n", (passed ? "PASS" : "FAIL"), what);
+    if (! passed)
+    {
+        checkFailures ++;
+    }
+}
+
+static int CheckSummary (void)
+{
+    printf ("\n%s: %d failure(s)\n", (checkFailures ? "FAILED" : "PASSED"), checkFailures);
+    return (checkFailures ? 1 : 0);
+}
+
+#endif
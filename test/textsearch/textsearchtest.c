@@ -0,0 +1,290 @@
+/*---------------------------------------------------------------------------
+ 
+  FILENAME:
+        textsearchtest.c
+ 
+  PURPOSE:
+        Check radtextsearch insert, find, remove and ordered traversal 
+        against a sorted reference.
+ 
+  REVISION HISTORY:
+        Date            Engineer        Revision        Remarks
+        10/19/2026      radlib          0               Original
+ 
+  NOTES:
+        Exits 0 if every check passes, 1 otherwise.
+ 
+----------------------------------------------------------------------------*/
+
+// System include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// radlib include files
+#include <radsysdefs.h>
+#include <radtextsearch.h>
+
+// Local include files
+#include "testcheck.h"
+
+
+#define TEST_MAX_KEYS           12000
+#define TEST_KEY_LENGTH         96
+
+typedef struct
+{
+    char            text[TEST_KEY_LENGTH];
+    int             ordinal;
+    int             member;
+} TEST_KEY;
+
+static TEST_KEY         keys[TEST_MAX_KEYS];
+static int              numKeys;
+
+
+static void AddKey (const char *text)
+{
+    snprintf (keys[numKeys].text, sizeof(keys[numKeys].text), "%s", text);
+    keys[numKeys].ordinal = numKeys;
+    numKeys ++;
+}
+
+static int CompareKeys (const void *a, const void *b)
+{
+    return strcmp (((TEST_KEY *)a)->text, ((TEST_KEY *)b)->text);
+}
+
+// keys sharing long and short prefixes, keys that prefix others, the
+// empty key and one level with every byte value (the widest inner node):
+static void BuildKeys (void)
+{
+    char            text[TEST_KEY_LENGTH];
+    int             i;
+
+    AddKey ("");
+    AddKey ("a");
+    AddKey ("ab");
+    AddKey ("abc");
+    AddKey ("abd");
+    for (i = 0; i < 4000; i ++)
+    {
+        sprintf (text, "key%05d", i);
+        AddKey (text);
+    }
+    for (i = 0; i < 3000; i ++)
+    {
+        sprintf (text, "sensors/station/outdoor/temperature/%d/value", i * 7);
+        AddKey (text);
+    }
+    for (i = 0; i < 4000; i ++)
+    {
+        sprintf (text, "%c%c%x", 'b' + (i % 20), 'a' + (i % 7), i * 2654435761U);
+        AddKey (text);
+    }
+    for (i = 1; i < 256; i ++)
+    {
+        text[0] = 'z';
+        text[1] = (char)i;
+        text[2] = 0;
+        AddKey (text);
+    }
+
+    // sort them into text order (the ordinals stay with them):
+    qsort (keys, numKeys, sizeof(keys[0]), CompareKeys);
+}
+
+typedef struct
+{
+    int             next;                       // index into keys[]
+    const char      *prefix;
+    int             wrong;
+    int             stopAfter;
+    int             calls;
+} WALK_STATE;
+
+// members must arrive in key order, skipping non-members and those outside
+// the prefix:
+static int WalkVisit (const char *text, int ordinal, void *data)
+{
+    WALK_STATE      *state = (WALK_STATE *)data;
+    size_t          prefixLen = strlen (state->prefix);
+
+    while (state->next < numKeys && 
+           (! keys[state->next].member || 
+            strncmp (keys[state->next].text, state->prefix, prefixLen) != 0))
+    {
+        state->next ++;
+    }
+
+    if (state->next >= numKeys || strcmp (keys[state->next].text, text) != 0 ||
+        keys[state->next].ordinal != ordinal)
+    {
+        state->wrong ++;
+    }
+    state->next ++;
+
+    return (++ state->calls != state->stopAfter);
+}
+
+static int CountMembers (const char *prefix)
+{
+    int             i, count = 0;
+
+    for (i = 0; i < numKeys; i ++)
+    {
+        if (keys[i].member && strncmp (keys[i].text, prefix, strlen (prefix)) == 0)
+        {
+            count ++;
+        }
+    }
+    return count;
+}
+
+static int CheckWalk (TEXT_SEARCH_ID id, const char *prefix)
+{
+    WALK_STATE      state;
+    int             visited;
+
+    memset (&state, 0, sizeof(state));
+    state.prefix = prefix;
+    if (prefix[0] == 0)
+    {
+        visited = radtextsearchExecAll (id, WalkVisit, &state);
+    }
+    else
+    {
+        visited = radtextsearchPrefix (id, prefix, WalkVisit, &state);
+    }
+
+    return (state.wrong == 0 && visited == CountMembers (prefix) && 
+            state.calls == visited);
+}
+
+static int CheckFinds (TEXT_SEARCH_ID id)
+{
+    int             i, ordinal, wrong = 0;
+
+    for (i = 0; i < numKeys; i ++)
+    {
+        ordinal = -1;
+        if (radtextsearchFind (id, keys[i].text, &ordinal) == OK)
+        {
+            if (! keys[i].member || ordinal != keys[i].ordinal)
+            {
+                wrong ++;
+            }
+        }
+        else if (keys[i].member)
+        {
+            wrong ++;
+        }
+    }
+
+    return (wrong == 0);
+}
+
+
+int main (int argc, char *argv[])
+{
+    TEXT_SEARCH_ID  id;
+    WALK_STATE      state;
+    int             i, ordinal, count;
+
+    BuildKeys ();
+
+    id = radtextsearchInit ();
+    Check (id != NULL, "radtextsearchInit");
+    if (id == NULL)
+    {
+        return 1;
+    }
+
+    Check (radtextsearchCount (id) == 0 && radtextsearchFind (id, "a", &ordinal) == ERROR &&
+           radtextsearchRemove (id, "a") == ERROR && radtextsearchRemove (id, NULL) == ERROR, 
+           "an empty search finds nothing");
+
+    // insert in a scrambled order:
+    for (i = 0; i < numKeys; i ++)
+    {
+        count = (int)(((unsigned)i * 7919U) % (unsigned)numKeys);
+        if (radtextsearchInsert (id, keys[count].text, keys[count].ordinal) != OK)
+        {
+            break;
+        }
+        keys[count].member = TRUE;
+    }
+    Check (i == numKeys && radtextsearchCount (id) == numKeys, "radtextsearchInsert");
+    Check (CheckFinds (id), "radtextsearchFind after inserts");
+    Check (radtextsearchFind (id, "ke", &ordinal) == ERROR &&
+           radtextsearchFind (id, "key00001x", &ordinal) == ERROR &&
+           radtextsearchFind (id, "abe", &ordinal) == ERROR, 
+           "prefixes and extensions of members are not members");
+
+    radtextsearchInsert (id, "abc", -99);
+    Check (radtextsearchFind (id, "abc", &ordinal) == OK && ordinal != -99 && 
+           radtextsearchCount (id) == numKeys, 
+           "inserting a member again keeps its ordinal");
+
+    Check (CheckWalk (id, ""), "radtextsearchExecAll visits members in text order");
+    Check (CheckWalk (id, "key01") && CheckWalk (id, "ab") && CheckWalk (id, "z") &&
+           CheckWalk (id, "sensors/station/outdoor/temperature/7") &&
+           CheckWalk (id, "nomatch"), 
+           "radtextsearchPrefix visits the prefix's members in text order");
+
+    memset (&state, 0, sizeof(state));
+    state.prefix = "key";
+    state.stopAfter = 10;
+    Check (radtextsearchPrefix (id, "key", WalkVisit, &state) == 10 && state.wrong == 0,
+           "returning FALSE stops a traversal");
+
+    Check (radtextsearchDebug (id->root) == 1, "the tree is valid after inserts");
+
+    // remove two of every three:
+    for (i = 0, count = 0; i < numKeys; i ++)
+    {
+        if ((i % 3) != 0)
+        {
+            if (radtextsearchRemove (id, keys[i].text) != OK)
+            {
+                break;
+            }
+            keys[i].member = FALSE;
+            count ++;
+        }
+    }
+    Check (i == numKeys && radtextsearchCount (id) == numKeys - count, 
+           "radtextsearchRemove");
+    Check (radtextsearchRemove (id, keys[1].text) == ERROR, 
+           "removing a non-member fails");
+    Check (CheckFinds (id), "radtextsearchFind after removals");
+    Check (CheckWalk (id, "") && CheckWalk (id, "key0") && CheckWalk (id, "z"), 
+           "traversals after removals");
+    Check (radtextsearchDebug (id->root) == 1, "the tree is valid after removals");
+
+    // and put some back:
+    for (i = 1; i < numKeys; i += 3)
+    {
+        radtextsearchInsert (id, keys[i].text, keys[i].ordinal);
+        keys[i].member = TRUE;
+    }
+    Check (CheckFinds (id) && CheckWalk (id, ""), "finds and traversal after re-inserts");
+
+    // empty it from the front:
+    count = radtextsearchCount (id);
+    while (radtextsearchRemove (id, NULL) == OK)
+    {
+        count --;
+    }
+    Check (count == 0 && radtextsearchCount (id) == 0 && 
+           radtextsearchExecAll (id, WalkVisit, &state) == 0, 
+           "removing the first member until none are left");
+
+    radtextsearchInsert (id, "again", 1);
+    Check (radtextsearchFind (id, "again", &ordinal) == OK && ordinal == 1, 
+           "an emptied search can be used again");
+
+    radtextsearchExit (id);
+
+    return CheckSummary ();
+}
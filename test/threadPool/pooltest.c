@@ -0,0 +1,257 @@
+/*---------------------------------------------------------------------------
+ 
+  FILENAME:
+        pooltest.c
+ 
+  PURPOSE:
+        Check radthreadPool task submission, parallel-for and waiting.
+ 
+  REVISION HISTORY:
+        Date            Engineer        Revision        Remarks
+        10/19/2026      radlib          0               Original
+ 
+  NOTES:
+        Usage: pooltest radSystemID [numWorkers]
+        Exits 0 if every check passes, 1 otherwise.
+ 
+----------------------------------------------------------------------------*/
+
+// System include files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// radlib include files
+#include <radsysdefs.h>
+#include <radsystem.h>
+#include <radprocess.h>
+#include <radthreadPool.h>
+
+// Local include files
+#include "testcheck.h"
+
+
+#define TEST_NUM_TASKS          5000
+#define TEST_NUM_INDEXES        100000
+#define TEST_NESTED_INDEXES     1000
+
+static RAD_THREAD_POOL_ID   pool;
+static pthread_t            parentThread;
+static int                  taskRuns[TEST_NUM_TASKS];
+static int                  taskDones[TEST_NUM_TASKS];
+static int                  doneCount;
+static int                  doneOffParent;
+static int                  indexHits[TEST_NUM_INDEXES];
+static int                  nestedHits[TEST_NUM_TASKS];
+
+
+static void msgHandler
+(
+    char        *srcQueueName,
+    UINT        msgType,
+    void        *msg,
+    UINT        length,
+    void        *userData
+)
+{
+    return;
+}
+
+static void evtHandler
+(
+    UINT        eventsRx,
+    UINT        rxData,
+    void        *userData
+)
+{
+    return;
+}
+
+static void CountTask (void *taskData)
+{
+    __sync_fetch_and_add (&taskRuns[(long)taskData], 1);
+}
+
+static void CountDone (void *taskData)
+{
+    taskDones[(long)taskData] ++;
+    doneCount ++;
+    if (! pthread_equal (pthread_self (), parentThread))
+    {
+        doneOffParent ++;
+    }
+}
+
+static void HitBody (int index, void *data)
+{
+    __sync_fetch_and_add (&((int *)data)[index], 1);
+}
+
+static void NestedBody (int index, void *data)
+{
+    __sync_fetch_and_add (&nestedHits[(long)data], 1);
+}
+
+// a task that fans out again from a worker:
+static void NestedTask (void *taskData)
+{
+    radthreadPoolParallelFor (pool, 0, TEST_NESTED_INDEXES, 0, NestedBody, taskData);
+}
+
+static int CountNot (int *counts, int num, int expected)
+{
+    int         i, wrong = 0;
+
+    for (i = 0; i < num; i ++)
+    {
+        if (counts[i] != expected)
+        {
+            wrong ++;
+        }
+    }
+    return wrong;
+}
+
+static void ResetCounts (void)
+{
+    memset (taskRuns, 0, sizeof(taskRuns));
+    memset (taskDones, 0, sizeof(taskDones));
+    doneCount = 0;
+    doneOffParent = 0;
+}
+
+
+int main (int argc, char *argv[])
+{
+    char        qname[128];
+    int         radSysID, numWorkers, grains[] = { 0, 1, 7, 1000, TEST_NUM_INDEXES * 2 };
+    long        i;
+    int         g, wrong, waits;
+
+    if (argc < 2)
+    {
+        printf ("Usage: pooltest radSystemID [numWorkers]\n");
+        return 1;
+    }
+    radSysID    = atoi (argv[1]);
+    numWorkers  = (argc > 2) ? atoi (argv[2]) : 0;
+
+    if (radSystemInit ((UCHAR)radSysID) == ERROR)
+    {
+        printf ("radSystemInit failed!\n");
+        return 1;
+    }
+
+    sprintf (qname, "/tmp/pooltest.%d", getpid ());
+    if (radProcessInit ("pooltest", qname, 1, FALSE, msgHandler, evtHandler, NULL)
+        == ERROR)
+    {
+        printf ("radProcessInit failed!\n");
+        radSystemExit ((UCHAR)radSysID);
+        return 1;
+    }
+
+    parentThread = pthread_self ();
+    pool = radthreadPoolCreate (numWorkers);
+    Check (pool != NULL, "radthreadPoolCreate");
+    if (pool == NULL)
+    {
+        radProcessExit ();
+        radSystemExit ((UCHAR)radSysID);
+        return 1;
+    }
+
+    // an idle pool has nothing to wait for:
+    radthreadPoolWait (pool);
+    Check (TRUE, "radthreadPoolWait returns on an idle pool");
+
+    // every task runs once and its completion is called once, in the parent:
+    for (i = 0; i < TEST_NUM_TASKS; i ++)
+    {
+        radthreadPoolSubmit (pool, CountTask, CountDone, (void *)i);
+    }
+    radthreadPoolWait (pool);
+    Check (CountNot (taskRuns, TEST_NUM_TASKS, 1) == 0, "submitted tasks each ran once");
+    Check (CountNot (taskDones, TEST_NUM_TASKS, 1) == 0, 
+           "radthreadPoolWait called each completion once");
+    Check (doneOffParent == 0, "completions ran in the parent thread");
+
+    // completions also arrive through radProcessWait:
+    ResetCounts ();
+    for (i = 0; i < TEST_NUM_TASKS; i ++)
+    {
+        radthreadPoolSubmit (pool, CountTask, CountDone, (void *)i);
+    }
+    for (waits = 0; doneCount < TEST_NUM_TASKS && waits < 10000; waits ++)
+    {
+        radProcessWait (10);
+    }
+    Check (doneCount == TEST_NUM_TASKS && CountNot (taskDones, TEST_NUM_TASKS, 1) == 0, 
+           "radProcessWait called each completion once");
+
+    Check (radthreadPoolSubmit (pool, NULL, NULL, NULL) == ERROR, 
+           "a NULL task is refused");
+
+    // each index is visited exactly once whatever the grain:
+    for (g = 0; g < (int)(sizeof(grains)/sizeof(grains[0])); g ++)
+    {
+        memset (indexHits, 0, sizeof(indexHits));
+        if (radthreadPoolParallelFor (pool, 0, TEST_NUM_INDEXES, grains[g], HitBody, indexHits)
+            != OK)
+        {
+            break;
+        }
+        if (CountNot (indexHits, TEST_NUM_INDEXES, 1) != 0)
+        {
+            break;
+        }
+    }
+    Check (g == (int)(sizeof(grains)/sizeof(grains[0])), 
+           "radthreadPoolParallelFor visits each index once");
+
+    memset (indexHits, 0, sizeof(indexHits));
+    radthreadPoolParallelFor (pool, 100, 200, 0, HitBody, indexHits);
+    wrong = CountNot (indexHits, 100, 0) + CountNot (indexHits + 100, 100, 1) + 
+            CountNot (indexHits + 200, TEST_NUM_INDEXES - 200, 0);
+    Check (wrong == 0, "radthreadPoolParallelFor stays within first..last");
+
+    Check (radthreadPoolParallelFor (pool, 10, 10, 0, HitBody, indexHits) == OK &&
+           radthreadPoolParallelFor (pool, 10, 5, 0, HitBody, indexHits) == OK &&
+           CountNot (indexHits + 100, 100, 1) == 0, 
+           "an empty range calls nothing");
+
+    // tasks that run a parallel-for of their own:
+    memset (nestedHits, 0, sizeof(nestedHits));
+    for (i = 0; i < TEST_NUM_TASKS; i += 10)
+    {
+        radthreadPoolSubmit (pool, NestedTask, NULL, (void *)i);
+    }
+    radthreadPoolWait (pool);
+    for (i = 0, wrong = 0; i < TEST_NUM_TASKS; i ++)
+    {
+        if (nestedHits[i] != ((i % 10) ? 0 : TEST_NESTED_INDEXES))
+        {
+            wrong ++;
+        }
+    }
+    Check (wrong == 0, "nested parallel-for from tasks completes");
+
+    // destroy finishes what is queued:
+    ResetCounts ();
+    for (i = 0; i < TEST_NUM_TASKS; i ++)
+    {
+        radthreadPoolSubmit (pool, CountTask, CountDone, (void *)i);
+    }
+    radthreadPoolDestroy (pool);
+    Check (CountNot (taskRuns, TEST_NUM_TASKS, 1) == 0 && 
+           CountNot (taskDones, TEST_NUM_TASKS, 1) == 0, 
+           "radthreadPoolDestroy runs and completes queued tasks");
+
+    radProcessExit ();
+    unlink (qname);
+    radSystemExit ((UCHAR)radSysID);
+
+    return CheckSummary ();
+}